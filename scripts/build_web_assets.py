@@ -0,0 +1,68 @@
+# PlatformIO pre-script: builds the LittleFS image directory from web/.
+#
+# Scripts and stylesheets get a content hash in their name so the browser can cache them forever,
+# index.html is rewritten to point at the hashed names. Everything is stored gzip-compressed, and
+# assets.txt lists "<path> <etag> <immutable>" for the firmware (see StaticAssets.cpp).
+
+Import("env")
+
+import gzip
+import hashlib
+import os
+import re
+import shutil
+
+PROJECT_DIR = env.subst("$PROJECT_DIR")
+SOURCE_DIR = os.path.join(PROJECT_DIR, "web")
+OUTPUT_DIR = env.subst("$PROJECT_DATA_DIR")
+HASHED_EXTENSIONS = (".js", ".css")
+ENTRY_PAGE = "index.html"
+
+
+def digest(content):
+    return hashlib.sha256(content).hexdigest()[:12]
+
+
+def write_gzip(name, content):
+    # mtime=0 keeps the output byte-identical between builds of the same sources
+    with open(os.path.join(OUTPUT_DIR, name + ".gz"), "wb") as output:
+        output.write(gzip.compress(content, compresslevel=9, mtime=0))
+
+
+def build_web_assets():
+    shutil.rmtree(OUTPUT_DIR, ignore_errors=True)
+    os.makedirs(OUTPUT_DIR)
+
+    renamed = {}
+    manifest = []
+    for name in sorted(os.listdir(SOURCE_DIR)):
+        if not name.endswith(HASHED_EXTENSIONS):
+            continue
+        with open(os.path.join(SOURCE_DIR, name), "rb") as source:
+            content = source.read()
+        tag = digest(content)
+        base, extension = os.path.splitext(name)
+        hashed = "%s.%s%s" % (base, tag, extension)
+        renamed[name] = hashed
+        write_gzip(hashed, content)
+        manifest.append((hashed, tag, 1))
+
+    with open(os.path.join(SOURCE_DIR, ENTRY_PAGE), "r", encoding="utf-8") as source:
+        page = source.read()
+    page = re.sub(r'(src|href)="([^"/:]+)"',
+                  lambda match: '%s="%s"' % (match.group(1), renamed.get(match.group(2), match.group(2))),
+                  page)
+    content = page.encode("utf-8")
+    write_gzip(ENTRY_PAGE, content)
+    manifest.append((ENTRY_PAGE, digest(content), 0))
+
+    with open(os.path.join(OUTPUT_DIR, "assets.txt"), "w") as output:
+        for path, tag, immutable in manifest:
+            output.write("%s %s %d\n" % (path, tag, immutable))
+
+    raw = sum(os.path.getsize(os.path.join(SOURCE_DIR, name)) for name in os.listdir(SOURCE_DIR))
+    packed = sum(os.path.getsize(os.path.join(OUTPUT_DIR, name)) for name in os.listdir(OUTPUT_DIR))
+    print("Web assets: %d bytes -> %d bytes in %s" % (raw, packed, OUTPUT_DIR))
+
+
+build_web_assets()
@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+"""Decodes the binary event log of the firmware (src/EventLog.h) into readable lines.
+
+Usage: scripts/decode_logs.py http://<esp_ip>/ [--file current|previous] [--follow]
+       scripts/decode_logs.py events.bin
+
+Without --file the RAM ring is read, --follow keeps polling it with ?since= and starts over when the device
+restarted. --file reads the warnings and errors kept on flash. A path reads a log saved from the device.
+Keep EVENTS in step with LogEvent: ids are only ever appended.
+"""
+
+import argparse
+import struct
+import sys
+import time
+import urllib.error
+import urllib.request
+
+HEADER = struct.Struct("<4sBBHI")
+RECORD = struct.Struct("<IIHBBiii")
+MAGIC = b"TLOG"
+FORMAT_VERSION = 1
+FOLLOW_INTERVAL_S = 2
+
+MODULES = ["system", "state", "heating", "ble", "api", "persistence", "ota"]
+LEVELS = ["INFO", "WARN", "ERROR"]
+RESET_REASONS = ["unknown", "power on", "external pin", "software", "panic", "interrupt watchdog",
+                 "task watchdog", "other watchdog", "deep sleep", "brownout", "SDIO"]
+COMMANDS = ["CREATE_ROOM", "UPDATE_ROOM", "DELETE_ROOM", "ADD_THERMOMETER", "REMOVE_THERMOMETER", "RESET_ROOMS",
+            "SET_HEATING_MODE", "SET_MANUAL_MODE", "SET_SCHEDULE_SLOT", "APPLY_BATCH", "SET_SCHEDULE_RANGES"]
+JSON_ERRORS = ["Ok", "EmptyInput", "IncompleteInput", "InvalidInput", "NoMemory", "TooDeep"]
+PARAMS = ["room_name", "mode"]
+DOMAINS = ["rooms", "schedule", "history", "heating_mode"]
+OTA_ERRORS = ["auth failed", "begin failed", "connect failed", "receive failed", "end failed"]
+
+
+def name(names, value):
+    return names[value] if 0 <= value < len(names) else str(value)
+
+
+def domain_bits(bits):
+    return ", ".join(domain for i, domain in enumerate(DOMAINS) if bits & (1 << i)) or "none"
+
+
+# LogEvent id -> function of the three arguments returning the message
+EVENTS = {
+    1: lambda a, b, c: "boot, reset reason %s" % name(RESET_REASONS, a),
+    10: lambda a, b, c: "create room rejected, %d rooms" % a,
+    11: lambda a, b, c: "update of an unknown room ignored",
+    12: lambda a, b, c: "add thermometer rejected, %d in the room" % a if a >= 0 else
+    "add thermometer rejected, unknown room",
+    13: lambda a, b, c: "batch rejected at operation %d, nothing applied" % a,
+    14: lambda a, b, c: "schedule range %d rejected, nothing applied" % a,
+    15: lambda a, b, c: "state command queue full, %s dropped" % name(COMMANDS, a),
+    20: lambda a, b, c: "exception in the relay task",
+    21: lambda a, b, c: "unknown error in the relay task",
+    30: lambda a, b, c: "failed to restart the BLE scan",
+    31: lambda a, b, c: "invalid thermometer address",
+    32: lambda a, b, c: "sensor registry full, sensor will not be read",
+    40: lambda a, b, c: "invalid JSON body: %s" % name(JSON_ERRORS, a),
+    41: lambda a, b, c: "missing parameter %s" % name(PARAMS, a),
+    42: lambda a, b, c: "room already exists",
+    43: lambda a, b, c: "room not found",
+    44: lambda a, b, c: "request body of %d bytes over the %d byte limit" % (a, b),
+    45: lambda a, b, c: "JSON piece too large, %s" % ("response truncated" if a else "render aborted"),
+    46: lambda a, b, c: "history busy, response cut short",
+    47: lambda a, b, c: "too many event stream clients (%d), closed the new one" % a,
+    48: lambda a, b, c: "schedule set in %d ms" % a,
+    49: lambda a, b, c: "route not traced, all %d route statistics in use" % a,
+    50: lambda a, b, c: "failed to open the %s file for writing" % name(DOMAINS, a),
+    51: lambda a, b, c: "failed to write the %s file" % name(DOMAINS, a),
+    52: lambda a, b, c: "saved %s, %d bytes" % (name(DOMAINS, a), b),
+    53: lambda a, b, c: "timed out waiting for pending writes: %s" % domain_bits(a),
+    54: lambda a, b, c: "%s file did not exist, created it" % name(DOMAINS, a),
+    60: lambda a, b, c: "OTA update started",
+    61: lambda a, b, c: "OTA update finished",
+    62: lambda a, b, c: "OTA update failed: %s" % name(OTA_ERRORS, a),
+    63: lambda a, b, c: "OTA update at %d%%" % a,
+    70: lambda a, b, c: "metric registry full at %d metrics, metric not registered" % a,
+}
+
+
+def parse(data):
+    """Returns (boot id, records) where each record is (sequence, ms, event, module, level, a, b, c)."""
+    if len(data) < HEADER.size:
+        sys.exit("No log header in %d bytes" % len(data))
+    magic, version, record_size, _, boot_id = HEADER.unpack_from(data)
+    if magic != MAGIC or version != FORMAT_VERSION or record_size != RECORD.size:
+        sys.exit("Not an event log of format %d" % FORMAT_VERSION)
+    end = HEADER.size + (len(data) - HEADER.size) // RECORD.size * RECORD.size
+    return boot_id, [RECORD.unpack_from(data, offset) for offset in range(HEADER.size, end, RECORD.size)]
+
+
+def describe(record):
+    sequence, time_ms, event, module, level, a, b, c = record
+    message = EVENTS[event](a, b, c) if event in EVENTS else "event %d: %d %d %d" % (event, a, b, c)
+    return "%10.3f #%-6d %-5s %-11s %s" % (time_ms / 1000.0, sequence, name(LEVELS, level), name(MODULES, module),
+                                           message)
+
+
+def fetch(url):
+    with urllib.request.urlopen(url, timeout=10) as response:
+        return response.read()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("source", help="device URL, e.g. http://192.168.1.50/, or a saved log file")
+    parser.add_argument("--file", choices=["current", "previous"], help="read the log kept on flash")
+    parser.add_argument("--follow", action="store_true", help="keep polling the RAM ring")
+    arguments = parser.parse_args()
+
+    if not arguments.source.startswith(("http://", "https://")):
+        with open(arguments.source, "rb") as source:
+            for record in parse(source.read())[1]:
+                print(describe(record))
+        return
+
+    base = arguments.source.rstrip("/") + "/api/logs"
+    if arguments.file:
+        for record in parse(fetch(base + "?file=" + arguments.file))[1]:
+            print(describe(record))
+        return
+
+    since, boot = 0, None
+    while True:
+        try:
+            boot_id, records = parse(fetch("%s?since=%d" % (base, since)))
+        except (urllib.error.URLError, OSError) as error:
+            if not arguments.follow:
+                sys.exit(str(error))
+            time.sleep(FOLLOW_INTERVAL_S)
+            continue
+        if boot is not None and boot_id != boot:
+            # Sequences start over after a restart
+            print("-- device restarted --")
+            since = 0
+            boot = boot_id
+            continue
+        boot = boot_id
+        for record in records:
+            if record[0] != since + 1 and since != 0:
+                print("-- %d records lost --" % (record[0] - since - 1))
+            print(describe(record))
+            since = record[0]
+        if not arguments.follow:
+            return
+        time.sleep(FOLLOW_INTERVAL_S)
+
+
+if __name__ == "__main__":
+    main()
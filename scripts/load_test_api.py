@@ -0,0 +1,262 @@
+#!/usr/bin/env python3
+"""Replays a mix of dashboard and integration requests against a device and reports what it could take.
+
+Usage: scripts/load_test_api.py http://<esp_ip>/ [--clients 4] [--duration 60] [--mutating]
+                                [--save-baseline FILE] [--baseline FILE]
+
+Every client loops over a weighted mix of room reads, heating reads, change polls, schedule reads and
+schedule edits (a PATCH writing back the mode a slot already has, so nothing reaches flash). --mutating adds
+thermometer adds and removes on the first room. Per request type the report shows throughput, latency
+percentiles and the largest heap drop the firmware measured across that route's handler; the device heap is
+sampled from /metrics during the run. The device rate-limits each IP (429) and sheds load past a few
+requests in flight (503); both are counted as rejected, not as errors.
+
+--save-baseline stores the numbers as JSON, --baseline compares a run with them and exits with 1 when
+latency, throughput or heap got noticeably worse.
+"""
+
+import argparse
+import json
+import random
+import re
+import sys
+import threading
+import time
+import urllib.error
+import urllib.parse
+import urllib.request
+
+MIX = (
+    ("rooms_get", 35),
+    ("heating_get", 20),
+    ("changes_poll", 20),
+    ("schedule_get", 10),
+    ("schedule_patch", 15),
+)
+MUTATING_MIX = (("thermometer_add", 10),)
+ROUTES = {
+    "rooms_get": ("GET", "/api/rooms"),
+    "heating_get": ("GET", "/api/heating/status"),
+    "changes_poll": ("GET", "/api/changes"),
+    "schedule_get": ("GET", "/api/schedule"),
+    "schedule_patch": ("PATCH", "/api/schedule"),
+    "thermometer_add": ("POST", "/api/thermometers"),
+}
+# A run is a regression when it is this much worse than the baseline
+LATENCY_TOLERANCE = 1.25
+THROUGHPUT_TOLERANCE = 0.8
+HEAP_TOLERANCE_BYTES = 4096
+METRICS_INTERVAL_S = 5
+TEST_MAC = "AA:BB:CC:00:00:%02X"
+
+
+def call(base, method, path, body=None):
+    data = json.dumps(body).encode("utf-8") if body is not None else None
+    request = urllib.request.Request(urllib.parse.urljoin(base, path), data=data, method=method)
+    if data is not None:
+        request.add_header("Content-Type", "application/json")
+    start = time.perf_counter()
+    try:
+        with urllib.request.urlopen(request, timeout=10) as response:
+            payload, status = response.read(), response.status
+    except urllib.error.HTTPError as error:
+        payload, status = b"", error.code
+    except OSError:
+        payload, status = b"", 0
+    return status, payload, time.perf_counter() - start
+
+
+def read_metrics(base):
+    status, payload, _ = call(base, "GET", "/metrics")
+    samples = {}
+    if status != 200:
+        return samples
+    for line in payload.decode("utf-8", "replace").splitlines():
+        match = re.match(r"^(\w+)(\{[^}]*\})? (\S+)$", line)
+        if match:
+            samples[(match.group(1), match.group(2) or "")] = float(match.group(3))
+    return samples
+
+
+def percentile(values, fraction):
+    if not values:
+        return 0.0
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+class Client(threading.Thread):
+    def __init__(self, base, mix, deadline, state, results, lock, number):
+        super().__init__(daemon=True)
+        self.base, self.mix, self.deadline, self.state = base, mix, deadline, state
+        self.results, self.lock, self.number = results, lock, number
+        self.since = None
+
+    def request(self, kind):
+        if kind == "changes_poll":
+            path = "/api/changes" + ("?since=%d" % self.since if self.since is not None else "")
+            status, payload, elapsed = call(self.base, "GET", path)
+            if status == 200:
+                try:
+                    self.since = json.loads(payload).get("version")
+                except ValueError:
+                    pass
+            return status, elapsed
+        if kind == "schedule_patch":
+            day, slot = random.randrange(7), random.randrange(48)
+            mode = self.state["schedule"][day][slot]
+            body = {"ranges": [{"day": day, "from": slot, "to": slot, "mode": mode}]}
+            return call(self.base, "PATCH", "/api/schedule", body)[::2]
+        if kind == "thermometer_add":
+            room = urllib.parse.quote(self.state["room"])
+            mac = TEST_MAC % self.number
+            status, _, elapsed = call(self.base, "POST", "/api/thermometers?room_name=" + room, {"mac": mac})
+            call(self.base, "DELETE", "/api/thermometers?room_name=%s&mac=%s" % (room, urllib.parse.quote(mac)))
+            return status, elapsed
+        method, path = ROUTES[kind]
+        return call(self.base, method, path)[::2]
+
+    def run(self):
+        kinds = [kind for kind, _ in self.mix]
+        weights = [weight for _, weight in self.mix]
+        while time.monotonic() < self.deadline:
+            kind = random.choices(kinds, weights)[0]
+            status, elapsed = self.request(kind)
+            with self.lock:
+                self.results.setdefault(kind, []).append((status, elapsed * 1000))
+
+
+class HeapSampler(threading.Thread):
+    def __init__(self, base, deadline):
+        super().__init__(daemon=True)
+        self.base, self.deadline = base, deadline
+        self.lowest_free = None
+        self.lowest_block = None
+
+    def run(self):
+        while time.monotonic() < self.deadline:
+            samples = read_metrics(self.base)
+            free = samples.get(("thermostat_heap_free_bytes", ""))
+            block = samples.get(("thermostat_heap_largest_free_block_bytes", ""))
+            if free is not None:
+                self.lowest_free = free if self.lowest_free is None else min(self.lowest_free, free)
+            if block is not None:
+                self.lowest_block = block if self.lowest_block is None else min(self.lowest_block, block)
+            time.sleep(METRICS_INTERVAL_S)
+
+
+def prepare(base, mutating):
+    status, payload, _ = call(base, "GET", "/api/schedule")
+    if status != 200:
+        sys.exit("GET /api/schedule answered %d" % status)
+    state = {"schedule": [day["hours"] for day in json.loads(payload)["days"]]}
+    if mutating:
+        status, payload, _ = call(base, "GET", "/api/rooms")
+        rooms = json.loads(payload).get("rooms", []) if status == 200 else []
+        if not rooms:
+            sys.exit("--mutating needs at least one room")
+        state["room"] = rooms[0]["room_name"]
+    return state
+
+
+def summarize(results, duration, metrics):
+    report = {}
+    for kind, samples in sorted(results.items()):
+        method, path = ROUTES[kind]
+        ok = [elapsed for status, elapsed in samples if 200 <= status < 300]
+        rejected = sum(1 for status, _ in samples if status in (429, 503))
+        held = metrics.get(("thermostat_http_handler_heap_held_max_bytes",
+                            '{method="%s",route="%s"}' % (method, path)))
+        report[kind] = {
+            "requests": len(samples),
+            "ok_per_s": len(ok) / duration,
+            "rejected": rejected,
+            "errors": len(samples) - len(ok) - rejected,
+            "p50_ms": percentile(ok, 0.5),
+            "p90_ms": percentile(ok, 0.9),
+            "p99_ms": percentile(ok, 0.99),
+            "max_ms": max(ok) if ok else 0.0,
+            "heap_held_max_bytes": held,
+        }
+    return report
+
+
+def print_report(report, device):
+    print("%-16s %8s %8s %8s %6s %8s %8s %8s %8s %10s" % (
+        "request", "count", "ok/s", "rejected", "errors", "p50 ms", "p90 ms", "p99 ms", "max ms", "heap held"))
+    for kind, row in report.items():
+        held = "%d" % row["heap_held_max_bytes"] if row["heap_held_max_bytes"] is not None else "-"
+        print("%-16s %8d %8.1f %8d %6d %8.1f %8.1f %8.1f %8.1f %10s" % (
+            kind, row["requests"], row["ok_per_s"], row["rejected"], row["errors"], row["p50_ms"],
+            row["p90_ms"], row["p99_ms"], row["max_ms"], held))
+    print("device: lowest free heap %s bytes, lowest largest block %s bytes, heap low-water mark %s bytes" % (
+        device.get("lowest_free_heap"), device.get("lowest_largest_block"), device.get("min_free_heap")))
+
+
+def compare(report, device, baseline):
+    problems = []
+    for kind, row in report.items():
+        before = baseline["requests"].get(kind)
+        if not before:
+            continue
+        if before["p90_ms"] > 0 and row["p90_ms"] > before["p90_ms"] * LATENCY_TOLERANCE:
+            problems.append("%s p90 %.1f ms, baseline %.1f ms" % (kind, row["p90_ms"], before["p90_ms"]))
+        if row["ok_per_s"] < before["ok_per_s"] * THROUGHPUT_TOLERANCE:
+            problems.append("%s %.1f ok/s, baseline %.1f ok/s" % (kind, row["ok_per_s"], before["ok_per_s"]))
+    lowest, lowest_before = device.get("lowest_free_heap"), baseline["device"].get("lowest_free_heap")
+    if lowest is not None and lowest_before is not None and lowest < lowest_before - HEAP_TOLERANCE_BYTES:
+        problems.append("lowest free heap %d bytes, baseline %d bytes" % (lowest, lowest_before))
+    return problems
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("base", help="device URL, e.g. http://192.168.1.50/")
+    parser.add_argument("--clients", type=int, default=4)
+    parser.add_argument("--duration", type=float, default=60, help="seconds")
+    parser.add_argument("--mutating", action="store_true", help="also add and remove thermometers")
+    parser.add_argument("--save-baseline", metavar="FILE")
+    parser.add_argument("--baseline", metavar="FILE")
+    arguments = parser.parse_args()
+
+    state = prepare(arguments.base, arguments.mutating)
+    mix = MIX + (MUTATING_MIX if arguments.mutating else ())
+    deadline = time.monotonic() + arguments.duration
+    results, lock = {}, threading.Lock()
+    sampler = HeapSampler(arguments.base, deadline)
+    clients = [Client(arguments.base, mix, deadline, state, results, lock, number)
+               for number in range(arguments.clients)]
+    sampler.start()
+    for client in clients:
+        client.start()
+    for client in clients:
+        client.join()
+    sampler.join()
+
+    metrics = read_metrics(arguments.base)
+    device = {
+        "lowest_free_heap": sampler.lowest_free,
+        "lowest_largest_block": sampler.lowest_block,
+        "min_free_heap": metrics.get(("thermostat_heap_min_free_bytes", "")),
+        "rejected_rate_limited": metrics.get(("thermostat_http_rejected_total", '{reason="rate_limited"}')),
+        "rejected_overloaded": metrics.get(("thermostat_http_rejected_total", '{reason="overloaded"}')),
+    }
+    report = summarize(results, arguments.duration, metrics)
+    print_report(report, device)
+
+    run = {"clients": arguments.clients, "duration_s": arguments.duration, "mutating": arguments.mutating,
+           "requests": report, "device": device}
+    if arguments.save_baseline:
+        with open(arguments.save_baseline, "w") as output:
+            json.dump(run, output, indent=2, sort_keys=True)
+    if arguments.baseline:
+        with open(arguments.baseline) as source:
+            problems = compare(report, device, json.load(source))
+        for problem in problems:
+            print("REGRESSION " + problem)
+        if problems:
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
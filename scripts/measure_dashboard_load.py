@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""Fetches the dashboard like a browser would and reports bytes and time for a first and a repeat visit.
+
+Usage: scripts/measure_dashboard_load.py http://<esp_ip>/ [rounds]
+
+The repeat visit sends If-None-Match for index.html and skips assets the browser would keep in its
+cache (Cache-Control immutable / max-age). Run it against firmware before and after a UI change.
+"""
+
+import gzip
+import re
+import sys
+import time
+import urllib.error
+import urllib.parse
+import urllib.request
+
+
+def fetch(url, etag=None):
+    request = urllib.request.Request(url, headers={"Accept-Encoding": "gzip"})
+    if etag:
+        request.add_header("If-None-Match", etag)
+    start = time.perf_counter()
+    try:
+        with urllib.request.urlopen(request, timeout=10) as response:
+            body = response.read()
+            status, headers = response.status, response.headers
+    except urllib.error.HTTPError as error:
+        body, status, headers = b"", error.code, error.headers
+    return status, headers, body, time.perf_counter() - start
+
+
+def local_assets(page):
+    return [name for name in re.findall(r'(?:src|href)="([^"]+)"', page) if "://" not in name]
+
+
+def visit(base, cache):
+    total_bytes, start = 0, time.perf_counter()
+    status, headers, body, _ = fetch(base, cache.get("/"))
+    total_bytes += len(body)
+    if status == 200:
+        cache["/"] = headers.get("ETag")
+        if headers.get("Content-Encoding") == "gzip":
+            body = gzip.decompress(body)
+        cache["page"] = body.decode("utf-8")
+    for asset in local_assets(cache["page"]):
+        if "immutable" in cache.get(asset, ""):
+            continue
+        status, headers, body, _ = fetch(urllib.parse.urljoin(base, asset))
+        total_bytes += len(body)
+        cache[asset] = headers.get("Cache-Control") or ""
+    return total_bytes, time.perf_counter() - start
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__)
+        sys.exit(1)
+    base = sys.argv[1]
+    rounds = int(sys.argv[2]) if len(sys.argv) > 2 else 5
+    for label, reuse in (("first visit", False), ("repeat visit", True)):
+        cache, sizes, times = {}, [], []
+        if reuse:
+            visit(base, cache)
+        for _ in range(rounds):
+            size, elapsed = visit(base, dict(cache) if reuse else {})
+            sizes.append(size)
+            times.append(elapsed * 1000)
+        print("%-13s %7d bytes  median %6.1f ms  max %6.1f ms" %
+              (label, sizes[-1], sorted(times)[len(times) // 2], max(times)))
+
+
+if __name__ == "__main__":
+    main()
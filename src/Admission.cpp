@@ -0,0 +1,129 @@
+#include "Admission.h"
+#include <Arduino.h>
+
+struct ClientBucket {
+    uint32_t address;
+    uint32_t milliTokens;   ///< Thousandths of a request, so a refill never rounds down to nothing.
+    uint32_t lastMs;
+};
+
+MetricCounter rateLimitedMetric;
+MetricCounter overloadedMetric;
+MetricCounter sharedBucketMetric;
+
+// Only touched by the AsyncTCP task
+static ClientBucket clients[RATE_LIMITED_CLIENTS];
+static uint8_t clientCount = 0;
+static ClientBucket overflowBucket = {0, CLIENT_REQUEST_BURST * 1000, 0};
+static AsyncWebServerRequest *rejectedBodies[REJECTED_BODY_REQUESTS];
+static uint8_t nextRejectedBody = 0;
+
+static const char RATE_LIMITED_BODY[] = R"({"message":"Prea multe cereri, reîncercați mai târziu"})";
+static const char OVERLOADED_BODY[] = R"({"message":"Serverul este ocupat, reîncercați mai târziu"})";
+// Whole status line and headers, the connection is closed after the body
+static const char RATE_LIMITED_HEAD[] = "HTTP/1.1 429 Too Many Requests\r\n"
+                                        "Content-Type: application/json\r\n"
+                                        "Content-Length: 58\r\n"
+                                        "Retry-After: 1\r\n"
+                                        "Connection: close\r\n\r\n";
+static const char OVERLOADED_HEAD[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                                      "Content-Type: application/json\r\n"
+                                      "Content-Length: 61\r\n"
+                                      "Retry-After: 1\r\n"
+                                      "Connection: close\r\n\r\n";
+static_assert(sizeof(RATE_LIMITED_BODY) - 1 == 58, "Update Content-Length in RATE_LIMITED_HEAD");
+static_assert(sizeof(OVERLOADED_BODY) - 1 == 61, "Update Content-Length in OVERLOADED_HEAD");
+
+// The least recently seen client gives up its bucket to a new one, but only once the bucket would be full
+// again anyway. A fresh bucket for every newcomer would let more than RATE_LIMITED_CLIENTS clients take
+// turns evicting each other, each starting with a full burst.
+static ClientBucket &findBucket(uint32_t address, uint32_t now) {
+    ClientBucket *oldest = &clients[0];
+    for (uint8_t i = 0; i < clientCount; i++) {
+        if (clients[i].address == address) {
+            return clients[i];
+        }
+        if (now - clients[i].lastMs > now - oldest->lastMs) {
+            oldest = &clients[i];
+        }
+    }
+    if (clientCount == RATE_LIMITED_CLIENTS && now - oldest->lastMs < CLIENT_BUCKET_REFILL_MS) {
+        sharedBucketMetric.add();
+        return overflowBucket;
+    }
+    ClientBucket &bucket = clientCount < RATE_LIMITED_CLIENTS ? clients[clientCount++] : *oldest;
+    bucket.address = address;
+    bucket.milliTokens = CLIENT_REQUEST_BURST * 1000;
+    bucket.lastMs = now;
+    return bucket;
+}
+
+static bool takeToken(uint32_t address) {
+    uint32_t now = millis();
+    ClientBucket &bucket = findBucket(address, now);
+    uint32_t elapsed = now - bucket.lastMs;
+    bucket.lastMs = now;
+    uint32_t capacity = CLIENT_REQUEST_BURST * 1000;
+    // Past this a refill fills the bucket anyway, capping it keeps the product in range
+    uint32_t refill = elapsed >= CLIENT_REQUEST_BURST * 1000 ? capacity : elapsed * CLIENT_REQUESTS_PER_SECOND;
+    bucket.milliTokens = capacity - bucket.milliTokens > refill ? bucket.milliTokens + refill : capacity;
+    if (bucket.milliTokens < 1000) {
+        return false;
+    }
+    bucket.milliTokens -= 1000;
+    return true;
+}
+
+Admission admitRequest(AsyncWebServerRequest *request) {
+    if (!takeToken(static_cast<uint32_t>(request->client()->remoteIP()))) {
+        rateLimitedMetric.add();
+        return Admission::RATE_LIMITED;
+    }
+    if (apiRequestsInFlight() >= MAX_CONCURRENT_API_REQUESTS || ESP.getMaxAllocHeap() < ADMISSION_MIN_FREE_BLOCK) {
+        overloadedMetric.add();
+        return Admission::OVERLOADED;
+    }
+    return Admission::ADMITTED;
+}
+
+void rejectRequest(AsyncWebServerRequest *request, Admission admission) {
+    bool limited = admission == Admission::RATE_LIMITED;
+    const char *head = limited ? RATE_LIMITED_HEAD : OVERLOADED_HEAD;
+    const char *body = limited ? RATE_LIMITED_BODY : OVERLOADED_BODY;
+    // Written straight to the connection without a response object. Without the copy flag lwIP sends from
+    // the constants in flash, so a rejection allocates nothing beyond the segment headers
+    AsyncClient *client = request->client();
+    client->add(head, strlen(head), 0);
+    client->add(body, strlen(body), 0);
+    client->send();
+    // Closing here would free the request under the parser, the next poll ends the connection instead.
+    // The request never gets a response, so its own poll handler had nothing left to do
+    client->onPoll([](void *, AsyncClient *connection) {
+        connection->close();
+    }, nullptr);
+}
+
+bool admitBodySegment(AsyncWebServerRequest *request, size_t index) {
+    if (index != 0) {
+        for (AsyncWebServerRequest *rejected: rejectedBodies) {
+            if (rejected == request) {
+                return false;
+            }
+        }
+        return true;
+    }
+    // A new request may reuse the address of an earlier rejected one
+    for (AsyncWebServerRequest *&rejected: rejectedBodies) {
+        if (rejected == request) {
+            rejected = nullptr;
+        }
+    }
+    Admission admission = admitRequest(request);
+    if (admission == Admission::ADMITTED) {
+        return true;
+    }
+    rejectRequest(request, admission);
+    rejectedBodies[nextRejectedBody] = request;
+    nextRejectedBody = (nextRejectedBody + 1) % REJECTED_BODY_REQUESTS;
+    return false;
+}
@@ -0,0 +1,54 @@
+#ifndef ESP32_TERMOSTAT_ADMISSION_H
+#define ESP32_TERMOSTAT_ADMISSION_H
+
+#include <cstdint>
+#include <ESPAsyncWebServer.h>
+#include "Metrics.h"
+#include "RouteStats.h"
+
+// Admission control in front of every API handler. A request is turned away before its handler allocates
+// anything when its client ran out of tokens (429) or when too many API requests are already in flight or
+// the heap is fragmented (503). Rejections write a preformatted response with Retry-After straight to the
+// connection, without allocating a response object.
+
+constexpr uint8_t MAX_CONCURRENT_API_REQUESTS = 4;
+static_assert(MAX_CONCURRENT_API_REQUESTS < MAX_TRACED_REQUESTS, "In-flight requests are counted by the trace");
+// Below this largest free block a handler could fail halfway, better refuse it up front
+constexpr uint32_t ADMISSION_MIN_FREE_BLOCK = 8192;
+constexpr uint8_t RATE_LIMITED_CLIENTS = 16;
+constexpr uint32_t CLIENT_REQUESTS_PER_SECOND = 5;
+constexpr uint32_t CLIENT_REQUEST_BURST = 20;
+// An empty bucket is full again after this long. Only a bucket idle that long is handed to a new client, with
+// every bucket in use the newcomers share one overflow bucket.
+constexpr uint32_t CLIENT_BUCKET_REFILL_MS = CLIENT_REQUEST_BURST * 1000 / CLIENT_REQUESTS_PER_SECOND;
+constexpr uint8_t REJECTED_BODY_REQUESTS = 8;
+
+enum class Admission : uint8_t {
+    ADMITTED,
+    RATE_LIMITED,
+    OVERLOADED
+};
+
+extern MetricCounter rateLimitedMetric;
+extern MetricCounter overloadedMetric;
+extern MetricCounter sharedBucketMetric;
+
+/**
+ * @brief Takes a token from the client's bucket and checks the global limits. Only called by the AsyncTCP task.
+ */
+Admission admitRequest(AsyncWebServerRequest *request);
+
+/**
+ * @brief Answers a request that was not admitted and closes its connection on the next poll.
+ */
+void rejectRequest(AsyncWebServerRequest *request, Admission admission);
+
+/**
+ * @brief Admission for a body segment: decided on the first segment, later segments of a rejected
+ * request are dropped without calling the body handler again.
+ *
+ * @return True if the body handler should run.
+ */
+bool admitBodySegment(AsyncWebServerRequest *request, size_t index);
+
+#endif //ESP32_TERMOSTAT_ADMISSION_H
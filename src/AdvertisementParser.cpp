@@ -0,0 +1,193 @@
+#include "AdvertisementParser.h"
+
+// AD type "Service Data - 16-bit UUID"
+static constexpr uint8_t AD_TYPE_SERVICE_DATA_16 = 0x16;
+
+static uint16_t readUint16Le(const uint8_t *data) {
+    return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+static uint16_t readUint16Be(const uint8_t *data) {
+    return static_cast<uint16_t>((data[0] << 8) | data[1]);
+}
+
+// MAC[6] BE, temperature int16 BE 0.1 °C, humidity %, battery %, battery mV BE, counter
+static bool parseAtc1441(const uint8_t *data, uint8_t length, SensorReading &reading) {
+    reading.temperatureCenti = static_cast<int16_t>(static_cast<int16_t>(readUint16Be(data + 6)) * 10);
+    reading.humidityCenti = static_cast<uint16_t>(data[8] * 100);
+    reading.batteryPercent = data[9];
+    reading.batteryMv = readUint16Be(data + 10);
+    reading.frameCounter = data[12];
+    reading.fields = READING_TEMPERATURE | READING_HUMIDITY | READING_BATTERY_MV | READING_BATTERY_PERCENT;
+    return true;
+}
+
+// MAC[6] LE, temperature int16 LE 0.01 °C, humidity LE 0.01 %, battery mV LE, battery %, counter, flags
+static bool parsePvvx(const uint8_t *data, uint8_t length, SensorReading &reading) {
+    reading.temperatureCenti = static_cast<int16_t>(readUint16Le(data + 6));
+    reading.humidityCenti = readUint16Le(data + 8);
+    reading.batteryMv = readUint16Le(data + 10);
+    reading.batteryPercent = data[12];
+    reading.frameCounter = data[13];
+    reading.fields = READING_TEMPERATURE | READING_HUMIDITY | READING_BATTERY_MV | READING_BATTERY_PERCENT;
+    return true;
+}
+
+// Payload size of the BTHome v2 object ids up to 0x58, 0 for ids this table does not know.
+// Objects are not self-describing, so parsing has to stop at the first unknown id.
+static const uint8_t BTHOME_OBJECT_SIZES[] = {
+    1, 1, 2, 2, 3, 3, 2, 2, 2, 1, 3, 3, 2, 2, 2, 1,   // 0x00 - 0x0F
+    1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,   // 0x10 - 0x1F
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,   // 0x20 - 0x2F
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 2, 2, 4, 2,   // 0x30 - 0x3F
+    2, 2, 3, 2, 2, 2, 1, 2, 2, 2, 2, 3, 4, 4, 4, 4,   // 0x40 - 0x4F
+    4, 2, 2, 0, 0, 4, 2, 1, 1                         // 0x50 - 0x58
+};
+
+// Device info byte, then (object id, value) pairs in little endian
+static bool parseBtHome(const uint8_t *data, uint8_t length, SensorReading &reading) {
+    uint8_t deviceInfo = data[0];
+    if ((deviceInfo & 0x01) != 0 || (deviceInfo >> 5) != 2) {
+        return false; // Encrypted, or not version 2
+    }
+    uint8_t offset = 1;
+    while (offset < length) {
+        uint8_t objectId = data[offset];
+        uint8_t size = objectId < sizeof(BTHOME_OBJECT_SIZES) ? BTHOME_OBJECT_SIZES[objectId] : 0;
+        if (size == 0 || offset + 1 + size > length) {
+            break;
+        }
+        const uint8_t *value = data + offset + 1;
+        switch (objectId) {
+            case 0x00:
+                reading.frameCounter = value[0];
+                break;
+            case 0x01:
+                reading.batteryPercent = value[0];
+                reading.fields |= READING_BATTERY_PERCENT;
+                break;
+            case 0x02:
+                reading.temperatureCenti = static_cast<int16_t>(readUint16Le(value));
+                reading.fields |= READING_TEMPERATURE;
+                break;
+            case 0x45:
+                reading.temperatureCenti = static_cast<int16_t>(static_cast<int16_t>(readUint16Le(value)) * 10);
+                reading.fields |= READING_TEMPERATURE;
+                break;
+            case 0x03:
+                reading.humidityCenti = readUint16Le(value);
+                reading.fields |= READING_HUMIDITY;
+                break;
+            case 0x2E:
+                reading.humidityCenti = static_cast<uint16_t>(value[0] * 100);
+                reading.fields |= READING_HUMIDITY;
+                break;
+            case 0x0C:
+                reading.batteryMv = readUint16Le(value);
+                reading.fields |= READING_BATTERY_MV;
+                break;
+            default:
+                break;
+        }
+        offset += 1 + size;
+    }
+    return reading.fields != 0;
+}
+
+// Frame control LE, product id LE, counter, [MAC 6], [capability 1 (+2 IO)], [object id LE, length, value]
+static bool parseMiBeacon(const uint8_t *data, uint8_t length, SensorReading &reading) {
+    uint16_t frameControl = readUint16Le(data);
+    if ((frameControl & 0x0008) != 0 || (frameControl & 0x0040) == 0) {
+        return false; // Encrypted, or no object in this frame
+    }
+    reading.frameCounter = data[4];
+    uint8_t offset = 5;
+    if (frameControl & 0x0010) {
+        offset += 6;
+    }
+    if (frameControl & 0x0020) {
+        if (offset >= length) {
+            return false;
+        }
+        offset += (data[offset] & 0x20) ? 3 : 1;
+    }
+    if (offset + 3 > length) {
+        return false;
+    }
+    uint16_t objectId = readUint16Le(data + offset);
+    uint8_t size = data[offset + 2];
+    const uint8_t *value = data + offset + 3;
+    if (offset + 3 + size > length) {
+        return false;
+    }
+    // Values are in 0.1 units
+    switch (objectId) {
+        case 0x1004:
+            if (size < 2) return false;
+            reading.temperatureCenti = static_cast<int16_t>(static_cast<int16_t>(readUint16Le(value)) * 10);
+            reading.fields = READING_TEMPERATURE;
+            return true;
+        case 0x1006:
+            if (size < 2) return false;
+            reading.humidityCenti = static_cast<uint16_t>(readUint16Le(value) * 10);
+            reading.fields = READING_HUMIDITY;
+            return true;
+        case 0x100A:
+            if (size < 1) return false;
+            reading.batteryPercent = value[0];
+            reading.fields = READING_BATTERY_PERCENT;
+            return true;
+        case 0x100D:
+            if (size < 4) return false;
+            reading.temperatureCenti = static_cast<int16_t>(static_cast<int16_t>(readUint16Le(value)) * 10);
+            reading.humidityCenti = static_cast<uint16_t>(readUint16Le(value + 2) * 10);
+            reading.fields = READING_TEMPERATURE | READING_HUMIDITY;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Order matters only where a UUID/length pair matches more than one entry
+static const AdvertisementDecoder DECODERS[] = {
+    {"atc1441", ATC_SERVICE_UUID, ATC1441_SERVICE_DATA_LEN, ATC1441_SERVICE_DATA_LEN, parseAtc1441},
+    {"pvvx", ATC_SERVICE_UUID, PVVX_SERVICE_DATA_LEN, PVVX_SERVICE_DATA_LEN, parsePvvx},
+    {"bthome", BTHOME_SERVICE_UUID, 3, 255, parseBtHome},
+    {"mibeacon", MIBEACON_SERVICE_UUID, 5, 255, parseMiBeacon},
+};
+static constexpr uint8_t DECODER_COUNT = sizeof(DECODERS) / sizeof(DECODERS[0]);
+
+bool parseThermometerAdvertisement(const uint8_t *payload, size_t length, SensorReading &reading) {
+    size_t offset = 0;
+    while (offset < length) {
+        uint8_t fieldLength = payload[offset];
+        if (fieldLength == 0) {
+            break; // Padding at the end of the advertisement
+        }
+        if (offset + 1 + fieldLength > length) {
+            return false; // Truncated structure
+        }
+        const uint8_t *field = payload + offset + 1;
+        if (field[0] == AD_TYPE_SERVICE_DATA_16 && fieldLength >= 3) {
+            uint16_t uuid = readUint16Le(field + 1);
+            auto dataLength = static_cast<uint8_t>(fieldLength - 3);
+            for (uint8_t i = 0; i < DECODER_COUNT; i++) {
+                const AdvertisementDecoder &decoder = DECODERS[i];
+                if (decoder.serviceUuid != uuid || dataLength < decoder.minLength || dataLength > decoder.maxLength) {
+                    continue;
+                }
+                reading.fields = 0;
+                if (decoder.parse(field + 3, dataLength, reading)) {
+                    reading.decoder = i;
+                    return true;
+                }
+            }
+        }
+        offset += 1 + fieldLength;
+    }
+    return false;
+}
+
+const char *decoderName(uint8_t decoder) {
+    return decoder < DECODER_COUNT ? DECODERS[decoder].name : "unknown";
+}
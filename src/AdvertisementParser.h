@@ -0,0 +1,71 @@
+#ifndef ESP32_TERMOSTAT_ADVERTISEMENTPARSER_H
+#define ESP32_TERMOSTAT_ADVERTISEMENTPARSER_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Plain C++ without Arduino dependencies so it can be built and fed captured payloads on a PC.
+
+// Environmental Sensing service, used by the ATC1441 and pvvx custom thermometer firmwares
+constexpr uint16_t ATC_SERVICE_UUID = 0x181A;
+constexpr uint8_t ATC1441_SERVICE_DATA_LEN = 13;
+constexpr uint8_t PVVX_SERVICE_DATA_LEN = 15;
+constexpr uint16_t BTHOME_SERVICE_UUID = 0xFCD2;
+constexpr uint16_t MIBEACON_SERVICE_UUID = 0xFE95;
+
+// Bits of SensorReading::fields, not every format carries every value in each advertisement
+enum ReadingField : uint8_t {
+    READING_TEMPERATURE = 1 << 0,
+    READING_HUMIDITY = 1 << 1,
+    READING_BATTERY_MV = 1 << 2,
+    READING_BATTERY_PERCENT = 1 << 3
+};
+
+/**
+ * @struct SensorReading
+ * @brief Compact record of one decoded advertisement, small enough to be queued by value.
+ */
+struct SensorReading {
+    uint8_t mac[6];            ///< Sensor address, most significant byte first.
+    int16_t temperatureCenti;  ///< Temperature in 0.01 °C.
+    uint16_t humidityCenti;    ///< Relative humidity in 0.01 %.
+    uint16_t batteryMv;        ///< Battery voltage in mV.
+    uint8_t batteryPercent;    ///< Battery level in %.
+    uint8_t frameCounter;      ///< Measurement / packet counter sent by the sensor.
+    uint8_t fields;            ///< ReadingField bits of the values present.
+    uint8_t decoder;           ///< Index of the decoder that produced the reading.
+    int8_t rssi;               ///< Signal strength of the advertisement in dBm.
+    uint32_t receivedMs;       ///< millis() when the advertisement was received.
+};
+
+/**
+ * @struct AdvertisementDecoder
+ * @brief One supported sensor format, matched on the 16-bit service data UUID and its length.
+ *
+ * parse() reads straight from the advertisement buffer and only fills the measurement fields.
+ */
+struct AdvertisementDecoder {
+    const char *name;
+    uint16_t serviceUuid;
+    uint8_t minLength;
+    uint8_t maxLength;
+    bool (*parse)(const uint8_t *data, uint8_t length, SensorReading &reading);
+};
+
+/**
+ * @brief Walks the advertisement once and hands the first service data element a decoder accepts to it.
+ *
+ * The caller sets mac, rssi and receivedMs.
+ *
+ * @param payload Raw advertising data (sequence of length/type/value structures).
+ * @param length Payload length.
+ * @return False if the payload carries no supported, unencrypted sensor data.
+ */
+bool parseThermometerAdvertisement(const uint8_t *payload, size_t length, SensorReading &reading);
+
+/**
+ * @brief Name of a decoder, as stored in SensorReading::decoder.
+ */
+const char *decoderName(uint8_t decoder);
+
+#endif //ESP32_TERMOSTAT_ADVERTISEMENTPARSER_H
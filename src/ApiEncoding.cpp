@@ -0,0 +1,104 @@
+#include "ApiEncoding.h"
+#include <Arduino.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include "RouteStats.h"
+
+static bool mediaTypeIs(const char *type, size_t length, const char *name) {
+    return strlen(name) == length && strncasecmp(type, name, length) == 0;
+}
+
+// q parameter of one media range, 1 when it has none
+static float mediaQuality(const char *parameters, const char *end) {
+    const char *q = parameters;
+    while ((q = strstr(q, "q=")) != nullptr && q < end) {
+        if (q == parameters || q[-1] == ';' || q[-1] == ' ') {
+            return strtof(q + 2, nullptr);
+        }
+        q += 2;
+    }
+    return 1.0f;
+}
+
+ApiEncoding negotiateEncoding(AsyncWebServerRequest *request) {
+    AsyncWebHeader *accept = request->getHeader("Accept");
+    if (accept == nullptr) {
+        return ApiEncoding::JSON;
+    }
+    // Highest quality each encoding is accepted with, JSON also stands for the wildcards
+    float msgpackQuality = 0.0f;
+    float jsonQuality = 0.0f;
+    const char *range = accept->value().c_str();
+    while (*range != '\0') {
+        while (*range == ' ' || *range == ',') {
+            range++;
+        }
+        const char *end = range + strcspn(range, ",");
+        size_t typeLength = strcspn(range, ";,");
+        while (typeLength > 0 && range[typeLength - 1] == ' ') {
+            typeLength--;
+        }
+        // Other media types are skipped without parsing their quality
+        if (mediaTypeIs(range, typeLength, "application/msgpack") ||
+            mediaTypeIs(range, typeLength, "application/x-msgpack")) {
+            msgpackQuality = std::max(msgpackQuality, mediaQuality(range + typeLength, end));
+        } else if (mediaTypeIs(range, typeLength, "application/json") ||
+                   mediaTypeIs(range, typeLength, "application/*") || mediaTypeIs(range, typeLength, "*/*")) {
+            jsonQuality = std::max(jsonQuality, mediaQuality(range + typeLength, end));
+        }
+        range = end;
+    }
+    // Named explicitly, MessagePack wins a tie with a wildcard
+    return msgpackQuality > 0.0f && msgpackQuality >= jsonQuality ? ApiEncoding::MSGPACK : ApiEncoding::JSON;
+}
+
+const char *encodingContentType(ApiEncoding encoding) {
+    return encoding == ApiEncoding::MSGPACK ? "application/msgpack" : "application/json";
+}
+
+void serializeDocument(const JsonDocument &doc, ApiEncoding encoding, std::string &out) {
+    if (encoding == ApiEncoding::MSGPACK) {
+        serializeMsgPack(doc, out);
+    } else {
+        serializeJson(doc, out);
+    }
+}
+
+void sendEncodedBody(AsyncWebServerRequest *request, int code, ApiEncoding encoding,
+                     const std::shared_ptr<const std::string> &body, const char *etag) {
+    // A callback response reads the bytes lazily, the lambda keeps them alive until then
+    AsyncWebServerResponse *response = request->beginResponse(
+            encodingContentType(encoding), body->size(),
+            [body](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+                size_t count = std::min(maxLen, body->size() - index);
+                memcpy(buffer, body->data() + index, count);
+                return count;
+            });
+    response->setCode(code);
+    response->addHeader("Vary", "Accept");
+    if (etag != nullptr) {
+        response->addHeader("ETag", etag);
+        response->addHeader("Cache-Control", "no-cache");
+    }
+    RequestTrace trace = currentRequestTrace();
+    noteResponseStart(trace);
+    noteResponseBytes(trace, body->size());
+    request->send(response);
+}
+
+void sendDocument(AsyncWebServerRequest *request, int code, const JsonDocument &doc) {
+    ApiEncoding encoding = negotiateEncoding(request);
+    if (encoding == ApiEncoding::JSON) {
+        String response;
+        serializeJson(doc, response);
+        RequestTrace trace = currentRequestTrace();
+        noteResponseStart(trace);
+        noteResponseBytes(trace, response.length());
+        request->send(code, "application/json", response);
+        return;
+    }
+    std::shared_ptr<std::string> body = std::make_shared<std::string>();
+    serializeMsgPack(doc, *body);
+    sendEncodedBody(request, code, encoding, body);
+}
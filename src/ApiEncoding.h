@@ -0,0 +1,43 @@
+#ifndef ESP32_TERMOSTAT_APIENCODING_H
+#define ESP32_TERMOSTAT_APIENCODING_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <ArduinoJson.h>
+#include <ESPAsyncWebServer.h>
+
+// Response encodings a client can ask for with the Accept header. Request bodies are always JSON.
+enum class ApiEncoding : uint8_t {
+    JSON,
+    MSGPACK,
+    COUNT
+};
+
+/**
+ * @brief Picks MessagePack when the Accept header lists application/msgpack (or x-msgpack) with a quality above
+ *        0 and at least that of JSON or a wildcard, JSON otherwise.
+ */
+ApiEncoding negotiateEncoding(AsyncWebServerRequest *request);
+
+const char *encodingContentType(ApiEncoding encoding);
+
+/**
+ * @brief Serializes doc in the given encoding, appending to out.
+ */
+void serializeDocument(const JsonDocument &doc, ApiEncoding encoding, std::string &out);
+
+/**
+ * @brief Sends bytes shared with other responses, the body stays alive until this response is done with it.
+ *
+ * @param etag Optional, sent together with Cache-Control: no-cache.
+ */
+void sendEncodedBody(AsyncWebServerRequest *request, int code, ApiEncoding encoding,
+                     const std::shared_ptr<const std::string> &body, const char *etag = nullptr);
+
+/**
+ * @brief Sends doc in the encoding the client asked for.
+ */
+void sendDocument(AsyncWebServerRequest *request, int code, const JsonDocument &doc);
+
+#endif //ESP32_TERMOSTAT_APIENCODING_H
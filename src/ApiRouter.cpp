@@ -0,0 +1,199 @@
+#include "ApiRouter.h"
+#include <Arduino.h>
+#include "Admission.h"
+
+static const char *methodName(WebRequestMethod method) {
+    switch (method) {
+        case HTTP_GET:
+            return "GET";
+        case HTTP_POST:
+            return "POST";
+        case HTTP_PUT:
+            return "PUT";
+        case HTTP_DELETE:
+            return "DELETE";
+        case HTTP_PATCH:
+            return "PATCH";
+        default:
+            return "OTHER";
+    }
+}
+
+// Placeholder value of the route whose handler is running, only touched on the web server task
+static char currentPathParam[API_PATH_PARAM_LEN];
+static bool pathParamSet = false;
+static uint32_t currentPathParamUint = 0;
+
+static void enterRoute(const ApiRoute &route, const char *param) {
+    pathParamSet = route.param != ApiPathParam::NONE;
+    if (pathParamSet) {
+        strcpy(currentPathParam, param);
+        currentPathParamUint = route.param == ApiPathParam::UINT ? strtoul(param, nullptr, 10) : 0;
+    }
+}
+
+static void leaveRoute() {
+    pathParamSet = false;
+    currentPathParamUint = 0;
+}
+
+// Checks the segment against the placeholder type, copies it to param (API_PATH_PARAM_LEN bytes) if it fits
+static bool readPathParam(ApiPathParam type, const char *segment, char *param) {
+    size_t length = strlen(segment);
+    if (length == 0 || length >= API_PATH_PARAM_LEN) {
+        return false;
+    }
+    if (type == ApiPathParam::UINT) {
+        uint64_t value = 0;
+        for (const char *digit = segment; *digit != '\0'; digit++) {
+            if (*digit < '0' || *digit > '9') {
+                return false;
+            }
+            value = value * 10 + (*digit - '0');
+            if (value > UINT32_MAX) {
+                return false;
+            }
+        }
+    }
+    if (param != nullptr) {
+        memcpy(param, segment, length + 1);
+    }
+    return true;
+}
+
+// strcmp() of a route path against the first length bytes of path followed by '{', the placeholder routes
+// under that prefix compare equal
+static int comparePlaceholderPrefix(const char *routePath, const char *path, size_t length) {
+    int order = strncmp(routePath, path, length);
+    return order != 0 ? order : static_cast<unsigned char>(routePath[length]) - '{';
+}
+
+class ApiRouter : public AsyncWebHandler {
+public:
+    void begin(const ApiRoute *table, uint8_t count) {
+        routes = table;
+        routeCount = count;
+        for (uint8_t i = 0; i < routeCount; i++) {
+            stats[i] = addRouteStats(methodName(routes[i].method), routes[i].path);
+            hasPlaceholders |= routes[i].param != ApiPathParam::NONE;
+        }
+    }
+
+    bool canHandle(AsyncWebServerRequest *request) override {
+        if (findRoute(request, nullptr) < 0) {
+            return false;
+        }
+        // Keep every header, handlers look at If-None-Match, Accept and Accept-Encoding
+        request->addInterestingHeader("ANY");
+        return true;
+    }
+
+    void handleRequest(AsyncWebServerRequest *request) override {
+        char param[API_PATH_PARAM_LEN];
+        int8_t index = findRoute(request, param);
+        if (index < 0 || routes[index].onRequest == nullptr) {
+            return;
+        }
+        Admission admission = admitRequest(request);
+        if (admission != Admission::ADMITTED) {
+            rejectRequest(request, admission);
+            return;
+        }
+        RequestTrace trace = beginRouteHandler(stats[index], request);
+        enterRoute(routes[index], param);
+        routes[index].onRequest(request);
+        leaveRoute();
+        endRouteHandler(trace);
+    }
+
+    void handleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index,
+                    size_t total) override {
+        char param[API_PATH_PARAM_LEN];
+        int8_t route = findRoute(request, param);
+        if (route < 0 || routes[route].onBody == nullptr || !admitBodySegment(request, index)) {
+            return;
+        }
+        if (index + len != total) {
+            enterRoute(routes[route], param);
+            routes[route].onBody(request, data, len, index, total);
+            leaveRoute();
+            return;
+        }
+        RequestTrace trace = beginRouteHandler(stats[route], request);
+        enterRoute(routes[route], param);
+        routes[route].onBody(request, data, len, index, total);
+        leaveRoute();
+        endRouteHandler(trace);
+    }
+
+    bool isRequestHandlerTrivial() override {
+        return false;
+    }
+
+private:
+    const ApiRoute *routes = nullptr;
+    uint8_t routeCount = 0;
+    RouteStats *stats[MAX_API_ROUTES] = {};
+    bool hasPlaceholders = false;
+
+    // First route with the exact path, then the few methods registered for it. Failing that, the placeholder
+    // routes of the parent path, the value goes to param when it is not nullptr.
+    int8_t findRoute(AsyncWebServerRequest *request, char *param) const {
+        const char *path = request->url().c_str();
+        WebRequestMethodComposite method = request->method();
+        uint8_t low = 0;
+        uint8_t high = routeCount;
+        while (low < high) {
+            uint8_t middle = (low + high) / 2;
+            if (strcmp(routes[middle].path, path) < 0) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        for (uint8_t i = low; i < routeCount && strcmp(routes[i].path, path) == 0; i++) {
+            if (routes[i].method == method && routes[i].param == ApiPathParam::NONE) {
+                return static_cast<int8_t>(i);
+            }
+        }
+
+        const char *segment = strrchr(path, '/');
+        if (!hasPlaceholders || segment == nullptr) {
+            return -1;
+        }
+        size_t prefixLength = ++segment - path;
+        low = 0;
+        high = routeCount;
+        while (low < high) {
+            uint8_t middle = (low + high) / 2;
+            if (comparePlaceholderPrefix(routes[middle].path, path, prefixLength) < 0) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        for (uint8_t i = low; i < routeCount && comparePlaceholderPrefix(routes[i].path, path, prefixLength) == 0;
+             i++) {
+            if (routes[i].method == method && routes[i].param != ApiPathParam::NONE &&
+                readPathParam(routes[i].param, segment, param)) {
+                return static_cast<int8_t>(i);
+            }
+        }
+        return -1;
+    }
+};
+
+static ApiRouter router;
+
+void registerApiRoutes(AsyncWebServer &webServer, const ApiRoute *routes, uint8_t count) {
+    router.begin(routes, count);
+    webServer.addHandler(&router);
+}
+
+const char *apiPathParam() {
+    return pathParamSet ? currentPathParam : nullptr;
+}
+
+uint32_t apiPathParamUint() {
+    return currentPathParamUint;
+}
@@ -0,0 +1,96 @@
+#ifndef ESP32_TERMOSTAT_APIROUTER_H
+#define ESP32_TERMOSTAT_APIROUTER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <ESPAsyncWebServer.h>
+#include "RouteStats.h"
+
+// The API routes are one constexpr table sorted by path, served by a single handler that finds a route with a
+// binary search on the exact path. Unlike server.on() nothing is allocated per route, a request is not walked
+// past a String comparison for every route, and "/api/sensors" does not also match "/api/sensors/health".
+// Every route goes through admission control (Admission.h) and is traced (RouteStats.h).
+//
+// A route path may end in a typed placeholder segment, "/api/rooms/{name}". Exact paths are tried first, a
+// placeholder route only matches when no exact route does and the segment has the route's type.
+
+typedef void (*ApiRequestHandler)(AsyncWebServerRequest *request);
+typedef void (*ApiBodyHandler)(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+
+enum class ApiPathParam : uint8_t {
+    NONE = 0,
+    STRING,     ///< Any non-empty segment shorter than API_PATH_PARAM_LEN.
+    UINT,       ///< Decimal digits only, at most UINT32_MAX.
+};
+
+struct ApiRoute {
+    const char *path;
+    WebRequestMethod method;
+    ApiRequestHandler onRequest;    ///< nullptr for body routes.
+    ApiBodyHandler onBody;          ///< Body routes answer from the last body segment.
+    ApiPathParam param;             ///< Type of the {placeholder} the path ends in, NONE when left out.
+};
+
+constexpr uint8_t MAX_API_ROUTES = MAX_TRACED_ROUTES;
+// Longest placeholder value, terminator included, a longer segment does not match. Fits a room name.
+constexpr size_t API_PATH_PARAM_LEN = 32;
+
+constexpr int compareRoutePaths(const char *a, const char *b) {
+    return *a != *b || *a == '\0' ? static_cast<unsigned char>(*a) - static_cast<unsigned char>(*b)
+                                  : compareRoutePaths(a + 1, b + 1);
+}
+
+/**
+ * @brief True if the routes are sorted by path, then by method, with every path and method at most once.
+ *        Checked with a static_assert next to the table.
+ */
+constexpr bool apiRoutesSorted(const ApiRoute *routes, size_t count) {
+    return count < 2 || ((compareRoutePaths(routes[0].path, routes[1].path) < 0 ||
+                          (compareRoutePaths(routes[0].path, routes[1].path) == 0 &&
+                           routes[0].method < routes[1].method)) &&
+                         apiRoutesSorted(routes + 1, count - 1));
+}
+
+constexpr bool pathHasNoPlaceholder(const char *path) {
+    return *path == '\0' || (*path != '{' && pathHasNoPlaceholder(path + 1));
+}
+
+// The rest of a placeholder after its '{': a name up to the closing '}' that ends the path
+constexpr bool isPlaceholderRest(const char *path) {
+    return *path == '}' ? path[1] == '\0'
+                        : *path != '\0' && *path != '/' && *path != '{' && isPlaceholderRest(path + 1);
+}
+
+constexpr bool pathEndsInPlaceholder(const char *path) {
+    return *path != '\0' && *path != '{' &&
+           ((*path == '/' && path[1] == '{') ? isPlaceholderRest(path + 2) : pathEndsInPlaceholder(path + 1));
+}
+
+/**
+ * @brief True if every route with a path parameter ends in a single {placeholder} segment and no other route
+ *        has one. Checked with a static_assert next to the table.
+ */
+constexpr bool apiRoutePlaceholdersValid(const ApiRoute *routes, size_t count) {
+    return count == 0 || ((routes[0].param == ApiPathParam::NONE ? pathHasNoPlaceholder(routes[0].path)
+                                                                 : pathEndsInPlaceholder(routes[0].path)) &&
+                          apiRoutePlaceholdersValid(routes + 1, count - 1));
+}
+
+/**
+ * @brief Registers the handler serving the table. Call right after initRouteTracing(), so API requests
+ *        are matched before the static assets and the event stream.
+ */
+void registerApiRoutes(AsyncWebServer &webServer, const ApiRoute *routes, uint8_t count);
+
+/**
+ * @brief Value of the {placeholder} segment of the route being handled, nullptr if the route has none.
+ *        Only valid inside the route's handler, on the web server task.
+ */
+const char *apiPathParam();
+
+/**
+ * @brief apiPathParam() of an ApiPathParam::UINT route as a number, 0 outside such a route.
+ */
+uint32_t apiPathParamUint();
+
+#endif //ESP32_TERMOSTAT_APIROUTER_H
@@ -1,16 +1,108 @@
 #include "BLEConnection.h"
 #include "globalSettings.h"
+#include "AdvertisementParser.h"
+#include "SpscRing.h"
+#include "EventLog.h"
 #include <NimBLEDevice.h>
 #include <freertos/semphr.h>
 #include <Arduino.h>
 
 extern SemaphoreHandle_t bleSemaphore;
 
+// Filled by the NimBLE host task, drained by readAdvertisingData
+static SpscRing<SensorReading, BLE_READING_RING_SIZE> readingRing;
+static std::atomic<uint32_t> advertisementsSeen{0};
+static std::atomic<uint32_t> readingsDecoded{0};
+
+// Scan policy state, only written by readAdvertisingData and read under scanStatsMux by the web server
+static portMUX_TYPE scanStatsMux = portMUX_INITIALIZER_UNLOCKED;
+static ScanLevel scanLevel = ScanLevel::AGGRESSIVE;
+static uint32_t scanLevelChanges = 0;
+static uint32_t msInLevel[static_cast<uint8_t>(ScanLevel::COUNT)] = {};
+static uint32_t levelSinceMs = 0;
+
 void readAdvertisingData(void *parameter);
 
+class ThermometerScanCallbacks : public NimBLEAdvertisedDeviceCallbacks {
+    // Runs in the NimBLE host task: decode in place, queue a compact record and leave
+    void onResult(NimBLEAdvertisedDevice *advertisedDevice) override {
+        advertisementsSeen.fetch_add(1, std::memory_order_relaxed);
+        SensorReading reading{};
+        if (!parseThermometerAdvertisement(advertisedDevice->getPayload(), advertisedDevice->getPayloadLength(),
+                                           reading)) {
+            return;
+        }
+        // NimBLE keeps the address least significant byte first
+        const uint8_t *native = advertisedDevice->getAddress().getNative();
+        for (int i = 0; i < 6; i++) {
+            reading.mac[i] = native[5 - i];
+        }
+        reading.rssi = static_cast<int8_t>(advertisedDevice->getRSSI());
+        reading.receivedMs = millis();
+        if (readingRing.push(reading)) {
+            readingsDecoded.fetch_add(1, std::memory_order_relaxed);
+            if (bleTaskHandle != NULL) {
+                xTaskNotifyGive(bleTaskHandle);
+            }
+        }
+    }
+};
+
+static ThermometerScanCallbacks scanCallbacks;
+
+static void onScanEnded(NimBLEScanResults results) {
+    // A continuous scan only ends if the host resets, let the task restart it
+    if (bleTaskHandle != NULL) {
+        xTaskNotifyGive(bleTaskHandle);
+    }
+}
+
+static bool startContinuousScan() {
+    if (xSemaphoreTake(bleSemaphore, pdMS_TO_TICKS(500)) != pdTRUE) {
+        return false;
+    }
+    NimBLEScan *scan = NimBLEDevice::getScan();
+    bool started = scan->isScanning() || scan->start(0, onScanEnded, false);
+    xSemaphoreGive(bleSemaphore);
+    return started;
+}
+
+// NimBLE only applies a new interval/window when the scan is started, so a level change restarts it
+static bool applyScanLevel(ScanLevel level) {
+    if (xSemaphoreTake(bleSemaphore, pdMS_TO_TICKS(500)) != pdTRUE) {
+        return false;
+    }
+    ScanParameters parameters = scanParametersFor(level);
+    NimBLEScan *scan = NimBLEDevice::getScan();
+    if (scan->isScanning()) {
+        scan->stop();
+    }
+    scan->setInterval(parameters.intervalMs);
+    scan->setWindow(parameters.windowMs);
+    bool started = scan->start(0, onScanEnded, false);
+    xSemaphoreGive(bleSemaphore);
+    return started;
+}
+
+static void updateScanPolicy(uint32_t nowMs) {
+    int32_t oldestAge = sensorRegistry.oldestReadingAge(nowMs, SCAN_LOST_SENSOR_AGE_S);
+    ScanLevel next = selectScanLevel(oldestAge, scanLevel);
+    if (next != scanLevel && !applyScanLevel(next)) {
+        return; // Keep accounting for the old level, retried on the next pass
+    }
+    portENTER_CRITICAL(&scanStatsMux);
+    msInLevel[static_cast<uint8_t>(scanLevel)] += nowMs - levelSinceMs;
+    levelSinceMs = nowMs;
+    if (next != scanLevel) {
+        scanLevel = next;
+        scanLevelChanges++;
+    }
+    portEXIT_CRITICAL(&scanStatsMux);
+}
+
 void initBLEConnection() {
     NimBLEDevice::init("Thermostat");
-    
+
     // Ensure semaphore is created properly
     if (bleSemaphore == NULL) {
         bleSemaphore = xSemaphoreCreateMutex();
@@ -18,6 +110,18 @@ void initBLEConnection() {
             Serial.println("Failed to create BLE semaphore in initBLEConnection");
         }
     }
+
+    NimBLEScan *scan = NimBLEDevice::getScan();
+    // Every advertisement carries a new measurement, so duplicates must reach the callback
+    scan->setAdvertisedDeviceCallbacks(&scanCallbacks, true);
+    scan->setActiveScan(false);
+    scan->setDuplicateFilter(false);
+    // Start at full duty until the registry knows how fresh the sensors are
+    ScanParameters parameters = scanParametersFor(scanLevel);
+    scan->setInterval(parameters.intervalMs);
+    scan->setWindow(parameters.windowMs);
+    // Results are consumed in the callback, nothing needs to be kept in the scan result list
+    scan->setMaxResults(0);
 }
 
 void beginAdvertisingReadings() {
@@ -28,25 +132,56 @@ void beginAdvertisingReadings() {
             return;
         }
     }
-    xTaskCreatePinnedToCore(readAdvertisingData, "readAdvertisingData", 12288, nullptr, 3, &bleTaskHandle, 1);
+    xTaskCreatePinnedToCore(readAdvertisingData, "readAdvertisingData", 4096, nullptr, 3, &bleTaskHandle, 1);
 }
 
 void readAdvertisingData(void *parameter) {
+    levelSinceMs = millis();
+    startContinuousScan();
     for (;;) {
-        if (xSemaphoreTake(bleSemaphore, pdMS_TO_TICKS(500)) == pdTRUE) {
-            bleAdvertisingReader.initAllThermometers();
-            xSemaphoreGive(bleSemaphore);
-        }
-        vTaskDelay(50 / portTICK_PERIOD_MS);
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
 
-        for (int i = 0; i < 4; ++i) {
-            if (xSemaphoreTake(bleSemaphore, pdMS_TO_TICKS(500)) == pdTRUE) {
-                bleAdvertisingReader.readAdvertising(0.5);
-                xSemaphoreGive(bleSemaphore);
+        SensorReading reading{};
+        uint32_t firstMatchMs = 0;
+        bool matched = false;
+        time_t now = time(nullptr);
+        while (readingRing.pop(reading)) {
+            if (!sensorRegistry.apply(reading, now)) {
+                sensorDiscovery.record(reading);
+            } else if (!matched) {
+                firstMatchMs = reading.receivedMs;
+                matched = true;
             }
-            vTaskDelay(50 / portTICK_PERIOD_MS);
         }
+        if (matched) {
+            // The relay task compares the room aggregates and ignores readings that changed nothing
+            notifySensorUpdate(firstMatchMs);
+        }
+        uint32_t nowMs = millis();
+        sensorRegistry.rollMinute(nowMs);
+        updateScanPolicy(nowMs);
+
+        if (!NimBLEDevice::getScan()->isScanning() && !startContinuousScan()) {
+            logEvent(LogModule::BLE, LogLevel::ERROR, LogEvent::BLE_SCAN_RESTART_FAILED);
+        }
+    }
+}
 
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
+BLEScanStats getBLEScanStats() {
+    BLEScanStats stats{};
+    stats.advertisementsSeen = advertisementsSeen.load(std::memory_order_relaxed);
+    stats.readingsDecoded = readingsDecoded.load(std::memory_order_relaxed);
+    stats.readingsDropped = readingRing.droppedCount();
+    stats.scanning = NimBLEDevice::getScan()->isScanning();
+    uint32_t nowMs = millis();
+    portENTER_CRITICAL(&scanStatsMux);
+    stats.level = scanLevel;
+    stats.levelChanges = scanLevelChanges;
+    for (uint8_t i = 0; i < static_cast<uint8_t>(ScanLevel::COUNT); i++) {
+        stats.msInLevel[i] = msInLevel[i];
     }
+    stats.msInLevel[static_cast<uint8_t>(scanLevel)] += nowMs - levelSinceMs;
+    portEXIT_CRITICAL(&scanStatsMux);
+    stats.parameters = scanParametersFor(stats.level);
+    return stats;
 }
@@ -1,8 +1,24 @@
 #ifndef ESP32_TERMOSTAT_BLECONNECTION_H
 #define ESP32_TERMOSTAT_BLECONNECTION_H
 
+#include <cstddef>
+#include <cstdint>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include "ScanPolicy.h"
+
+constexpr size_t BLE_READING_RING_SIZE = 32;
+
+struct BLEScanStats {
+    uint32_t advertisementsSeen;  ///< Every advertisement delivered by the scan.
+    uint32_t readingsDecoded;     ///< Thermometer readings queued for the registry.
+    uint32_t readingsDropped;     ///< Readings lost because the ring was full.
+    bool scanning;
+    ScanLevel level;              ///< Duty cycle currently chosen by the scan policy.
+    ScanParameters parameters;
+    uint32_t levelChanges;        ///< Scan restarts caused by the policy.
+    uint32_t msInLevel[static_cast<uint8_t>(ScanLevel::COUNT)];
+};
 
 void initBLEConnection();
 
@@ -10,6 +26,8 @@ void beginAdvertisingReadings();
 
 void readAdvertisingData(void * parameter);
 
+BLEScanStats getBLEScanStats();
+
 // Add task handle for better task management
 extern TaskHandle_t bleTaskHandle;
 
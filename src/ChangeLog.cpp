@@ -0,0 +1,113 @@
+#include "ChangeLog.h"
+#include <Arduino.h>
+#include <cstring>
+
+// Written by the owning task, copied by the web server task
+static portMUX_TYPE changeLogMux = portMUX_INITIALIZER_UNLOCKED;
+static ChangeEntry changeLog[CHANGE_LOG_LENGTH];
+static uint8_t changeCount = 0;
+static uint32_t changeVersion = 0;
+// Newest version dropped because the log was full, anything at or before it may be missing
+static uint32_t droppedVersion = 0;
+
+static bool sameEntity(const ChangeEntry &entry, ChangeKind kind, uint8_t day, const char *roomName) {
+    bool entryIsRoom = entry.kind == ChangeKind::ROOM || entry.kind == ChangeKind::ROOM_REMOVED;
+    bool isRoom = kind == ChangeKind::ROOM || kind == ChangeKind::ROOM_REMOVED;
+    if (entryIsRoom || isRoom) {
+        return entryIsRoom && isRoom && strcmp(entry.roomName, roomName) == 0;
+    }
+    return entry.kind == kind && (kind != ChangeKind::SCHEDULE_DAY || entry.day == day);
+}
+
+// Moves the entity to the end of the log with the next change version
+static void appendChange(ChangeKind kind, uint8_t day = 0, const char *roomName = "") {
+    portENTER_CRITICAL(&changeLogMux);
+    for (uint8_t i = 0; i < changeCount; i++) {
+        if (sameEntity(changeLog[i], kind, day, roomName)) {
+            memmove(&changeLog[i], &changeLog[i + 1], (changeCount - i - 1) * sizeof(ChangeEntry));
+            changeCount--;
+            break;
+        }
+    }
+    if (changeCount == CHANGE_LOG_LENGTH) {
+        droppedVersion = changeLog[0].version;
+        memmove(&changeLog[0], &changeLog[1], (CHANGE_LOG_LENGTH - 1) * sizeof(ChangeEntry));
+        changeCount--;
+    }
+    ChangeEntry &entry = changeLog[changeCount++];
+    entry.version = changeVersion + 1;
+    entry.kind = kind;
+    entry.day = day;
+    copyStateString(entry.roomName, sizeof(entry.roomName), roomName);
+    portEXIT_CRITICAL(&changeLogMux);
+}
+
+// Entries of one publish share a version, readers only see it once the whole publish is logged
+static void commitChanges() {
+    portENTER_CRITICAL(&changeLogMux);
+    changeVersion++;
+    portEXIT_CRITICAL(&changeLogMux);
+}
+
+void recordRoomsChanges(const RoomsSnapshot &before, const RoomsSnapshot &after) {
+    bool changed = false;
+    if (before.mode != after.mode) {
+        appendChange(ChangeKind::ROOM_MODE);
+        changed = true;
+    }
+    for (uint8_t r = 0; r < after.roomCount; r++) {
+        const RoomSnapshot *previous = findRoomSnapshot(before, after.rooms[r].name);
+        if (previous == nullptr || memcmp(previous, &after.rooms[r], sizeof(RoomSnapshot)) != 0) {
+            appendChange(ChangeKind::ROOM, 0, after.rooms[r].name);
+            changed = true;
+        }
+    }
+    for (uint8_t r = 0; r < before.roomCount; r++) {
+        if (findRoomSnapshot(after, before.rooms[r].name) == nullptr) {
+            appendChange(ChangeKind::ROOM_REMOVED, 0, before.rooms[r].name);
+            changed = true;
+        }
+    }
+    if (changed) {
+        commitChanges();
+    }
+}
+
+void recordHeatingChange() {
+    appendChange(ChangeKind::HEATING);
+    commitChanges();
+}
+
+void recordScheduleChanges(const ScheduleSnapshot &before, const ScheduleSnapshot &after) {
+    bool changed = false;
+    for (uint8_t day = 0; day < 7; day++) {
+        if (memcmp(before.slots[day], after.slots[day], sizeof(after.slots[day])) != 0) {
+            appendChange(ChangeKind::SCHEDULE_DAY, day);
+            changed = true;
+        }
+    }
+    if (before.userDirectiveCount != after.userDirectiveCount ||
+        before.smartDirectiveCount != after.smartDirectiveCount ||
+        memcmp(before.userDirectives, after.userDirectives, sizeof(after.userDirectives)) != 0 ||
+        memcmp(before.smartDirectives, after.smartDirectives, sizeof(after.smartDirectives)) != 0) {
+        appendChange(ChangeKind::DIRECTIVES);
+        changed = true;
+    }
+    if (changed) {
+        commitChanges();
+    }
+}
+
+void readChangesSince(uint32_t since, ChangeSet &out) {
+    out.count = 0;
+    portENTER_CRITICAL(&changeLogMux);
+    out.version = changeVersion;
+    out.resync = since < droppedVersion || since > changeVersion;
+    for (uint8_t i = 0; !out.resync && i < changeCount; i++) {
+        // Entries of a publish still being logged carry changeVersion + 1
+        if (changeLog[i].version > since && changeLog[i].version <= changeVersion) {
+            out.entries[out.count++] = changeLog[i];
+        }
+    }
+    portEXIT_CRITICAL(&changeLogMux);
+}
@@ -0,0 +1,52 @@
+#ifndef ESP32_TERMOSTAT_CHANGELOG_H
+#define ESP32_TERMOSTAT_CHANGELOG_H
+
+#include <cstdint>
+#include "SystemState.h"
+
+// Bounded log of which entities the published snapshots changed, behind GET /api/changes?since=<version>.
+// Every publish that changed something gets the next change version. The log keeps at most one entry per
+// entity (a room, the room mode, the heating state, a schedule day, the directive lists), so it only overflows
+// when many different rooms are created or removed; a client asking for anything older then has to resync.
+
+constexpr uint8_t CHANGE_LOG_LENGTH = 48;
+
+enum class ChangeKind : uint8_t {
+    ROOM,
+    ROOM_REMOVED,
+    ROOM_MODE,
+    HEATING,
+    SCHEDULE_DAY,
+    DIRECTIVES
+};
+
+struct ChangeEntry {
+    uint32_t version;
+    ChangeKind kind;
+    uint8_t day;                    ///< SCHEDULE_DAY only.
+    char roomName[ROOM_NAME_LEN];   ///< ROOM and ROOM_REMOVED only.
+};
+
+struct ChangeSet {
+    uint32_t version;   ///< Pass as since on the next call.
+    bool resync;        ///< since is older than the log, the client has to fetch the full state.
+    uint8_t count;
+    ChangeEntry entries[CHANGE_LOG_LENGTH];
+};
+
+/**
+ * @brief Records the rooms that differ between two rooms snapshots. Only called by the owning task, before
+ * the new snapshot is published.
+ */
+void recordRoomsChanges(const RoomsSnapshot &before, const RoomsSnapshot &after);
+
+void recordHeatingChange();
+
+void recordScheduleChanges(const ScheduleSnapshot &before, const ScheduleSnapshot &after);
+
+/**
+ * @brief Copies the entries newer than since, oldest first.
+ */
+void readChangesSince(uint32_t since, ChangeSet &out);
+
+#endif //ESP32_TERMOSTAT_CHANGELOG_H
@@ -0,0 +1,139 @@
+#include "ChunkedJson.h"
+#include <Arduino.h>
+#include <algorithm>
+#include <cstring>
+#include "RouteStats.h"
+#include "EventLog.h"
+
+struct ChunkedJsonState {
+    std::unique_ptr<JsonChunkSource> source;
+    char piece[JSON_PIECE_LEN];
+    size_t length = 0;
+    size_t offset = 0;
+    RequestTrace trace;
+};
+
+size_t writeJsonLiteral(char *out, size_t size, const char *literal) {
+    size_t length = strlen(literal);
+    if (length >= size) {
+        return size;
+    }
+    memcpy(out, literal, length);
+    return length;
+}
+
+size_t writeJsonElement(const JsonDocument &doc, bool first, char *out, size_t size) {
+    size_t prefix = 0;
+    if (!first) {
+        out[prefix++] = ',';
+    }
+    size_t available = size - prefix;
+    size_t written = serializeJson(doc, out + prefix, available);
+    // serializeJson keeps room for the terminator, a full buffer means the output was cut
+    if (written >= available - 1) {
+        return size;
+    }
+    return prefix + written;
+}
+
+size_t writeMsgPackElement(const JsonDocument &doc, char *out, size_t size) {
+    size_t written = serializeMsgPack(doc, out, size);
+    // Nothing marks a cut MessagePack output, a full buffer is taken as one
+    return written >= size ? size : written;
+}
+
+size_t writeMsgPackMapHeader(char *out, size_t size, uint8_t entries) {
+    if (size < 1 || entries > 15) {
+        return size;
+    }
+    out[0] = static_cast<char>(0x80 | entries);
+    return 1;
+}
+
+size_t writeMsgPackKey(char *out, size_t size, const char *key, int32_t arrayCount) {
+    size_t length = strlen(key);
+    // fixstr, then a fixarray or an array 16 header
+    size_t needed = 1 + length + (arrayCount < 0 ? 0 : arrayCount < 16 ? 1 : 3);
+    if (length > 31 || arrayCount > UINT16_MAX || needed >= size) {
+        return size;
+    }
+    out[0] = static_cast<char>(0xA0 | length);
+    memcpy(out + 1, key, length);
+    char *header = out + 1 + length;
+    if (arrayCount >= 16) {
+        header[0] = static_cast<char>(0xDC);
+        header[1] = static_cast<char>(arrayCount >> 8);
+        header[2] = static_cast<char>(arrayCount & 0xFF);
+    } else if (arrayCount >= 0) {
+        header[0] = static_cast<char>(0x90 | arrayCount);
+    }
+    return needed;
+}
+
+bool renderJsonSource(JsonChunkSource &source, std::string &out) {
+    char piece[JSON_PIECE_LEN];
+    while (true) {
+        size_t length = source.nextPiece(piece, sizeof(piece));
+        if (length == 0) {
+            return true;
+        }
+        if (length >= sizeof(piece)) {
+            logEvent(LogModule::API, LogLevel::ERROR, LogEvent::API_JSON_PIECE_TOO_LARGE, 0);
+            return false;
+        }
+        out.append(piece, length);
+    }
+}
+
+// Fills the chunk the response asks for from the current piece, rendering the next one when it runs out
+static size_t fillChunk(ChunkedJsonState &state, uint8_t *buffer, size_t maxLen) {
+    size_t written = 0;
+    while (written < maxLen) {
+        if (state.offset == state.length) {
+            if (!state.source) {
+                break;
+            }
+            state.offset = 0;
+            state.length = state.source->nextPiece(state.piece, sizeof(state.piece));
+            if (state.length >= sizeof(state.piece)) {
+                logEvent(LogModule::API, LogLevel::ERROR, LogEvent::API_JSON_PIECE_TOO_LARGE, 1);
+                state.length = 0;
+            }
+            if (state.length == 0) {
+                state.source.reset();
+                break;
+            }
+        }
+        size_t count = std::min(maxLen - written, state.length - state.offset);
+        memcpy(buffer + written, state.piece + state.offset, count);
+        written += count;
+        state.offset += count;
+    }
+    noteResponseBytes(state.trace, written);
+    return written;
+}
+
+AsyncWebServerResponse *beginChunkedJson(AsyncWebServerRequest *request, std::unique_ptr<JsonChunkSource> source,
+                                         const char *contentType) {
+    std::shared_ptr<ChunkedJsonState> state(new(std::nothrow) ChunkedJsonState);
+    if (!state) {
+        return nullptr;
+    }
+    state->source = std::move(source);
+    state->trace = currentRequestTrace();
+    noteResponseStart(state->trace);
+    return request->beginChunkedResponse(
+            contentType, [state](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+                return fillChunk(*state, buffer, maxLen);
+            });
+}
+
+bool sendChunkedJson(AsyncWebServerRequest *request, std::unique_ptr<JsonChunkSource> source,
+                     const char *contentType) {
+    AsyncWebServerResponse *response = beginChunkedJson(request, std::move(source), contentType);
+    if (response == nullptr) {
+        return false;
+    }
+    request->send(response);
+    return true;
+}
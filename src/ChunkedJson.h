@@ -0,0 +1,90 @@
+#ifndef ESP32_TERMOSTAT_CHUNKEDJSON_H
+#define ESP32_TERMOSTAT_CHUNKEDJSON_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <ArduinoJson.h>
+#include <ESPAsyncWebServer.h>
+
+// Largest single piece, one room with all its thermometers or one day of the schedule fits comfortably
+constexpr size_t JSON_PIECE_LEN = 768;
+
+/**
+ * @class JsonChunkSource
+ * @brief Produces a JSON response one small piece at a time.
+ *
+ * A piece is a self-contained part of the output (an opening bracket, one room, one day of the schedule),
+ * so a response never holds more than one piece next to the snapshot it is rendered from, however large
+ * the whole document is.
+ */
+class JsonChunkSource {
+public:
+    virtual ~JsonChunkSource() = default;
+
+    /**
+     * @brief Writes the next piece of the document.
+     *
+     * @param out Destination buffer.
+     * @param size Size of out, always JSON_PIECE_LEN.
+     * @return Number of bytes written, 0 once the document is complete.
+     *         Returning size or more means the piece did not fit and ends the response.
+     */
+    virtual size_t nextPiece(char *out, size_t size) = 0;
+};
+
+/**
+ * @brief Copies a literal piece such as "{\"rooms\":[".
+ */
+size_t writeJsonLiteral(char *out, size_t size, const char *literal);
+
+/**
+ * @brief Serializes one array element, preceded by a comma unless it is the first one.
+ */
+size_t writeJsonElement(const JsonDocument &doc, bool first, char *out, size_t size);
+
+/**
+ * @brief MessagePack counterpart of writeJsonElement(), elements need no separator.
+ */
+size_t writeMsgPackElement(const JsonDocument &doc, char *out, size_t size);
+
+/**
+ * @brief Writes the header of a MessagePack map of fewer than 16 entries, its keys and values follow as pieces.
+ */
+size_t writeMsgPackMapHeader(char *out, size_t size, uint8_t entries);
+
+/**
+ * @brief Writes a map key shorter than 32 characters and, unless arrayCount is negative, the header of the array
+ *        that is its value. The array elements follow as pieces.
+ */
+size_t writeMsgPackKey(char *out, size_t size, const char *key, int32_t arrayCount = -1);
+
+/**
+ * @brief Renders the whole document into out, for responses that are kept and sent many times.
+ *
+ * @return False if a piece did not fit.
+ */
+bool renderJsonSource(JsonChunkSource &source, std::string &out);
+
+/**
+ * @brief Builds a chunked response pulling pieces from the source as TCP space frees up, for callers that add
+ *        headers before sending it.
+ *
+ * @param request The request to answer.
+ * @param source Owned by the response from here on, released as soon as the last piece was produced.
+ * @param contentType Sources may produce other formats as well, such as the /metrics exposition or MessagePack.
+ * @return nullptr if the response state could not be allocated.
+ */
+AsyncWebServerResponse *beginChunkedJson(AsyncWebServerRequest *request, std::unique_ptr<JsonChunkSource> source,
+                                         const char *contentType = "application/json");
+
+/**
+ * @brief Sends the response of beginChunkedJson().
+ *
+ * @return False if the response state could not be allocated, nothing was sent in that case.
+ */
+bool sendChunkedJson(AsyncWebServerRequest *request, std::unique_ptr<JsonChunkSource> source,
+                     const char *contentType = "application/json");
+
+#endif //ESP32_TERMOSTAT_CHUNKEDJSON_H
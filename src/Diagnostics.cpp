@@ -0,0 +1,131 @@
+#include "Diagnostics.h"
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <esp_heap_caps.h>
+#include <esp_idf_version.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <memory>
+#include "ApiEncoding.h"
+
+// Room for tasks created between counting and listing them
+constexpr UBaseType_t EXTRA_TASK_SLOTS = 2;
+
+static const char *taskStateName(eTaskState state) {
+    switch (state) {
+        case eRunning:
+            return "running";
+        case eReady:
+            return "ready";
+        case eBlocked:
+            return "blocked";
+        case eSuspended:
+            return "suspended";
+        case eDeleted:
+            return "deleted";
+        default:
+            return "invalid";
+    }
+}
+
+void handleGetTasks(AsyncWebServerRequest *request) {
+#if configUSE_TRACE_FACILITY
+    UBaseType_t capacity = uxTaskGetNumberOfTasks() + EXTRA_TASK_SLOTS;
+    std::unique_ptr<TaskStatus_t[]> tasks(new(std::nothrow) TaskStatus_t[capacity]);
+    if (!tasks) {
+        request->send(503, "application/json", R"({"message":"Memorie insuficienta"})");
+        return;
+    }
+    uint32_t totalRunTime = 0;
+    UBaseType_t count = uxTaskGetSystemState(tasks.get(), capacity, &totalRunTime);
+
+    JsonDocument doc;
+    doc["uptime_ms"] = millis();
+    JsonArray taskArray = doc["tasks"].to<JsonArray>();
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t &task = tasks[i];
+        JsonObject taskObj = taskArray.add<JsonObject>();
+        taskObj["name"] = task.pcTaskName;
+        taskObj["state"] = taskStateName(task.eCurrentState);
+        taskObj["priority"] = task.uxCurrentPriority;
+        BaseType_t core = xTaskGetAffinity(task.xHandle);
+        if (core == tskNO_AFFINITY) {
+            taskObj["core"] = nullptr;
+        } else {
+            taskObj["core"] = core;
+        }
+        // StackType_t is a byte on the ESP32, the high-water mark is in bytes
+        taskObj["stack_free_min_bytes"] = task.usStackHighWaterMark;
+#if configGENERATE_RUN_TIME_STATS
+        if (totalRunTime > 0) {
+            // Share of both cores since boot, the idle tasks take what is left
+            taskObj["cpu_percent"] = static_cast<float>(task.ulRunTimeCounter) * 100.0f /
+                                     (static_cast<float>(totalRunTime) * portNUM_PROCESSORS);
+        }
+#endif
+    }
+    tasks.reset();
+    sendDocument(request, 200, doc);
+#else
+    request->send(501, "application/json", R"({"message":"Firmware compilat fara statistici de taskuri"})");
+#endif
+}
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
+struct FreeBlockClasses {
+    uint32_t counts[HEAP_SIZE_CLASS_COUNT + 1];
+};
+
+// Runs with the heap locked, must not allocate
+static bool countFreeBlock(walker_heap_into_t, walker_block_info_t block, void *argument) {
+    if (block.used) {
+        return true;
+    }
+    auto *classes = static_cast<FreeBlockClasses *>(argument);
+    uint8_t sizeClass = 0;
+    while (sizeClass < HEAP_SIZE_CLASS_COUNT && block.size > HEAP_SIZE_CLASS_BOUNDS[sizeClass]) {
+        sizeClass++;
+    }
+    classes->counts[sizeClass]++;
+    return true;
+}
+#endif
+
+static void addHeapJson(JsonObject heapObj, uint32_t caps) {
+    multi_heap_info_t info{};
+    heap_caps_get_info(&info, caps);
+    heapObj["free"] = info.total_free_bytes;
+    heapObj["allocated"] = info.total_allocated_bytes;
+    heapObj["largest_free_block"] = info.largest_free_block;
+    heapObj["min_free"] = info.minimum_free_bytes;
+    heapObj["free_blocks"] = info.free_blocks;
+    heapObj["allocated_blocks"] = info.allocated_blocks;
+    // 0 when all free memory is one block, close to 100 when it is scattered in small pieces
+    heapObj["fragmentation_percent"] = info.total_free_bytes > 0
+                                       ? 100 - info.largest_free_block * 100 / info.total_free_bytes : 0;
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
+    FreeBlockClasses classes{};
+    heap_caps_walk(caps, countFreeBlock, &classes);
+    JsonArray classArray = heapObj["free_block_classes"].to<JsonArray>();
+    for (uint8_t i = 0; i <= HEAP_SIZE_CLASS_COUNT; i++) {
+        JsonObject classObj = classArray.add<JsonObject>();
+        if (i < HEAP_SIZE_CLASS_COUNT) {
+            classObj["max_bytes"] = HEAP_SIZE_CLASS_BOUNDS[i];
+        } else {
+            classObj["max_bytes"] = nullptr;
+        }
+        classObj["count"] = classes.counts[i];
+    }
+#endif
+}
+
+void handleGetHeap(AsyncWebServerRequest *request) {
+    JsonDocument doc;
+    addHeapJson(doc["internal"].to<JsonObject>(), MALLOC_CAP_INTERNAL);
+    if (ESP.getPsramSize() > 0) {
+        addHeapJson(doc["psram"].to<JsonObject>(), MALLOC_CAP_SPIRAM);
+    } else {
+        doc["psram"] = nullptr;
+    }
+    sendDocument(request, 200, doc);
+}
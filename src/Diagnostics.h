@@ -0,0 +1,26 @@
+#ifndef ESP32_TERMOSTAT_DIAGNOSTICS_H
+#define ESP32_TERMOSTAT_DIAGNOSTICS_H
+
+#include <cstdint>
+#include <ESPAsyncWebServer.h>
+
+// On-demand views of the FreeRTOS tasks and the heap, meant for sizing task stacks and spotting leaks on a
+// running device. /metrics keeps the few numbers worth graphing, these list everything at the moment of the call.
+
+// Upper bounds of the free block size classes in /api/debug/heap, larger blocks land in a last class
+constexpr uint8_t HEAP_SIZE_CLASS_COUNT = 6;
+constexpr uint32_t HEAP_SIZE_CLASS_BOUNDS[HEAP_SIZE_CLASS_COUNT] = {32, 128, 512, 2048, 8192, 32768};
+
+/**
+ * @brief Every task with its state, priority, core, stack high-water mark and, when the firmware keeps
+ *        run-time statistics, its share of the CPU since boot.
+ */
+void handleGetTasks(AsyncWebServerRequest *request);
+
+/**
+ * @brief Internal RAM and PSRAM: free, allocated, largest free block, low-water mark, block counts and,
+ *        where the heap can be walked, free blocks per size class.
+ */
+void handleGetHeap(AsyncWebServerRequest *request);
+
+#endif //ESP32_TERMOSTAT_DIAGNOSTICS_H
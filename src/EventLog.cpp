@@ -0,0 +1,172 @@
+#include "EventLog.h"
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "ResponseCache.h"
+#include "RouteStats.h"
+
+static_assert((EVENT_LOG_CAPACITY & (EVENT_LOG_CAPACITY - 1)) == 0, "EVENT_LOG_CAPACITY must be a power of two");
+
+static LogRecord records[EVENT_LOG_CAPACITY];
+// Sequence of the record a slot holds once it is completely written, 0 while a writer is in it
+static std::atomic<uint32_t> committed[EVENT_LOG_CAPACITY];
+static std::atomic<uint32_t> lastSequence{0};
+// Only touched by the web server task
+static uint32_t flushedSequence = 0;
+// Set by the OTA task while flash is being rewritten
+static std::atomic<bool> fileSuspended{false};
+
+static const char *const MODULE_NAMES[] = {"system", "state", "heating", "ble", "api", "persistence", "ota"};
+static const char *const LEVEL_NAMES[] = {"info", "warn", "error"};
+
+void logEvent(LogModule module, LogLevel level, LogEvent event, int32_t arg0, int32_t arg1, int32_t arg2) {
+    uint32_t sequence = lastSequence.fetch_add(1, std::memory_order_relaxed) + 1;
+    uint32_t index = sequence & (EVENT_LOG_CAPACITY - 1);
+    committed[index].store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    LogRecord &record = records[index];
+    record.sequence = sequence;
+    // The tick count is a plain load, millis() would go through esp_timer
+    record.timeMs = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    record.event = static_cast<uint16_t>(event);
+    record.module = static_cast<uint8_t>(module);
+    record.level = static_cast<uint8_t>(level);
+    record.args[0] = arg0;
+    record.args[1] = arg1;
+    record.args[2] = arg2;
+    committed[index].store(sequence, std::memory_order_release);
+}
+
+// Same retry rule as the snapshot seqlock: the copy only counts if the slot did not change under it
+static bool copyRecord(uint32_t sequence, LogRecord &out) {
+    std::atomic<uint32_t> &slot = committed[sequence & (EVENT_LOG_CAPACITY - 1)];
+    if (slot.load(std::memory_order_acquire) != sequence) {
+        return false;
+    }
+    out = records[sequence & (EVENT_LOG_CAPACITY - 1)];
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.load(std::memory_order_relaxed) == sequence;
+}
+
+// Oldest sequence after since that can still be in the ring
+static uint32_t firstAvailable(uint32_t since, uint32_t last) {
+    uint32_t oldest = last >= EVENT_LOG_CAPACITY ? last - EVENT_LOG_CAPACITY + 1 : 1;
+    return std::max(since + 1, oldest);
+}
+
+static LogHeader makeHeader() {
+    LogHeader header{{'T', 'L', 'O', 'G'}, EVENT_LOG_FORMAT_VERSION, sizeof(LogRecord), 0, cacheBootId()};
+    return header;
+}
+
+static File openLogFile() {
+    File file = LittleFS.open(EVENT_LOG_FILE, "a");
+    if (file && file.size() >= EVENT_LOG_FILE_LIMIT) {
+        file.close();
+        LittleFS.remove(EVENT_LOG_PREVIOUS_FILE);
+        LittleFS.rename(EVENT_LOG_FILE, EVENT_LOG_PREVIOUS_FILE);
+        file = LittleFS.open(EVENT_LOG_FILE, "a");
+    }
+    if (file && file.size() == 0) {
+        LogHeader header = makeHeader();
+        file.write(reinterpret_cast<const uint8_t *>(&header), sizeof(header));
+    }
+    return file;
+}
+
+static void echoRecord(const LogRecord &record) {
+    const char *module = record.module < sizeof(MODULE_NAMES) / sizeof(MODULE_NAMES[0])
+                         ? MODULE_NAMES[record.module] : "unknown";
+    const char *level = record.level < sizeof(LEVEL_NAMES) / sizeof(LEVEL_NAMES[0])
+                        ? LEVEL_NAMES[record.level] : "unknown";
+    Serial.printf("[%lu] %s %s event %u: %ld %ld %ld\n", static_cast<unsigned long>(record.timeMs), module, level,
+                  record.event, static_cast<long>(record.args[0]), static_cast<long>(record.args[1]),
+                  static_cast<long>(record.args[2]));
+}
+
+void suspendEventLogFile(bool suspended) {
+    fileSuspended.store(suspended);
+}
+
+void flushEventLog() {
+    uint32_t last = lastSequence.load(std::memory_order_acquire);
+    if (last == flushedSequence) {
+        return;
+    }
+    File file;
+    uint32_t sequence = firstAvailable(flushedSequence, last);
+    for (; sequence <= last; sequence++) {
+        LogRecord record{};
+        if (!copyRecord(sequence, record)) {
+            if (committed[sequence & (EVENT_LOG_CAPACITY - 1)].load(std::memory_order_acquire) == 0) {
+                break; // Still being written, picked up by the next flush
+            }
+            continue; // Overwritten before this task got to it
+        }
+        // Boots are kept too, they separate the runs in the file
+        bool boot = record.event == static_cast<uint16_t>(LogEvent::BOOT);
+        if (boot || record.level >= static_cast<uint8_t>(EVENT_LOG_SERIAL_LEVEL)) {
+            echoRecord(record);
+        }
+        if (fileSuspended.load() || (record.level < static_cast<uint8_t>(LogLevel::WARN) && !boot)) {
+            continue;
+        }
+        if (!file) {
+            file = openLogFile();
+        }
+        if (file) {
+            file.write(reinterpret_cast<const uint8_t *>(&record), sizeof(record));
+        }
+    }
+    flushedSequence = sequence - 1;
+    if (file) {
+        file.close();
+    }
+}
+
+void handleGetLogs(AsyncWebServerRequest *request) {
+    if (request->hasParam("file")) {
+        const char *path = request->getParam("file")->value() == "previous" ? EVENT_LOG_PREVIOUS_FILE
+                                                                              : EVENT_LOG_FILE;
+        if (!LittleFS.exists(path)) {
+            request->send(404, "application/json", R"({"message":"Fisierul de log nu exista"})");
+            return;
+        }
+        noteResponseStart(currentRequestTrace());
+        request->send(LittleFS, path, "application/octet-stream");
+        return;
+    }
+    uint32_t since = request->hasParam("since")
+                     ? strtoul(request->getParam("since")->value().c_str(), nullptr, 10) : 0;
+    uint32_t last = lastSequence.load(std::memory_order_acquire);
+    uint32_t first = firstAvailable(since, last);
+
+    std::shared_ptr<std::string> body = std::make_shared<std::string>();
+    body->reserve(sizeof(LogHeader) + (last >= first ? last - first + 1 : 0) * sizeof(LogRecord));
+    LogHeader header = makeHeader();
+    body->append(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (uint32_t sequence = first; sequence <= last; sequence++) {
+        LogRecord record{};
+        if (copyRecord(sequence, record)) {
+            body->append(reinterpret_cast<const char *>(&record), sizeof(record));
+        }
+    }
+    // A callback response reads the bytes lazily, the lambda keeps them alive until then
+    AsyncWebServerResponse *response = request->beginResponse(
+            "application/octet-stream", body->size(),
+            [body](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+                size_t count = std::min(maxLen, body->size() - index);
+                memcpy(buffer, body->data() + index, count);
+                return count;
+            });
+    response->addHeader("Cache-Control", "no-store");
+    RequestTrace trace = currentRequestTrace();
+    noteResponseStart(trace);
+    noteResponseBytes(trace, body->size());
+    request->send(response);
+}
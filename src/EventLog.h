@@ -0,0 +1,129 @@
+#ifndef ESP32_TERMOSTAT_EVENTLOG_H
+#define ESP32_TERMOSTAT_EVENTLOG_H
+
+#include <cstdint>
+#include <ESPAsyncWebServer.h>
+
+// Structured event log for everything that happens after setup. logEvent() stores a fixed 24-byte record
+// (sequence, milliseconds since boot, event id, module, level and three integer arguments) in a lock-free
+// RAM ring: it never blocks, never allocates and never touches the UART, so the relay and BLE tasks can log
+// freely. Once a second the web server task echoes new boots, warnings and errors to Serial and appends them
+// to a LittleFS file, so they survive a restart. The message text of every event lives in
+// scripts/decode_logs.py, which also reads GET /api/logs.
+
+constexpr uint16_t EVENT_LOG_CAPACITY = 128;
+constexpr const char *EVENT_LOG_FILE = "/events.bin";
+// The file is renamed to this once it reaches EVENT_LOG_FILE_LIMIT, dropping the previous one
+constexpr const char *EVENT_LOG_PREVIOUS_FILE = "/events.old.bin";
+constexpr uint32_t EVENT_LOG_FILE_LIMIT = 8192;
+constexpr uint8_t EVENT_LOG_FORMAT_VERSION = 1;
+
+enum class LogModule : uint8_t {
+    SYSTEM,
+    STATE,
+    HEATING,
+    BLE,
+    API,
+    PERSISTENCE,
+    OTA
+};
+
+enum class LogLevel : uint8_t {
+    INFO,
+    WARN,
+    ERROR
+};
+
+// Build with -DEVENT_LOG_SERIAL_INFO=1 to echo informational records to Serial as well, by default they are
+// only kept in RAM for /api/logs
+#ifndef EVENT_LOG_SERIAL_INFO
+#define EVENT_LOG_SERIAL_INFO 0
+#endif
+constexpr LogLevel EVENT_LOG_SERIAL_LEVEL = EVENT_LOG_SERIAL_INFO ? LogLevel::INFO : LogLevel::WARN;
+
+// Stored on flash and decoded on the host: only append, never renumber. Arguments in brackets.
+enum class LogEvent : uint16_t {
+    BOOT = 1,                       ///< [reset reason]
+    ROOM_CREATE_REJECTED = 10,      ///< [room count]
+    ROOM_UPDATE_UNKNOWN = 11,
+    THERMOMETER_ADD_REJECTED = 12,  ///< [thermometers in the room]
+    BATCH_REJECTED = 13,            ///< [operation index]
+    SCHEDULE_RANGE_REJECTED = 14,   ///< [range index]
+    STATE_QUEUE_FULL = 15,          ///< [command type]
+    RELAY_TASK_EXCEPTION = 20,
+    RELAY_TASK_UNKNOWN_ERROR = 21,
+    BLE_SCAN_RESTART_FAILED = 30,
+    SENSOR_ADDRESS_INVALID = 31,
+    SENSOR_REGISTRY_FULL = 32,
+    API_JSON_INVALID = 40,          ///< [DeserializationError code]
+    API_PARAM_MISSING = 41,         ///< [LogParam]
+    API_ROOM_EXISTS = 42,
+    API_ROOM_NOT_FOUND = 43,
+    API_BODY_TOO_LARGE = 44,        ///< [body bytes, limit]
+    API_JSON_PIECE_TOO_LARGE = 45,  ///< [1 if the response was already started]
+    API_HISTORY_BUSY = 46,
+    API_EVENT_CLIENTS_FULL = 47,    ///< [clients]
+    API_SCHEDULE_SET = 48,          ///< [handler milliseconds]
+    API_ROUTE_NOT_TRACED = 49,      ///< [traced routes]
+    FILE_OPEN_FAILED = 50,          ///< [PersistDomain]
+    FILE_WRITE_FAILED = 51,         ///< [PersistDomain]
+    FILE_SAVED = 52,                ///< [PersistDomain]
+    FLUSH_TIMED_OUT = 53,           ///< [dirty domain bits]
+    FILE_CREATED = 54,              ///< [PersistDomain]
+    OTA_START = 60,
+    OTA_END = 61,
+    OTA_ERROR = 62,                 ///< [ota_error_t]
+    OTA_PROGRESS = 63,              ///< [percent, a multiple of OTA_PROGRESS_STEP]
+    METRIC_REGISTRY_FULL = 70       ///< [registered metrics]
+};
+
+// Argument of API_PARAM_MISSING
+enum class LogParam : int32_t {
+    ROOM_NAME,
+    MODE
+};
+
+struct LogRecord {
+    uint32_t sequence;          ///< Starts at 1 every boot, 0 marks an empty slot.
+    uint32_t timeMs;            ///< Since boot.
+    uint16_t event;
+    uint8_t module;
+    uint8_t level;
+    int32_t args[3];
+};
+static_assert(sizeof(LogRecord) == 24, "The decoder expects 24-byte records");
+
+// Little-endian header in front of the records, on /api/logs and at the start of each log file
+struct LogHeader {
+    char magic[4];              ///< "TLOG"
+    uint8_t version;
+    uint8_t recordSize;
+    uint16_t reserved;
+    uint32_t bootId;            ///< cacheBootId() of the boot that wrote the header.
+};
+static_assert(sizeof(LogHeader) == 12, "The decoder expects a 12-byte header");
+
+/**
+ * @brief Appends a record to the RAM ring. Safe from any task, the oldest record is overwritten when full.
+ */
+void logEvent(LogModule module, LogLevel level, LogEvent event, int32_t arg0 = 0, int32_t arg1 = 0,
+              int32_t arg2 = 0);
+
+/**
+ * @brief Echoes the records logged since the previous call to Serial and appends the boots, warnings and
+ *        errors among them to EVENT_LOG_FILE. Only called by the web server task.
+ */
+void flushEventLog();
+
+/**
+ * @brief While suspended (an OTA is rewriting flash) the flush leaves EVENT_LOG_FILE alone, the records stay
+ *        in the ring and on Serial.
+ */
+void suspendEventLogFile(bool suspended);
+
+/**
+ * @brief ?since=<sequence> returns only newer records, ?file=current or ?file=previous returns a log file.
+ */
+void handleGetLogs(AsyncWebServerRequest *request);
+
+#endif //ESP32_TERMOSTAT_EVENTLOG_H
@@ -4,11 +4,65 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "HeatingHistory.h"
+#include "SystemState.h"
+#include "SaveLoad.h"
+#include "Metrics.h"
+#include "EventLog.h"
+#include <atomic>
+#include <algorithm>
 
 #define RELAY_PIN 26
 time_t lastOn;
 std::vector<RoomData> roomsData;
 
+// millis() of the oldest advertisement not yet handled by a control pass, 0 when none is pending
+static std::atomic<uint32_t> pendingAdvertisementMs{0};
+// Set by requestControlUpdate() for changes that must reach the relay even if no room aggregate moved
+static std::atomic<bool> controlRequested{false};
+static ControlLatencyHistogram controlLatency{};
+
+static void recordControlLatency(uint32_t latencyMs) {
+    uint8_t bucket = 0;
+    while (bucket < CONTROL_LATENCY_BUCKETS - 1 && latencyMs > CONTROL_LATENCY_BOUNDS_MS[bucket]) {
+        bucket++;
+    }
+    portENTER_CRITICAL(&heatingMux);
+    controlLatency.counts[bucket]++;
+    controlLatency.samples++;
+    controlLatency.totalMs += latencyMs;
+    controlLatency.lastMs = latencyMs;
+    if (latencyMs > controlLatency.maxMs) {
+        controlLatency.maxMs = latencyMs;
+    }
+    portEXIT_CRITICAL(&heatingMux);
+}
+
+ControlLatencyHistogram getControlLatencyHistogram() {
+    portENTER_CRITICAL(&heatingMux);
+    ControlLatencyHistogram copy = controlLatency;
+    portEXIT_CRITICAL(&heatingMux);
+    return copy;
+}
+
+void notifySensorUpdate(uint32_t advertisementMs) {
+    if (advertisementMs == 0) {
+        advertisementMs = 1;
+    }
+    // Keep the oldest pending timestamp so the histogram reflects the worst case of a coalesced burst
+    uint32_t expected = 0;
+    pendingAdvertisementMs.compare_exchange_strong(expected, advertisementMs);
+    if (relayTaskHandle != NULL) {
+        xTaskNotifyGive(relayTaskHandle);
+    }
+}
+
+void requestControlUpdate() {
+    controlRequested.store(true);
+    if (relayTaskHandle != NULL) {
+        xTaskNotifyGive(relayTaskHandle);
+    }
+}
+
 heatingStatus isHeatingNeeded() {
     if (heatingMode == MANUAL) {
         if (manualMode == ON_MANUAL) {
@@ -43,56 +97,146 @@ void relay_init() {
     digitalWrite(RELAY_PIN, HIGH);
 }
 
+// Records the start and end of a heating run from the published rooms snapshot
+static RoomsSnapshot historyRooms;
+
+static void captureRunStart() {
+    roomsData.clear();
+    if (!readRoomsSnapshot(historyRooms)) {
+        return;
+    }
+    for (uint8_t i = 0; i < historyRooms.roomCount; i++) {
+        const RoomSnapshot &room = historyRooms.rooms[i];
+        roomsData.push_back({room.currentTemperature, room.currentTemperature, room.currentHumidity,
+                             room.currentHumidity, room.priority, room.name});
+    }
+}
+
+static void captureRunEnd() {
+    if (!readRoomsSnapshot(historyRooms)) {
+        return;
+    }
+    for (uint8_t i = 0; i < historyRooms.roomCount; i++) {
+        const RoomSnapshot &room = historyRooms.rooms[i];
+        for (auto &roomData: roomsData) {
+            if (roomData.name == room.name) {
+                roomData.endTemperature = room.currentTemperature;
+                roomData.endHumidity = room.currentHumidity;
+            }
+        }
+    }
+}
+
 void updateRelayStatus() {
     heatingStatus status = isHeatingNeeded();
     if (status == START) {
         if (!isHeating) {
             isHeating = true;
+            relayCyclesMetric.add();
+            relayOnMetric.set(1);
             lastOn = time(nullptr);
-            for (auto &room: rooms) {
-                roomsData.push_back({room.getRoomTemperature(), room.getRoomTemperature(), room.get_humidity(),
-                                     room.get_humidity(), room.get_room_priority(), room.get_room_name()});
-            }
+            captureRunStart();
             digitalWrite(RELAY_PIN, LOW);
         }
     } else if (status == STOP) {
         if (isHeating) {
             isHeating = false;
+            relayOnMetric.set(0);
             time_t now = time(nullptr);
-            for (auto &room: rooms) {
-                for (auto &roomData: roomsData) {
-                    if (room.get_room_name() == roomData.name) {
-                        roomData.endTemperature = room.getRoomTemperature();
-                        roomData.endHumidity = room.get_humidity();
-                    }
-                }
-            }
+            captureRunEnd();
             RunTime run = {lastOn, now, roomsData};
-            heatingHistory.addRunTime(run, true);
+            if (xSemaphoreTake(historySemaphore, portMAX_DELAY) == pdTRUE) {
+                heatingHistory.addRunTime(run, true);
+                xSemaphoreGive(historySemaphore);
+            }
             digitalWrite(RELAY_PIN, HIGH);
         }
     }
 }
 
+static TickType_t ticksSince(TickType_t since) {
+    return xTaskGetTickCount() - since;
+}
+
+// The relay task owns rooms, the heating mode and the scheduler: it applies queued commands right away,
+// evaluates the relay at most every CONTROL_MIN_INTERVAL_MS, refreshes the schedule on the watchdog tick
+// and writes dirty files once their quiet period is over.
 void relaySyncTask(void *parameter) {
+    TickType_t lastControl = 0, lastTick = 0;
+    bool firstRun = true, controlPending = true;
+    uint32_t controlAdvertisementMs = 0;
+    TickType_t wait = 0;
     while (true) {
+        ulTaskNotifyTake(pdTRUE, wait);
+        uint32_t passStart = micros();
         try {
-            updateRelayStatus();
-        } catch (const std::exception& e) {
-            Serial.printf("Exception in relay task: %s\n", e.what());
+            if (applyPendingStateCommands()) {
+                controlPending = true;
+            }
+            if (controlRequested.exchange(false)) {
+                controlPending = true;
+            }
+
+            if (firstRun || ticksSince(lastTick) >= pdMS_TO_TICKS(CONTROL_WATCHDOG_INTERVAL_MS)) {
+                lastTick = xTaskGetTickCount();
+                scheduler.updateSchedule();
+                publishScheduleSnapshot();
+                controlPending = true;
+            }
+
+            // A mode change from the schedule counts as an aggregate change as well
+            uint32_t advertisementMs = pendingAdvertisementMs.exchange(0);
+            bool aggregatesChanged = false;
+            publishRoomsSnapshot(&aggregatesChanged);
+            if (aggregatesChanged) {
+                controlPending = true;
+                if (advertisementMs != 0 && controlAdvertisementMs == 0) {
+                    controlAdvertisementMs = advertisementMs;
+                }
+            }
+
+            if (controlPending && (firstRun || ticksSince(lastControl) >= pdMS_TO_TICKS(CONTROL_MIN_INTERVAL_MS))) {
+                lastControl = xTaskGetTickCount();
+                bool wasHeating = isHeating;
+                updateRelayStatus();
+                publishHeatingSnapshot();
+                if (wasHeating != isHeating && controlAdvertisementMs != 0) {
+                    recordControlLatency(millis() - controlAdvertisementMs);
+                }
+                controlAdvertisementMs = 0;
+                controlPending = false;
+            }
+            flushDirtyDomains();
+            firstRun = false;
+        } catch (const std::exception &) {
+            logEvent(LogModule::HEATING, LogLevel::ERROR, LogEvent::RELAY_TASK_EXCEPTION);
         } catch (...) {
-            Serial.println("Unknown error in relay task");
+            logEvent(LogModule::HEATING, LogLevel::ERROR, LogEvent::RELAY_TASK_UNKNOWN_ERROR);
+        }
+        controlLoopMetric.observe(micros() - passStart);
+
+        TickType_t untilTick = pdMS_TO_TICKS(CONTROL_WATCHDOG_INTERVAL_MS) - std::min(ticksSince(lastTick),
+                                                                                      pdMS_TO_TICKS(CONTROL_WATCHDOG_INTERVAL_MS));
+        if (controlPending) {
+            TickType_t untilControl = pdMS_TO_TICKS(CONTROL_MIN_INTERVAL_MS) - std::min(ticksSince(lastControl),
+                                                                                       pdMS_TO_TICKS(CONTROL_MIN_INTERVAL_MS));
+            wait = std::min(untilControl, untilTick);
+        } else {
+            wait = untilTick;
+        }
+        uint32_t untilFlush = persistenceFlushDelayMs();
+        if (untilFlush != UINT32_MAX) {
+            wait = std::min(wait, pdMS_TO_TICKS(untilFlush));
         }
-        
-        vTaskDelay(15 * 1000 / portTICK_PERIOD_MS);
     }
 }
 
 void start_relay_sync() {
+    // Also runs the schedule update and the flash writes of every state change
     xTaskCreate(
             relaySyncTask,
             "RelayTask",
-            3072,        // Increased stack size
+            8192,
             nullptr,
             2,           // Lower priority
             &relayTaskHandle);
@@ -101,61 +245,3 @@ void start_relay_sync() {
         Serial.println("Failed to create relay task");
     }
 }
-
-void start_schedule_sync() {
-    // Make sure scheduler mutex is initialized
-    if (schedulerMutex == NULL) {
-        schedulerMutex = xSemaphoreCreateMutex();
-        if (schedulerMutex == NULL) {
-            Serial.println("Failed to create scheduler mutex");
-            return;
-        }
-    }
-    
-    // Increase stack size from 2048 to 4096 to prevent stack overflow
-    xTaskCreate(
-            update_schedule,
-            "ScheduleTask",
-            4096,
-            nullptr,
-            2,  // Lower priority
-            &scheduleTaskHandle);
-            
-    if (scheduleTaskHandle == NULL) {
-        Serial.println("Failed to create schedule task");
-    }
-}
-
-void update_schedule(void *parameter) {
-    while (true) {
-        try {
-            vTaskDelay(100 / portTICK_PERIOD_MS);
-            
-            // Check if mutex is initialized before attempting to take it
-            if (schedulerMutex == NULL) {
-                schedulerMutex = xSemaphoreCreateMutex();
-                if (schedulerMutex == NULL) {
-                    Serial.println("Failed to create scheduler mutex");
-                    vTaskDelay(5000 / portTICK_PERIOD_MS);
-                    continue;
-                }
-            }
-            
-            if (xSemaphoreTake(schedulerMutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-                scheduler.updateSchedule();
-                xSemaphoreGive(schedulerMutex);
-            } else {
-                Serial.println("Failed to take scheduler mutex");
-            }
-        } catch (const std::exception& e) {
-            Serial.printf("Exception in schedule task: %s\n", e.what());
-        } catch (...) {
-            Serial.println("Unknown error in schedule task");
-        }
-
-        vTaskDelay(15 * 1000 / portTICK_PERIOD_MS);
-    }
-    
-    vTaskDelete(NULL);
-}
-
@@ -2,6 +2,7 @@
 #define ESP32_TERMOSTAT_HEATINGCONTROL_H
 
 #include <string>
+#include <cstdint>
 
 enum heatingMode {
     AUTO,
@@ -26,16 +27,38 @@ struct RoomData {
     std::string name;
 };
 
+// Shortest spacing between two control passes; bursts of sensor updates are coalesced into one pass
+constexpr uint32_t CONTROL_MIN_INTERVAL_MS = 2000;
+// Fallback tick so stale sensors and schedule changes are still picked up without any notification
+constexpr uint32_t CONTROL_WATCHDOG_INTERVAL_MS = 15000;
+
+constexpr uint8_t CONTROL_LATENCY_BUCKETS = 8;
+// Upper bounds (ms) of the advertisement-to-relay latency buckets, the last bucket is open ended
+constexpr uint32_t CONTROL_LATENCY_BOUNDS_MS[CONTROL_LATENCY_BUCKETS - 1] = {100, 250, 500, 1000, 2500, 5000, 15000};
+
+struct ControlLatencyHistogram {
+    uint32_t counts[CONTROL_LATENCY_BUCKETS];
+    uint32_t samples;
+    uint32_t maxMs;
+    uint32_t lastMs;
+    uint64_t totalMs;
+};
+
 heatingStatus isHeatingNeeded();
 
+// Wakes the control loop after fresh sensor data; advertisementMs is the millis() of the reading.
+// The loop only re-evaluates the relay if a room aggregate actually changed.
+void notifySensorUpdate(uint32_t advertisementMs);
+
+// Wakes the control loop for a non-sensor change (mode, manual state, schedule)
+void requestControlUpdate();
+
+ControlLatencyHistogram getControlLatencyHistogram();
+
 void updateRelayStatus();
 
 void relay_init();
 
 void start_relay_sync();
 
-void start_schedule_sync();
-
-void update_schedule(void *pvParameters);
-
 #endif //ESP32_TERMOSTAT_HEATINGCONTROL_H
@@ -93,7 +93,7 @@ void HeatingHistory::addRunTime(const RunTime &run, bool needUpdate) {
     addRunTime(run.start, run.end, run.roomsData);
     if (needUpdate) {
         optimizeRunTimes();
-        // saveHistory(); // Ensure saveHistory is implemented
+        markDirty(PERSIST_HISTORY);
     }
 }
 
@@ -216,6 +216,23 @@ std::vector<RunTime> HeatingHistory::getRunTimes() const {
     return runTimes;
 }
 
+size_t HeatingHistory::getRunCount() const {
+    return runTimes.size();
+}
+
+bool HeatingHistory::getRunAt(size_t index, time_t &start, time_t &end) const {
+    if (index >= runTimes.size()) {
+        return false;
+    }
+    start = runTimes[index].start;
+    end = runTimes[index].end;
+    return true;
+}
+
+std::uint32_t HeatingHistory::getVersion() const {
+    return version;
+}
+
 // Retrieve all day history
 std::vector<DayWithDetails> HeatingHistory::getDayHistory() {
     optimizeHistory();
@@ -397,6 +414,7 @@ void HeatingHistory::addRunTime(time_t start, time_t end, const std::vector<Room
     // Create a RunTime object and store it
     RunTime run{start, end, roomsData};
     runTimes.push_back(run);
+    version++;
 
     // Convert to std::chrono for easier manipulation
     std::chrono::system_clock::time_point startTimePoint = std::chrono::system_clock::from_time_t(start);
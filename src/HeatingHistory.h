@@ -115,6 +115,7 @@ private:
     std::unordered_map<Month, MonthDetails, MonthHash> monthHistory;
     std::unordered_map<std::uint16_t, YearDetails> yearHistory;
     std::vector<RunTime> runTimes;
+    std::uint32_t version = 0;
 
     // Mutex for thread safety (optional)
     // mutable std::mutex historyMutex;
@@ -137,6 +138,14 @@ public:
 
     std::vector<RunTime> getRunTimes() const;
 
+    // Runs are kept in start order, these read one without copying the list and its room data
+    size_t getRunCount() const;
+
+    bool getRunAt(size_t index, time_t &start, time_t &end) const;
+
+    // Bumped by every added run, lets readers cache what they computed from the history
+    std::uint32_t getVersion() const;
+
     std::vector<DayWithDetails> getDayHistory();
 
     std::vector<MonthWithDetails> getMonthHistory();
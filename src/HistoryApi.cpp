@@ -0,0 +1,395 @@
+#include "HistoryApi.h"
+#include <Arduino.h>
+#include <ctime>
+#include <cstdlib>
+#include "globalSettings.h"
+#include "ChunkedJson.h"
+#include "ResponseCache.h"
+#include "EventLog.h"
+
+enum class HistorySeries : uint8_t {
+    RUNS,
+    DAYS,
+    MONTHS,
+    YEARS
+};
+
+struct HistoryQuery {
+    HistorySeries series;
+    time_t from;
+    time_t to;
+    uint16_t points;  ///< 0 sends every run or every slot.
+};
+
+struct HistoryCacheEntry {
+    bool valid;
+    HistoryQuery query;
+    uint32_t version;
+    std::shared_ptr<const std::string> body;
+};
+
+// Only touched by the AsyncTCP task
+static HistoryCacheEntry historyCache[HISTORY_CACHE_ENTRIES];
+static uint8_t nextCacheEntry = 0;
+
+static const char *seriesName(HistorySeries series) {
+    switch (series) {
+        case HistorySeries::RUNS:
+            return "runs";
+        case HistorySeries::DAYS:
+            return "days";
+        case HistorySeries::MONTHS:
+            return "months";
+        default:
+            return "years";
+    }
+}
+
+static const char *seriesResolution(HistorySeries series) {
+    switch (series) {
+        case HistorySeries::RUNS:
+            return "run";
+        case HistorySeries::DAYS:
+            return "hour";
+        case HistorySeries::MONTHS:
+            return "day";
+        default:
+            return "month";
+    }
+}
+
+// How far back HeatingHistory keeps each series
+static time_t seriesRetention(HistorySeries series) {
+    switch (series) {
+        case HistorySeries::RUNS:
+            return 7 * 86400;
+        case HistorySeries::DAYS:
+            return 31 * 86400;
+        case HistorySeries::MONTHS:
+            return 366 * 86400;
+        default:
+            return 10 * 366 * 86400;
+    }
+}
+
+static bool lockHistory() {
+    return xSemaphoreTake(historySemaphore, pdMS_TO_TICKS(HISTORY_LOCK_TIMEOUT_MS)) == pdTRUE;
+}
+
+static void unlockHistory() {
+    xSemaphoreGive(historySemaphore);
+}
+
+// Start of the hour, day or month containing time
+static time_t slotStart(time_t time, HistorySeries series) {
+    tm local{};
+    localtime_r(&time, &local);
+    local.tm_sec = 0;
+    local.tm_min = 0;
+    if (series != HistorySeries::DAYS) {
+        local.tm_hour = 0;
+    }
+    if (series == HistorySeries::YEARS) {
+        local.tm_mday = 1;
+    }
+    local.tm_isdst = -1;
+    return mktime(&local);
+}
+
+static time_t nextSlotStart(time_t start, HistorySeries series) {
+    tm local{};
+    localtime_r(&start, &local);
+    if (series == HistorySeries::DAYS) {
+        local.tm_hour++;
+    } else if (series == HistorySeries::MONTHS) {
+        local.tm_mday++;
+    } else {
+        local.tm_mon++;
+    }
+    local.tm_isdst = -1;
+    return mktime(&local);
+}
+
+// Heating seconds recorded for the slot starting at start, the caller holds the history lock
+static uint32_t slotSeconds(time_t start, HistorySeries series) {
+    tm local{};
+    localtime_r(&start, &local);
+    auto year = static_cast<uint16_t>(local.tm_year + 1900);
+    auto month = static_cast<uint8_t>(local.tm_mon + 1);
+    if (series == HistorySeries::DAYS) {
+        return heatingHistory.getDayHistory(Day(local.tm_mday, month, year)).history[local.tm_hour];
+    }
+    if (series == HistorySeries::MONTHS) {
+        return heatingHistory.getMonthHistory(Month(month, year)).history[local.tm_mday - 1];
+    }
+    return heatingHistory.getYearHistory(year).history[local.tm_mon];
+}
+
+/**
+ * @class HistoryJsonSource
+ * @brief Renders {"series":..,"resolution":..,"from":..,"to":..,"points":[[start,value],...]} one bucket per piece.
+ *
+ * Each bucket is summed under a short hold of the history lock, so a long answer never keeps the relay task
+ * from recording a run and nothing but the current bucket is ever held in RAM.
+ */
+class HistoryJsonSource : public JsonChunkSource {
+private:
+    HistoryQuery query;
+    uint32_t slotCount = 0;
+    uint32_t bucketCount = 0;
+    uint32_t bucket = 0;
+    uint32_t slotIndex = 0;
+    time_t slot = 0;
+    size_t runIndex = 0;
+    uint8_t stage = 0;
+
+    // Full resolution runs: the next run overlapping the range, as [start,end]
+    size_t nextRun(char *out, size_t size, bool &found) {
+        found = false;
+        time_t start = 0, end = 0;
+        if (!lockHistory()) {
+            return size;
+        }
+        while (heatingHistory.getRunAt(runIndex, start, end)) {
+            runIndex++;
+            if (end > query.from && start < query.to) {
+                found = true;
+                break;
+            }
+        }
+        unlockHistory();
+        if (!found) {
+            return 0;
+        }
+        return snprintf(out, size, "%s[%ld,%ld]", bucket++ == 0 ? "" : ",", static_cast<long>(start),
+                        static_cast<long>(end));
+    }
+
+    // Seconds of heating overlapping [bucketStart, bucketEnd), runs are in start order
+    bool runSeconds(time_t bucketStart, time_t bucketEnd, uint32_t &seconds) {
+        seconds = 0;
+        if (!lockHistory()) {
+            return false;
+        }
+        time_t start = 0, end = 0;
+        while (heatingHistory.getRunAt(runIndex, start, end) && end <= bucketStart) {
+            runIndex++;
+        }
+        for (size_t i = runIndex; heatingHistory.getRunAt(i, start, end) && start < bucketEnd; i++) {
+            time_t overlapStart = start > bucketStart ? start : bucketStart;
+            time_t overlapEnd = end < bucketEnd ? end : bucketEnd;
+            if (overlapEnd > overlapStart) {
+                seconds += overlapEnd - overlapStart;
+            }
+        }
+        unlockHistory();
+        return true;
+    }
+
+    size_t nextBucket(char *out, size_t size) {
+        time_t bucketStart;
+        uint32_t seconds = 0;
+        if (query.series == HistorySeries::RUNS) {
+            time_t span = (query.to - query.from) / bucketCount;
+            bucketStart = query.from + span * bucket;
+            time_t bucketEnd = bucket + 1 == bucketCount ? query.to : bucketStart + span;
+            if (!runSeconds(bucketStart, bucketEnd, seconds)) {
+                return size;
+            }
+        } else {
+            uint32_t lastSlot = static_cast<uint32_t>((static_cast<uint64_t>(bucket) + 1) * slotCount / bucketCount);
+            bucketStart = slot;
+            if (!lockHistory()) {
+                return size;
+            }
+            for (; slotIndex < lastSlot; slotIndex++) {
+                seconds += slotSeconds(slot, query.series);
+                slot = nextSlotStart(slot, query.series);
+            }
+            unlockHistory();
+        }
+        return snprintf(out, size, "%s[%ld,%lu]", bucket++ == 0 ? "" : ",", static_cast<long>(bucketStart),
+                        static_cast<unsigned long>(seconds));
+    }
+
+public:
+    explicit HistoryJsonSource(const HistoryQuery &historyQuery) : query(historyQuery), slot(historyQuery.from) {
+        if (query.series == HistorySeries::RUNS) {
+            bucketCount = query.points;
+            return;
+        }
+        for (time_t t = query.from; t < query.to && slotCount < HISTORY_MAX_SLOTS; t = nextSlotStart(t, query.series)) {
+            slotCount++;
+        }
+        bucketCount = query.points != 0 && query.points < slotCount ? query.points : slotCount;
+    }
+
+    size_t nextPiece(char *out, size_t size) override {
+        if (stage == 0) {
+            stage = 1;
+            return snprintf(out, size, R"({"series":"%s","resolution":"%s","from":%ld,"to":%ld,"points":[)",
+                            seriesName(query.series), query.points != 0 ? "bucket" : seriesResolution(query.series),
+                            static_cast<long>(query.from), static_cast<long>(query.to));
+        }
+        if (stage == 1) {
+            size_t length = 0;
+            if (query.series == HistorySeries::RUNS && query.points == 0) {
+                bool found = false;
+                length = nextRun(out, size, found);
+                if (found || length >= size) {
+                    return length;
+                }
+            } else if (bucket < bucketCount && query.to > query.from) {
+                length = nextBucket(out, size);
+                if (length >= size) {
+                    logEvent(LogModule::API, LogLevel::WARN, LogEvent::API_HISTORY_BUSY);
+                }
+                return length;
+            }
+            stage = 2;
+        }
+        if (stage == 2) {
+            stage = 3;
+            return writeJsonLiteral(out, size, "]}");
+        }
+        return 0;
+    }
+};
+
+static bool readTimeParam(AsyncWebServerRequest *request, const char *name, time_t &value) {
+    if (!request->hasParam(name)) {
+        return true;
+    }
+    const String &text = request->getParam(name)->value();
+    char *end = nullptr;
+    long long parsed = strtoll(text.c_str(), &end, 10);
+    if (text.length() == 0 || *end != '\0' || parsed < 0) {
+        return false;
+    }
+    value = static_cast<time_t>(parsed);
+    return true;
+}
+
+static bool readHistoryQuery(AsyncWebServerRequest *request, HistorySeries series, HistoryQuery &query) {
+    time_t now = time(nullptr);
+    query.series = series;
+    query.to = now;
+    query.from = 0;
+    bool hasFrom = request->hasParam("from");
+    if (!readTimeParam(request, "to", query.to) || !readTimeParam(request, "from", query.from)) {
+        request->send(400, "application/json", R"({"message":"from și to trebuie să fie timpi Unix"})");
+        return false;
+    }
+    // Nothing later exists, and a far future to would walk slots for minutes on this task. Widened below, to
+    // ends at most with the current slot
+    if (query.to > now) {
+        query.to = now;
+    }
+    if (!hasFrom) {
+        query.from = query.to - seriesRetention(series);
+    }
+    if (query.from >= query.to) {
+        request->send(400, "application/json", R"({"message":"from trebuie să fie înaintea lui to"})");
+        return false;
+    }
+    query.points = 0;
+    if (request->hasParam("points")) {
+        long points = strtol(request->getParam("points")->value().c_str(), nullptr, 10);
+        if (points < 1 || points > HISTORY_MAX_POINTS) {
+            request->send(400, "application/json", R"({"message":"points trebuie să fie între 1 și 500"})");
+            return false;
+        }
+        query.points = static_cast<uint16_t>(points);
+    }
+    // Nothing older is kept, and whole slots keep the cache key stable until the range really moves
+    if (query.from < now - seriesRetention(series)) {
+        query.from = now - seriesRetention(series);
+    }
+    if (series == HistorySeries::RUNS) {
+        query.from -= query.from % 60;
+        query.to += (60 - query.to % 60) % 60;
+    } else {
+        query.from = slotStart(query.from, series);
+        query.to = nextSlotStart(slotStart(query.to - 1, series), series);
+    }
+    if (query.to <= query.from) {
+        request->send(400, "application/json", R"({"message":"Intervalul cerut nu mai este păstrat"})");
+        return false;
+    }
+    return true;
+}
+
+static bool sameQuery(const HistoryQuery &a, const HistoryQuery &b) {
+    return a.series == b.series && a.from == b.from && a.to == b.to && a.points == b.points;
+}
+
+// JSON whatever Accept asks for: full resolution runs are streamed without counting them first, and a MessagePack
+// array needs its length before its first element
+static void sendHistory(AsyncWebServerRequest *request, HistorySeries series) {
+    HistoryQuery query{};
+    if (!readHistoryQuery(request, series, query)) {
+        return;
+    }
+    if (query.points == 0) {
+        // Full resolution can be thousands of entries, never built in RAM
+        std::unique_ptr<JsonChunkSource> source(new(std::nothrow) HistoryJsonSource(query));
+        if (!source || !sendChunkedJson(request, std::move(source))) {
+            request->send(503, "application/json", R"({"message":"Starea este ocupată, reîncercați"})");
+        }
+        return;
+    }
+
+    if (!lockHistory()) {
+        request->send(503, "application/json", R"({"message":"Starea este ocupată, reîncercați"})");
+        return;
+    }
+    uint32_t version = heatingHistory.getVersion();
+    unlockHistory();
+    char etag[96];
+    snprintf(etag, sizeof(etag), "\"%08lx-h%u-%lu-%ld-%ld-%u\"", static_cast<unsigned long>(cacheBootId()),
+             static_cast<unsigned>(series), static_cast<unsigned long>(version), static_cast<long>(query.from),
+             static_cast<long>(query.to), query.points);
+    AsyncWebHeader *ifNoneMatch = request->getHeader("If-None-Match");
+    if (ifNoneMatch != nullptr && ifNoneMatch->value() == etag) {
+        AsyncWebServerResponse *response = request->beginResponse(304);
+        response->addHeader("ETag", etag);
+        response->addHeader("Cache-Control", "no-cache");
+        request->send(response);
+        return;
+    }
+    for (const HistoryCacheEntry &entry: historyCache) {
+        if (entry.valid && entry.version == version && sameQuery(entry.query, query)) {
+            sendEncodedBody(request, 200, ApiEncoding::JSON, entry.body, etag);
+            return;
+        }
+    }
+    std::shared_ptr<std::string> body = std::make_shared<std::string>();
+    HistoryJsonSource source(query);
+    if (!renderJsonSource(source, *body)) {
+        request->send(503, "application/json", R"({"message":"Starea este ocupată, reîncercați"})");
+        return;
+    }
+    HistoryCacheEntry &entry = historyCache[nextCacheEntry];
+    nextCacheEntry = (nextCacheEntry + 1) % HISTORY_CACHE_ENTRIES;
+    entry.valid = true;
+    entry.query = query;
+    entry.version = version;
+    entry.body = body;
+    sendEncodedBody(request, 200, ApiEncoding::JSON, entry.body, etag);
+}
+
+void handleGetHistoryRuns(AsyncWebServerRequest *request) {
+    sendHistory(request, HistorySeries::RUNS);
+}
+
+void handleGetHistoryDays(AsyncWebServerRequest *request) {
+    sendHistory(request, HistorySeries::DAYS);
+}
+
+void handleGetHistoryMonths(AsyncWebServerRequest *request) {
+    sendHistory(request, HistorySeries::MONTHS);
+}
+
+void handleGetHistoryYears(AsyncWebServerRequest *request) {
+    sendHistory(request, HistorySeries::YEARS);
+}
@@ -0,0 +1,28 @@
+#ifndef ESP32_TERMOSTAT_HISTORYAPI_H
+#define ESP32_TERMOSTAT_HISTORYAPI_H
+
+#include <cstdint>
+#include <ESPAsyncWebServer.h>
+
+// GET /api/history/{runs,days,months,years}?from=&to=&points=
+//   runs    heating runs as [start,end], kept for the last 7 days
+//   days    heating seconds per hour, kept for the last 31 days
+//   months  heating seconds per day, kept for the last 12 months
+//   years   heating seconds per month, kept for the last 10 years
+// from and to are Unix times, widened to whole slots (whole minutes for runs) and clipped to what is kept and to
+// the present. A range that ends before anything kept is answered with 400.
+// points=N sums consecutive slots into N buckets of [start,seconds] on the device. Those answers are small and
+// cached until a run is added or the range moves to the next slot; full resolution answers are streamed.
+
+constexpr uint16_t HISTORY_MAX_POINTS = 500;
+// More slots than any series keeps (31 days of hours), a range is never walked further than this
+constexpr uint16_t HISTORY_MAX_SLOTS = 800;
+constexpr uint8_t HISTORY_CACHE_ENTRIES = 4;
+constexpr uint32_t HISTORY_LOCK_TIMEOUT_MS = 200;
+
+void handleGetHistoryRuns(AsyncWebServerRequest *request);
+void handleGetHistoryDays(AsyncWebServerRequest *request);
+void handleGetHistoryMonths(AsyncWebServerRequest *request);
+void handleGetHistoryYears(AsyncWebServerRequest *request);
+
+#endif //ESP32_TERMOSTAT_HISTORYAPI_H
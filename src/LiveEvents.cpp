@@ -0,0 +1,268 @@
+#include "LiveEvents.h"
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include "LocalAPI.h"
+#include "SystemState.h"
+#include "EventLog.h"
+
+static AsyncEventSource events("/api/events");
+// AsyncEventSource keeps its clients in an unlocked list that the AsyncTCP task changes on connect and
+// disconnect, so it is only ever walked from that task: eventId, events.send() and client->close() below
+// all run in AsyncTCP callbacks
+static uint32_t eventId = 0;
+static std::atomic<uint8_t> eventClients{0};
+
+struct PendingEvent {
+    const char *name = nullptr;
+    std::string payload;
+};
+
+// Filled by the web server task, emptied by the AsyncTCP task. Payloads are swapped in and out under the lock,
+// nothing is allocated or freed while it is held
+static PendingEvent outbox[EVENT_OUTBOX_LEN];
+static uint8_t outboxCount = 0;
+static portMUX_TYPE outboxMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Last state broadcast, only touched by the web server task in publishLiveEvents
+static RoomsSnapshot sentRooms;
+static ScheduleSnapshot sentSchedule;
+static uint32_t sentRoomsVersion = 0;
+static uint32_t sentHeatingVersion = 0;
+static uint32_t sentScheduleVersion = 0;
+static bool haveSentState = false;
+
+static void addHeatingJson(JsonObject heating, const HeatingSnapshot &snapshot) {
+    heating["mode"] = heatingModeToString(snapshot.mode);
+    heating["manual"] = manualModeToString(snapshot.manual);
+    heating["isHeating"] = snapshot.isHeating;
+}
+
+static bool sendSnapshot(AsyncEventSourceClient *client) {
+    std::unique_ptr<RoomsSnapshot> rooms(new(std::nothrow) RoomsSnapshot);
+    HeatingSnapshot heating{};
+    if (!rooms || !readRoomsSnapshot(*rooms) || !readHeatingSnapshot(heating)) {
+        return false;
+    }
+    JsonDocument doc;
+    addRoomsJson(doc["rooms"].to<JsonArray>(), *rooms);
+    addHeatingJson(doc["heating"].to<JsonObject>(), heating);
+    String payload;
+    serializeJson(doc, payload);
+    client->send(payload.c_str(), "snapshot", eventId, EVENT_RETRY_MS);
+    return true;
+}
+
+// Queues the event for the next client poll, false if the outbox is full
+static bool broadcast(JsonDocument &doc, const char *event) {
+    std::string payload;
+    serializeJson(doc, payload);
+    bool queued = false;
+    portENTER_CRITICAL(&outboxMux);
+    if (outboxCount < EVENT_OUTBOX_LEN) {
+        outbox[outboxCount].name = event;
+        outbox[outboxCount].payload.swap(payload);
+        outboxCount++;
+        queued = true;
+    }
+    portEXIT_CRITICAL(&outboxMux);
+    return queued;
+}
+
+// Runs on the AsyncTCP task, the first client poll after a publish sends the events to every client
+static void sendPendingEvents() {
+    PendingEvent pending[EVENT_OUTBOX_LEN];
+    portENTER_CRITICAL(&outboxMux);
+    uint8_t count = outboxCount;
+    for (uint8_t i = 0; i < count; i++) {
+        pending[i].name = outbox[i].name;
+        pending[i].payload.swap(outbox[i].payload);
+    }
+    outboxCount = 0;
+    portEXIT_CRITICAL(&outboxMux);
+    for (uint8_t i = 0; i < count; i++) {
+        events.send(pending[i].payload.c_str(), pending[i].name, ++eventId);
+    }
+}
+
+static void discardPendingEvents() {
+    PendingEvent pending[EVENT_OUTBOX_LEN];
+    portENTER_CRITICAL(&outboxMux);
+    for (uint8_t i = 0; i < outboxCount; i++) {
+        pending[i].payload.swap(outbox[i].payload);
+    }
+    outboxCount = 0;
+    portEXIT_CRITICAL(&outboxMux);
+}
+
+// The handlers below replace the poll and disconnect handlers AsyncEventSourceClient installs on its
+// connection (ESPAsyncWebServer 1.2.x) and keep doing what those did
+static void onClientPoll(void *argument, AsyncClient *) {
+    static_cast<AsyncEventSourceClient *>(argument)->_onPoll();
+    sendPendingEvents();
+}
+
+// Closing from onConnect would free the client inside its own constructor, refused clients go on their first poll
+static void closeOnPoll(void *argument, AsyncClient *) {
+    static_cast<AsyncEventSourceClient *>(argument)->close();
+}
+
+static void onClientDisconnect(void *argument, AsyncClient *connection) {
+    eventClients.fetch_sub(1);
+    static_cast<AsyncEventSourceClient *>(argument)->_onDisconnect();
+    delete connection;
+}
+
+// Anything besides the live readings changed, the dashboard has to rebuild the room list
+static bool roomStructureChanged(const RoomsSnapshot &before, const RoomsSnapshot &after) {
+    if (before.mode != after.mode || before.roomCount != after.roomCount) {
+        return true;
+    }
+    for (uint8_t r = 0; r < after.roomCount; r++) {
+        const RoomSnapshot &a = before.rooms[r];
+        const RoomSnapshot &b = after.rooms[r];
+        if (strcmp(a.name, b.name) != 0 || a.homeTarget != b.homeTarget || a.homeLowOffset != b.homeLowOffset ||
+            a.homeHighOffset != b.homeHighOffset || a.awayTarget != b.awayTarget ||
+            a.awayLowOffset != b.awayLowOffset || a.awayHighOffset != b.awayHighOffset ||
+            a.nightTarget != b.nightTarget || a.nightLowOffset != b.nightLowOffset ||
+            a.nightHighOffset != b.nightHighOffset || a.priority != b.priority ||
+            a.thermometerCount != b.thermometerCount) {
+            return true;
+        }
+        for (uint8_t i = 0; i < b.thermometerCount; i++) {
+            if (strcmp(a.thermometers[i].mac, b.thermometers[i].mac) != 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static bool readingsChanged(const RoomSnapshot &before, const RoomSnapshot &after) {
+    if (before.valid != after.valid || before.currentTemperature != after.currentTemperature ||
+        before.currentHumidity != after.currentHumidity) {
+        return true;
+    }
+    for (uint8_t i = 0; i < after.thermometerCount; i++) {
+        const ThermometerSnapshot &a = before.thermometers[i];
+        const ThermometerSnapshot &b = after.thermometers[i];
+        if (a.valid != b.valid || a.temperature != b.temperature || a.humidity != b.humidity) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// False if the event could not be queued, the same change is published again on the next pass
+static bool publishRooms(const RoomsSnapshot &rooms) {
+    JsonDocument doc;
+    if (!haveSentState || roomStructureChanged(sentRooms, rooms)) {
+        addRoomsJson(doc["rooms"].to<JsonArray>(), rooms);
+        return broadcast(doc, "rooms");
+    }
+    JsonArray changed = doc["rooms"].to<JsonArray>();
+    for (uint8_t r = 0; r < rooms.roomCount; r++) {
+        const RoomSnapshot &room = rooms.rooms[r];
+        if (!readingsChanged(sentRooms.rooms[r], room)) {
+            continue;
+        }
+        JsonObject roomObj = changed.add<JsonObject>();
+        roomObj["room_name"] = room.name;
+        roomObj["valid"] = room.valid;
+        roomObj["current_temperature"] = room.currentTemperature;
+        roomObj["current_humidity"] = room.currentHumidity;
+        JsonArray thermos = roomObj["thermometers"].to<JsonArray>();
+        for (uint8_t i = 0; i < room.thermometerCount; i++) {
+            JsonObject thermoObj = thermos.add<JsonObject>();
+            thermoObj["mac"] = room.thermometers[i].mac;
+            thermoObj["temperature"] = room.thermometers[i].temperature;
+            thermoObj["humidity"] = room.thermometers[i].humidity;
+        }
+    }
+    return changed.size() == 0 || broadcast(doc, "temperatures");
+}
+
+static bool publishSchedule(const ScheduleSnapshot &schedule) {
+    JsonDocument doc;
+    JsonArray slots = doc["slots"].to<JsonArray>();
+    uint16_t changes = 0;
+    for (uint8_t day = 0; day < 7 && changes <= MAX_SCHEDULE_SLOT_CHANGES; day++) {
+        for (uint8_t slot = 0; slot < 48; slot++) {
+            if (sentSchedule.slots[day][slot] == schedule.slots[day][slot]) {
+                continue;
+            }
+            if (++changes > MAX_SCHEDULE_SLOT_CHANGES) {
+                break;
+            }
+            JsonObject slotObj = slots.add<JsonObject>();
+            slotObj["day"] = day;
+            slotObj["slot"] = slot;
+            slotObj["mode"] = modeToString(static_cast<themperature_modes>(schedule.slots[day][slot]));
+        }
+    }
+    if (changes > MAX_SCHEDULE_SLOT_CHANGES) {
+        doc.clear();
+        doc["reload"] = true;
+    } else if (changes == 0) {
+        return true; // Only the directive lists moved
+    }
+    return broadcast(doc, "schedule");
+}
+
+void initLiveEvents(AsyncWebServer &webServer) {
+    events.onConnect([](AsyncEventSourceClient *client) {
+        AsyncClient *connection = client->client();
+        connection->onDisconnect(onClientDisconnect, client);
+        uint8_t clients = eventClients.fetch_add(1) + 1;
+        if (clients > MAX_EVENT_CLIENTS) {
+            logEvent(LogModule::API, LogLevel::WARN, LogEvent::API_EVENT_CLIENTS_FULL, clients);
+            connection->onPoll(closeOnPoll, client);
+            return;
+        }
+        if (!sendSnapshot(client)) {
+            connection->onPoll(closeOnPoll, client);
+            return;
+        }
+        connection->onPoll(onClientPoll, client);
+    });
+    webServer.addHandler(&events);
+}
+
+void publishLiveEvents() {
+    if (eventClients.load() == 0) {
+        // Nobody listens, new clients start from a snapshot anyway
+        haveSentState = false;
+        discardPendingEvents();
+        return;
+    }
+    uint32_t version = 0;
+    std::unique_ptr<RoomsSnapshot> rooms(new(std::nothrow) RoomsSnapshot);
+    if (rooms && readRoomsSnapshot(*rooms, &version) && (!haveSentState || version != sentRoomsVersion) &&
+        publishRooms(*rooms)) {
+        memcpy(&sentRooms, rooms.get(), sizeof(sentRooms));
+        sentRoomsVersion = version;
+    }
+    rooms.reset();
+
+    HeatingSnapshot heating{};
+    if (readHeatingSnapshot(heating, &version) && (!haveSentState || version != sentHeatingVersion)) {
+        JsonDocument doc;
+        addHeatingJson(doc.to<JsonObject>(), heating);
+        if (broadcast(doc, "heating")) {
+            sentHeatingVersion = version;
+        }
+    }
+
+    std::unique_ptr<ScheduleSnapshot> schedule(new(std::nothrow) ScheduleSnapshot);
+    if (schedule && readScheduleSnapshot(*schedule, &version) &&
+        (!haveSentState || version != sentScheduleVersion)) {
+        // The first pass after a quiet period only records the baseline, clients fetch the schedule on demand
+        if (!haveSentState || publishSchedule(*schedule)) {
+            memcpy(&sentSchedule, schedule.get(), sizeof(sentSchedule));
+            sentScheduleVersion = version;
+        }
+    }
+    haveSentState = true;
+}
@@ -0,0 +1,30 @@
+#ifndef ESP32_TERMOSTAT_LIVEEVENTS_H
+#define ESP32_TERMOSTAT_LIVEEVENTS_H
+
+#include <cstdint>
+#include <ESPAsyncWebServer.h>
+
+// Server-Sent Events on /api/events. A new client gets a "snapshot" event, after that the web server task
+// compares the published snapshots once per EVENT_COALESCE_MS and queues what changed. The AsyncTCP task
+// sends the queued events from the next client poll, within about half a second:
+//   rooms         full room list, when a room, its settings, its thermometers or the room mode changed
+//   temperatures  only the live readings of the rooms whose readings changed
+//   heating       mode, manual mode and relay state
+//   schedule      changed slots, or {"reload":true} when too many changed to list
+
+constexpr uint8_t MAX_EVENT_CLIENTS = 4;
+constexpr uint32_t EVENT_COALESCE_MS = 1000;
+constexpr uint8_t MAX_SCHEDULE_SLOT_CHANGES = 48;
+// Browsers reconnect after this long when the stream drops
+constexpr uint32_t EVENT_RETRY_MS = 5000;
+// Events waiting for a client poll, a pass queues at most four
+constexpr uint8_t EVENT_OUTBOX_LEN = 8;
+
+void initLiveEvents(AsyncWebServer &webServer);
+
+/**
+ * @brief Queues the changes since the previous call. Called by the web server task every EVENT_COALESCE_MS.
+ */
+void publishLiveEvents();
+
+#endif //ESP32_TERMOSTAT_LIVEEVENTS_H
@@ -1,53 +1,136 @@
 #include "LocalAPI.h"
 #include "SaveLoad.h"
 #include "globalSettings.h"
+#include "SystemState.h"
+#include "BLEConnection.h"
+#include "StaticAssets.h"
+#include "LiveEvents.h"
+#include "ChunkedJson.h"
+#include "ResponseCache.h"
+#include "ApiEncoding.h"
+#include "HistoryApi.h"
+#include "RequestBody.h"
+#include "ChangeLog.h"
+#include "Metrics.h"
+#include "RouteStats.h"
+#include "ApiRouter.h"
+#include "Diagnostics.h"
+#include "EventLog.h"
 #include <Arduino.h>
 #include <ESPAsyncWebServer.h>
 #include <ArduinoJson.h>
 #include <LittleFS.h>
 #include <vector>
+#include <memory>
 
 
 AsyncWebServer server(80);
 
-Room *findRoomByName(const std::string &room_name) {
-    for (auto &room: rooms) {
-        if (room.get_room_name() == room_name) {
-            return &room;
-        }
+// Handlers never touch the live rooms, heating or scheduler globals: reads come from the published
+// snapshots and writes are queued for the relay task, so a slow request can never stall the control loop.
+
+static void sendStateBusy(AsyncWebServerRequest *request) {
+    request->send(503, "application/json", R"({"message":"Starea este ocupată, reîncercați"})");
+}
+
+// Snapshots are a few KB, so they are copied to the heap instead of the AsyncTCP task stack
+static std::unique_ptr<RoomsSnapshot> loadRoomsSnapshot(uint32_t *version = nullptr) {
+    std::unique_ptr<RoomsSnapshot> snapshot(new(std::nothrow) RoomsSnapshot);
+    if (!snapshot || !readRoomsSnapshot(*snapshot, version)) {
+        return nullptr;
+    }
+    return snapshot;
+}
+
+static std::unique_ptr<ScheduleSnapshot> loadScheduleSnapshot(uint32_t *version = nullptr) {
+    std::unique_ptr<ScheduleSnapshot> snapshot(new(std::nothrow) ScheduleSnapshot);
+    if (!snapshot || !readScheduleSnapshot(*snapshot, version)) {
+        return nullptr;
+    }
+    return snapshot;
+}
+
+static_assert(API_PATH_PARAM_LEN <= ROOM_NAME_LEN, "A room name from the path must fit");
+
+// From the path on /api/rooms/{name}, from ?room_name= everywhere else
+static bool readRoomNameParam(AsyncWebServerRequest *request, char *roomName) {
+    if (apiPathParam() != nullptr) {
+        return copyStateString(roomName, ROOM_NAME_LEN, apiPathParam());
+    }
+    if (!request->hasParam("room_name")) {
+        logEvent(LogModule::API, LogLevel::WARN, LogEvent::API_PARAM_MISSING,
+                 static_cast<int32_t>(LogParam::ROOM_NAME));
+        request->send(400, "application/json", R"({"message":"room_name nu este specificat"})");
+        return false;
     }
-    return nullptr;
+    if (!copyStateString(roomName, ROOM_NAME_LEN, request->getParam("room_name")->value().c_str())) {
+        request->send(400, "application/json", R"({"message":"room_name este prea lung"})");
+        return false;
+    }
+    return true;
 }
 
+// Sorted by path, then by method, see ApiRouter.h
+static constexpr ApiRoute API_ROUTES[] = {
+        {"/api/batch", HTTP_POST, nullptr, handleBatchBody},
+        {"/api/cache", HTTP_GET, handleGetResponseCache, nullptr},
+        {"/api/changes", HTTP_GET, handleGetChanges, nullptr},
+        {"/api/debug/heap", HTTP_GET, handleGetHeap, nullptr},
+        {"/api/debug/slow", HTTP_GET, handleGetSlowRequests, nullptr},
+        {"/api/debug/tasks", HTTP_GET, handleGetTasks, nullptr},
+        {"/api/heating/latency", HTTP_GET, handleGetControlLatency, nullptr},
+        {"/api/heating/manual", HTTP_GET, handleGetManualMode, nullptr},
+        {"/api/heating/manual", HTTP_POST, handleSetManualMode, nullptr},
+        {"/api/heating/mode", HTTP_GET, handleGetHeatingMode, nullptr},
+        {"/api/heating/mode", HTTP_POST, handleSetHeatingMode, nullptr},
+        {"/api/heating/status", HTTP_GET, handleGetHeating, nullptr},
+        {"/api/history/days", HTTP_GET, handleGetHistoryDays, nullptr},
+        {"/api/history/months", HTTP_GET, handleGetHistoryMonths, nullptr},
+        {"/api/history/runs", HTTP_GET, handleGetHistoryRuns, nullptr},
+        {"/api/history/years", HTTP_GET, handleGetHistoryYears, nullptr},
+        {"/api/logs", HTTP_GET, handleGetLogs, nullptr},
+        {"/api/persistence", HTTP_GET, handleGetPersistence, nullptr},
+        {"/api/rooms", HTTP_GET, handleGetRooms, nullptr},
+        {"/api/rooms", HTTP_POST, nullptr, handleCreateRoomBody},
+        {"/api/rooms", HTTP_DELETE, handleDeleteRoom, nullptr},
+        {"/api/rooms", HTTP_PUT, nullptr, handleUpdateRoomBody},
+        {"/api/rooms/{name}", HTTP_DELETE, handleDeleteRoom, nullptr, ApiPathParam::STRING},
+        {"/api/rooms/{name}", HTTP_PUT, nullptr, handleUpdateRoomBody, ApiPathParam::STRING},
+        {"/api/schedule", HTTP_GET, handleGetSchedule, nullptr},
+        {"/api/schedule", HTTP_POST, nullptr, handleSetScheduleBody},
+        {"/api/schedule", HTTP_PATCH, nullptr, handlePatchScheduleBody},
+        {"/api/sensors", HTTP_GET, handleGetSensors, nullptr},
+        {"/api/sensors/discover", HTTP_GET, handleDiscoverSensors, nullptr},
+        {"/api/sensors/health", HTTP_GET, handleGetSensorHealth, nullptr},
+        {"/api/settings/reset", HTTP_GET, handleResetSettings, nullptr},
+        {"/api/thermometers", HTTP_POST, nullptr, handleAddThermometerBody},
+        {"/api/thermometers", HTTP_DELETE, handleRemoveThermometer, nullptr},
+        {"/metrics", HTTP_GET, handleGetMetrics, nullptr},
+};
+constexpr uint8_t API_ROUTE_COUNT = sizeof(API_ROUTES) / sizeof(API_ROUTES[0]);
+static_assert(API_ROUTE_COUNT <= MAX_API_ROUTES, "Raise MAX_TRACED_ROUTES");
+static_assert(apiRoutesSorted(API_ROUTES, API_ROUTE_COUNT), "API_ROUTES must be sorted by path, then method");
+static_assert(apiRoutePlaceholdersValid(API_ROUTES, API_ROUTE_COUNT),
+              "Only routes with a path parameter end in a {placeholder}");
+
 void startWebServer(void *parameter) {
-    server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
-        request->send(LittleFS, "/index.html", "text/html");
-    });
-    server.serveStatic("/", LittleFS, "/");
-    server.on("/api/rooms", HTTP_GET, handleGetRooms);
-    server.on("/api/rooms", HTTP_POST, [](AsyncWebServerRequest *request) {
-    }, nullptr, handleCreateRoomBody);
-    server.on("/api/rooms", HTTP_PUT, [](AsyncWebServerRequest *request) {
-    }, nullptr, handleUpdateRoomBody);
-    server.on("/api/rooms", HTTP_DELETE, handleDeleteRoom);
-    server.on("/api/thermometers", HTTP_POST, [](AsyncWebServerRequest *request) {
-    }, nullptr, handleAddThermometerBody);
-    server.on("/api/thermometers", HTTP_DELETE, handleRemoveThermometer);
-    server.on("/api/settings/reset", HTTP_GET, handleResetSettings);
-    server.on("/api/heating/mode", HTTP_GET, handleGetHeatingMode);
-    server.on("/api/heating/mode", HTTP_POST, handleSetHeatingMode);
-    server.on("/api/heating/manual", HTTP_GET, handleGetManualMode);
-    server.on("/api/heating/manual", HTTP_POST, handleSetManualMode);
-    server.on("/api/heating/status", HTTP_GET, handleGetHeating);
-    server.on("/api/schedule", HTTP_GET, handleGetSchedule);
-    server.on("/api/schedule", HTTP_POST, [](AsyncWebServerRequest *request) {
-    }, nullptr, handleSetScheduleBody);
+    initRouteTracing(server);
+    registerApiRoutes(server, API_ROUTES, API_ROUTE_COUNT);
+    initLiveEvents(server);
+    bool compressedAssets = registerStaticAssets(server);
+    if (!compressedAssets) {
+        server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
+            request->send(LittleFS, "/index.html", "text/html");
+        });
+        server.serveStatic("/", LittleFS, "/");
+    }
+    // Every file that exists was matched by an asset route or serveStatic, no LittleFS lookup here
     server.onNotFound([](AsyncWebServerRequest *request) {
         if (request->url().startsWith("/api/")) {
             request->send(404, "application/json", "{\"error\":\"Not found\"}");
             return;
         }
-        request->send(LittleFS, request->url(), request->contentType());
+        request->send(404);
     });
     server.begin();
 }
@@ -67,6 +150,17 @@ std::string modeToString(themperature_modes mode) {
     }
 }
 
+themperature_modes stringToMode(const std::string &modeStr) {
+    if (modeStr == "HOME") {
+        return HOME;
+    } else if (modeStr == "AWAY") {
+        return AWAY;
+    } else if (modeStr == "NIGHT") {
+        return NIGHT;
+    }
+    return ANTIFREEZE;
+}
+
 std::string heatingModeToString(enum heatingMode mode) {
     switch (mode) {
         case AUTO:
@@ -84,180 +178,289 @@ std::string manualModeToString(enum manualMode mode) {
     return (mode == ON_MANUAL) ? "ON" : "OFF";
 }
 
+enum heatingMode stringToHeatingMode(const std::string &modeStr) {
+    if (modeStr == "AUTO") {
+        return AUTO;
+    } else if (modeStr == "MANUAL") {
+        return MANUAL;
+    }
+    return OFF;
+}
+
+static void addRoomJson(JsonObject roomObj, const RoomSnapshot &room, themperature_modes mode) {
+    roomObj["room_name"] = room.name;
+    roomObj["current_temperature"] = room.currentTemperature;
+    roomObj["current_humidity"] = room.currentHumidity;
+    roomObj["home_target_temperature"] = room.homeTarget;
+    roomObj["home_low_offset"] = room.homeLowOffset;
+    roomObj["home_high_offset"] = room.homeHighOffset;
+    roomObj["away_target_temperature"] = room.awayTarget;
+    roomObj["away_low_offset"] = room.awayLowOffset;
+    roomObj["away_high_offset"] = room.awayHighOffset;
+    roomObj["night_target_temperature"] = room.nightTarget;
+    roomObj["night_low_offset"] = room.nightLowOffset;
+    roomObj["night_high_offset"] = room.nightHighOffset;
+    roomObj["room_priority"] = room.priority;
+    roomObj["mode"] = modeToString(mode);
+    JsonArray thermos = roomObj["thermometers"].to<JsonArray>();
+    for (uint8_t i = 0; i < room.thermometerCount; i++) {
+        JsonObject thermoObj = thermos.add<JsonObject>();
+        thermoObj["mac"] = room.thermometers[i].mac;
+        thermoObj["temperature"] = room.thermometers[i].temperature;
+        thermoObj["humidity"] = room.thermometers[i].humidity;
+    }
+}
+
+void addRoomsJson(JsonArray roomsArray, const RoomsSnapshot &snapshot) {
+    for (uint8_t r = 0; r < snapshot.roomCount; r++) {
+        addRoomJson(roomsArray.add<JsonObject>(), snapshot.rooms[r], snapshot.mode);
+    }
+}
+
+// {"rooms":[...]} rendered one room per piece, MessagePack clients get the same map
+class RoomsSource : public JsonChunkSource {
+private:
+    std::unique_ptr<RoomsSnapshot> snapshot;
+    ApiEncoding encoding;
+    uint8_t piece = 0;
+
+public:
+    RoomsSource(std::unique_ptr<RoomsSnapshot> rooms, ApiEncoding roomsEncoding)
+            : snapshot(std::move(rooms)), encoding(roomsEncoding) {}
+
+    size_t nextPiece(char *out, size_t size) override {
+        bool packed = encoding == ApiEncoding::MSGPACK;
+        uint8_t current = piece++;
+        if (current == 0) {
+            return packed ? writeMsgPackMapHeader(out, size, 1) : writeJsonLiteral(out, size, "{\"rooms\":[");
+        }
+        if (packed && current == 1) {
+            return writeMsgPackKey(out, size, "rooms", snapshot->roomCount);
+        }
+        uint8_t room = current - (packed ? 2 : 1);
+        if (room < snapshot->roomCount) {
+            JsonDocument doc;
+            addRoomJson(doc.to<JsonObject>(), snapshot->rooms[room], snapshot->mode);
+            return packed ? writeMsgPackElement(doc, out, size) : writeJsonElement(doc, room == 0, out, size);
+        }
+        if (!packed && room == snapshot->roomCount) {
+            return writeJsonLiteral(out, size, "]}");
+        }
+        return 0;
+    }
+};
+
+static std::unique_ptr<JsonChunkSource> makeRoomsSource(ApiEncoding encoding, uint32_t &version) {
+    auto snapshot = loadRoomsSnapshot(&version);
+    if (!snapshot) {
+        return nullptr;
+    }
+    return std::unique_ptr<JsonChunkSource>(new(std::nothrow) RoomsSource(std::move(snapshot), encoding));
+}
+
 void handleGetRooms(AsyncWebServerRequest *request) {
-    JsonDocument doc;
-    JsonArray roomsArray = doc["rooms"].to<JsonArray>();
-    for (auto &room: rooms) {
-        JsonObject roomObj = roomsArray.add<JsonObject>();
-        roomObj["room_name"] = room.get_room_name();
-        roomObj["current_temperature"] = room.getRoomTemperature();
-        roomObj["current_humidity"] = room.get_humidity();
-        roomObj["home_target_temperature"] = room.get_home_temperature();
-        roomObj["home_low_offset"] = room.get_home_low_offset();
-        roomObj["home_high_offset"] = room.get_home_high_offset();
-        roomObj["away_target_temperature"] = room.get_away_temperature();
-        roomObj["away_low_offset"] = room.get_away_low_offset();
-        roomObj["away_high_offset"] = room.get_away_high_offset();
-        roomObj["night_target_temperature"] = room.get_night_temperature();
-        roomObj["night_low_offset"] = room.get_night_low_offset();
-        roomObj["night_high_offset"] = room.get_night_high_offset();
-        roomObj["room_priority"] = room.get_room_priority();
-        roomObj["mode"] = modeToString(Room::get_room_mode());
-        JsonArray thermos = roomObj["thermometers"].to<JsonArray>();
-        for (int i = 0; i < room.get_thermometer_number(); i++) {
-            JsonObject thermoObj = thermos.add<JsonObject>();
-            thermoObj["mac"] = room.get_mac_by_index(i);
-            thermoObj["temperature"] = room.get_temperature_by_index(i);
-            thermoObj["humidity"] = room.get_humidity_by_index(i);
-        }
-    }
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    if (!sendCachedStream(request, CachedRoute::ROOMS, roomsSnapshotVersion(), makeRoomsSource)) {
+        sendStateBusy(request);
+    }
 }
 
 void handleCreateRoomBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
-    String body = String((char *) data, len);
+    size_t bodyLength = 0;
+    const char *body = collectRequestBody(request, data, len, index, total, ROOM_BODY_LIMIT, bodyLength);
+    if (body == nullptr) {
+        return;
+    }
     JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, body);
+    DeserializationError error = deserializeJson(doc, body, bodyLength);
     if (error) {
-        Serial.print("Eroare la parsarea JSON: ");
-        Serial.println(error.c_str());
+        logEvent(LogModule::API, LogLevel::WARN, LogEvent::API_JSON_INVALID, error.code());
         request->send(400, "application/json", R"({"message":"JSON invalid"})");
         return;
     }
     if (!doc["room_name"].is<const char *>()) {
-        Serial.println("room_name este obligatoriu");
+        logEvent(LogModule::API, LogLevel::WARN, LogEvent::API_PARAM_MISSING,
+                 static_cast<int32_t>(LogParam::ROOM_NAME));
         request->send(400, "application/json", R"({"message":"room_name este obligatoriu"})");
         return;
     }
-    std::string room_name = doc["room_name"].as<const char *>();
-    if (findRoomByName(room_name) != nullptr) {
-        Serial.println("Camera deja există");
+    StateCommand command{};
+    command.type = StateCommandType::CREATE_ROOM;
+    if (!copyStateString(command.roomName, sizeof(command.roomName), doc["room_name"].as<const char *>())) {
+        request->send(400, "application/json", R"({"message":"room_name este prea lung"})");
+        return;
+    }
+    auto snapshot = loadRoomsSnapshot();
+    if (!snapshot) {
+        sendStateBusy(request);
+        return;
+    }
+    if (findRoomSnapshot(*snapshot, command.roomName) != nullptr) {
+        logEvent(LogModule::API, LogLevel::WARN, LogEvent::API_ROOM_EXISTS);
         request->send(400, "application/json", R"({"message":"Camera deja există"})");
         return;
     }
-    float home_temp = doc["home_target_temperature"] | 22.0f;
-    float home_low = doc["home_low_offset"] | 0.5f;
-    float home_high = doc["home_high_offset"] | 0.5f;
-    float priority = doc["room_priority"] | 5.0f;
-    float away_temp = doc["away_target_temperature"] | 18.0f;
-    float away_low = doc["away_low_offset"] | 0.75f;
-    float away_high = doc["away_high_offset"] | 0.75f;
-    float night_temp = doc["night_target_temperature"] | 21.0f;
-    float night_low = doc["night_low_offset"] | 0.6f;
-    float night_high = doc["night_high_offset"] | 0.6f;
-    rooms.emplace_back(room_name, home_temp, home_low, home_high, priority, away_temp, away_low, away_high,
-                       night_temp, night_low, night_high, true);
-    saveRooms();
+    if (snapshot->roomCount >= MAX_ROOMS) {
+        request->send(400, "application/json", R"({"message":"Numărul maxim de camere a fost atins"})");
+        return;
+    }
+    RoomSettings &settings = command.settings;
+    settings.fields = ROOM_FIELD_ALL;
+    settings.homeTarget = doc["home_target_temperature"] | 22.0f;
+    settings.homeLowOffset = doc["home_low_offset"] | 0.5f;
+    settings.homeHighOffset = doc["home_high_offset"] | 0.5f;
+    settings.priority = doc["room_priority"] | 5.0f;
+    settings.awayTarget = doc["away_target_temperature"] | 18.0f;
+    settings.awayLowOffset = doc["away_low_offset"] | 0.75f;
+    settings.awayHighOffset = doc["away_high_offset"] | 0.75f;
+    settings.nightTarget = doc["night_target_temperature"] | 21.0f;
+    settings.nightLowOffset = doc["night_low_offset"] | 0.6f;
+    settings.nightHighOffset = doc["night_high_offset"] | 0.6f;
+    if (!submitStateCommand(command)) {
+        sendStateBusy(request);
+        return;
+    }
     JsonDocument responseDoc;
     responseDoc["message"] = "Camera a fost creată cu succes";
-    responseDoc["room_name"] = room_name;
-    String response;
-    serializeJson(responseDoc, response);
-    request->send(201, "application/json", response);
+    responseDoc["room_name"] = command.roomName;
+    sendDocument(request, 201, responseDoc);
 }
 
-void handleUpdateRoomBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
-    if (!request->hasParam("room_name")) {
-        Serial.println("room_name nu este specificat");
-        request->send(400, "application/json", R"({"message":"room_name nu este specificat"})");
-        return;
+// Only the values present in source are set, the rest keep their current value
+static void readRoomSettings(JsonObjectConst source, RoomSettings &settings) {
+    if (source["home_target_temperature"].is<float>()) {
+        settings.homeTarget = source["home_target_temperature"].as<float>();
+        settings.fields |= ROOM_FIELD_HOME_TARGET;
     }
-    String room_name = request->getParam("room_name")->value();
-    Room *room = findRoomByName(room_name.c_str());
-    if (room == nullptr) {
-        Serial.println("Camera nu a fost găsită");
-        request->send(404, "application/json", R"({"message":"Camera nu a fost găsită"})");
-        return;
+    if (source["home_low_offset"].is<float>()) {
+        settings.homeLowOffset = source["home_low_offset"].as<float>();
+        settings.fields |= ROOM_FIELD_HOME_LOW;
     }
-    String body = String((char *) data, len);
-    JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, body);
-    if (error) {
-        Serial.print("Eroare la parsarea JSON: ");
-        Serial.println(error.c_str());
-        request->send(400, "application/json", R"({"message":"JSON invalid"})");
-        return;
+    if (source["home_high_offset"].is<float>()) {
+        settings.homeHighOffset = source["home_high_offset"].as<float>();
+        settings.fields |= ROOM_FIELD_HOME_HIGH;
+    }
+    if (source["room_priority"].is<float>()) {
+        settings.priority = source["room_priority"].as<float>();
+        settings.fields |= ROOM_FIELD_PRIORITY;
+    }
+    if (source["away_target_temperature"].is<float>()) {
+        settings.awayTarget = source["away_target_temperature"].as<float>();
+        settings.fields |= ROOM_FIELD_AWAY_TARGET;
     }
-    if (doc["home_target_temperature"].is<float>()) {
-        room->set_home_temperature(doc["home_target_temperature"].as<float>(), true);
+    if (source["away_low_offset"].is<float>()) {
+        settings.awayLowOffset = source["away_low_offset"].as<float>();
+        settings.fields |= ROOM_FIELD_AWAY_LOW;
     }
-    if (doc["home_low_offset"].is<float>()) {
-        room->set_home_low_offset(doc["home_low_offset"].as<float>(), true);
+    if (source["away_high_offset"].is<float>()) {
+        settings.awayHighOffset = source["away_high_offset"].as<float>();
+        settings.fields |= ROOM_FIELD_AWAY_HIGH;
     }
-    if (doc["home_high_offset"].is<float>()) {
-        room->set_home_high_offset(doc["home_high_offset"].as<float>(), true);
+    if (source["night_target_temperature"].is<float>()) {
+        settings.nightTarget = source["night_target_temperature"].as<float>();
+        settings.fields |= ROOM_FIELD_NIGHT_TARGET;
     }
-    if (doc["room_priority"].is<float>()) {
-        room->set_room_priority(doc["room_priority"].as<float>(), true);
+    if (source["night_low_offset"].is<float>()) {
+        settings.nightLowOffset = source["night_low_offset"].as<float>();
+        settings.fields |= ROOM_FIELD_NIGHT_LOW;
     }
-    if (doc["away_target_temperature"].is<float>()) {
-        room->set_away_temperature(doc["away_target_temperature"].as<float>(), true);
+    if (source["night_high_offset"].is<float>()) {
+        settings.nightHighOffset = source["night_high_offset"].as<float>();
+        settings.fields |= ROOM_FIELD_NIGHT_HIGH;
     }
-    if (doc["away_low_offset"].is<float>()) {
-        room->set_away_low_offset(doc["away_low_offset"].as<float>(), true);
+}
+
+void handleUpdateRoomBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+    size_t bodyLength = 0;
+    const char *body = collectRequestBody(request, data, len, index, total, ROOM_BODY_LIMIT, bodyLength);
+    if (body == nullptr) {
+        return;
+    }
+    StateCommand command{};
+    command.type = StateCommandType::UPDATE_ROOM;
+    if (!readRoomNameParam(request, command.roomName)) {
+        return;
     }
-    if (doc["away_high_offset"].is<float>()) {
-        room->set_away_high_offset(doc["away_high_offset"].as<float>(), true);
+    auto snapshot = loadRoomsSnapshot();
+    if (!snapshot) {
+        sendStateBusy(request);
+        return;
     }
-    if (doc["night_target_temperature"].is<float>()) {
-        room->set_night_temperature(doc["night_target_temperature"].as<float>(), true);
+    if (findRoomSnapshot(*snapshot, command.roomName) == nullptr) {
+        logEvent(LogModule::API, LogLevel::WARN, LogEvent::API_ROOM_NOT_FOUND);
+        request->send(404, "application/json", R"({"message":"Camera nu a fost găsită"})");
+        return;
     }
-    if (doc["night_low_offset"].is<float>()) {
-        room->set_night_low_offset(doc["night_low_offset"].as<float>(), true);
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, body, bodyLength);
+    if (error) {
+        logEvent(LogModule::API, LogLevel::WARN, LogEvent::API_JSON_INVALID, error.code());
+        request->send(400, "application/json", R"({"message":"JSON invalid"})");
+        return;
     }
-    if (doc["night_high_offset"].is<float>()) {
-        room->set_night_high_offset(doc["night_high_offset"].as<float>(), true);
+    readRoomSettings(doc.as<JsonObjectConst>(), command.settings);
+    if (!submitStateCommand(command)) {
+        sendStateBusy(request);
+        return;
     }
-    saveRooms();
     JsonDocument responseDoc;
     responseDoc["message"] = "Setările camerei au fost actualizate";
-    String response;
-    serializeJson(responseDoc, response);
-    request->send(200, "application/json", response);
+    sendDocument(request, 200, responseDoc);
 }
 
 void handleDeleteRoom(AsyncWebServerRequest *request) {
-    if (!request->hasParam("room_name")) {
-        Serial.println("room_name nu este specificat");
-        request->send(400, "application/json", R"({"message":"room_name nu este specificat"})");
+    StateCommand command{};
+    command.type = StateCommandType::DELETE_ROOM;
+    if (!readRoomNameParam(request, command.roomName)) {
         return;
     }
-    String room_name = request->getParam("room_name")->value();
-    auto it = std::find_if(rooms.begin(), rooms.end(), [&](const Room &room) -> bool {
-        return room.get_room_name() == room_name.c_str();
-    });
-    if (it == rooms.end()) {
-        Serial.println("Camera nu a fost găsită");
+    auto snapshot = loadRoomsSnapshot();
+    if (!snapshot) {
+        sendStateBusy(request);
+        return;
+    }
+    if (findRoomSnapshot(*snapshot, command.roomName) == nullptr) {
+        logEvent(LogModule::API, LogLevel::WARN, LogEvent::API_ROOM_NOT_FOUND);
         request->send(404, "application/json", R"({"message":"Camera nu a fost găsită"})");
         return;
     }
-    rooms.erase(it);
-    saveRooms();
+    if (!submitStateCommand(command)) {
+        sendStateBusy(request);
+        return;
+    }
     JsonDocument responseDoc;
-    responseDoc["message"] = "Camera " + room_name + " a fost ștearsă";
-    String response;
-    serializeJson(responseDoc, response);
-    request->send(200, "application/json", response);
+    responseDoc["message"] = "Camera " + String(command.roomName) + " a fost ștearsă";
+    sendDocument(request, 200, responseDoc);
 }
 
 void handleAddThermometerBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+    size_t bodyLength = 0;
+    const char *body = collectRequestBody(request, data, len, index, total, THERMOMETER_BODY_LIMIT, bodyLength);
+    if (body == nullptr) {
+        return;
+    }
+    StateCommand command{};
+    command.type = StateCommandType::ADD_THERMOMETER;
     if (!request->hasParam("room_name")) {
         request->send(400, "application/json", R"({"message":"room_name este obligatoriu"})");
         return;
     }
-    String room_name = request->getParam("room_name")->value();
-    Room *room = findRoomByName(room_name.c_str());
+    if (!readRoomNameParam(request, command.roomName)) {
+        return;
+    }
+    auto snapshot = loadRoomsSnapshot();
+    if (!snapshot) {
+        sendStateBusy(request);
+        return;
+    }
+    const RoomSnapshot *room = findRoomSnapshot(*snapshot, command.roomName);
     if (room == nullptr) {
         request->send(404, "application/json", R"({"message":"Camera nu a fost găsită"})");
         return;
     }
-    String body = String((char *) data, len);
     JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, body);
+    DeserializationError error = deserializeJson(doc, body, bodyLength);
     if (error) {
-        Serial.println(error.c_str());
+        logEvent(LogModule::API, LogLevel::WARN, LogEvent::API_JSON_INVALID, error.code());
         request->send(400, "application/json", R"({"message":"JSON invalid"})");
         return;
     }
@@ -265,17 +468,27 @@ void handleAddThermometerBody(AsyncWebServerRequest *request, uint8_t *data, siz
         request->send(400, "application/json", R"({"message":"mac este obligatoriu"})");
         return;
     }
-    std::string mac = doc["mac"].as<const char *>();
-    if (room->thermometerExist(mac)) {
+    uint8_t address[6];
+    if (!parseMacAddress(doc["mac"].as<const char *>(), address)) {
+        request->send(400, "application/json", R"({"message":"mac invalid"})");
+        return;
+    }
+    formatMacAddress(address, command.mac);
+    if (roomSnapshotHasThermometer(*room, command.mac)) {
         request->send(400, "application/json", R"({"message":"Termometrul deja există în cameră"})");
         return;
     }
-    room->addThermometer(mac, false);
+    if (room->thermometerCount >= MAX_ROOM_THERMOMETERS) {
+        request->send(400, "application/json", R"({"message":"Numărul maxim de termometre a fost atins"})");
+        return;
+    }
+    if (!submitStateCommand(command)) {
+        sendStateBusy(request);
+        return;
+    }
     JsonDocument responseDoc;
-    responseDoc["message"] = "Termometrul a fost adăugat la camera " + room->get_room_name();
-    String response;
-    serializeJson(responseDoc, response);
-    request->send(201, "application/json", response);
+    responseDoc["message"] = "Termometrul a fost adăugat la camera " + String(command.roomName);
+    sendDocument(request, 201, responseDoc);
 }
 
 void handleRemoveThermometer(AsyncWebServerRequest *request) {
@@ -283,219 +496,570 @@ void handleRemoveThermometer(AsyncWebServerRequest *request) {
         request->send(400, "application/json", R"({"message":"room_name și mac sunt obligatorii"})");
         return;
     }
-    String room_name = request->getParam("room_name")->value();
-    String mac = request->getParam("mac")->value();
-    Room *room = findRoomByName(room_name.c_str());
+    StateCommand command{};
+    command.type = StateCommandType::REMOVE_THERMOMETER;
+    if (!readRoomNameParam(request, command.roomName)) {
+        return;
+    }
+    // Stored addresses are upper case with colons, same as the add path
+    uint8_t address[6];
+    if (!parseMacAddress(request->getParam("mac")->value().c_str(), address)) {
+        request->send(400, "application/json", R"({"message":"mac invalid"})");
+        return;
+    }
+    formatMacAddress(address, command.mac);
+    auto snapshot = loadRoomsSnapshot();
+    if (!snapshot) {
+        sendStateBusy(request);
+        return;
+    }
+    const RoomSnapshot *room = findRoomSnapshot(*snapshot, command.roomName);
     if (room == nullptr) {
         request->send(404, "application/json", R"({"message":"Camera nu a fost găsită"})");
         return;
     }
-    if (!room->thermometerExist(mac.c_str())) {
+    if (!roomSnapshotHasThermometer(*room, command.mac)) {
         request->send(404, "application/json", R"({"message":"Termometrul nu există în cameră"})");
         return;
     }
-    room->removeThermometer(mac.c_str(), false);
+    if (!submitStateCommand(command)) {
+        sendStateBusy(request);
+        return;
+    }
     JsonDocument responseDoc;
-    responseDoc["message"] = "Termometrul " + mac + " a fost eliminat din camera " + room_name;
-    String response;
-    serializeJson(responseDoc, response);
-    request->send(200, "application/json", response);
+    responseDoc["message"] = "Termometrul " + String(command.mac) + " a fost eliminat din camera " +
+                             String(command.roomName);
+    sendDocument(request, 200, responseDoc);
 }
 
 void handleResetSettings(AsyncWebServerRequest *request) {
-    rooms.clear();
-    saveRooms();
+    StateCommand command{};
+    command.type = StateCommandType::RESET_ROOMS;
+    if (!submitStateCommand(command)) {
+        sendStateBusy(request);
+        return;
+    }
     JsonDocument responseDoc;
     responseDoc["message"] = "Setările au fost resetate la valorile implicite";
-    String response;
-    serializeJson(responseDoc, response);
-    request->send(200, "application/json", response);
+    sendDocument(request, 200, responseDoc);
 }
 
-void handleGetHeatingMode(AsyncWebServerRequest *request) {
+static bool renderHeatingMode(ApiEncoding encoding, std::string &body, uint32_t &version) {
+    HeatingSnapshot snapshot{};
+    if (!readHeatingSnapshot(snapshot, &version)) {
+        return false;
+    }
     JsonDocument doc;
-    doc["mode"] = heatingModeToString(heatingMode);
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    doc["mode"] = heatingModeToString(snapshot.mode);
+    serializeDocument(doc, encoding, body);
+    return true;
+}
+
+void handleGetHeatingMode(AsyncWebServerRequest *request) {
+    if (!sendCachedResponse(request, CachedRoute::HEATING_MODE, heatingSnapshotVersion(), renderHeatingMode)) {
+        sendStateBusy(request);
+    }
 }
 
 void handleSetHeatingMode(AsyncWebServerRequest *request) {
     if (!request->hasParam("mode")) {
-        Serial.println("mode nu este specificat");
+        logEvent(LogModule::API, LogLevel::WARN, LogEvent::API_PARAM_MISSING,
+                 static_cast<int32_t>(LogParam::MODE));
         request->send(400, "application/json", R"({"message":"mode nu este specificat"})");
         return;
     }
     std::string mode = request->getParam("mode")->value().c_str();
-    if (mode == "AUTO") {
-        heatingMode = AUTO;
-    } else if (mode == "MANUAL") {
-        heatingMode = MANUAL;
-    } else {
-        heatingMode = OFF;
+    StateCommand command{};
+    command.type = StateCommandType::SET_HEATING_MODE;
+    command.heating = stringToHeatingMode(mode);
+    if (!submitStateCommand(command)) {
+        sendStateBusy(request);
+        return;
     }
-    saveHeatingMode();
     JsonDocument doc;
     doc["message"] = "Modul de încălzire a fost setat la " + String(mode.c_str());
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    sendDocument(request, 200, doc);
 }
 
-void handleGetManualMode(AsyncWebServerRequest *request) {
+static bool renderManualMode(ApiEncoding encoding, std::string &body, uint32_t &version) {
+    HeatingSnapshot snapshot{};
+    if (!readHeatingSnapshot(snapshot, &version)) {
+        return false;
+    }
     JsonDocument doc;
-    doc["mode"] = manualModeToString(manualMode);
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    doc["mode"] = manualModeToString(snapshot.manual);
+    serializeDocument(doc, encoding, body);
+    return true;
+}
+
+void handleGetManualMode(AsyncWebServerRequest *request) {
+    if (!sendCachedResponse(request, CachedRoute::MANUAL_MODE, heatingSnapshotVersion(), renderManualMode)) {
+        sendStateBusy(request);
+    }
 }
 
 void handleSetManualMode(AsyncWebServerRequest *request) {
     if (!request->hasParam("mode")) {
-        Serial.println("mode nu este specificat");
+        logEvent(LogModule::API, LogLevel::WARN, LogEvent::API_PARAM_MISSING,
+                 static_cast<int32_t>(LogParam::MODE));
         request->send(400, "application/json", R"({"message":"mode nu este specificat"})");
         return;
     }
     std::string mode = request->getParam("mode")->value().c_str();
-    if (mode == "ON") {
-        manualMode = ON_MANUAL;
-    } else {
-        manualMode = OFF_MANUAL;
+    StateCommand command{};
+    command.type = StateCommandType::SET_MANUAL_MODE;
+    command.manual = mode == "ON" ? ON_MANUAL : OFF_MANUAL;
+    if (!submitStateCommand(command)) {
+        sendStateBusy(request);
+        return;
     }
-    saveHeatingMode();
     JsonDocument doc;
     doc["message"] = "Modul manual a fost setat la " + String(mode.c_str());
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    sendDocument(request, 200, doc);
+}
+
+static bool renderHeatingStatus(ApiEncoding encoding, std::string &body, uint32_t &version) {
+    HeatingSnapshot snapshot{};
+    if (!readHeatingSnapshot(snapshot, &version)) {
+        return false;
+    }
+    JsonDocument doc;
+    doc["isHeating"] = snapshot.isHeating;
+    serializeDocument(doc, encoding, body);
+    return true;
 }
 
 void handleGetHeating(AsyncWebServerRequest *request) {
+    if (!sendCachedResponse(request, CachedRoute::HEATING_STATUS, heatingSnapshotVersion(), renderHeatingStatus)) {
+        sendStateBusy(request);
+    }
+}
+
+void handleGetControlLatency(AsyncWebServerRequest *request) {
+    ControlLatencyHistogram histogram = getControlLatencyHistogram();
+    JsonDocument doc;
+    JsonArray buckets = doc["buckets"].to<JsonArray>();
+    for (uint8_t i = 0; i < CONTROL_LATENCY_BUCKETS; i++) {
+        JsonObject bucket = buckets.add<JsonObject>();
+        if (i < CONTROL_LATENCY_BUCKETS - 1) {
+            bucket["le_ms"] = CONTROL_LATENCY_BOUNDS_MS[i];
+        } else {
+            bucket["le_ms"] = "inf";
+        }
+        bucket["count"] = histogram.counts[i];
+    }
+    doc["samples"] = histogram.samples;
+    doc["max_ms"] = histogram.maxMs;
+    doc["last_ms"] = histogram.lastMs;
+    doc["avg_ms"] = histogram.samples ? (uint32_t) (histogram.totalMs / histogram.samples) : 0;
+    sendDocument(request, 200, doc);
+}
+
+void handleGetPersistence(AsyncWebServerRequest *request) {
+    PersistenceStats stats = getPersistenceStats();
     JsonDocument doc;
-    doc["isHeating"] = isHeating;
-    String response;
-    serializeJson(doc, response);
-    request->send(200, "application/json", response);
+    JsonObject domains = doc["domains"].to<JsonObject>();
+    for (uint8_t i = 0; i < PERSIST_DOMAIN_COUNT; i++) {
+        JsonObject domain = domains[persistDomainName(static_cast<PersistDomain>(i))].to<JsonObject>();
+        domain["requested"] = stats.requested[i];
+        domain["written"] = stats.written[i];
+        domain["writes_saved"] = stats.requested[i] > stats.written[i] ? stats.requested[i] - stats.written[i] : 0;
+        domain["bytes_written"] = stats.bytesWritten[i];
+    }
+    doc["failures"] = stats.failures;
+    sendDocument(request, 200, doc);
 }
 
-void handleGetSchedule(AsyncWebServerRequest *request) {
-    Serial.println("handleGetSchedule called");
-    uint32_t start = millis();
+void handleGetResponseCache(AsyncWebServerRequest *request) {
+    JsonDocument doc;
+    JsonObject routes = doc["routes"].to<JsonObject>();
+    for (uint8_t i = 0; i < static_cast<uint8_t>(CachedRoute::COUNT); i++) {
+        auto route = static_cast<CachedRoute>(i);
+        JsonObject routeObj = routes[cachedRouteName(route)].to<JsonObject>();
+        for (uint8_t e = 0; e < static_cast<uint8_t>(ApiEncoding::COUNT); e++) {
+            auto encoding = static_cast<ApiEncoding>(e);
+            ResponseCacheStats stats = getResponseCacheStats(route, encoding);
+            JsonObject encodingObj = routeObj[encoding == ApiEncoding::JSON ? "json" : "msgpack"].to<JsonObject>();
+            uint32_t requests = stats.hits + stats.misses + stats.notModified;
+            encodingObj["hits"] = stats.hits;
+            encodingObj["misses"] = stats.misses;
+            encodingObj["not_modified"] = stats.notModified;
+            encodingObj["hit_rate"] = requests > 0 ? static_cast<float>(requests - stats.misses) / requests : 0.0f;
+            encodingObj["last_render_us"] = stats.lastRenderMicros;
+            encodingObj["saved_us"] = stats.savedMicros;
+            encodingObj["cached_bytes"] = stats.cachedBytes;
+        }
+    }
+    sendDocument(request, 200, doc);
+}
+
+void handleGetSensors(AsyncWebServerRequest *request) {
+    std::unique_ptr<SensorState[]> sensors(new(std::nothrow) SensorState[MAX_REGISTERED_SENSORS]);
+    if (!sensors) {
+        sendStateBusy(request);
+        return;
+    }
+    uint8_t count = sensorRegistry.list(sensors.get(), MAX_REGISTERED_SENSORS);
+    BLEScanStats scanStats = getBLEScanStats();
+    time_t now = time(nullptr);
+    JsonDocument doc;
+    doc["scanning"] = scanStats.scanning;
+    doc["advertisements_seen"] = scanStats.advertisementsSeen;
+    doc["readings_decoded"] = scanStats.readingsDecoded;
+    doc["readings_dropped"] = scanStats.readingsDropped;
+    JsonObject policy = doc["scan_policy"].to<JsonObject>();
+    policy["level"] = scanLevelName(scanStats.level);
+    policy["interval_ms"] = scanStats.parameters.intervalMs;
+    policy["window_ms"] = scanStats.parameters.windowMs;
+    policy["level_changes"] = scanStats.levelChanges;
+    JsonObject timeInLevel = policy["ms_in_level"].to<JsonObject>();
+    for (uint8_t i = 0; i < static_cast<uint8_t>(ScanLevel::COUNT); i++) {
+        timeInLevel[scanLevelName(static_cast<ScanLevel>(i))] = scanStats.msInLevel[i];
+    }
+    JsonArray sensorsArray = doc["sensors"].to<JsonArray>();
+    char mac[MAC_STRING_LEN];
+    for (uint8_t i = 0; i < count; i++) {
+        const SensorState &sensor = sensors[i];
+        formatMacAddress(sensor.mac, mac);
+        JsonObject sensorObj = sensorsArray.add<JsonObject>();
+        sensorObj["mac"] = mac;
+        sensorObj["valid"] = sensor.isFresh(now);
+        sensorObj["readings_per_minute"] = sensor.readingsLastMinute;
+        sensorObj["total_readings"] = sensor.totalReadings;
+        if (sensor.hasReading) {
+            sensorObj["format"] = decoderName(sensor.decoder);
+            sensorObj["age_s"] = now - sensor.lastSeen;
+            sensorObj["temperature"] = sensor.temperature;
+            sensorObj["humidity"] = sensor.humidity;
+            sensorObj["battery_mv"] = sensor.batteryMv;
+            sensorObj["battery_percent"] = sensor.batteryPercent;
+            sensorObj["rssi"] = sensor.rssi;
+        }
+    }
+    sendDocument(request, 200, doc);
+}
 
-    JsonDocument *doc = new JsonDocument();
-    if (!doc) {
-        request->send(500, "application/json", "{\"error\":\"Memory allocation failed\"}");
+void handleDiscoverSensors(AsyncWebServerRequest *request) {
+    std::unique_ptr<DiscoveredSensor[]> sensors(new(std::nothrow) DiscoveredSensor[DISCOVERY_CACHE_SIZE]);
+    if (!sensors) {
+        sendStateBusy(request);
         return;
     }
+    uint8_t count = sensorDiscovery.listBySignal(sensors.get(), DISCOVERY_CACHE_SIZE);
+    uint32_t now = millis();
+    JsonDocument doc;
+    doc["evictions"] = sensorDiscovery.evictionCount();
+    JsonArray sensorsArray = doc["sensors"].to<JsonArray>();
+    char mac[MAC_STRING_LEN];
+    for (uint8_t i = 0; i < count; i++) {
+        const DiscoveredSensor &sensor = sensors[i];
+        // Sensors added to a room after they were cached
+        if (sensorRegistry.contains(sensor.mac)) {
+            continue;
+        }
+        formatMacAddress(sensor.mac, mac);
+        JsonObject sensorObj = sensorsArray.add<JsonObject>();
+        sensorObj["mac"] = mac;
+        sensorObj["format"] = decoderName(sensor.decoder);
+        sensorObj["rssi"] = sensor.rssi;
+        sensorObj["sightings"] = sensor.sightings;
+        sensorObj["age_s"] = (now - sensor.lastSeenMs) / 1000;
+        if (sensor.hasTemperature) {
+            sensorObj["temperature"] = sensor.temperature;
+        }
+    }
+    sendDocument(request, 200, doc);
+}
+
+void handleGetSensorHealth(AsyncWebServerRequest *request) {
+    std::unique_ptr<SensorHealthEntry[]> sensors(new(std::nothrow) SensorHealthEntry[MAX_REGISTERED_SENSORS]);
+    if (!sensors) {
+        sendStateBusy(request);
+        return;
+    }
+    uint8_t count = sensorRegistry.listHealth(sensors.get(), MAX_REGISTERED_SENSORS, millis());
+    JsonDocument doc;
+    JsonArray bounds = doc["gap_bounds_ms"].to<JsonArray>();
+    for (uint32_t bound: HEALTH_GAP_BOUNDS_MS) {
+        bounds.add(bound);
+    }
+    JsonArray sensorsArray = doc["sensors"].to<JsonArray>();
+    char mac[MAC_STRING_LEN];
+    for (uint8_t i = 0; i < count; i++) {
+        const SensorHealthReport &report = sensors[i].report;
+        formatMacAddress(sensors[i].mac, mac);
+        JsonObject sensorObj = sensorsArray.add<JsonObject>();
+        sensorObj["mac"] = mac;
+        sensorObj["readings_per_minute"] = sensors[i].readingsLastMinute;
+        if (!report.hasFrame) {
+            sensorObj["last_frame_ms"] = nullptr;
+            continue;
+        }
+        sensorObj["last_frame_ms"] = report.msSinceLastFrame;
+        sensorObj["rssi_ewma"] = report.rssiEwma;
+        JsonArray gaps = sensorObj["gap_histogram"].to<JsonArray>();
+        for (uint32_t gapCount: report.gapCounts) {
+            gaps.add(gapCount);
+        }
+        if (report.lossRate >= 0) {
+            sensorObj["loss_rate"] = report.lossRate;
+        }
+        if (report.batteryMv > 0) {
+            sensorObj["battery_mv"] = report.batteryMv;
+        }
+        if (report.hasBatteryTrend) {
+            sensorObj["battery_trend_mv_per_day"] = report.batteryTrendMvPerDay;
+        }
+        if (report.daysToEmpty >= 0) {
+            sensorObj["days_to_empty"] = report.daysToEmpty;
+        }
+    }
+    sendDocument(request, 200, doc);
+}
+
+static void addDirectiveJson(JsonObject directiveObj, const directive &entry) {
+    directiveObj["start_time"] = entry.startTime;
+    directiveObj["end_time"] = entry.finalTime;
+    directiveObj["mode"] = modeToString(entry.mode);
+}
+
+// {"days":[...],"user_directives":[...],"smart_directives":[...]} rendered one day or directive per piece
+class ScheduleJsonSource : public JsonChunkSource {
+private:
+    std::unique_ptr<ScheduleSnapshot> snapshot;
+    uint16_t piece = 0;
+
+    static size_t writeDirective(const directive &entry, bool first, char *out, size_t size) {
+        JsonDocument doc;
+        addDirectiveJson(doc.to<JsonObject>(), entry);
+        return writeJsonElement(doc, first, out, size);
+    }
 
-    try {
-        JsonArray scheduleArray = (*doc)["days"].to<JsonArray>();
+public:
+    explicit ScheduleJsonSource(std::unique_ptr<ScheduleSnapshot> schedule) : snapshot(std::move(schedule)) {}
 
-        // Initialize mutex if it doesn't exist
-        if (schedulerMutex == NULL) {
-            Serial.println("Creating scheduler mutex in handleGetSchedule");
-            schedulerMutex = xSemaphoreCreateMutex();
-            if (schedulerMutex == NULL) {
-                Serial.println("Failed to create scheduler mutex");
-                request->send(500, "application/json", "{\"error\":\"Failed to create mutex\"}");
-                delete doc;
-                return;
+    size_t nextPiece(char *out, size_t size) override {
+        const ScheduleSnapshot &schedule = *snapshot;
+        uint16_t current = piece++;
+        if (current == 0) {
+            return writeJsonLiteral(out, size, "{\"days\":[");
+        }
+        current -= 1;
+        if (current < 7) {
+            JsonDocument doc;
+            JsonArray dayArray = doc["hours"].to<JsonArray>();
+            for (int j = 0; j < 48; j++) {
+                dayArray.add(modeToString((themperature_modes) schedule.slots[current][j]));
             }
+            return writeJsonElement(doc, current == 0, out, size);
+        }
+        current -= 7;
+        if (current == 0) {
+            return writeJsonLiteral(out, size, "],\"user_directives\":[");
+        }
+        current -= 1;
+        if (current < schedule.userDirectiveCount) {
+            return writeDirective(schedule.userDirectives[current], current == 0, out, size);
+        }
+        current -= schedule.userDirectiveCount;
+        if (current == 0) {
+            return writeJsonLiteral(out, size, "],\"smart_directives\":[");
         }
+        current -= 1;
+        if (current < schedule.smartDirectiveCount) {
+            return writeDirective(schedule.smartDirectives[current], current == 0, out, size);
+        }
+        current -= schedule.smartDirectiveCount;
+        if (current == 0) {
+            return writeJsonLiteral(out, size, "]}");
+        }
+        return 0;
+    }
+};
 
-        if (xSemaphoreTake(schedulerMutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-            for (int i = 0; i < 7; i++) {
-                JsonObject dayObj = scheduleArray.add<JsonObject>();
-                JsonArray dayArray = dayObj["hours"].to<JsonArray>();
-                for (int j = 0; j < 48; j++) {
-                    switch (scheduler.getScheduleAtTime(i, j)) {
-                        case HOME:
-                            dayArray.add("HOME");
-                            break;
-                        case AWAY:
-                            dayArray.add("AWAY");
-                            break;
-                        case NIGHT:
-                            dayArray.add("NIGHT");
-                            break;
-                        default:
-                            dayArray.add("ANTIFREEZE");
-                            break;
-                    }
+// Binary clients get each day as an array of mode numbers indexing "modes" instead of 48 mode names,
+// {"modes":[...],"days":[[...]],"user_directives":[...],"smart_directives":[...]} one day or directive per piece
+class PackedScheduleSource : public JsonChunkSource {
+private:
+    std::unique_ptr<ScheduleSnapshot> snapshot;
+    uint16_t piece = 0;
+
+    static size_t writeDirective(const directive &entry, char *out, size_t size) {
+        JsonDocument doc;
+        addDirectiveJson(doc.to<JsonObject>(), entry);
+        return writeMsgPackElement(doc, out, size);
+    }
+
+public:
+    explicit PackedScheduleSource(std::unique_ptr<ScheduleSnapshot> schedule) : snapshot(std::move(schedule)) {}
+
+    size_t nextPiece(char *out, size_t size) override {
+        const ScheduleSnapshot &schedule = *snapshot;
+        uint16_t current = piece++;
+        switch (current) {
+            case 0:
+                return writeMsgPackMapHeader(out, size, 4);
+            case 1:
+                return writeMsgPackKey(out, size, "modes");
+            case 2: {
+                JsonDocument doc;
+                JsonArray modes = doc.to<JsonArray>();
+                for (uint8_t mode = HOME; mode <= ANTIFREEZE; mode++) {
+                    modes.add(modeToString(static_cast<themperature_modes>(mode)));
                 }
+                return writeMsgPackElement(doc, out, size);
             }
-            xSemaphoreGive(schedulerMutex);
-        } else {
-            Serial.println("Failed to take scheduler mutex in handleGetSchedule");
-        }
-
-        JsonArray userDirectivesArray = (*doc)["user_directives"].to<JsonArray>();
-        for (auto &user_directive: scheduler.getUserDirectives()) {
-            JsonObject directiveObj = userDirectivesArray.add<JsonObject>();
-            directiveObj["start_time"] = user_directive.startTime;
-            directiveObj["end_time"] = user_directive.finalTime;
-            switch (user_directive.mode) {
-                case HOME:
-                    directiveObj["mode"] = "HOME";
-                    break;
-                case AWAY:
-                    directiveObj["mode"] = "AWAY";
-                    break;
-                case NIGHT:
-                    directiveObj["mode"] = "NIGHT";
-                    break;
-                default:
-                    directiveObj["mode"] = "ANTIFREEZE";
-                    break;
+            case 3:
+                return writeMsgPackKey(out, size, "days", 7);
+            default:
+                break;
+        }
+        current -= 4;
+        if (current < 7) {
+            JsonDocument doc;
+            JsonArray slots = doc.to<JsonArray>();
+            for (uint8_t slot = 0; slot < 48; slot++) {
+                slots.add(schedule.slots[current][slot]);
             }
+            return writeMsgPackElement(doc, out, size);
         }
+        current -= 7;
+        if (current == 0) {
+            return writeMsgPackKey(out, size, "user_directives", schedule.userDirectiveCount);
+        }
+        current -= 1;
+        if (current < schedule.userDirectiveCount) {
+            return writeDirective(schedule.userDirectives[current], out, size);
+        }
+        current -= schedule.userDirectiveCount;
+        if (current == 0) {
+            return writeMsgPackKey(out, size, "smart_directives", schedule.smartDirectiveCount);
+        }
+        current -= 1;
+        if (current < schedule.smartDirectiveCount) {
+            return writeDirective(schedule.smartDirectives[current], out, size);
+        }
+        return 0;
+    }
+};
+
+static std::unique_ptr<JsonChunkSource> makeScheduleSource(ApiEncoding encoding, uint32_t &version) {
+    auto snapshot = loadScheduleSnapshot(&version);
+    if (!snapshot) {
+        return nullptr;
+    }
+    if (encoding == ApiEncoding::MSGPACK) {
+        return std::unique_ptr<JsonChunkSource>(new(std::nothrow) PackedScheduleSource(std::move(snapshot)));
+    }
+    return std::unique_ptr<JsonChunkSource>(new(std::nothrow) ScheduleJsonSource(std::move(snapshot)));
+}
 
-        JsonArray smartDirectivesArray = (*doc)["smart_directives"].to<JsonArray>();
-        for (auto &smart_directive: scheduler.getSmartDirectives()) {
-            JsonObject directiveObj = smartDirectivesArray.add<JsonObject>();
-            directiveObj["start_time"] = smart_directive.startTime;
-            directiveObj["end_time"] = smart_directive.finalTime;
-            switch (smart_directive.mode) {
-                case HOME:
-                    directiveObj["mode"] = "HOME";
-                    break;
-                case AWAY:
-                    directiveObj["mode"] = "AWAY";
-                    break;
-                case NIGHT:
-                    directiveObj["mode"] = "NIGHT";
-                    break;
-                default:
-                    directiveObj["mode"] = "ANTIFREEZE";
-                    break;
+void handleGetSchedule(AsyncWebServerRequest *request) {
+    if (!sendCachedStream(request, CachedRoute::SCHEDULE, scheduleSnapshotVersion(), makeScheduleSource)) {
+        sendStateBusy(request);
+    }
+}
+
+// Current values of the entities in a change set, rooms that no longer exist are listed by name only
+static bool addChangesJson(JsonDocument &doc, const ChangeSet &changes) {
+    bool wantsRooms = false, wantsHeating = false, wantsSchedule = false;
+    for (uint8_t i = 0; i < changes.count; i++) {
+        ChangeKind kind = changes.entries[i].kind;
+        wantsRooms |= kind == ChangeKind::ROOM || kind == ChangeKind::ROOM_REMOVED || kind == ChangeKind::ROOM_MODE;
+        wantsHeating |= kind == ChangeKind::HEATING;
+        wantsSchedule |= kind == ChangeKind::SCHEDULE_DAY || kind == ChangeKind::DIRECTIVES;
+    }
+    std::unique_ptr<RoomsSnapshot> rooms = wantsRooms ? loadRoomsSnapshot() : nullptr;
+    std::unique_ptr<ScheduleSnapshot> schedule = wantsSchedule ? loadScheduleSnapshot() : nullptr;
+    HeatingSnapshot heating{};
+    if ((wantsRooms && !rooms) || (wantsSchedule && !schedule) || (wantsHeating && !readHeatingSnapshot(heating))) {
+        return false;
+    }
+    for (uint8_t i = 0; i < changes.count; i++) {
+        const ChangeEntry &entry = changes.entries[i];
+        switch (entry.kind) {
+            case ChangeKind::ROOM:
+            case ChangeKind::ROOM_REMOVED: {
+                const RoomSnapshot *room = findRoomSnapshot(*rooms, entry.roomName);
+                if (room != nullptr) {
+                    addRoomJson(doc["rooms"].add<JsonObject>(), *room, rooms->mode);
+                } else {
+                    doc["removed_rooms"].add(entry.roomName);
+                }
+                break;
+            }
+            case ChangeKind::ROOM_MODE:
+                doc["room_mode"] = modeToString(rooms->mode);
+                break;
+            case ChangeKind::HEATING:
+                doc["heating"]["mode"] = heatingModeToString(heating.mode);
+                doc["heating"]["manual"] = manualModeToString(heating.manual);
+                doc["heating"]["isHeating"] = heating.isHeating;
+                break;
+            case ChangeKind::SCHEDULE_DAY: {
+                JsonObject dayObj = doc["days"].add<JsonObject>();
+                dayObj["day"] = entry.day;
+                JsonArray hours = dayObj["hours"].to<JsonArray>();
+                for (uint8_t slot = 0; slot < 48; slot++) {
+                    hours.add(modeToString(static_cast<themperature_modes>(schedule->slots[entry.day][slot])));
+                }
+                break;
+            }
+            case ChangeKind::DIRECTIVES: {
+                JsonArray userDirectives = doc["user_directives"].to<JsonArray>();
+                for (uint8_t d = 0; d < schedule->userDirectiveCount; d++) {
+                    addDirectiveJson(userDirectives.add<JsonObject>(), schedule->userDirectives[d]);
+                }
+                JsonArray smartDirectives = doc["smart_directives"].to<JsonArray>();
+                for (uint8_t d = 0; d < schedule->smartDirectiveCount; d++) {
+                    addDirectiveJson(smartDirectives.add<JsonObject>(), schedule->smartDirectives[d]);
+                }
+                break;
             }
         }
+    }
+    return true;
+}
 
-        String response;
-        serializeJson(*doc, response);
-        request->send(200, "application/json", response);
+void handleGetChanges(AsyncWebServerRequest *request) {
+    std::unique_ptr<ChangeSet> changes(new(std::nothrow) ChangeSet);
+    if (!changes) {
+        sendStateBusy(request);
+        return;
+    }
+    bool hasSince = request->hasParam("since");
+    uint32_t since = hasSince ? strtoul(request->getParam("since")->value().c_str(), nullptr, 10) : 0;
+    readChangesSince(since, *changes);
+    // Versions restart with every boot, a cursor from before a reboot means nothing
+    bool otherBoot = request->hasParam("boot") &&
+                     strtoul(request->getParam("boot")->value().c_str(), nullptr, 10) != cacheBootId();
 
-        delete doc;
-        Serial.println("handleGetSchedule completed in " + String(millis() - start) + "ms");
-    } catch (const std::exception &e) {
-        if (doc) delete doc;
-        Serial.printf("Exception in handleGetSchedule: %s\n", e.what());
-        request->send(500, "application/json", "{\"error\":\"Internal server error\"}");
-    } catch (...) {
-        if (doc) delete doc;
-        Serial.println("Unknown error in handleGetSchedule");
-        request->send(500, "application/json", "{\"error\":\"Internal server error\"}");
+    JsonDocument doc;
+    doc["version"] = changes->version;
+    doc["boot"] = cacheBootId();
+    if (!hasSince || otherBoot || changes->resync) {
+        doc["resync"] = true;
+        sendDocument(request, 200, doc);
+        return;
     }
+    if (!addChangesJson(doc, *changes)) {
+        sendStateBusy(request);
+        return;
+    }
+    sendDocument(request, 200, doc);
 }
 
 void handleSetScheduleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+    size_t bodyLength = 0;
+    const char *body = collectRequestBody(request, data, len, index, total, SCHEDULE_BODY_LIMIT, bodyLength);
+    if (body == nullptr) {
+        return;
+    }
     uint32_t start = millis();
-    String body = String((char *) data, len);
     JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, body);
+    DeserializationError error = deserializeJson(doc, body, bodyLength);
     if (error) {
-        Serial.print("Eroare la parsarea JSON: ");
-        Serial.println(error.c_str());
+        logEvent(LogModule::API, LogLevel::WARN, LogEvent::API_JSON_INVALID, error.code());
         request->send(400, "application/json", R"({"message":"JSON invalid"})");
         return;
     }
@@ -505,45 +1069,236 @@ void handleSetScheduleBody(AsyncWebServerRequest *request, uint8_t *data, size_t
     }
     int day = doc["day"].as<int>();
     int hour = doc["hour"].as<int>();
-    std::string mode = doc["mode"].as<const char *>();
-    themperature_modes modeEnum;
-    if (mode == "HOME") {
-        modeEnum = HOME;
-    } else if (mode == "AWAY") {
-        modeEnum = AWAY;
-    } else if (mode == "NIGHT") {
-        modeEnum = NIGHT;
-    } else {
-        modeEnum = ANTIFREEZE;
+    if (day < 0 || day >= 7 || hour < 0 || hour >= 48) {
+        request->send(400, "application/json", R"({"message":"day sau hour în afara intervalului"})");
+        return;
+    }
+    StateCommand command{};
+    command.type = StateCommandType::SET_SCHEDULE_SLOT;
+    command.day = day;
+    command.slot = hour;
+    command.scheduleMode = stringToMode(doc["mode"].as<const char *>());
+    if (!submitStateCommand(command)) {
+        sendStateBusy(request);
+        return;
     }
 
-    // Initialize mutex if it doesn't exist
-    if (schedulerMutex == NULL) {
-        Serial.println("Creating scheduler mutex in handleSetScheduleBody");
-        schedulerMutex = xSemaphoreCreateMutex();
-        if (schedulerMutex == NULL) {
-            Serial.println("Failed to create scheduler mutex");
-            request->send(500, "application/json", "{\"error\":\"Failed to create mutex\"}");
-            return;
+    JsonDocument responseDoc;
+    responseDoc["message"] = "Programul a fost actualizat";
+    sendDocument(request, 200, responseDoc);
+
+    logEvent(LogModule::API, LogLevel::INFO, LogEvent::API_SCHEDULE_SET, millis() - start);
+}
+
+static bool readScheduleMode(const char *name, themperature_modes &mode) {
+    for (uint8_t value = HOME; value <= ANTIFREEZE; value++) {
+        if (modeToString(static_cast<themperature_modes>(value)) == name) {
+            mode = static_cast<themperature_modes>(value);
+            return true;
         }
     }
+    return false;
+}
 
-    if (xSemaphoreTake(schedulerMutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-        scheduler.setScheduleAtTime(day, hour, modeEnum);
-        xSemaphoreGive(schedulerMutex);
-    } else {
-        Serial.println("Failed to take scheduler mutex in handleSetScheduleBody");
-        request->send(503, "application/json", R"({"message":"Scheduler busy, try again"})");
+// {"ranges":[{"day":0,"from":12,"to":17,"mode":"HOME"},...]}, from and to are slots, to included
+void handlePatchScheduleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+    size_t bodyLength = 0;
+    const char *body = collectRequestBody(request, data, len, index, total, SCHEDULE_RANGES_BODY_LIMIT, bodyLength);
+    if (body == nullptr) {
         return;
     }
-
-    saveSchedule();
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, body, bodyLength);
+    if (error) {
+        request->send(400, "application/json", R"({"message":"JSON invalid"})");
+        return;
+    }
+    JsonArrayConst rangesArray = doc["ranges"].as<JsonArrayConst>();
+    if (rangesArray.isNull() || rangesArray.size() == 0 || rangesArray.size() > MAX_SCHEDULE_RANGES) {
+        request->send(400, "application/json", R"({"message":"ranges trebuie să conțină între 1 și 64 de intervale"})");
+        return;
+    }
+    std::unique_ptr<ScheduleRanges> ranges(new(std::nothrow) ScheduleRanges);
+    if (!ranges) {
+        sendStateBusy(request);
+        return;
+    }
+    ranges->count = 0;
+    for (JsonObjectConst rangeObj: rangesArray) {
+        int day = rangeObj["day"] | -1;
+        int from = rangeObj["from"] | -1;
+        int to = rangeObj["to"] | -1;
+        ScheduleRange &range = ranges->ranges[ranges->count];
+        if (day < 0 || day >= 7 || from < 0 || to < from || to >= 48 ||
+            !readScheduleMode(rangeObj["mode"] | "", range.mode)) {
+            JsonDocument responseDoc;
+            responseDoc["message"] = "Interval invalid, nicio modificare nu a fost aplicată";
+            responseDoc["index"] = ranges->count;
+            sendDocument(request, 400, responseDoc);
+            return;
+        }
+        range.day = day;
+        range.fromSlot = from;
+        range.toSlot = to;
+        ranges->count++;
+    }
+    // The owning task frees the ranges as soon as they are queued
+    uint8_t count = ranges->count;
+    if (!submitScheduleRanges(ranges.get())) {
+        sendStateBusy(request);
+        return;
+    }
+    ranges.release();
 
     JsonDocument responseDoc;
     responseDoc["message"] = "Programul a fost actualizat";
-    String response;
-    serializeJson(responseDoc, response);
-    request->send(200, "application/json", response);
+    responseDoc["ranges"] = count;
+    sendDocument(request, 200, responseDoc);
+}
+
+// Fills command from one batch operation and checks it against the rooms snapshot as the operations before it
+// will leave it. Returns the status the operation would get as a separate request, message says why.
+static int readBatchOperation(JsonObjectConst operation, const RoomsSnapshot &rooms, const StateBatch &batch,
+                              StateCommand &command, const char *&message) {
+    const char *op = operation["op"] | "";
+    message = "OK";
+    if (strcmp(op, "set_heating_mode") == 0 || strcmp(op, "set_manual_mode") == 0) {
+        if (!operation["mode"].is<const char *>()) {
+            message = "mode nu este specificat";
+            return 400;
+        }
+        std::string mode = operation["mode"].as<const char *>();
+        if (strcmp(op, "set_heating_mode") == 0) {
+            command.type = StateCommandType::SET_HEATING_MODE;
+            command.heating = stringToHeatingMode(mode);
+        } else {
+            command.type = StateCommandType::SET_MANUAL_MODE;
+            command.manual = mode == "ON" ? ON_MANUAL : OFF_MANUAL;
+        }
+        return 200;
+    }
+    if (strcmp(op, "set_schedule_slot") == 0) {
+        if (!operation["day"].is<int>() || !operation["hour"].is<int>() || !operation["mode"].is<const char *>()) {
+            message = "day, hour și mode sunt obligatorii";
+            return 400;
+        }
+        int day = operation["day"].as<int>();
+        int hour = operation["hour"].as<int>();
+        if (day < 0 || day >= 7 || hour < 0 || hour >= 48) {
+            message = "day sau hour în afara intervalului";
+            return 400;
+        }
+        command.type = StateCommandType::SET_SCHEDULE_SLOT;
+        command.day = day;
+        command.slot = hour;
+        command.scheduleMode = stringToMode(operation["mode"].as<const char *>());
+        return 200;
+    }
+
+    // Everything else targets a room
+    if (strcmp(op, "update_room") == 0) {
+        command.type = StateCommandType::UPDATE_ROOM;
+    } else if (strcmp(op, "add_thermometer") == 0) {
+        command.type = StateCommandType::ADD_THERMOMETER;
+    } else if (strcmp(op, "remove_thermometer") == 0) {
+        command.type = StateCommandType::REMOVE_THERMOMETER;
+    } else {
+        message = "op necunoscut";
+        return 400;
+    }
+    if (!operation["room_name"].is<const char *>()) {
+        message = "room_name este obligatoriu";
+        return 400;
+    }
+    if (!copyStateString(command.roomName, sizeof(command.roomName), operation["room_name"].as<const char *>())) {
+        message = "room_name este prea lung";
+        return 400;
+    }
+    const RoomSnapshot *room = findRoomSnapshot(rooms, command.roomName);
+    if (room == nullptr) {
+        message = "Camera nu a fost găsită";
+        return 404;
+    }
+    if (command.type == StateCommandType::UPDATE_ROOM) {
+        readRoomSettings(operation, command.settings);
+        return 200;
+    }
+    uint8_t address[6];
+    if (!operation["mac"].is<const char *>() || !parseMacAddress(operation["mac"].as<const char *>(), address)) {
+        message = "mac invalid";
+        return 400;
+    }
+    formatMacAddress(address, command.mac);
+    uint8_t index = batch.count;
+    bool present = batchThermometerPresent(batch, index, command.roomName, command.mac,
+                                           roomSnapshotHasThermometer(*room, command.mac));
+    if (command.type == StateCommandType::REMOVE_THERMOMETER) {
+        if (!present) {
+            message = "Termometrul nu există în cameră";
+            return 404;
+        }
+        return 200;
+    }
+    if (present) {
+        message = "Termometrul deja există în cameră";
+        return 400;
+    }
+    if (batchThermometerCount(batch, index, command.roomName, room->thermometerCount) >= MAX_ROOM_THERMOMETERS) {
+        message = "Numărul maxim de termometre a fost atins";
+        return 400;
+    }
+    return 200;
+}
 
-    Serial.println("handleSetScheduleBody completed in " + String(millis() - start) + "ms");
+void handleBatchBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+    size_t bodyLength = 0;
+    const char *body = collectRequestBody(request, data, len, index, total, BATCH_BODY_LIMIT, bodyLength);
+    if (body == nullptr) {
+        return;
+    }
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, body, bodyLength);
+    if (error) {
+        logEvent(LogModule::API, LogLevel::WARN, LogEvent::API_JSON_INVALID, error.code());
+        request->send(400, "application/json", R"({"message":"JSON invalid"})");
+        return;
+    }
+    JsonArrayConst operations = doc["operations"];
+    if (operations.isNull() || operations.size() == 0 || operations.size() > MAX_BATCH_OPERATIONS) {
+        request->send(400, "application/json", R"({"message":"operations trebuie să conțină între 1 și 16 operații"})");
+        return;
+    }
+    auto snapshot = loadRoomsSnapshot();
+    std::unique_ptr<StateBatch> batch(new(std::nothrow) StateBatch{});
+    if (!snapshot || !batch) {
+        sendStateBusy(request);
+        return;
+    }
+
+    JsonDocument responseDoc;
+    JsonArray results = responseDoc["results"].to<JsonArray>();
+    bool valid = true;
+    for (JsonObjectConst operation: operations) {
+        StateCommand &command = batch->operations[batch->count];
+        const char *message = nullptr;
+        int status = readBatchOperation(operation, *snapshot, *batch, command, message);
+        batch->count++;
+        JsonObject result = results.add<JsonObject>();
+        result["status"] = status;
+        result["message"] = message;
+        valid = valid && status == 200;
+    }
+    if (!valid) {
+        responseDoc["message"] = "Nicio operație nu a fost aplicată";
+        sendDocument(request, 400, responseDoc);
+        return;
+    }
+    if (!submitStateBatch(batch.get())) {
+        sendStateBusy(request);
+        return;
+    }
+    // The owning task frees it now
+    batch.release();
+    responseDoc["message"] = "Operațiile au fost aplicate";
+    sendDocument(request, 200, responseDoc);
 }
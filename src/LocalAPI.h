@@ -34,11 +34,27 @@ void handleSetHeatingMode(AsyncWebServerRequest *request);
 void handleGetManualMode(AsyncWebServerRequest *request);
 void handleSetManualMode(AsyncWebServerRequest *request);
 void handleGetHeating(AsyncWebServerRequest *request);
+void handleGetControlLatency(AsyncWebServerRequest *request);
+void handleGetPersistence(AsyncWebServerRequest *request);
+void handleGetResponseCache(AsyncWebServerRequest *request);
+void handleGetChanges(AsyncWebServerRequest *request);
+void handleGetSensors(AsyncWebServerRequest *request);
+void handleDiscoverSensors(AsyncWebServerRequest *request);
+void handleGetSensorHealth(AsyncWebServerRequest *request);
 void handleGetSchedule(AsyncWebServerRequest *request);
 void handleSetScheduleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handlePatchScheduleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handleBatchBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
 
-Room *findRoomByName(const std::string &room_name);
 std::string modeToString(themperature_modes mode);
 themperature_modes stringToMode(const std::string &modeStr);
+std::string heatingModeToString(enum heatingMode mode);
+std::string manualModeToString(enum manualMode mode);
+enum heatingMode stringToHeatingMode(const std::string &modeStr);
+
+struct RoomsSnapshot;
+
+// Same room objects as GET /api/rooms, shared with the live event stream
+void addRoomsJson(JsonArray roomsArray, const RoomsSnapshot &snapshot);
 
 #endif // ESP32_TERMOSTAT_LOCALAPI_H
@@ -0,0 +1,380 @@
+#include "Metrics.h"
+#include <Arduino.h>
+#include <cstring>
+#include <memory>
+#include "globalSettings.h"
+#include "BLEConnection.h"
+#include "SaveLoad.h"
+#include "SystemState.h"
+#include "ChunkedJson.h"
+#include "RouteStats.h"
+#include "Admission.h"
+#include "EventLog.h"
+
+struct MetricEntry {
+    const char *name;
+    const char *help;
+    MetricType type;
+    const void *metric;         ///< MetricCounter, MetricGauge or MetricHistogram, unused when sampled.
+    MetricSampler sampler;
+    uintptr_t argument;
+    const char *labelNames[2];
+    const char *labelValues[2];
+};
+
+MetricCounter relayCyclesMetric;
+MetricGauge relayOnMetric;
+MetricHistogram controlLoopMetric;
+
+// Filled by setup() and the web server task before the server starts, read by /metrics afterwards
+static MetricEntry metrics[MAX_METRICS];
+static std::atomic<uint8_t> metricCount{0};
+
+static bool addMetric(const MetricEntry &entry) {
+    uint8_t count = metricCount.load(std::memory_order_relaxed);
+    if (count >= MAX_METRICS) {
+        logEvent(LogModule::SYSTEM, LogLevel::WARN, LogEvent::METRIC_REGISTRY_FULL, count);
+        return false;
+    }
+    metrics[count] = entry;
+    metricCount.store(count + 1, std::memory_order_release);
+    return true;
+}
+
+bool registerCounter(const char *name, const char *help, const MetricCounter &counter,
+                     const char *labelName, const char *labelValue) {
+    return addMetric({name, help, MetricType::COUNTER, &counter, nullptr, 0, {labelName, nullptr},
+                      {labelValue, nullptr}});
+}
+
+bool registerGauge(const char *name, const char *help, const MetricGauge &gauge,
+                   const char *labelName, const char *labelValue) {
+    return addMetric({name, help, MetricType::GAUGE, &gauge, nullptr, 0, {labelName, nullptr},
+                      {labelValue, nullptr}});
+}
+
+bool registerHistogram(const char *name, const char *help, const MetricHistogram &histogram,
+                       const char *labelName, const char *labelValue,
+                       const char *labelName2, const char *labelValue2) {
+    return addMetric({name, help, MetricType::HISTOGRAM, &histogram, nullptr, 0, {labelName, labelName2},
+                      {labelValue, labelValue2}});
+}
+
+bool registerSampled(const char *name, const char *help, MetricType type, MetricSampler sampler,
+                     uintptr_t argument, const char *labelName, const char *labelValue) {
+    return addMetric({name, help, type, nullptr, sampler, argument, {labelName, nullptr}, {labelValue, nullptr}});
+}
+
+static uint32_t sampleStackFree(uintptr_t argument) {
+    TaskHandle_t task = *reinterpret_cast<TaskHandle_t *>(argument);
+    return task != NULL ? uxTaskGetStackHighWaterMark(task) : 0;
+}
+
+static uint32_t sampleFlashBytes(uintptr_t argument) {
+    return getPersistenceStats().bytesWritten[argument];
+}
+
+static uint32_t sampleFlashWrites(uintptr_t argument) {
+    return getPersistenceStats().written[argument];
+}
+
+void initMetrics() {
+    registerSampled("thermostat_heap_free_bytes", "Free internal heap", MetricType::GAUGE,
+                    [](uintptr_t) -> uint32_t { return ESP.getFreeHeap(); });
+    registerSampled("thermostat_heap_min_free_bytes", "Lowest free heap since boot", MetricType::GAUGE,
+                    [](uintptr_t) -> uint32_t { return ESP.getMinFreeHeap(); });
+    registerSampled("thermostat_heap_largest_free_block_bytes", "Largest block malloc can still return",
+                    MetricType::GAUGE, [](uintptr_t) -> uint32_t { return ESP.getMaxAllocHeap(); });
+    registerSampled("thermostat_psram_size_bytes", "PSRAM size, 0 without PSRAM", MetricType::GAUGE,
+                    [](uintptr_t) -> uint32_t { return ESP.getPsramSize(); });
+    registerSampled("thermostat_psram_used_bytes", "PSRAM in use", MetricType::GAUGE,
+                    [](uintptr_t) -> uint32_t { return ESP.getPsramSize() - ESP.getFreePsram(); });
+    const char *stackHelp = "Smallest amount of stack the task ever had left";
+    registerSampled("thermostat_task_stack_free_min_bytes", stackHelp, MetricType::GAUGE, sampleStackFree,
+                    reinterpret_cast<uintptr_t>(&relayTaskHandle), "task", "relay");
+    registerSampled("thermostat_task_stack_free_min_bytes", stackHelp, MetricType::GAUGE, sampleStackFree,
+                    reinterpret_cast<uintptr_t>(&bleTaskHandle), "task", "ble");
+    registerSampled("thermostat_task_stack_free_min_bytes", stackHelp, MetricType::GAUGE, sampleStackFree,
+                    reinterpret_cast<uintptr_t>(&webServerTaskHandle), "task", "web");
+    registerSampled("thermostat_ble_advertisements_total", "Advertisements delivered by the scan",
+                    MetricType::COUNTER, [](uintptr_t) -> uint32_t { return getBLEScanStats().advertisementsSeen; });
+    registerSampled("thermostat_ble_readings_dropped_total", "Readings lost because the ring was full",
+                    MetricType::COUNTER, [](uintptr_t) -> uint32_t { return getBLEScanStats().readingsDropped; });
+    registerCounter("thermostat_http_rejected_total", "API requests turned away", rateLimitedMetric,
+                    "reason", "rate_limited");
+    registerCounter("thermostat_http_rejected_total", "API requests turned away", overloadedMetric,
+                    "reason", "overloaded");
+    registerCounter("thermostat_http_shared_bucket_total", "API requests of clients past the tracked ones",
+                    sharedBucketMetric);
+    registerCounter("thermostat_relay_cycles_total", "Times the relay switched the heating on", relayCyclesMetric);
+    registerGauge("thermostat_relay_on", "1 while the heating is on", relayOnMetric);
+    registerHistogram("thermostat_control_loop_duration_microseconds", "One pass of the relay task",
+                      controlLoopMetric);
+    for (uint8_t i = 0; i < PERSIST_DOMAIN_COUNT; i++) {
+        registerSampled("thermostat_flash_written_bytes_total", "Bytes written to flash per file",
+                        MetricType::COUNTER, sampleFlashBytes, i, "file",
+                        persistDomainName(static_cast<PersistDomain>(i)));
+    }
+    for (uint8_t i = 0; i < PERSIST_DOMAIN_COUNT; i++) {
+        registerSampled("thermostat_flash_writes_total", "File rewrites per file", MetricType::COUNTER,
+                        sampleFlashWrites, i, "file", persistDomainName(static_cast<PersistDomain>(i)));
+    }
+}
+
+static const char *typeName(MetricType type) {
+    switch (type) {
+        case MetricType::COUNTER:
+            return "counter";
+        case MetricType::GAUGE:
+            return "gauge";
+        default:
+            return "histogram";
+    }
+}
+
+// {name="value",...} including le when given, nothing when there are no labels at all
+static int formatLabels(char *out, size_t size, const char *const names[2], const char *const values[2],
+                        const char *le = nullptr) {
+    int length = 0;
+    for (uint8_t i = 0; i < 2 && names[i] != nullptr; i++) {
+        length += snprintf(out + length, length < (int) size ? size - length : 0, "%s%s=\"%s\"",
+                           length == 0 ? "{" : ",", names[i], values[i]);
+    }
+    if (le != nullptr) {
+        length += snprintf(out + length, length < (int) size ? size - length : 0, "%sle=\"%s\"",
+                           length == 0 ? "{" : ",", le);
+    }
+    if (length > 0) {
+        length += snprintf(out + length, length < (int) size ? size - length : 0, "}");
+    }
+    return length;
+}
+
+// Per-route families rendered from RouteStats after the registry, see RouteStats.h
+enum class RouteFamily : uint8_t {
+    HANDLER,
+    RESPONSE_START,
+    RESPONSE_BYTES,
+    IN_FLIGHT,
+    HEAP_HELD,
+    COUNT
+};
+
+static const char *routeFamilyName(RouteFamily family) {
+    switch (family) {
+        case RouteFamily::HANDLER:
+            return "thermostat_http_handler_duration_microseconds";
+        case RouteFamily::RESPONSE_START:
+            return "thermostat_http_response_start_microseconds";
+        case RouteFamily::RESPONSE_BYTES:
+            return "thermostat_http_response_bytes";
+        case RouteFamily::IN_FLIGHT:
+            return "thermostat_http_requests_in_flight";
+        default:
+            return "thermostat_http_handler_heap_held_max_bytes";
+    }
+}
+
+static const char *routeFamilyHelp(RouteFamily family) {
+    switch (family) {
+        case RouteFamily::HANDLER:
+            return "Synchronous part of the request handler";
+        case RouteFamily::RESPONSE_START:
+            return "Headers parsed until the response was handed to the server";
+        case RouteFamily::RESPONSE_BYTES:
+            return "Response body bytes sent through the API send helpers";
+        case RouteFamily::IN_FLIGHT:
+            return "Requests whose handler ran and whose connection is still open";
+        default:
+            return "Largest drop of free heap across the handler, held by the response until it is sent";
+    }
+}
+
+static const MetricHistogram &routeFamilyHistogram(const RouteStats &route, RouteFamily family) {
+    switch (family) {
+        case RouteFamily::HANDLER:
+            return route.handlerMicros;
+        case RouteFamily::RESPONSE_START:
+            return route.responseStartMicros;
+        default:
+            return route.responseBytes;
+    }
+}
+
+/**
+ * @class MetricsTextSource
+ * @brief Renders the registry, the readings of every registered sensor and the per-route families,
+ * one sample line per piece.
+ */
+class MetricsTextSource : public JsonChunkSource {
+private:
+    uint8_t entryCount;
+    uint8_t entry = 0;
+    uint8_t line = 0;
+    // Histogram copied when its first line is written so the buckets, sum and count agree
+    uint32_t counts[METRIC_MAX_BOUNDS + 1]{};
+    uint32_t sum = 0;
+    std::unique_ptr<SensorState[]> sensors;
+    uint8_t sensorCount = 0;
+    uint8_t sensor = 0;
+    uint8_t routeCount;
+    uint8_t family = 0;
+    uint8_t route = 0;
+
+    int writeHistogramLine(const char *name, const char *const labelNames[2], const char *const labelValues[2],
+                           const MetricHistogram &histogram, char *out, size_t size, bool &done) {
+        uint8_t boundCount = histogram.getBoundCount();
+        if (line == 0) {
+            sum = histogram.getSum();
+            for (uint8_t i = 0; i <= boundCount; i++) {
+                counts[i] = histogram.getCount(i);
+            }
+        }
+        uint32_t total = 0;
+        for (uint8_t i = 0; i <= boundCount; i++) {
+            total += counts[i];
+        }
+        char labels[128];
+        if (line <= boundCount) {
+            uint32_t cumulative = 0;
+            for (uint8_t i = 0; i <= line; i++) {
+                cumulative += counts[i];
+            }
+            char le[12];
+            if (line < boundCount) {
+                snprintf(le, sizeof(le), "%lu", static_cast<unsigned long>(histogram.getBound(line)));
+            } else {
+                strcpy(le, "+Inf");
+            }
+            formatLabels(labels, sizeof(labels), labelNames, labelValues, le);
+            return snprintf(out, size, "%s_bucket%s %lu\n", name, labels, static_cast<unsigned long>(cumulative));
+        }
+        formatLabels(labels, sizeof(labels), labelNames, labelValues);
+        if (line == boundCount + 1) {
+            return snprintf(out, size, "%s_sum%s %lu\n", name, labels, static_cast<unsigned long>(sum));
+        }
+        done = true;
+        return snprintf(out, size, "%s_count%s %lu\n", name, labels, static_cast<unsigned long>(total));
+    }
+
+    int writeEntryLine(const MetricEntry &metric, char *out, size_t size, bool &done) {
+        if (metric.type == MetricType::HISTOGRAM) {
+            return writeHistogramLine(metric.name, metric.labelNames, metric.labelValues,
+                                      *static_cast<const MetricHistogram *>(metric.metric), out, size, done);
+        }
+        done = true;
+        char labels[128];
+        formatLabels(labels, sizeof(labels), metric.labelNames, metric.labelValues);
+        if (metric.sampler != nullptr) {
+            return snprintf(out, size, "%s%s %lu\n", metric.name, labels,
+                            static_cast<unsigned long>(metric.sampler(metric.argument)));
+        }
+        if (metric.type == MetricType::GAUGE) {
+            return snprintf(out, size, "%s%s %ld\n", metric.name, labels,
+                            static_cast<long>(static_cast<const MetricGauge *>(metric.metric)->get()));
+        }
+        return snprintf(out, size, "%s%s %lu\n", metric.name, labels,
+                        static_cast<unsigned long>(static_cast<const MetricCounter *>(metric.metric)->get()));
+    }
+
+    size_t nextEntryPiece(char *out, size_t size) {
+        int length = 0;
+        const MetricEntry &metric = metrics[entry];
+        if (line == 0 && (entry == 0 || strcmp(metrics[entry - 1].name, metric.name) != 0)) {
+            length = snprintf(out, size, "# HELP %s %s\n# TYPE %s %s\n", metric.name, metric.help,
+                              metric.name, typeName(metric.type));
+            if (length >= (int) size) {
+                return size;
+            }
+        }
+        bool done = false;
+        length += writeEntryLine(metric, out + length, size - length, done);
+        line++;
+        if (done) {
+            entry++;
+            line = 0;
+        }
+        return length < (int) size ? length : size;
+    }
+
+    size_t nextSensorPiece(char *out, size_t size) {
+        int length = 0;
+        if (sensor == 0) {
+            length = snprintf(out, size, "# HELP thermostat_ble_readings_total Advertisements received per "
+                                         "registered sensor\n# TYPE thermostat_ble_readings_total counter\n");
+        }
+        char mac[MAC_STRING_LEN];
+        formatMacAddress(sensors[sensor].mac, mac);
+        length += snprintf(out + length, size - length, "thermostat_ble_readings_total{mac=\"%s\"} %lu\n", mac,
+                           static_cast<unsigned long>(sensors[sensor].totalReadings));
+        sensor++;
+        return length < (int) size ? length : size;
+    }
+
+    size_t nextRoutePiece(char *out, size_t size) {
+        auto current = static_cast<RouteFamily>(family);
+        const char *name = routeFamilyName(current);
+        bool gaugeFamily = current == RouteFamily::IN_FLIGHT || current == RouteFamily::HEAP_HELD;
+        int length = 0;
+        if (route == 0 && line == 0) {
+            length = snprintf(out, size, "# HELP %s %s\n# TYPE %s %s\n", name, routeFamilyHelp(current), name,
+                              gaugeFamily ? "gauge" : "histogram");
+            if (length >= (int) size) {
+                return size;
+            }
+        }
+        const RouteStats &stats = getRouteStats(route);
+        const char *const labelNames[2] = {"method", "route"};
+        const char *const labelValues[2] = {stats.method, stats.path};
+        bool done = true;
+        if (gaugeFamily) {
+            const MetricGauge &gauge = current == RouteFamily::IN_FLIGHT ? stats.inFlight : stats.heapHeldMax;
+            char labels[128];
+            formatLabels(labels, sizeof(labels), labelNames, labelValues);
+            length += snprintf(out + length, size - length, "%s%s %ld\n", name, labels,
+                               static_cast<long>(gauge.get()));
+        } else {
+            done = false;
+            length += writeHistogramLine(name, labelNames, labelValues, routeFamilyHistogram(stats, current),
+                                         out + length, size - length, done);
+            line++;
+        }
+        if (done) {
+            line = 0;
+            if (++route == routeCount) {
+                route = 0;
+                family++;
+            }
+        }
+        return length < (int) size ? length : size;
+    }
+
+public:
+    MetricsTextSource() : entryCount(metricCount.load(std::memory_order_acquire)),
+                          routeCount(getRouteStatsCount()) {
+        sensors.reset(new(std::nothrow) SensorState[MAX_REGISTERED_SENSORS]);
+        if (sensors) {
+            sensorCount = sensorRegistry.list(sensors.get(), MAX_REGISTERED_SENSORS);
+        }
+    }
+
+    size_t nextPiece(char *out, size_t size) override {
+        if (entry < entryCount) {
+            return nextEntryPiece(out, size);
+        }
+        if (sensor < sensorCount) {
+            return nextSensorPiece(out, size);
+        }
+        if (routeCount > 0 && family < static_cast<uint8_t>(RouteFamily::COUNT)) {
+            return nextRoutePiece(out, size);
+        }
+        return 0;
+    }
+};
+
+void handleGetMetrics(AsyncWebServerRequest *request) {
+    std::unique_ptr<JsonChunkSource> source(new(std::nothrow) MetricsTextSource);
+    if (!source || !sendChunkedJson(request, std::move(source), "text/plain; version=0.0.4")) {
+        request->send(503, "application/json", R"({"message":"State busy, try again"})");
+    }
+}
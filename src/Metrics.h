@@ -0,0 +1,129 @@
+#ifndef ESP32_TERMOSTAT_METRICS_H
+#define ESP32_TERMOSTAT_METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <ESPAsyncWebServer.h>
+
+// Firmware-wide counters, gauges and fixed-bucket histograms, served at GET /metrics in the Prometheus
+// text format. Recording is a relaxed atomic add (a histogram adds a short bucket search), so it is safe
+// from any task and cheap enough for the BLE and control paths. Values are 32 bit and wrap, which
+// Prometheus treats as a counter reset.
+
+constexpr uint8_t MAX_METRICS = 64;
+constexpr uint8_t METRIC_MAX_BOUNDS = 10;
+constexpr uint8_t METRIC_LATENCY_BOUND_COUNT = 10;
+// Shared by every *_microseconds histogram
+constexpr uint32_t METRIC_LATENCY_BOUNDS_US[METRIC_LATENCY_BOUND_COUNT] = {
+        100, 250, 500, 1000, 2500, 5000, 10000, 25000, 100000, 500000};
+
+enum class MetricType : uint8_t {
+    COUNTER,
+    GAUGE,
+    HISTOGRAM
+};
+
+class MetricCounter {
+private:
+    std::atomic<uint32_t> value{0};
+
+public:
+    void add(uint32_t amount = 1) {
+        value.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    uint32_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+};
+
+class MetricGauge {
+private:
+    std::atomic<int32_t> value{0};
+
+public:
+    void set(int32_t newValue) {
+        value.store(newValue, std::memory_order_relaxed);
+    }
+
+    int32_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+};
+
+/**
+ * @class MetricHistogram
+ * @brief Counts observations per bucket, a bucket holds the values up to and including its bound.
+ */
+class MetricHistogram {
+private:
+    const uint32_t *bounds;
+    uint8_t boundCount;
+    std::atomic<uint32_t> counts[METRIC_MAX_BOUNDS + 1]{};
+    std::atomic<uint32_t> sum{0};
+
+public:
+    explicit MetricHistogram(const uint32_t *histogramBounds = METRIC_LATENCY_BOUNDS_US,
+                             uint8_t histogramBoundCount = METRIC_LATENCY_BOUND_COUNT)
+            : bounds(histogramBounds),
+              boundCount(histogramBoundCount < METRIC_MAX_BOUNDS ? histogramBoundCount : METRIC_MAX_BOUNDS) {}
+
+    void observe(uint32_t value) {
+        uint8_t bucket = 0;
+        while (bucket < boundCount && value > bounds[bucket]) {
+            bucket++;
+        }
+        counts[bucket].fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    uint8_t getBoundCount() const {
+        return boundCount;
+    }
+
+    uint32_t getBound(uint8_t bucket) const {
+        return bounds[bucket];
+    }
+
+    /**
+     * @brief Non-cumulative count of a bucket, boundCount is the +Inf bucket.
+     */
+    uint32_t getCount(uint8_t bucket) const {
+        return counts[bucket].load(std::memory_order_relaxed);
+    }
+
+    uint32_t getSum() const {
+        return sum.load(std::memory_order_relaxed);
+    }
+};
+
+// Reads a value that already lives elsewhere (heap, persistence stats) when /metrics is scraped
+using MetricSampler = uint32_t (*)(uintptr_t argument);
+
+extern MetricCounter relayCyclesMetric;
+extern MetricGauge relayOnMetric;
+extern MetricHistogram controlLoopMetric;
+
+/**
+ * @brief Registers the built-in metrics. Call once from setup().
+ */
+void initMetrics();
+
+// Entries sharing a name must be registered one after the other, they are rendered under one HELP and TYPE.
+// Names, help texts and labels are not copied and have to outlive the registry (string literals).
+bool registerCounter(const char *name, const char *help, const MetricCounter &counter,
+                     const char *labelName = nullptr, const char *labelValue = nullptr);
+
+bool registerGauge(const char *name, const char *help, const MetricGauge &gauge,
+                   const char *labelName = nullptr, const char *labelValue = nullptr);
+
+bool registerHistogram(const char *name, const char *help, const MetricHistogram &histogram,
+                       const char *labelName = nullptr, const char *labelValue = nullptr,
+                       const char *labelName2 = nullptr, const char *labelValue2 = nullptr);
+
+bool registerSampled(const char *name, const char *help, MetricType type, MetricSampler sampler,
+                     uintptr_t argument = 0, const char *labelName = nullptr, const char *labelValue = nullptr);
+
+void handleGetMetrics(AsyncWebServerRequest *request);
+
+#endif //ESP32_TERMOSTAT_METRICS_H
@@ -1,22 +1,37 @@
 #include "OTAUpdate.h"
+#include "SaveLoad.h"
+#include "EventLog.h"
+
+// Only touched by the OTA task
+static uint8_t lastProgressStep = 0;
 
 void setupOTAUpdate() {
     ArduinoOTA.onStart([]() {
-        Serial.println("Start");
+        lastProgressStep = 0;
+        logEvent(LogModule::OTA, LogLevel::INFO, LogEvent::OTA_START);
+        // The filesystem may be rewritten and the device restarts afterwards. Nothing more is written to
+        // flash until then, a filesystem image must not get the old state written over it at the restart
+        flushPersistenceNow(2000);
+        suspendPersistence(ArduinoOTA.getCommand() == U_SPIFFS);
+        suspendEventLogFile(true);
     });
     ArduinoOTA.onEnd([]() {
-        Serial.println("\nEnd");
+        logEvent(LogModule::OTA, LogLevel::INFO, LogEvent::OTA_END);
     });
     ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
-        Serial.printf("Progress: %u%%\r", (progress / (total / 100)));
+        // One record per step, a record per received chunk would push everything else out of the ring
+        uint8_t percent = total > 0 ? static_cast<uint64_t>(progress) * 100 / total : 0;
+        uint8_t step = percent / OTA_PROGRESS_STEP;
+        if (step > lastProgressStep) {
+            lastProgressStep = step;
+            logEvent(LogModule::OTA, LogLevel::INFO, LogEvent::OTA_PROGRESS, step * OTA_PROGRESS_STEP);
+        }
     });
     ArduinoOTA.onError([](ota_error_t error) {
-        Serial.printf("Error[%u]: ", error);
-        if (error == OTA_AUTH_ERROR) Serial.println("Auth Failed");
-        else if (error == OTA_BEGIN_ERROR) Serial.println("Begin Failed");
-        else if (error == OTA_CONNECT_ERROR) Serial.println("Connect Failed");
-        else if (error == OTA_RECEIVE_ERROR) Serial.println("Receive Failed");
-        else if (error == OTA_END_ERROR) Serial.println("End Failed");
+        // No restart follows, the device keeps running on what is in flash
+        resumePersistence();
+        suspendEventLogFile(false);
+        logEvent(LogModule::OTA, LogLevel::ERROR, LogEvent::OTA_ERROR, error);
     });
     ArduinoOTA.begin();
 }
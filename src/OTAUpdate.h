@@ -2,6 +2,10 @@
 #define ESP32_TERMOSTAT_OTAUPDATE_H
 
 #include <ArduinoOTA.h>
+#include <cstdint>
+
+// The progress of an update is logged once per this many percent
+constexpr uint8_t OTA_PROGRESS_STEP = 10;
 
 void setupOTAUpdate();
 
@@ -0,0 +1,37 @@
+#include "RequestBody.h"
+#include <Arduino.h>
+#include <cstdlib>
+#include <cstring>
+#include "EventLog.h"
+
+const char *collectRequestBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index,
+                               size_t total, size_t limit, size_t &length) {
+    if (index == 0) {
+        if (total > limit) {
+            logEvent(LogModule::API, LogLevel::WARN, LogEvent::API_BODY_TOO_LARGE, total, limit);
+            request->send(413, "application/json", R"({"message":"Corpul cererii este prea mare"})");
+            return nullptr;
+        }
+        if (len == total) {
+            length = len;
+            return reinterpret_cast<const char *>(data);
+        }
+        // Freed by the request destructor together with the request
+        request->_tempObject = malloc(total);
+        if (request->_tempObject == nullptr) {
+            request->send(503, "application/json", R"({"message":"Memorie insuficientă"})");
+            return nullptr;
+        }
+    }
+    // No buffer past the first segment means the body was already rejected
+    if (request->_tempObject == nullptr || index + len > total) {
+        return nullptr;
+    }
+    auto *buffer = static_cast<char *>(request->_tempObject);
+    memcpy(buffer + index, data, len);
+    if (index + len < total) {
+        return nullptr;
+    }
+    length = total;
+    return buffer;
+}
@@ -0,0 +1,32 @@
+#ifndef ESP32_TERMOSTAT_REQUESTBODY_H
+#define ESP32_TERMOSTAT_REQUESTBODY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ESPAsyncWebServer.h>
+
+// Largest body accepted per route, anything above is answered with 413 before it is buffered
+constexpr size_t ROOM_BODY_LIMIT = 1024;
+constexpr size_t THERMOMETER_BODY_LIMIT = 256;
+constexpr size_t SCHEDULE_BODY_LIMIT = 1024;
+constexpr size_t SCHEDULE_RANGES_BODY_LIMIT = 4096;
+constexpr size_t BATCH_BODY_LIMIT = 4096;
+
+/**
+ * @brief Assembles a request body delivered in several TCP segments.
+ *
+ * Call it first thing from a body handler with the handler's arguments. A body that arrives in one segment is
+ * returned in place without copying. A longer one is copied once into a buffer sized from Content-Length, kept
+ * in request->_tempObject (the request frees it), and returned when its last byte arrived.
+ *
+ * @param request The request being received.
+ * @param data, len, index, total The body handler arguments.
+ * @param limit Largest accepted body for the route.
+ * @param length Output, length of the complete body.
+ * @return The complete body, or nullptr while more segments are expected or once a 413 / 503 was sent.
+ *         Only one call per request returns the body.
+ */
+const char *collectRequestBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index,
+                               size_t total, size_t limit, size_t &length);
+
+#endif //ESP32_TERMOSTAT_REQUESTBODY_H
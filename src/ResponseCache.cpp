@@ -0,0 +1,176 @@
+#include "ResponseCache.h"
+#include <Arduino.h>
+#include <esp_system.h>
+
+struct CacheEntry {
+    bool valid;
+    uint32_t version;
+    std::shared_ptr<const std::string> body;
+    ResponseCacheStats stats;
+};
+
+static CacheEntry entries[static_cast<uint8_t>(CachedRoute::COUNT)][static_cast<uint8_t>(ApiEncoding::COUNT)];
+static uint32_t bootId = 0;
+
+const char *cachedRouteName(CachedRoute route) {
+    switch (route) {
+        case CachedRoute::ROOMS:
+            return "rooms";
+        case CachedRoute::SCHEDULE:
+            return "schedule";
+        case CachedRoute::HEATING_MODE:
+            return "heating_mode";
+        case CachedRoute::MANUAL_MODE:
+            return "manual_mode";
+        case CachedRoute::HEATING_STATUS:
+            return "heating_status";
+        default:
+            return "unknown";
+    }
+}
+
+uint32_t cacheBootId() {
+    if (bootId == 0) {
+        bootId = esp_random() | 1;
+    }
+    return bootId;
+}
+
+// Versions restart at every boot, the boot id keeps an old ETag from matching new content
+static void formatEtag(char *out, size_t size, CachedRoute route, ApiEncoding encoding, uint32_t version) {
+    snprintf(out, size, "\"%08lx-%u%u-%lu\"", static_cast<unsigned long>(cacheBootId()),
+             static_cast<unsigned>(route), static_cast<unsigned>(encoding), static_cast<unsigned long>(version));
+}
+
+// 304 or hit, false when the entry cannot answer and the body has to be rendered
+static bool answerFromCache(AsyncWebServerRequest *request, CacheEntry &entry, const char *etag,
+                            ApiEncoding encoding, uint32_t currentVersion) {
+    AsyncWebHeader *ifNoneMatch = request->getHeader("If-None-Match");
+    if (ifNoneMatch != nullptr && ifNoneMatch->value() == etag) {
+        entry.stats.notModified++;
+        entry.stats.savedMicros += entry.stats.lastRenderMicros;
+        AsyncWebServerResponse *response = request->beginResponse(304);
+        response->addHeader("ETag", etag);
+        response->addHeader("Cache-Control", "no-cache");
+        response->addHeader("Vary", "Accept");
+        request->send(response);
+        return true;
+    }
+
+    if (entry.valid && entry.version == currentVersion) {
+        entry.stats.hits++;
+        entry.stats.savedMicros += entry.stats.lastRenderMicros;
+        sendEncodedBody(request, 200, encoding, entry.body, etag);
+        return true;
+    }
+    return false;
+}
+
+bool sendCachedResponse(AsyncWebServerRequest *request, CachedRoute route, uint32_t currentVersion,
+                        CachedRenderer render) {
+    ApiEncoding encoding = negotiateEncoding(request);
+    CacheEntry &entry = entries[static_cast<uint8_t>(route)][static_cast<uint8_t>(encoding)];
+    char etag[32];
+    formatEtag(etag, sizeof(etag), route, encoding, currentVersion);
+    if (answerFromCache(request, entry, etag, encoding, currentVersion)) {
+        return true;
+    }
+
+    uint32_t start = micros();
+    std::shared_ptr<std::string> body = std::make_shared<std::string>();
+    uint32_t version = 0;
+    if (!render(encoding, *body, version)) {
+        return false;
+    }
+    entry.stats.misses++;
+    entry.stats.lastRenderMicros = micros() - start;
+    entry.stats.cachedBytes = body->size();
+    entry.valid = true;
+    entry.version = version;
+    entry.body = body;
+    // The snapshot may have moved on since currentVersion was read, tag what was actually rendered
+    formatEtag(etag, sizeof(etag), route, encoding, version);
+    sendEncodedBody(request, 200, encoding, entry.body, etag);
+    return true;
+}
+
+// Passes the pieces of a streamed miss through, copying them aside while the body stays small enough to keep
+class KeepingSource : public JsonChunkSource {
+private:
+    std::unique_ptr<JsonChunkSource> source;
+    CacheEntry &entry;
+    uint32_t version;
+    std::shared_ptr<std::string> kept;  // Dropped once the body outgrows RESPONSE_CACHE_KEEP_LEN
+    uint32_t renderMicros = 0;
+
+    void finish() {
+        entry.stats.lastRenderMicros = renderMicros;
+        // A slower stream of an older version must not replace what a newer one already kept
+        bool newer = !entry.valid || static_cast<int32_t>(version - entry.version) > 0;
+        if (!newer) {
+            return;
+        }
+        entry.stats.cachedBytes = kept ? kept->size() : 0;
+        entry.valid = static_cast<bool>(kept);
+        entry.version = version;
+        entry.body = std::move(kept);
+    }
+
+public:
+    KeepingSource(std::unique_ptr<JsonChunkSource> inner, CacheEntry &cacheEntry, uint32_t renderedVersion)
+            : source(std::move(inner)), entry(cacheEntry), version(renderedVersion),
+              kept(new(std::nothrow) std::string) {}
+
+    size_t nextPiece(char *out, size_t size) override {
+        uint32_t start = micros();
+        size_t length = source->nextPiece(out, size);
+        renderMicros += micros() - start;
+        if (length == 0) {
+            finish();
+            return 0;
+        }
+        // A piece that did not fit cuts the response short, it is never kept
+        if (length >= size || (kept && kept->size() + length > RESPONSE_CACHE_KEEP_LEN)) {
+            kept.reset();
+        } else if (kept) {
+            kept->append(out, length);
+        }
+        return length;
+    }
+};
+
+bool sendCachedStream(AsyncWebServerRequest *request, CachedRoute route, uint32_t currentVersion,
+                      CachedSourceFactory makeSource) {
+    ApiEncoding encoding = negotiateEncoding(request);
+    CacheEntry &entry = entries[static_cast<uint8_t>(route)][static_cast<uint8_t>(encoding)];
+    char etag[32];
+    formatEtag(etag, sizeof(etag), route, encoding, currentVersion);
+    if (answerFromCache(request, entry, etag, encoding, currentVersion)) {
+        return true;
+    }
+
+    uint32_t version = 0;
+    std::unique_ptr<JsonChunkSource> source = makeSource(encoding, version);
+    if (!source) {
+        return false;
+    }
+    std::unique_ptr<JsonChunkSource> keeping(new(std::nothrow) KeepingSource(std::move(source), entry, version));
+    if (!keeping) {
+        return false;
+    }
+    AsyncWebServerResponse *response = beginChunkedJson(request, std::move(keeping), encodingContentType(encoding));
+    if (response == nullptr) {
+        return false;
+    }
+    entry.stats.misses++;
+    formatEtag(etag, sizeof(etag), route, encoding, version);
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", "no-cache");
+    response->addHeader("Vary", "Accept");
+    request->send(response);
+    return true;
+}
+
+ResponseCacheStats getResponseCacheStats(CachedRoute route, ApiEncoding encoding) {
+    return entries[static_cast<uint8_t>(route)][static_cast<uint8_t>(encoding)].stats;
+}
@@ -0,0 +1,94 @@
+#ifndef ESP32_TERMOSTAT_RESPONSECACHE_H
+#define ESP32_TERMOSTAT_RESPONSECACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <ESPAsyncWebServer.h>
+#include "ApiEncoding.h"
+#include "ChunkedJson.h"
+
+// GET routes whose body only depends on one published snapshot version
+enum class CachedRoute : uint8_t {
+    ROOMS,
+    SCHEDULE,
+    HEATING_MODE,
+    MANUAL_MODE,
+    HEATING_STATUS,
+    COUNT
+};
+
+struct ResponseCacheStats {
+    uint32_t hits;              ///< Served from the cached bytes.
+    uint32_t misses;            ///< Rendered because the version moved (or nothing was cached yet).
+    uint32_t notModified;       ///< Answered with 304 from the client's ETag.
+    uint32_t lastRenderMicros;  ///< Cost of the latest render, for a stream the time spent producing its pieces.
+    uint64_t savedMicros;       ///< Render time avoided by hits and 304s, estimated from the latest render.
+    uint32_t cachedBytes;       ///< 0 while a streamed body is too large to keep.
+};
+
+/**
+ * @brief Renders the body of a route from the current snapshot.
+ *
+ * @param encoding Encoding the client negotiated.
+ * @param body Output, the complete response body.
+ * @param version Output, the snapshot version the body was rendered from.
+ * @return False if the snapshot could not be read or the body could not be allocated.
+ */
+using CachedRenderer = bool (*)(ApiEncoding encoding, std::string &body, uint32_t &version);
+
+// Streamed bodies up to this size are kept for the next request. Larger ones are streamed again on every miss,
+// so a big home never holds its whole rooms document on the heap.
+constexpr size_t RESPONSE_CACHE_KEEP_LEN = 4096;
+
+/**
+ * @brief Builds the piece source of a route from the current snapshot.
+ *
+ * @param encoding Encoding the client negotiated.
+ * @param version Output, the snapshot version the source renders.
+ * @return nullptr if the snapshot could not be read or the source could not be allocated.
+ */
+using CachedSourceFactory = std::unique_ptr<JsonChunkSource> (*)(ApiEncoding encoding, uint32_t &version);
+
+/**
+ * @brief Answers a GET from the cache when the route's snapshot version did not move.
+ *
+ * Every encoding has its own cached body. The ETag is derived from the route, the encoding, the version and a
+ * per-boot id, so a client holding the current ETag gets a 304 without anything being rendered. On a miss the
+ * body is rendered once and kept until the next version; responses in flight keep their own reference, so
+ * replacing an entry never frees bytes being sent.
+ * Only called from the AsyncTCP task, which runs every handler.
+ *
+ * @param request The request to answer.
+ * @param route Cache slot of the route.
+ * @param currentVersion Version of the snapshot the route depends on, read without copying the snapshot.
+ * @param render Builds the body on a miss.
+ * @return False if render failed, nothing was sent in that case.
+ */
+bool sendCachedResponse(AsyncWebServerRequest *request, CachedRoute route, uint32_t currentVersion,
+                        CachedRenderer render);
+
+/**
+ * @brief Same as sendCachedResponse(), but a miss streams the body one piece at a time instead of rendering it
+ *        first.
+ *
+ * The pieces are copied aside while they are sent, and the body becomes the route's entry once the last one was
+ * produced, as long as it stayed within RESPONSE_CACHE_KEEP_LEN. A larger body is never held whole, each miss
+ * streams it again. A client that disconnects early leaves the entry as it was.
+ *
+ * @param makeSource Builds the piece source on a miss.
+ * @return False if makeSource failed or the response could not be allocated, nothing was sent in that case.
+ */
+bool sendCachedStream(AsyncWebServerRequest *request, CachedRoute route, uint32_t currentVersion,
+                      CachedSourceFactory makeSource);
+
+ResponseCacheStats getResponseCacheStats(CachedRoute route, ApiEncoding encoding);
+
+const char *cachedRouteName(CachedRoute route);
+
+/**
+ * @brief Random per-boot id mixed into ETags, versions restart at every boot.
+ */
+uint32_t cacheBootId();
+
+#endif //ESP32_TERMOSTAT_RESPONSECACHE_H
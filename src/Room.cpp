@@ -1,10 +1,10 @@
 #include <string>
 #include <utility>
 #include <cmath>
-#include <memory>
 #include "Room.h"
 #include "SaveLoad.h"
 #include "globalSettings.h"
+#include "SensorRegistry.h"
 
 themperature_modes Room::mode = HOME;
 
@@ -21,7 +21,7 @@ Room::Room(std::string room_name, bool load) {
     this->night_low_offset = 0.6f;
     this->room_priority = 5;
     if (!load) {
-        saveRooms();
+        markDirty(PERSIST_ROOMS);
     }
 }
 
@@ -40,26 +40,31 @@ Room::Room(std::string room_name, float home_target_temperature, float home_low_
     this->night_low_offset = night_low_offset;
     this->room_priority = room_priority;
     if (!load) {
-        saveRooms();
+        markDirty(PERSIST_ROOMS);
     }
 }
 
-void Room::addThermometer(std::string mac, bool load) {
-    auto thermometer = std::make_shared<ATC_MiThermometer>(mac);
-    thermometer->setTimeTracking(true);
-    bleAdvertisingReader.addThermometer(thermometer.get());
-    this->thermometers.push_back(thermometer);
+bool Room::addThermometer(std::string mac, bool load) {
+    mac = normalizeMacAddress(mac);
+    // A thermometer the registry cannot track would never get a reading
+    if (!sensorRegistry.registerSensor(mac)) {
+        return false;
+    }
+    this->thermometers.push_back(mac);
     if (!load) {
-        saveRooms();
+        markDirty(PERSIST_ROOMS);
     }
+    return true;
 }
 
 void Room::calculateRoomTemperature() {
     float total = 0;
     uint8_t count = 0;
+    time_t now = time(nullptr);
+    SensorState state{};
     for (auto &thermometer: this->thermometers) {
-        if (time(nullptr) - thermometer->getLastReadTime() < 60) {
-            total += thermometer->getTemperaturePrecise();
+        if (sensorRegistry.getState(thermometer, state) && state.isFresh(now)) {
+            total += state.temperature;
             count++;
         }
     }
@@ -116,29 +121,32 @@ float Room::get_temperature_needs() {
 }
 
 bool Room::valid_thermometers() {
+    time_t now = time(nullptr);
+    SensorState state{};
     for (auto &thermometer: this->thermometers) {
-        if (time(nullptr) - thermometer->getLastReadTime() < 60) return true;
+        if (sensorRegistry.getState(thermometer, state) && state.isFresh(now)) return true;
     }
     return false;
 }
 
-void Room::removeThermometer(const std::string mac, bool load) {
+void Room::removeThermometer(std::string mac, bool load) {
+    mac = normalizeMacAddress(mac);
     for (auto it = this->thermometers.begin(); it != this->thermometers.end(); ++it) {
-        if ((*it)->getAddressString() == mac) {
-            bleAdvertisingReader.removeThermometer(it->get());
+        if (*it == mac) {
+            sensorRegistry.unregisterSensor(mac);
             this->thermometers.erase(it);
             break;
         }
     }
     if (!load) {
-        saveRooms();
+        markDirty(PERSIST_ROOMS);
     }
 }
 
 void Room::set_room_name(std::string new_name, bool load) {
     this->room_name = std::move(new_name);
     if (!load) {
-        saveRooms();
+        markDirty(PERSIST_ROOMS);
     }
 }
 
@@ -149,7 +157,7 @@ std::string Room::get_room_name() const {
 void Room::set_home_temperature(float new_temperature, bool load) {
     this->home_target_temperature = new_temperature;
     if (!load) {
-        saveRooms();
+        markDirty(PERSIST_ROOMS);
     }
 }
 
@@ -160,7 +168,7 @@ float Room::get_home_temperature() const {
 void Room::set_home_low_offset(float new_low_offset, bool load) {
     this->home_low_offset = new_low_offset;
     if (!load) {
-        saveRooms();
+        markDirty(PERSIST_ROOMS);
     }
 }
 
@@ -171,7 +179,7 @@ float Room::get_home_low_offset() const {
 void Room::set_home_high_offset(float new_high_offset, bool load) {
     this->home_high_offset = new_high_offset;
     if (!load) {
-        saveRooms();
+        markDirty(PERSIST_ROOMS);
     }
 }
 
@@ -182,7 +190,7 @@ float Room::get_home_high_offset() const {
 void Room::set_away_temperature(float new_temperature, bool load) {
     this->away_target_temperature = new_temperature;
     if (!load) {
-        saveRooms();
+        markDirty(PERSIST_ROOMS);
     }
 }
 
@@ -193,7 +201,7 @@ float Room::get_away_temperature() const {
 void Room::set_away_low_offset(float new_low_offset, bool load) {
     this->away_low_offset = new_low_offset;
     if (!load) {
-        saveRooms();
+        markDirty(PERSIST_ROOMS);
     }
 }
 
@@ -204,7 +212,7 @@ float Room::get_away_low_offset() const {
 void Room::set_away_high_offset(float new_high_offset, bool load) {
     this->away_high_offset = new_high_offset;
     if (!load) {
-        saveRooms();
+        markDirty(PERSIST_ROOMS);
     }
 }
 
@@ -215,7 +223,7 @@ float Room::get_away_high_offset() const {
 void Room::set_night_temperature(float new_temperature, bool load) {
     this->night_target_temperature = new_temperature;
     if (!load) {
-        saveRooms();
+        markDirty(PERSIST_ROOMS);
     }
 }
 
@@ -226,7 +234,7 @@ float Room::get_night_temperature() const {
 void Room::set_night_low_offset(float new_low_offset, bool load) {
     this->night_low_offset = new_low_offset;
     if (!load) {
-        saveRooms();
+        markDirty(PERSIST_ROOMS);
     }
 }
 
@@ -237,7 +245,7 @@ float Room::get_night_low_offset() const {
 void Room::set_night_high_offset(float new_high_offset, bool load) {
     this->night_high_offset = new_high_offset;
     if (!load) {
-        saveRooms();
+        markDirty(PERSIST_ROOMS);
     }
 }
 
@@ -248,7 +256,7 @@ float Room::get_night_high_offset() const {
 void Room::set_room_priority(float new_priority, bool load) {
     this->room_priority = new_priority;
     if (!load) {
-        saveRooms();
+        markDirty(PERSIST_ROOMS);
     }
 }
 
@@ -269,8 +277,9 @@ uint8_t Room::get_thermometer_number() {
 }
 
 bool Room::thermometerExist(std::string mac) {
+    mac = normalizeMacAddress(mac);
     for (auto &thermometer: this->thermometers) {
-        if (thermometer->getAddressString() == mac) {
+        if (thermometer == mac) {
             return true;
         }
     }
@@ -278,53 +287,53 @@ bool Room::thermometerExist(std::string mac) {
 }
 
 float Room::get_temperature_by_index(int index) {
-    if (index >= 0 && index < this->thermometers.size()) {
-        if (time(nullptr) - this->thermometers[index]->getLastReadTime() < 60) {
-            return this->thermometers[index]->getTemperaturePrecise();
-        } else{
-            Serial.print("Temperature is not valid");
-            Serial.println(time(nullptr) - this->thermometers[index]->getLastReadTime());
-        }
+    SensorState state{};
+    if (index >= 0 && index < this->thermometers.size() &&
+        sensorRegistry.getState(this->thermometers[index], state) && state.isFresh(time(nullptr))) {
+        return state.temperature;
     }
     return 0.0f;
 }
 
 float Room::get_humidity_by_index(int index) {
-    if (index >= 0 && index < this->thermometers.size()) {
-        if (time(nullptr) - this->thermometers[index]->getLastReadTime() < 60) {
-            return this->thermometers[index]->getHumidity();
-        }
+    SensorState state{};
+    if (index >= 0 && index < this->thermometers.size() &&
+        sensorRegistry.getState(this->thermometers[index], state) && state.isFresh(time(nullptr))) {
+        return state.humidity;
     }
     return 0.0f;
 }
 
 int Room::get_battery_mv_by_index(int index) {
-    if (index >= 0 && index < this->thermometers.size()) {
-        return this->thermometers[index]->getBatteryVoltage();
+    SensorState state{};
+    if (index >= 0 && index < this->thermometers.size() && sensorRegistry.getState(this->thermometers[index], state)) {
+        return state.batteryMv;
     }
-    return 0; // Sau gestionează eroarea corespunzător
+    return 0;
 }
 
 int Room::get_battery_percent_by_index(int index) {
-    if (index >= 0 && index < this->thermometers.size()) {
-        return this->thermometers[index]->getBatteryLevel();
+    SensorState state{};
+    if (index >= 0 && index < this->thermometers.size() && sensorRegistry.getState(this->thermometers[index], state)) {
+        return state.batteryPercent;
     }
-    return 0; // Sau gestionează eroarea corespunzător
+    return 0;
 }
 
 bool Room::get_valid_by_index(int index) {
-    if (index >= 0 && index < this->thermometers.size()) {
-        return time(nullptr) - this->thermometers[index]->getLastReadTime() < 60;
-    }
-    return false; // Sau gestionează eroarea corespunzător
+    SensorState state{};
+    return index >= 0 && index < this->thermometers.size() &&
+           sensorRegistry.getState(this->thermometers[index], state) && state.isFresh(time(nullptr));
 }
 
 void Room::calculateRoomHumidity() {
     float total = 0;
     int count = 0;
+    time_t now = time(nullptr);
+    SensorState state{};
     for (auto &thermometer: this->thermometers) {
-        if (time(nullptr) - thermometer->getLastReadTime() < 60) {
-            total += thermometer->getHumidity();
+        if (sensorRegistry.getState(thermometer, state) && state.isFresh(now)) {
+            total += state.humidity;
             count++;
         }
     }
@@ -342,7 +351,7 @@ float Room::get_humidity() {
 
 std::string Room::get_mac_by_index(int index) {
     if (index >= 0 && index < this->thermometers.size()) {
-        return this->thermometers[index]->getAddressString();
+        return this->thermometers[index];
     }
     return ""; // Sau gestionează eroarea corespunzător
 }
@@ -3,8 +3,6 @@
 
 #include <string>
 #include <vector>
-#include <memory> // Adăugat pentru smart pointers
-#include "ATC_MiThermometer.h"
 #include <cstdint>
 
 enum themperature_modes {
@@ -17,7 +15,7 @@ enum themperature_modes {
 class Room {
 private:
     std::string room_name;
-    std::vector<std::shared_ptr<ATC_MiThermometer>> thermometers; // Modificat pentru a folosi shared_ptr
+    std::vector<std::string> thermometers; // MAC addresses, the readings live in sensorRegistry
     float home_target_temperature;
     float home_low_offset;
     float home_high_offset;
@@ -32,7 +30,8 @@ private:
     float humidity{};
     static themperature_modes mode;
 public:
-    void addThermometer(std::string mac, bool load = false);
+    // False if the MAC is malformed or the sensor registry is full, the room is left unchanged
+    bool addThermometer(std::string mac, bool load = false);
 
     float getRoomTemperature();
 
@@ -0,0 +1,249 @@
+#include "RouteStats.h"
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <functional>
+#include <utility>
+#include "ApiEncoding.h"
+#include "EventLog.h"
+
+struct TraceSlot {
+    AsyncWebServerRequest *request;
+    RouteStats *route;          ///< Set once a traced handler picked the request up.
+    uint16_t generation;
+    bool active;                ///< Handler ran, waiting for the disconnect.
+    bool started;               ///< Response handed to the server.
+    uint8_t inFlight;
+    uint32_t arrivalMicros;
+    uint32_t freeHeapBefore;
+    uint32_t handlerStartMicros;
+    uint32_t handlerMicros;
+    uint32_t responseStartMicros;
+    uint32_t bytes;
+    std::function<void()> onDisconnect;    ///< Handler callback chained behind the one that closes the trace.
+};
+
+// Only touched by the AsyncTCP task, apart from the statistics read by /metrics
+static RouteStats routes[MAX_TRACED_ROUTES];
+static uint8_t routeCount = 0;
+static TraceSlot slots[MAX_TRACED_REQUESTS];
+static uint8_t nextSlot = 0;
+static int8_t currentSlot = -1;
+static uint8_t requestsInFlight = 0;
+static SlowRequestSample slowRequests[SLOW_REQUEST_SAMPLES];
+static uint8_t slowRequestCount = 0;
+static uint8_t nextSlowRequest = 0;
+
+// Claims a slot that is not waiting for a disconnect, the oldest one first
+static int8_t claimSlot(AsyncWebServerRequest *request, uint32_t now) {
+    for (uint8_t i = 0; i < MAX_TRACED_REQUESTS; i++) {
+        uint8_t candidate = (nextSlot + i) % MAX_TRACED_REQUESTS;
+        TraceSlot &slot = slots[candidate];
+        if (slot.active) {
+            continue;
+        }
+        nextSlot = (candidate + 1) % MAX_TRACED_REQUESTS;
+        uint16_t generation = slot.generation + 1;
+        slot = TraceSlot{};
+        slot.request = request;
+        slot.generation = generation;
+        slot.arrivalMicros = now;
+        return static_cast<int8_t>(candidate);
+    }
+    return -1;
+}
+
+// Sees every request right after its headers were parsed and never handles it
+class RequestArrivalProbe : public AsyncWebHandler {
+public:
+    bool canHandle(AsyncWebServerRequest *request) override {
+        uint32_t now = micros();
+        for (TraceSlot &slot: slots) {
+            if (slot.request == request && !slot.active) {
+                slot.arrivalMicros = now;
+                return false;
+            }
+        }
+        claimSlot(request, now);
+        return false;
+    }
+};
+
+static RequestArrivalProbe arrivalProbe;
+
+void initRouteTracing(AsyncWebServer &webServer) {
+    webServer.addHandler(&arrivalProbe);
+}
+
+RouteStats *addRouteStats(const char *method, const char *path) {
+    if (routeCount >= MAX_TRACED_ROUTES) {
+        logEvent(LogModule::API, LogLevel::WARN, LogEvent::API_ROUTE_NOT_TRACED, routeCount);
+        return nullptr;
+    }
+    RouteStats &route = routes[routeCount++];
+    route.method = method;
+    route.path = path;
+    return &route;
+}
+
+static void recordSlowRequest(const TraceSlot &slot, uint32_t totalMicros) {
+    SlowRequestSample &sample = slowRequests[nextSlowRequest];
+    nextSlowRequest = (nextSlowRequest + 1) % SLOW_REQUEST_SAMPLES;
+    if (slowRequestCount < SLOW_REQUEST_SAMPLES) {
+        slowRequestCount++;
+    }
+    sample.method = slot.route->method;
+    sample.path = slot.route->path;
+    sample.finishedMs = millis();
+    sample.waitMicros = slot.handlerStartMicros - slot.arrivalMicros;
+    sample.handlerMicros = slot.handlerMicros;
+    sample.responseStartMicros = slot.responseStartMicros;
+    sample.totalMicros = totalMicros;
+    sample.bytes = slot.bytes;
+    sample.inFlight = slot.inFlight;
+}
+
+static void finishRequest(int8_t index, uint16_t generation) {
+    TraceSlot &slot = slots[index];
+    if (!slot.active || slot.generation != generation) {
+        return;
+    }
+    uint32_t totalMicros = micros() - slot.arrivalMicros;
+    RouteStats &route = *slot.route;
+    route.responseStartMicros.observe(slot.responseStartMicros);
+    route.responseBytes.observe(slot.bytes);
+    route.inFlight.set(route.inFlight.get() - 1);
+    requestsInFlight--;
+    if (totalMicros >= SLOW_REQUEST_US) {
+        recordSlowRequest(slot, totalMicros);
+    }
+    slot.active = false;
+    slot.request = nullptr;
+    std::function<void()> onDisconnect = std::move(slot.onDisconnect);
+    slot.onDisconnect = nullptr;
+    if (onDisconnect) {
+        onDisconnect();
+    }
+}
+
+RequestTrace beginRouteHandler(RouteStats *route, AsyncWebServerRequest *request) {
+    uint32_t now = micros();
+    int8_t index = -1;
+    for (uint8_t i = 0; i < MAX_TRACED_REQUESTS; i++) {
+        if (slots[i].request == request && !slots[i].active) {
+            index = static_cast<int8_t>(i);
+            break;
+        }
+    }
+    if (index < 0) {
+        index = claimSlot(request, now);
+    }
+    if (route == nullptr || index < 0) {
+        return {-1, 0};
+    }
+    TraceSlot &slot = slots[index];
+    slot.route = route;
+    slot.active = true;
+    slot.handlerStartMicros = now;
+    slot.freeHeapBefore = ESP.getFreeHeap();
+    slot.inFlight = ++requestsInFlight;
+    route->inFlight.set(route->inFlight.get() + 1);
+    uint16_t generation = slot.generation;
+    // Every request ends with a disconnect, with or without a response. The request keeps a single callback,
+    // handlers chain theirs behind this one through onRequestDisconnect()
+    request->onDisconnect([index, generation]() {
+        finishRequest(index, generation);
+    });
+    currentSlot = index;
+    return {index, generation};
+}
+
+void endRouteHandler(RequestTrace trace) {
+    currentSlot = -1;
+    if (trace.slot < 0) {
+        return;
+    }
+    TraceSlot &slot = slots[trace.slot];
+    if (slot.generation != trace.generation) {
+        return;
+    }
+    uint32_t now = micros();
+    slot.handlerMicros = now - slot.handlerStartMicros;
+    slot.route->handlerMicros.observe(slot.handlerMicros);
+    uint32_t freeHeapAfter = ESP.getFreeHeap();
+    if (slot.freeHeapBefore > freeHeapAfter &&
+        static_cast<int32_t>(slot.freeHeapBefore - freeHeapAfter) > slot.route->heapHeldMax.get()) {
+        slot.route->heapHeldMax.set(static_cast<int32_t>(slot.freeHeapBefore - freeHeapAfter));
+    }
+    // Plain request->send() calls are not seen, their response went out before the handler returned
+    if (!slot.started) {
+        slot.started = true;
+        slot.responseStartMicros = now - slot.arrivalMicros;
+    }
+}
+
+void onRequestDisconnect(AsyncWebServerRequest *request, std::function<void()> callback) {
+    for (TraceSlot &slot: slots) {
+        if (slot.request == request && slot.active) {
+            slot.onDisconnect = std::move(callback);
+            return;
+        }
+    }
+    request->onDisconnect(std::move(callback));
+}
+
+RequestTrace currentRequestTrace() {
+    if (currentSlot < 0) {
+        return {-1, 0};
+    }
+    return {currentSlot, slots[currentSlot].generation};
+}
+
+void noteResponseStart(RequestTrace trace) {
+    if (trace.slot < 0 || slots[trace.slot].generation != trace.generation || slots[trace.slot].started) {
+        return;
+    }
+    slots[trace.slot].started = true;
+    slots[trace.slot].responseStartMicros = micros() - slots[trace.slot].arrivalMicros;
+}
+
+void noteResponseBytes(RequestTrace trace, size_t bytes) {
+    if (trace.slot >= 0 && slots[trace.slot].generation == trace.generation && slots[trace.slot].active) {
+        slots[trace.slot].bytes += bytes;
+    }
+}
+
+uint8_t apiRequestsInFlight() {
+    return requestsInFlight;
+}
+
+uint8_t getRouteStatsCount() {
+    return routeCount;
+}
+
+const RouteStats &getRouteStats(uint8_t index) {
+    return routes[index];
+}
+
+void handleGetSlowRequests(AsyncWebServerRequest *request) {
+    uint32_t now = millis();
+    JsonDocument doc;
+    doc["threshold_us"] = SLOW_REQUEST_US;
+    doc["in_flight"] = requestsInFlight;
+    JsonArray samples = doc["samples"].to<JsonArray>();
+    // Newest first
+    for (uint8_t i = 0; i < slowRequestCount; i++) {
+        const SlowRequestSample &sample =
+                slowRequests[(nextSlowRequest + SLOW_REQUEST_SAMPLES - 1 - i) % SLOW_REQUEST_SAMPLES];
+        JsonObject sampleObj = samples.add<JsonObject>();
+        sampleObj["method"] = sample.method;
+        sampleObj["route"] = sample.path;
+        sampleObj["age_ms"] = now - sample.finishedMs;
+        sampleObj["wait_us"] = sample.waitMicros;
+        sampleObj["handler_us"] = sample.handlerMicros;
+        sampleObj["response_start_us"] = sample.responseStartMicros;
+        sampleObj["total_us"] = sample.totalMicros;
+        sampleObj["bytes"] = sample.bytes;
+        sampleObj["in_flight"] = sample.inFlight;
+    }
+    sendDocument(request, 200, doc);
+}
@@ -0,0 +1,100 @@
+#ifndef ESP32_TERMOSTAT_ROUTESTATS_H
+#define ESP32_TERMOSTAT_ROUTESTATS_H
+
+#include <cstdint>
+#include <functional>
+#include <ESPAsyncWebServer.h>
+#include "Metrics.h"
+
+// Per-route request tracing for the API. A probe registered ahead of every other handler notes when the
+// headers of a request were parsed, the route wrapper times the handler, the send helpers note when the
+// response started and how many body bytes it carries, and the disconnect that ends every request closes
+// the trace. Everything runs on the AsyncTCP task, so the bookkeeping is a few stores into fixed slots.
+// Requests that took SLOW_REQUEST_US or more end up in a ring shown by GET /api/debug/slow.
+
+constexpr uint8_t MAX_TRACED_ROUTES = 40;
+constexpr uint8_t MAX_TRACED_REQUESTS = 8;
+constexpr uint8_t SLOW_REQUEST_SAMPLES = 16;
+constexpr uint32_t SLOW_REQUEST_US = 100000;
+constexpr uint8_t RESPONSE_BYTES_BOUND_COUNT = 8;
+constexpr uint32_t RESPONSE_BYTES_BOUNDS[RESPONSE_BYTES_BOUND_COUNT] = {
+        64, 256, 1024, 2048, 4096, 8192, 16384, 65536};
+
+struct RouteStats {
+    const char *method;
+    const char *path;
+    MetricHistogram handlerMicros;          ///< Synchronous part of the handler.
+    MetricHistogram responseStartMicros;    ///< Headers parsed until the response was handed to the server.
+    MetricHistogram responseBytes{RESPONSE_BYTES_BOUNDS, RESPONSE_BYTES_BOUND_COUNT};
+    MetricGauge inFlight;
+    MetricGauge heapHeldMax;    ///< Largest drop of free heap across the handler, kept by its response until sent.
+};
+
+struct SlowRequestSample {
+    const char *method;
+    const char *path;
+    uint32_t finishedMs;        ///< millis() when the connection closed.
+    uint32_t waitMicros;        ///< Headers parsed (or body received) until the handler ran.
+    uint32_t handlerMicros;
+    uint32_t responseStartMicros;
+    uint32_t totalMicros;       ///< Headers parsed until the connection closed.
+    uint32_t bytes;
+    uint8_t inFlight;           ///< API requests in flight on every route when this one started.
+};
+
+// Identifies a traced request after its handler returned, for responses that are produced later
+struct RequestTrace {
+    int8_t slot;
+    uint16_t generation;
+};
+
+/**
+ * @brief Registers the arrival probe. Call before any other handler is added.
+ */
+void initRouteTracing(AsyncWebServer &webServer);
+
+/**
+ * @brief Hands out the statistics of one route, nullptr once MAX_TRACED_ROUTES are in use.
+ *
+ * @param method Method name, a string literal.
+ * @param path Route path, a string literal.
+ */
+RouteStats *addRouteStats(const char *method, const char *path);
+
+/**
+ * @brief Starts timing the handler of a request, must be paired with endRouteHandler().
+ */
+RequestTrace beginRouteHandler(RouteStats *route, AsyncWebServerRequest *request);
+
+void endRouteHandler(RequestTrace trace);
+
+/**
+ * @brief Runs callback when the request disconnects. Use this instead of request->onDisconnect(), which keeps
+ *        a single callback and would replace the one that closes the trace.
+ */
+void onRequestDisconnect(AsyncWebServerRequest *request, std::function<void()> callback);
+
+/**
+ * @brief The request whose handler is running, {-1, 0} outside of a traced handler.
+ */
+RequestTrace currentRequestTrace();
+
+/**
+ * @brief Called by the send helpers when they hand a response to the server.
+ */
+void noteResponseStart(RequestTrace trace);
+
+void noteResponseBytes(RequestTrace trace, size_t bytes);
+
+/**
+ * @brief API requests whose handler ran and whose connection is still open.
+ */
+uint8_t apiRequestsInFlight();
+
+uint8_t getRouteStatsCount();
+
+const RouteStats &getRouteStats(uint8_t index);
+
+void handleGetSlowRequests(AsyncWebServerRequest *request);
+
+#endif //ESP32_TERMOSTAT_ROUTESTATS_H
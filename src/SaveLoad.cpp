@@ -1,7 +1,29 @@
 #include "SaveLoad.h"
 #include <LittleFS.h>
 #include <ArduinoJson.h>
+#include <atomic>
+#include <algorithm>
+#include <esp_system.h>
 #include "globalSettings.h"
+#include "EventLog.h"
+
+static std::atomic<uint8_t> dirtyDomains{0};
+static std::atomic<bool> flushRequested{false};
+// Set for an OTA: nothing is written until it fails or the device restarts
+static std::atomic<bool> suspended{false};
+static std::atomic<bool> discardOnRestart{false};
+static uint32_t lastMarkMs[PERSIST_DOMAIN_COUNT];
+static PersistenceStats persistenceStats;
+static portMUX_TYPE persistMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void flushOnRestart() {
+    // A filesystem OTA just replaced the partition, the state in RAM is older than the image
+    if (discardOnRestart.load()) {
+        return;
+    }
+    suspended.store(false);
+    flushPersistenceNow(1000);
+}
 
 void initSaveLoad() {
     if (!LittleFS.begin(true)) {
@@ -9,25 +31,164 @@ void initSaveLoad() {
         return;
     }
     Serial.println("LittleFS mounted successfully");
+    esp_register_shutdown_handler(flushOnRestart);
+}
+
+const char *persistDomainName(PersistDomain domain) {
+    switch (domain) {
+        case PERSIST_ROOMS:
+            return "rooms";
+        case PERSIST_SCHEDULE:
+            return "schedule";
+        case PERSIST_HISTORY:
+            return "history";
+        case PERSIST_HEATING_MODE:
+            return "heating_mode";
+        default:
+            return "unknown";
+    }
+}
+
+static void recordWrite(PersistDomain domain, size_t bytes) {
+    if (bytes == 0) {
+        logEvent(LogModule::PERSISTENCE, LogLevel::ERROR, LogEvent::FILE_WRITE_FAILED, domain);
+    } else {
+        logEvent(LogModule::PERSISTENCE, LogLevel::INFO, LogEvent::FILE_SAVED, domain, bytes);
+    }
+    portENTER_CRITICAL(&persistMux);
+    if (bytes == 0) {
+        persistenceStats.failures++;
+    } else {
+        persistenceStats.written[domain]++;
+        persistenceStats.bytesWritten[domain] += bytes;
+    }
+    portEXIT_CRITICAL(&persistMux);
+}
+
+void markDirty(PersistDomain domain) {
+    portENTER_CRITICAL(&persistMux);
+    persistenceStats.requested[domain]++;
+    lastMarkMs[domain] = millis();
+    portEXIT_CRITICAL(&persistMux);
+    dirtyDomains.fetch_or(1 << domain);
+}
+
+static void writeDomain(PersistDomain domain) {
+    switch (domain) {
+        case PERSIST_ROOMS:
+            saveRooms();
+            break;
+        case PERSIST_SCHEDULE:
+            saveSchedule();
+            break;
+        case PERSIST_HISTORY:
+            saveHistory();
+            break;
+        case PERSIST_HEATING_MODE:
+            saveHeatingMode();
+            break;
+        default:
+            break;
+    }
+}
+
+void suspendPersistence(bool filesystemReplaced) {
+    discardOnRestart.store(filesystemReplaced);
+    suspended.store(true);
+}
+
+void resumePersistence() {
+    discardOnRestart.store(false);
+    suspended.store(false);
+}
+
+void flushDirtyDomains() {
+    if (suspended.load()) {
+        return;
+    }
+    uint8_t dirty = dirtyDomains.load();
+    if (dirty == 0) {
+        flushRequested.store(false);
+        return;
+    }
+    bool force = flushRequested.exchange(false);
+    uint32_t now = millis();
+    for (uint8_t i = 0; i < PERSIST_DOMAIN_COUNT; i++) {
+        if (!(dirty & (1 << i))) {
+            continue;
+        }
+        portENTER_CRITICAL(&persistMux);
+        uint32_t quietFor = now - lastMarkMs[i];
+        portEXIT_CRITICAL(&persistMux);
+        if (!force && quietFor < PERSIST_QUIET_PERIOD_MS) {
+            continue;
+        }
+        // Cleared before writing so a change made while the file is written marks it dirty again
+        dirtyDomains.fetch_and(~(1 << i));
+        writeDomain(static_cast<PersistDomain>(i));
+    }
+}
+
+uint32_t persistenceFlushDelayMs() {
+    uint8_t dirty = dirtyDomains.load();
+    if (dirty == 0 || suspended.load()) {
+        return UINT32_MAX;
+    }
+    uint32_t now = millis();
+    uint32_t delay = UINT32_MAX;
+    portENTER_CRITICAL(&persistMux);
+    for (uint8_t i = 0; i < PERSIST_DOMAIN_COUNT; i++) {
+        if (dirty & (1 << i)) {
+            uint32_t quietFor = now - lastMarkMs[i];
+            uint32_t remaining = quietFor >= PERSIST_QUIET_PERIOD_MS ? 0 : PERSIST_QUIET_PERIOD_MS - quietFor;
+            delay = std::min(delay, remaining);
+        }
+    }
+    portEXIT_CRITICAL(&persistMux);
+    return delay;
+}
+
+void flushPersistenceNow(uint32_t timeoutMs) {
+    if (dirtyDomains.load() == 0 || suspended.load()) {
+        return;
+    }
+    if (relayTaskHandle == NULL || xTaskGetCurrentTaskHandle() == relayTaskHandle) {
+        flushRequested.store(true);
+        flushDirtyDomains();
+        return;
+    }
+    // The relay task owns the data, so it does the writing and this task only waits for it
+    flushRequested.store(true);
+    xTaskNotifyGive(relayTaskHandle);
+    uint32_t start = millis();
+    while (dirtyDomains.load() != 0 && millis() - start < timeoutMs) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    if (dirtyDomains.load() != 0) {
+        logEvent(LogModule::PERSISTENCE, LogLevel::ERROR, LogEvent::FLUSH_TIMED_OUT, dirtyDomains.load());
+    }
+}
+
+PersistenceStats getPersistenceStats() {
+    portENTER_CRITICAL(&persistMux);
+    PersistenceStats copy = persistenceStats;
+    portEXIT_CRITICAL(&persistMux);
+    return copy;
 }
 
 void saveRooms() {
     if (!LittleFS.exists("/rooms.json")) {
-        Serial.println("Rooms file does not exist. Creating new file.");
+        logEvent(LogModule::PERSISTENCE, LogLevel::INFO, LogEvent::FILE_CREATED, PERSIST_ROOMS);
         LittleFS.open("/rooms.json", "w").close();
     }
     File file = LittleFS.open("/rooms.json", "w");
     if (!file) {
-        Serial.println("There was an error opening the file for writing");
+        logEvent(LogModule::PERSISTENCE, LogLevel::ERROR, LogEvent::FILE_OPEN_FAILED, PERSIST_ROOMS);
         return;
     }
     JsonDocument doc;
     JsonArray roomsArray = doc["rooms"].to<JsonArray>();
-    if (rooms.empty()) {
-        Serial.println("No rooms to save");
-        return;
-    }
-    for (Room room: rooms) {
+    for (Room &room: rooms) {
         JsonObject roomObject = roomsArray.add<JsonObject>();
         roomObject["name"] = room.get_room_name();
         roomObject["home_temperature"] = room.get_home_temperature();
@@ -47,10 +208,9 @@ void saveRooms() {
         }
     }
     doc["time"] = time(nullptr);
-    if (serializeJson(doc, file) == 0) {
-        Serial.println("Failed to write to file");
-    }
+    size_t written = serializeJson(doc, file);
     file.close();
+    recordWrite(PERSIST_ROOMS, written);
 }
 
 void loadRooms() {
@@ -82,6 +242,7 @@ void loadRooms() {
                   roomObject["night_high_offset"].as<float>(), true);
         JsonArray thermometersArray = roomObject["thermometers"].as<JsonArray>();
         for (JsonObject thermometerObject: thermometersArray) {
+            // A malformed address is dropped, the registry logs it
             room.addThermometer(thermometerObject["mac"].as<std::string>(), true);
         }
         rooms.push_back(room);
@@ -91,12 +252,12 @@ void loadRooms() {
 
 void saveSchedule() {
     if (!LittleFS.exists("/schedule.json")) {
-        Serial.println("Schedule file does not exist. Creating new file.");
+        logEvent(LogModule::PERSISTENCE, LogLevel::INFO, LogEvent::FILE_CREATED, PERSIST_SCHEDULE);
         LittleFS.open("/schedule.json", "w").close();
     }
     File file = LittleFS.open("/schedule.json", "w");
     if (!file) {
-        Serial.println("There was an error opening the file for writing");
+        logEvent(LogModule::PERSISTENCE, LogLevel::ERROR, LogEvent::FILE_OPEN_FAILED, PERSIST_SCHEDULE);
         return;
     }
     JsonDocument doc;
@@ -170,12 +331,9 @@ void saveSchedule() {
                 break;
         }
     }
-    if (serializeJson(doc, file) == 0) {
-        Serial.println("Failed to write to file");
-    } else {
-        Serial.println("Schedule saved successfully.");
-    }
+    size_t written = serializeJson(doc, file);
     file.close();
+    recordWrite(PERSIST_SCHEDULE, written);
 }
 
 void loadSchedule() {
@@ -255,20 +413,22 @@ void loadSchedule() {
 
 void saveHistory() {
     if (!LittleFS.exists("/history.json")) {
-        Serial.println("History file does not exist. Creating new file.");
+        logEvent(LogModule::PERSISTENCE, LogLevel::INFO, LogEvent::FILE_CREATED, PERSIST_HISTORY);
         File file = LittleFS.open("/history.json", "w");
         if (!file) {
-            Serial.println("Failed to create history file.");
+            logEvent(LogModule::PERSISTENCE, LogLevel::ERROR, LogEvent::FILE_OPEN_FAILED, PERSIST_HISTORY);
             return;
         }
         file.close();
     }
     File file = LittleFS.open("/history.json", "w");
     if (!file) {
-        Serial.println("There was an error opening the file for writing");
+        logEvent(LogModule::PERSISTENCE, LogLevel::ERROR, LogEvent::FILE_OPEN_FAILED, PERSIST_HISTORY);
         return;
     }
     JsonDocument doc;
+    // The getters prune old entries, readers must not walk the maps meanwhile
+    xSemaphoreTake(historySemaphore, portMAX_DELAY);
     JsonArray daysArray = doc["days"].to<JsonArray>();
     for (const auto &day: heatingHistory.getDayHistory()) {
         JsonObject dayObject = daysArray.add<JsonObject>();
@@ -318,13 +478,11 @@ void saveHistory() {
             roomObject["priority"] = room.priority;
         }
     }
+    xSemaphoreGive(historySemaphore);
     doc["time"] = time(nullptr);
-    if (serializeJson(doc, file) == 0) {
-        Serial.println("Failed to write to file");
-    } else {
-        Serial.println("History successfully saved.");
-    }
+    size_t written = serializeJson(doc, file);
     file.close();
+    recordWrite(PERSIST_HISTORY, written);
 }
 
 void loadHistory() {
@@ -431,7 +589,9 @@ void loadHistory() {
             runTimes.push_back(run);
         }
     }
+    xSemaphoreTake(historySemaphore, portMAX_DELAY);
     heatingHistory = HeatingHistory(runTimes, days, months, years);
+    xSemaphoreGive(historySemaphore);
     Serial.println("History successfully loaded.");
     file.close();
 }
@@ -443,7 +603,7 @@ void saveHeatingMode() {
     }
     File file = LittleFS.open("/heatingMode.json", "w");
     if (!file) {
-        Serial.println("There was an error opening the file for writing");
+        logEvent(LogModule::PERSISTENCE, LogLevel::ERROR, LogEvent::FILE_OPEN_FAILED, PERSIST_HEATING_MODE);
         return;
     }
     JsonDocument doc;
@@ -463,10 +623,9 @@ void saveHeatingMode() {
     } else {
         doc["manualMode"] = "OFF";
     }
-    if (serializeJson(doc, file) == 0) {
-        Serial.println("Failed to write to file");
-    }
+    size_t written = serializeJson(doc, file);
     file.close();
+    recordWrite(PERSIST_HEATING_MODE, written);
 }
 
 void loadHeatingMode() {
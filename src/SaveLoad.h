@@ -1,8 +1,67 @@
 #ifndef ESP32_TERMOSTAT_SAVELOAD_H
 #define ESP32_TERMOSTAT_SAVELOAD_H
 
+#include <cstdint>
+
+// Files that are rewritten by the write-behind persistence
+enum PersistDomain : uint8_t {
+    PERSIST_ROOMS,
+    PERSIST_SCHEDULE,
+    PERSIST_HISTORY,
+    PERSIST_HEATING_MODE,
+    PERSIST_DOMAIN_COUNT
+};
+
+// A dirty domain is only written once it has not been touched for this long
+constexpr uint32_t PERSIST_QUIET_PERIOD_MS = 3000;
+
+struct PersistenceStats {
+    uint32_t requested[PERSIST_DOMAIN_COUNT]; ///< markDirty() calls
+    uint32_t written[PERSIST_DOMAIN_COUNT];   ///< Actual file rewrites
+    uint32_t bytesWritten[PERSIST_DOMAIN_COUNT];
+    uint32_t failures;
+};
+
 void initSaveLoad();
 
+/**
+ * @brief Records that a domain changed; the file is rewritten after PERSIST_QUIET_PERIOD_MS without changes.
+ */
+void markDirty(PersistDomain domain);
+
+/**
+ * @brief Writes every dirty domain whose quiet period elapsed, or all of them after flushPersistenceNow().
+ * Only called by the relay task, which owns the data being written.
+ */
+void flushDirtyDomains();
+
+/**
+ * @brief Milliseconds until the next dirty domain is due, UINT32_MAX if nothing is dirty.
+ */
+uint32_t persistenceFlushDelayMs();
+
+/**
+ * @brief Writes all dirty domains right away (OTA start, restart) and waits up to timeoutMs for it.
+ */
+void flushPersistenceNow(uint32_t timeoutMs);
+
+/**
+ * @brief Holds every file write back while an OTA runs, the domains stay dirty. Call after flushPersistenceNow().
+ *
+ * @param filesystemReplaced True for a filesystem image: the restart afterwards then drops the dirty state
+ *        instead of writing it into the new image.
+ */
+void suspendPersistence(bool filesystemReplaced);
+
+/**
+ * @brief Writes resume after a failed OTA, the pending domains are written when due.
+ */
+void resumePersistence();
+
+PersistenceStats getPersistenceStats();
+
+const char *persistDomainName(PersistDomain domain);
+
 void saveRooms();
 
 void loadRooms();
@@ -0,0 +1,44 @@
+#include "ScanPolicy.h"
+
+ScanLevel selectScanLevel(int32_t oldestAgeSeconds, ScanLevel current) {
+    if (oldestAgeSeconds < 0) {
+        return ScanLevel::RELAXED;
+    }
+    if (oldestAgeSeconds >= SCAN_AGGRESSIVE_AGE_S) {
+        return ScanLevel::AGGRESSIVE;
+    }
+    if (current == ScanLevel::AGGRESSIVE && oldestAgeSeconds >= SCAN_AGGRESSIVE_AGE_S - SCAN_RELAX_HYSTERESIS_S) {
+        return ScanLevel::AGGRESSIVE;
+    }
+    if (oldestAgeSeconds >= SCAN_NORMAL_AGE_S) {
+        return ScanLevel::NORMAL;
+    }
+    if (current != ScanLevel::RELAXED && oldestAgeSeconds >= SCAN_NORMAL_AGE_S - SCAN_RELAX_HYSTERESIS_S) {
+        return ScanLevel::NORMAL;
+    }
+    return ScanLevel::RELAXED;
+}
+
+ScanParameters scanParametersFor(ScanLevel level) {
+    switch (level) {
+        case ScanLevel::AGGRESSIVE:
+            return {100, 100}; // 100 % duty, the radio only leaves BLE for WiFi coexistence slots
+        case ScanLevel::NORMAL:
+            return {200, 100};
+        case ScanLevel::RELAXED:
+        default:
+            return {400, 100}; // Still catches one of the ~4 advertisements a sensor sends every 10 s
+    }
+}
+
+const char *scanLevelName(ScanLevel level) {
+    switch (level) {
+        case ScanLevel::AGGRESSIVE:
+            return "aggressive";
+        case ScanLevel::NORMAL:
+            return "normal";
+        case ScanLevel::RELAXED:
+        default:
+            return "relaxed";
+    }
+}
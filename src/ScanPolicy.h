@@ -0,0 +1,45 @@
+#ifndef ESP32_TERMOSTAT_SCANPOLICY_H
+#define ESP32_TERMOSTAT_SCANPOLICY_H
+
+#include <cstdint>
+
+// Plain C++ without Arduino dependencies so the policy can be replayed against recorded sensor ages on a PC.
+
+enum class ScanLevel : uint8_t {
+    RELAXED,    ///< Every sensor heard recently, leave most of the air time to WiFi.
+    NORMAL,
+    AGGRESSIVE, ///< A sensor is getting close to the staleness limit, listen continuously.
+    COUNT
+};
+
+struct ScanParameters {
+    uint16_t intervalMs;
+    uint16_t windowMs;
+};
+
+// Oldest reading age (seconds) at which the policy escalates, measured against the 60 s limit of Room
+constexpr int32_t SCAN_NORMAL_AGE_S = 15;
+constexpr int32_t SCAN_AGGRESSIVE_AGE_S = 30;
+// Ages have to drop this far below a threshold before the policy steps back down
+constexpr int32_t SCAN_RELAX_HYSTERESIS_S = 5;
+// Sensors silent for longer than this are treated as lost (dead battery, moved away) and stop driving the
+// scan, otherwise one missing thermometer would keep the radio at full duty forever
+constexpr int32_t SCAN_LOST_SENSOR_AGE_S = 300;
+
+/**
+ * @brief Chooses the scan level from the age of the stalest registered sensor.
+ *
+ * Escalation is immediate, stepping down needs the age to fall SCAN_RELAX_HYSTERESIS_S below the threshold
+ * so a sensor advertising right at the boundary does not make the scan restart every second.
+ *
+ * @param oldestAgeSeconds Age of the oldest reading among the sensors that are not lost,
+ *                         negative if there is none.
+ * @param current Level currently in use.
+ */
+ScanLevel selectScanLevel(int32_t oldestAgeSeconds, ScanLevel current);
+
+ScanParameters scanParametersFor(ScanLevel level);
+
+const char *scanLevelName(ScanLevel level);
+
+#endif //ESP32_TERMOSTAT_SCANPOLICY_H
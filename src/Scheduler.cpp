@@ -23,7 +23,7 @@ Scheduler::Scheduler(themperature_modes (*schedule)[48], std::vector<directive>
     this->userDirectives = std::move(userDirectives);
     this->smartDirectives = std::move(smartDirectives);
     if (!load) {
-        saveSchedule();
+        markDirty(PERSIST_SCHEDULE);
     }
 }
 
@@ -84,7 +84,7 @@ void Scheduler::addUserDirective(time_t t1, time_t t2, themperature_modes m, boo
     directive d = {t1, m, t2};
     this->userDirectives.push_back(d);
     if (!load) {
-        saveSchedule();
+        markDirty(PERSIST_SCHEDULE);
     }
 }
 
@@ -92,7 +92,7 @@ void Scheduler::addSmartDirective(time_t t1, time_t t2, themperature_modes m, bo
     directive d = {t1, m, t2};
     this->smartDirectives.push_back(d);
     if (!load) {
-        saveSchedule();
+        markDirty(PERSIST_SCHEDULE);
     }
 }
 
@@ -363,18 +363,32 @@ uint8_t Scheduler::getSmartDirectiveNumber() {
 void Scheduler::setScheduleAtTime(uint8_t day, uint8_t time, themperature_modes mode, bool load) {
     this->schedule[day][time] = mode;
     if (!load) {
-        saveSchedule();
+        markDirty(PERSIST_SCHEDULE);
     }
 }
 
+bool Scheduler::setScheduleRange(uint8_t day, uint8_t fromSlot, uint8_t toSlot, themperature_modes mode) {
+    bool changed = false;
+    for (uint8_t slot = fromSlot; slot <= toSlot; slot++) {
+        if (this->schedule[day][slot] != mode) {
+            this->schedule[day][slot] = mode;
+            changed = true;
+        }
+    }
+    if (changed) {
+        markDirty(PERSIST_SCHEDULE);
+    }
+    return changed;
+}
+
 void Scheduler::removeUserDirectiveAtIndex(uint8_t index) {
     this->userDirectives.erase(this->userDirectives.begin() + index);
-    saveSchedule();
+    markDirty(PERSIST_SCHEDULE);
 }
 
 void Scheduler::removeSmartDirectiveAtIndex(uint8_t index) {
     this->smartDirectives.erase(this->smartDirectives.begin() + index);
-    saveSchedule();
+    markDirty(PERSIST_SCHEDULE);
 }
 
 void Scheduler::removeUserDirective(time_t t1, time_t t2, themperature_modes m) {
@@ -382,7 +396,7 @@ void Scheduler::removeUserDirective(time_t t1, time_t t2, themperature_modes m)
         if (this->userDirectives[i].startTime == t1 && this->userDirectives[i].finalTime == t2 &&
             this->userDirectives[i].mode == m) {
             this->userDirectives.erase(this->userDirectives.begin() + i);
-            saveSchedule();
+            markDirty(PERSIST_SCHEDULE);
             return;
         }
     }
@@ -393,7 +407,7 @@ void Scheduler::removeSmartDirective(time_t t1, time_t t2, themperature_modes m)
         if (this->smartDirectives[i].startTime == t1 && this->smartDirectives[i].finalTime == t2 &&
             this->smartDirectives[i].mode == m) {
             this->smartDirectives.erase(this->smartDirectives.begin() + i);
-            saveSchedule();
+            markDirty(PERSIST_SCHEDULE);
             return;
         }
     }
@@ -161,6 +161,17 @@ public:
      */
     void setScheduleAtTime(uint8_t day, uint8_t time, themperature_modes mode, bool load = false);
 
+    /**
+     * @brief Sets a run of consecutive slots of one day, the file is marked dirty once and only if a slot changed.
+     *
+     * @param day The day of the schedule.
+     * @param fromSlot First slot of the run.
+     * @param toSlot Last slot of the run, included.
+     * @param mode The mode to set.
+     * @return True if at least one slot changed.
+     */
+    bool setScheduleRange(uint8_t day, uint8_t fromSlot, uint8_t toSlot, themperature_modes mode);
+
     /**
      * @brief Gets the user directives.
      *
@@ -0,0 +1,56 @@
+#include "SensorDiscovery.h"
+#include <algorithm>
+#include <cstring>
+
+void SensorDiscovery::record(const SensorReading &reading) {
+    portENTER_CRITICAL(&mux);
+    DiscoveredSensor *slot = nullptr;
+    DiscoveredSensor *oldest = nullptr;
+    for (uint8_t i = 0; i < count; i++) {
+        if (memcmp(entries[i].mac, reading.mac, 6) == 0) {
+            slot = &entries[i];
+            break;
+        }
+        if (oldest == nullptr || reading.receivedMs - entries[i].lastSeenMs > reading.receivedMs - oldest->lastSeenMs) {
+            oldest = &entries[i];
+        }
+    }
+    if (slot == nullptr) {
+        if (count < DISCOVERY_CACHE_SIZE) {
+            slot = &entries[count++];
+        } else {
+            slot = oldest;
+            evictions++;
+        }
+        memset(slot, 0, sizeof(*slot));
+        memcpy(slot->mac, reading.mac, 6);
+    }
+    slot->decoder = reading.decoder;
+    slot->rssi = reading.rssi;
+    slot->lastSeenMs = reading.receivedMs;
+    slot->sightings++;
+    if (reading.fields & READING_TEMPERATURE) {
+        slot->hasTemperature = true;
+        slot->temperature = static_cast<float>(reading.temperatureCenti) / 100.0f;
+    }
+    portEXIT_CRITICAL(&mux);
+}
+
+uint8_t SensorDiscovery::listBySignal(DiscoveredSensor *out, uint8_t maxCount) const {
+    portENTER_CRITICAL(&mux);
+    uint8_t copied = std::min(count, maxCount);
+    memcpy(out, entries, copied * sizeof(DiscoveredSensor));
+    portEXIT_CRITICAL(&mux);
+    // Sorting happens on the copy, outside the lock
+    std::sort(out, out + copied, [](const DiscoveredSensor &a, const DiscoveredSensor &b) {
+        return a.rssi > b.rssi;
+    });
+    return copied;
+}
+
+uint32_t SensorDiscovery::evictionCount() const {
+    portENTER_CRITICAL(&mux);
+    uint32_t value = evictions;
+    portEXIT_CRITICAL(&mux);
+    return value;
+}
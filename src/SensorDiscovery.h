@@ -0,0 +1,55 @@
+#ifndef ESP32_TERMOSTAT_SENSORDISCOVERY_H
+#define ESP32_TERMOSTAT_SENSORDISCOVERY_H
+
+#include <cstdint>
+#include <freertos/FreeRTOS.h>
+#include "AdvertisementParser.h"
+
+constexpr uint8_t DISCOVERY_CACHE_SIZE = 24;
+
+/**
+ * @struct DiscoveredSensor
+ * @brief A compatible sensor heard nearby that no room uses yet.
+ */
+struct DiscoveredSensor {
+    uint8_t mac[6];
+    uint8_t decoder;            ///< Format of the last advertisement, see decoderName().
+    int8_t rssi;                ///< Signal strength of the last advertisement.
+    bool hasTemperature;
+    float temperature;          ///< Last temperature, valid when hasTemperature is set.
+    uint32_t sightings;         ///< Decoded advertisements since the sensor entered the cache.
+    uint32_t lastSeenMs;
+};
+
+/**
+ * @class SensorDiscovery
+ * @brief Fixed-size least recently seen cache of unregistered sensors.
+ *
+ * The table is allocated once, a new sensor replaces the one heard longest ago when it is full, so
+ * a crowded BLE environment can only churn the entries and never grow the heap.
+ * Written by the BLE task, read by the web server, both under a short spinlock.
+ */
+class SensorDiscovery {
+private:
+    DiscoveredSensor entries[DISCOVERY_CACHE_SIZE]{};
+    uint8_t count = 0;
+    uint32_t evictions = 0;
+    mutable portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+public:
+    /**
+     * @brief Records a reading that did not match any registered sensor.
+     */
+    void record(const SensorReading &reading);
+
+    /**
+     * @brief Copies the cache ordered by signal strength, strongest first.
+     *
+     * @return Number of entries written to out.
+     */
+    uint8_t listBySignal(DiscoveredSensor *out, uint8_t maxCount) const;
+
+    uint32_t evictionCount() const;
+};
+
+#endif //ESP32_TERMOSTAT_SENSORDISCOVERY_H
@@ -0,0 +1,98 @@
+#include "SensorHealth.h"
+#include <cstring>
+
+static uint8_t gapBucket(uint32_t gapMs) {
+    for (uint8_t i = 0; i < HEALTH_GAP_BUCKETS - 1; i++) {
+        if (gapMs < HEALTH_GAP_BOUNDS_MS[i]) {
+            return i;
+        }
+    }
+    return HEALTH_GAP_BUCKETS - 1;
+}
+
+static void resetBatteryFit(SensorHealth &health) {
+    health.batterySamples = 0;
+    health.fitHours = 0;
+    health.sumT = health.sumV = health.sumTT = health.sumTV = 0;
+}
+
+static void addBatterySample(SensorHealth &health, uint16_t batteryMv, uint32_t nowMs) {
+    if (health.batterySamples > 0) {
+        if (nowMs - health.batterySampleMs < HEALTH_BATTERY_SAMPLE_MS) {
+            return;
+        }
+        if (batteryMv > health.batteryMv + HEALTH_BATTERY_REPLACED_MV) {
+            resetBatteryFit(health);
+        } else {
+            health.fitHours += static_cast<float>(nowMs - health.batterySampleMs) / 3600000.0f;
+        }
+    }
+    double t = health.fitHours;
+    double v = batteryMv;
+    health.sumT += t;
+    health.sumV += v;
+    health.sumTT += t * t;
+    health.sumTV += t * v;
+    health.batterySamples++;
+    health.batterySampleMs = nowMs;
+}
+
+void updateSensorHealth(SensorHealth &health, const SensorReading &reading) {
+    if (!health.hasFrame) {
+        health.hasFrame = true;
+        health.rssiEwma = reading.rssi;
+        health.lastCounter = reading.frameCounter;
+        health.measurementsReceived = 1;
+        health.measurementsExpected = 1;
+    } else {
+        health.rssiEwma += HEALTH_RSSI_ALPHA * (static_cast<float>(reading.rssi) - health.rssiEwma);
+        health.gapCounts[gapBucket(reading.receivedMs - health.lastFrameMs)]++;
+        // Sensors repeat each measurement over several advertisements, only a new counter value counts
+        auto step = static_cast<uint8_t>(reading.frameCounter - health.lastCounter);
+        if (step != 0) {
+            health.measurementsReceived++;
+            health.measurementsExpected += step <= HEALTH_MAX_COUNTER_STEP ? step : 1;
+            health.lastCounter = reading.frameCounter;
+        }
+        // Halve both counts now and then so the estimate follows recent placement changes
+        if (health.measurementsExpected >= 4096) {
+            health.measurementsReceived /= 2;
+            health.measurementsExpected /= 2;
+        }
+    }
+    health.lastFrameMs = reading.receivedMs;
+    if (reading.fields & READING_BATTERY_MV) {
+        addBatterySample(health, reading.batteryMv, reading.receivedMs);
+        health.batteryMv = reading.batteryMv;
+    }
+}
+
+SensorHealthReport makeSensorHealthReport(const SensorHealth &health, uint32_t nowMs) {
+    SensorHealthReport report{};
+    report.hasFrame = health.hasFrame;
+    report.rssiEwma = health.rssiEwma;
+    report.msSinceLastFrame = health.hasFrame ? nowMs - health.lastFrameMs : 0;
+    memcpy(report.gapCounts, health.gapCounts, sizeof(report.gapCounts));
+    report.lossRate = -1;
+    if (health.measurementsExpected > 1) {
+        report.lossRate = 1.0f - static_cast<float>(health.measurementsReceived) /
+                                 static_cast<float>(health.measurementsExpected);
+    }
+    report.batteryMv = health.batteryMv;
+    report.daysToEmpty = -1;
+    if (health.batterySamples >= HEALTH_BATTERY_MIN_SAMPLES) {
+        // Least squares slope of mV over hours
+        double n = health.batterySamples;
+        double denominator = n * health.sumTT - health.sumT * health.sumT;
+        if (denominator > 0) {
+            double slopePerHour = (n * health.sumTV - health.sumT * health.sumV) / denominator;
+            report.hasBatteryTrend = true;
+            report.batteryTrendMvPerDay = static_cast<float>(slopePerHour * 24.0);
+            if (slopePerHour < 0 && health.batteryMv > HEALTH_BATTERY_EMPTY_MV) {
+                report.daysToEmpty = static_cast<float>((health.batteryMv - HEALTH_BATTERY_EMPTY_MV) /
+                                                        (-slopePerHour * 24.0));
+            }
+        }
+    }
+    return report;
+}
@@ -0,0 +1,70 @@
+#ifndef ESP32_TERMOSTAT_SENSORHEALTH_H
+#define ESP32_TERMOSTAT_SENSORHEALTH_H
+
+#include <cstdint>
+#include "AdvertisementParser.h"
+
+// Plain C++ without Arduino dependencies, every update is O(1) and allocation free.
+
+constexpr uint8_t HEALTH_GAP_BUCKETS = 7;
+// Upper bounds of the inter-arrival buckets, the last bucket takes everything from 60 s up
+constexpr uint32_t HEALTH_GAP_BOUNDS_MS[HEALTH_GAP_BUCKETS - 1] = {2000, 5000, 10000, 20000, 30000, 60000};
+// Weight of a new sample in the RSSI moving average
+constexpr float HEALTH_RSSI_ALPHA = 0.125f;
+// The battery fit takes one sample per hour, enough for a trend that moves over months
+constexpr uint32_t HEALTH_BATTERY_SAMPLE_MS = 3600000;
+// A day of samples before the projection is reported
+constexpr uint16_t HEALTH_BATTERY_MIN_SAMPLES = 24;
+// CR2032 sensors stop advertising reliably around this voltage
+constexpr uint16_t HEALTH_BATTERY_EMPTY_MV = 2200;
+// A jump this large between samples means the battery was replaced, the fit restarts
+constexpr uint16_t HEALTH_BATTERY_REPLACED_MV = 300;
+// Counter jumps beyond this are treated as a sensor reboot rather than lost frames
+constexpr uint8_t HEALTH_MAX_COUNTER_STEP = 64;
+
+/**
+ * @struct SensorHealth
+ * @brief Running link and battery statistics of one sensor.
+ */
+struct SensorHealth {
+    bool hasFrame;
+    float rssiEwma;
+    uint32_t lastFrameMs;
+    uint32_t gapCounts[HEALTH_GAP_BUCKETS];
+    uint8_t lastCounter;
+    uint32_t measurementsReceived;  ///< Distinct counter values received.
+    uint32_t measurementsExpected;  ///< Counter steps observed, including the values never received.
+    uint16_t batteryMv;
+    uint32_t batterySampleMs;
+    uint16_t batterySamples;
+    float fitHours;                 ///< Hours since the first battery sample, wrap safe unlike millis().
+    double sumT;
+    double sumV;
+    double sumTT;
+    double sumTV;
+};
+
+/**
+ * @struct SensorHealthReport
+ * @brief Derived values served to the web interface.
+ */
+struct SensorHealthReport {
+    bool hasFrame;
+    float rssiEwma;
+    uint32_t msSinceLastFrame;
+    uint32_t gapCounts[HEALTH_GAP_BUCKETS];
+    float lossRate;                 ///< Share of measurements never received, negative if unknown.
+    uint16_t batteryMv;
+    bool hasBatteryTrend;
+    float batteryTrendMvPerDay;
+    float daysToEmpty;              ///< Negative if the battery is not draining measurably.
+};
+
+/**
+ * @brief Folds one decoded advertisement into the statistics.
+ */
+void updateSensorHealth(SensorHealth &health, const SensorReading &reading);
+
+SensorHealthReport makeSensorHealthReport(const SensorHealth &health, uint32_t nowMs);
+
+#endif //ESP32_TERMOSTAT_SENSORHEALTH_H
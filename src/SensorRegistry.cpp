@@ -0,0 +1,242 @@
+#include "SensorRegistry.h"
+#include <cstdio>
+#include <cstring>
+#include <Arduino.h>
+#include "EventLog.h"
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool parseMacAddress(const std::string &text, uint8_t mac[6]) {
+    if (text.size() != 17) {
+        return false;
+    }
+    for (int i = 0; i < 6; i++) {
+        int high = hexValue(text[i * 3]);
+        int low = hexValue(text[i * 3 + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        if (i < 5 && text[i * 3 + 2] != ':' && text[i * 3 + 2] != '-') {
+            return false;
+        }
+        mac[i] = static_cast<uint8_t>((high << 4) | low);
+    }
+    return true;
+}
+
+void formatMacAddress(const uint8_t mac[6], char *out) {
+    snprintf(out, 18, "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+std::string normalizeMacAddress(const std::string &text) {
+    uint8_t mac[6];
+    if (!parseMacAddress(text, mac)) {
+        return text;
+    }
+    char formatted[18];
+    formatMacAddress(mac, formatted);
+    return formatted;
+}
+
+int SensorRegistry::findLocked(const uint8_t mac[6]) const {
+    for (int i = 0; i < MAX_REGISTERED_SENSORS; i++) {
+        if (entries[i].references > 0 && memcmp(entries[i].state.mac, mac, 6) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool SensorRegistry::registerSensor(const std::string &mac) {
+    uint8_t address[6];
+    if (!parseMacAddress(mac, address)) {
+        logEvent(LogModule::BLE, LogLevel::WARN, LogEvent::SENSOR_ADDRESS_INVALID);
+        return false;
+    }
+    bool registered = false;
+    portENTER_CRITICAL(&mux);
+    int index = findLocked(address);
+    if (index >= 0) {
+        if (entries[index].references < UINT8_MAX) {
+            entries[index].references++;
+        }
+        registered = true;
+    } else {
+        for (auto &entry: entries) {
+            if (entry.references == 0) {
+                memset(&entry, 0, sizeof(entry));
+                memcpy(entry.state.mac, address, 6);
+                entry.references = 1;
+                entry.registeredAtMs = millis();
+                registered = true;
+                break;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&mux);
+    if (!registered) {
+        logEvent(LogModule::BLE, LogLevel::WARN, LogEvent::SENSOR_REGISTRY_FULL);
+    }
+    return registered;
+}
+
+void SensorRegistry::unregisterSensor(const std::string &mac) {
+    uint8_t address[6];
+    if (!parseMacAddress(mac, address)) {
+        return;
+    }
+    portENTER_CRITICAL(&mux);
+    int index = findLocked(address);
+    if (index >= 0) {
+        entries[index].references--;
+    }
+    portEXIT_CRITICAL(&mux);
+}
+
+bool SensorRegistry::apply(const SensorReading &reading, time_t now) {
+    SensorHealth health{};
+    portENTER_CRITICAL(&mux);
+    int index = findLocked(reading.mac);
+    if (index >= 0) {
+        Entry &entry = entries[index];
+        // Freshness follows the temperature, formats that split values over frames only refresh what they carry
+        if (reading.fields & READING_TEMPERATURE) {
+            entry.state.hasReading = true;
+            entry.state.lastSeen = now;
+            entry.state.lastSeenMs = reading.receivedMs;
+            entry.state.temperature = static_cast<float>(reading.temperatureCenti) / 100.0f;
+        }
+        if (reading.fields & READING_HUMIDITY) {
+            entry.state.humidity = static_cast<float>(reading.humidityCenti) / 100.0f;
+        }
+        if (reading.fields & READING_BATTERY_MV) {
+            entry.state.batteryMv = reading.batteryMv;
+        }
+        if (reading.fields & READING_BATTERY_PERCENT) {
+            entry.state.batteryPercent = reading.batteryPercent;
+        }
+        entry.state.decoder = reading.decoder;
+        entry.state.rssi = reading.rssi;
+        health = entry.health;
+        entry.state.frameCounter = reading.frameCounter;
+        entry.state.totalReadings++;
+        if (entry.readingsThisMinute < UINT16_MAX) {
+            entry.readingsThisMinute++;
+        }
+    }
+    portEXIT_CRITICAL(&mux);
+    if (index < 0) {
+        return false;
+    }
+    // The battery fit uses doubles (software emulated on the ESP32), it runs on a copy outside of the lock.
+    // Only the BLE task updates health, so nothing else can change it in between.
+    updateSensorHealth(health, reading);
+    portENTER_CRITICAL(&mux);
+    // The room may have dropped the sensor meanwhile
+    if (entries[index].references > 0 && memcmp(entries[index].state.mac, reading.mac, 6) == 0) {
+        entries[index].health = health;
+    }
+    portEXIT_CRITICAL(&mux);
+    return true;
+}
+
+void SensorRegistry::rollMinute(uint32_t nowMs) {
+    if (nowMs - minuteStartMs < 60000) {
+        return;
+    }
+    portENTER_CRITICAL(&mux);
+    for (auto &entry: entries) {
+        entry.state.readingsLastMinute = entry.readingsThisMinute;
+        entry.readingsThisMinute = 0;
+    }
+    portEXIT_CRITICAL(&mux);
+    minuteStartMs = nowMs;
+}
+
+bool SensorRegistry::getState(const std::string &mac, SensorState &out) const {
+    uint8_t address[6];
+    if (!parseMacAddress(mac, address)) {
+        return false;
+    }
+    portENTER_CRITICAL(&mux);
+    int index = findLocked(address);
+    if (index >= 0) {
+        out = entries[index].state;
+    }
+    portEXIT_CRITICAL(&mux);
+    return index >= 0;
+}
+
+bool SensorRegistry::contains(const uint8_t mac[6]) const {
+    portENTER_CRITICAL(&mux);
+    bool found = findLocked(mac) >= 0;
+    portEXIT_CRITICAL(&mux);
+    return found;
+}
+
+int32_t SensorRegistry::oldestReadingAge(uint32_t nowMs, int32_t ignoreOlderThan) const {
+    int32_t oldest = -1;
+    portENTER_CRITICAL(&mux);
+    for (const auto &entry: entries) {
+        if (entry.references == 0) {
+            continue;
+        }
+        uint32_t sinceMs = entry.state.hasReading ? entry.state.lastSeenMs : entry.registeredAtMs;
+        auto age = static_cast<int32_t>((nowMs - sinceMs) / 1000);
+        if (age > ignoreOlderThan) {
+            continue;
+        }
+        // Nothing heard yet counts as the stalest sensor still worth waiting for
+        if (!entry.state.hasReading) {
+            age = ignoreOlderThan;
+        }
+        if (age > oldest) {
+            oldest = age;
+        }
+    }
+    portEXIT_CRITICAL(&mux);
+    return oldest;
+}
+
+uint8_t SensorRegistry::listHealth(SensorHealthEntry *out, uint8_t maxCount, uint32_t nowMs) const {
+    uint8_t count = 0;
+    SensorHealth health{};
+    for (const auto &entry: entries) {
+        if (count >= maxCount) {
+            break;
+        }
+        // Copy under the lock, the least squares math runs outside of it
+        portENTER_CRITICAL(&mux);
+        bool used = entry.references > 0;
+        if (used) {
+            memcpy(out[count].mac, entry.state.mac, 6);
+            out[count].readingsLastMinute = entry.state.readingsLastMinute;
+            health = entry.health;
+        }
+        portEXIT_CRITICAL(&mux);
+        if (used) {
+            out[count++].report = makeSensorHealthReport(health, nowMs);
+        }
+    }
+    return count;
+}
+
+uint8_t SensorRegistry::list(SensorState *out, uint8_t maxCount) const {
+    uint8_t count = 0;
+    portENTER_CRITICAL(&mux);
+    for (const auto &entry: entries) {
+        if (count >= maxCount) {
+            break;
+        }
+        if (entry.references > 0) {
+            out[count++] = entry.state;
+        }
+    }
+    portEXIT_CRITICAL(&mux);
+    return count;
+}
@@ -0,0 +1,141 @@
+#ifndef ESP32_TERMOSTAT_SENSORREGISTRY_H
+#define ESP32_TERMOSTAT_SENSORREGISTRY_H
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <freertos/FreeRTOS.h>
+#include "AdvertisementParser.h"
+#include "SensorHealth.h"
+
+// Enough for every room to use its full set of thermometers (MAX_ROOMS * MAX_ROOM_THERMOMETERS)
+constexpr uint8_t MAX_REGISTERED_SENSORS = 64;
+// Same limit Room has always used to decide whether a thermometer still counts
+constexpr time_t SENSOR_STALE_SECONDS = 60;
+
+/**
+ * @struct SensorState
+ * @brief Copy of the latest data known for one registered sensor.
+ */
+struct SensorState {
+    uint8_t mac[6];
+    bool hasReading;            ///< False until the first temperature was received.
+    time_t lastSeen;            ///< time() of the last temperature.
+    uint32_t lastSeenMs;        ///< millis() of the last temperature.
+    float temperature;
+    float humidity;
+    uint16_t batteryMv;
+    uint8_t batteryPercent;
+    int8_t rssi;
+    uint8_t frameCounter;
+    uint8_t decoder;            ///< Format of the last advertisement, see decoderName().
+    uint32_t totalReadings;     ///< Advertisements received since the sensor was registered.
+    uint16_t readingsLastMinute;///< Advertisements received during the last complete minute.
+
+    bool isFresh(time_t now) const {
+        return hasReading && now - lastSeen < SENSOR_STALE_SECONDS;
+    }
+};
+
+struct SensorHealthEntry {
+    uint8_t mac[6];
+    uint16_t readingsLastMinute;
+    SensorHealthReport report;
+};
+
+/**
+ * @class SensorRegistry
+ * @brief Fixed table of the thermometers used by rooms, fed by the BLE scan consumer.
+ *
+ * Rooms register the MAC addresses they use (reference counted, a sensor may belong to several rooms),
+ * the BLE task applies decoded readings and everybody else reads copies. Every access holds a spinlock
+ * for a handful of word copies only, so the table is safe to use from any task.
+ */
+class SensorRegistry {
+private:
+    struct Entry {
+        SensorState state;
+        uint8_t references;     ///< Rooms using this sensor, 0 marks a free slot.
+        uint32_t registeredAtMs;///< Stands in for lastSeenMs until the first reading arrives.
+        uint16_t readingsThisMinute;
+        SensorHealth health;
+    };
+
+    Entry entries[MAX_REGISTERED_SENSORS]{};
+    uint32_t minuteStartMs = 0;
+    mutable portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+    int findLocked(const uint8_t mac[6]) const;
+
+public:
+    /**
+     * @brief Adds a reference to a sensor, creating its slot if needed.
+     *
+     * @return False if the MAC is malformed or the table is full.
+     */
+    bool registerSensor(const std::string &mac);
+
+    /**
+     * @brief Drops a reference, the slot is freed when no room uses the sensor anymore.
+     */
+    void unregisterSensor(const std::string &mac);
+
+    /**
+     * @brief Stores a reading if it belongs to a registered sensor. Called by the BLE task.
+     *
+     * @return True if the reading matched a registered sensor.
+     */
+    bool apply(const SensorReading &reading, time_t now);
+
+    /**
+     * @brief Closes the per-minute reading counters once a minute has elapsed since the last call.
+     */
+    void rollMinute(uint32_t nowMs);
+
+    bool getState(const std::string &mac, SensorState &out) const;
+
+    bool contains(const uint8_t mac[6]) const;
+
+    /**
+     * @brief Age of the stalest sensor. Uses millis() so an NTP adjustment cannot make every sensor look
+     * stale at once.
+     *
+     * @param ignoreOlderThan Sensors older than this many seconds are skipped. A sensor never heard reports
+     *                        this age until that long after its registration.
+     * @return Age in seconds, -1 if no registered sensor is within ignoreOlderThan.
+     */
+    int32_t oldestReadingAge(uint32_t nowMs, int32_t ignoreOlderThan) const;
+
+    /**
+     * @brief Builds the link and battery report of every registered sensor.
+     *
+     * @return Number of entries written to out.
+     */
+    uint8_t listHealth(SensorHealthEntry *out, uint8_t maxCount, uint32_t nowMs) const;
+
+    /**
+     * @brief Copies the state of every registered sensor.
+     *
+     * @return Number of entries written to out.
+     */
+    uint8_t list(SensorState *out, uint8_t maxCount) const;
+};
+
+/**
+ * @brief Parses "AA:BB:CC:DD:EE:FF" (any case, ':' or '-' separators) into display-order bytes.
+ */
+bool parseMacAddress(const std::string &text, uint8_t mac[6]);
+
+/**
+ * @brief Formats display-order bytes as upper case "AA:BB:CC:DD:EE:FF".
+ *
+ * @param out Buffer of at least 18 characters.
+ */
+void formatMacAddress(const uint8_t mac[6], char *out);
+
+/**
+ * @brief Returns the MAC in the canonical upper case form, or the input unchanged if it cannot be parsed.
+ */
+std::string normalizeMacAddress(const std::string &text);
+
+#endif //ESP32_TERMOSTAT_SENSORREGISTRY_H
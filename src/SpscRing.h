@@ -0,0 +1,69 @@
+#ifndef ESP32_TERMOSTAT_SPSCRING_H
+#define ESP32_TERMOSTAT_SPSCRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @class SpscRing
+ * @brief Fixed-size lock-free queue for exactly one producer task and one consumer task.
+ *
+ * push() never blocks and never allocates, so it is safe to call from the NimBLE host callbacks.
+ * When the consumer falls behind, new items are dropped and counted instead of overwriting old ones.
+ *
+ * @tparam T Item type, copied by value.
+ * @tparam Capacity Number of slots, must be a power of two.
+ */
+template<typename T, size_t Capacity>
+class SpscRing {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+private:
+    T items[Capacity];
+    std::atomic<uint32_t> head{0}; ///< Next slot to write, only advanced by the producer.
+    std::atomic<uint32_t> tail{0}; ///< Next slot to read, only advanced by the consumer.
+    std::atomic<uint32_t> dropped{0};
+
+public:
+    /**
+     * @brief Appends an item. Producer side only.
+     *
+     * @return False if the ring was full and the item was dropped.
+     */
+    bool push(const T &item) {
+        uint32_t writeIndex = head.load(std::memory_order_relaxed);
+        if (writeIndex - tail.load(std::memory_order_acquire) >= Capacity) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        items[writeIndex & (Capacity - 1)] = item;
+        head.store(writeIndex + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Removes the oldest item. Consumer side only.
+     *
+     * @return False if the ring was empty.
+     */
+    bool pop(T &item) {
+        uint32_t readIndex = tail.load(std::memory_order_relaxed);
+        if (readIndex == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = items[readIndex & (Capacity - 1)];
+        tail.store(readIndex + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    uint32_t droppedCount() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+};
+
+#endif //ESP32_TERMOSTAT_SPSCRING_H
@@ -0,0 +1,82 @@
+#ifndef ESP32_TERMOSTAT_STATESNAPSHOT_H
+#define ESP32_TERMOSTAT_STATESNAPSHOT_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * @class PublishedSnapshot
+ * @brief Double-buffered seqlock holding the latest immutable copy of a state domain.
+ *
+ * Exactly one task may call publish(). It always writes the buffer readers are not pointed at and then
+ * bumps the version, so readers never block the writer and the writer never waits for readers. A reader
+ * copies the active buffer and retries if the version moved while it was copying, which is the only case
+ * in which the writer could have started overwriting that buffer. The writer fences before overwriting,
+ * so a reader that saw any of the new bytes also sees the version that moved before them.
+ *
+ * @tparam T A trivially copyable snapshot structure.
+ */
+template<typename T>
+class PublishedSnapshot {
+    static_assert(std::is_trivially_copyable<T>::value, "Snapshots are copied with memcpy");
+
+private:
+    T buffers[2]{};
+    std::atomic<uint32_t> sequence{0};
+
+public:
+    /**
+     * @brief Publishes a new version. Must only be called from the owning task.
+     *
+     * @param value The new state.
+     */
+    void publish(const T &value) {
+        uint32_t current = sequence.load(std::memory_order_relaxed);
+        // The buffer about to be overwritten was the active one until the previous publish. Its version store
+        // must not be overtaken by the copy, pairs with the acquire fence in read()
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(&buffers[(current + 1) & 1], &value, sizeof(T));
+        sequence.store(current + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Copies the latest version without taking any lock.
+     *
+     * @param out Destination of the copy.
+     * @param version Optional output for the version that was copied.
+     * @param maxAttempts How many times to retry when a publish races with the copy.
+     * @return False only if every attempt raced with a publish.
+     */
+    bool read(T &out, uint32_t *version = nullptr, uint8_t maxAttempts = 8) const {
+        for (uint8_t attempt = 0; attempt < maxAttempts; ++attempt) {
+            uint32_t before = sequence.load(std::memory_order_acquire);
+            std::memcpy(&out, &buffers[before & 1], sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == before) {
+                if (version != nullptr) {
+                    *version = before;
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Gets the version of the latest published state.
+     */
+    uint32_t version() const {
+        return sequence.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Direct access to the latest published state, only valid from the owning task.
+     */
+    const T &writerView() const {
+        return buffers[sequence.load(std::memory_order_relaxed) & 1];
+    }
+};
+
+#endif //ESP32_TERMOSTAT_STATESNAPSHOT_H
@@ -0,0 +1,134 @@
+#include "StaticAssets.h"
+#include <Arduino.h>
+#include <LittleFS.h>
+
+struct StaticAsset {
+    char path[STATIC_ASSET_PATH_LEN];       ///< URL path, the file on LittleFS is path + ".gz".
+    char etag[STATIC_ASSET_ETAG_LEN];       ///< Quoted, ready for the ETag header.
+    const char *contentType;
+    bool immutable;
+};
+
+static StaticAsset assets[MAX_STATIC_ASSETS];
+static uint8_t assetCount = 0;
+
+static const char *contentTypeFor(const char *path) {
+    const char *extension = strrchr(path, '.');
+    if (extension == nullptr) return "application/octet-stream";
+    if (strcmp(extension, ".html") == 0) return "text/html";
+    if (strcmp(extension, ".js") == 0) return "application/javascript";
+    if (strcmp(extension, ".css") == 0) return "text/css";
+    if (strcmp(extension, ".json") == 0) return "application/json";
+    if (strcmp(extension, ".svg") == 0) return "image/svg+xml";
+    if (strcmp(extension, ".ico") == 0) return "image/x-icon";
+    return "application/octet-stream";
+}
+
+static bool loadManifest() {
+    File manifest = LittleFS.open(STATIC_ASSET_MANIFEST, "r");
+    if (!manifest) {
+        return false;
+    }
+    char line[STATIC_ASSET_PATH_LEN + STATIC_ASSET_ETAG_LEN + 8];
+    char name[STATIC_ASSET_PATH_LEN - 1];  // The path adds a leading "/"
+    char tag[STATIC_ASSET_ETAG_LEN - 2];
+    int immutable = 0;
+    while (manifest.available() && assetCount < MAX_STATIC_ASSETS) {
+        size_t length = manifest.readBytesUntil('\n', line, sizeof(line) - 1);
+        line[length] = '\0';
+        if (sscanf(line, "%46s %21s %d", name, tag, &immutable) != 3) {
+            continue;
+        }
+        StaticAsset &asset = assets[assetCount++];
+        snprintf(asset.path, sizeof(asset.path), "/%s", name);
+        snprintf(asset.etag, sizeof(asset.etag), "\"%s\"", tag);
+        asset.contentType = contentTypeFor(asset.path);
+        asset.immutable = immutable != 0;
+    }
+    manifest.close();
+    return assetCount > 0;
+}
+
+// q parameter of one coding in [coding, end), 1 when it has none
+static float codingQuality(const char *coding, const char *end) {
+    const char *q = coding;
+    while ((q = strstr(q, "q=")) != nullptr && q < end) {
+        if (q[-1] == ';' || q[-1] == ' ') {
+            return strtof(q + 2, nullptr);
+        }
+        q += 2;
+    }
+    return 1.0f;
+}
+
+// Without Accept-Encoding any coding is acceptable, otherwise gzip (or *) has to be listed with a quality above 0
+static bool acceptsGzip(AsyncWebServerRequest *request) {
+    AsyncWebHeader *acceptEncoding = request->getHeader("Accept-Encoding");
+    if (acceptEncoding == nullptr) {
+        return true;
+    }
+    float gzipQuality = -1.0f;
+    float wildcardQuality = 0.0f;
+    const char *coding = acceptEncoding->value().c_str();
+    while (*coding != '\0') {
+        while (*coding == ' ' || *coding == ',') {
+            coding++;
+        }
+        const char *end = coding + strcspn(coding, ",");
+        size_t length = strcspn(coding, ";, ");
+        if (length == 4 && strncasecmp(coding, "gzip", 4) == 0) {
+            gzipQuality = codingQuality(coding + length, end);
+        } else if (length == 1 && coding[0] == '*') {
+            wildcardQuality = codingQuality(coding + length, end);
+        }
+        coding = end;
+    }
+    // Named explicitly, gzip;q=0 refuses it even next to a wildcard
+    return gzipQuality >= 0.0f ? gzipQuality > 0.0f : wildcardQuality > 0.0f;
+}
+
+static void sendAsset(AsyncWebServerRequest *request, const StaticAsset &asset) {
+    const char *cacheControl = asset.immutable ? "public, max-age=31536000, immutable" : "no-cache";
+    AsyncWebHeader *ifNoneMatch = request->getHeader("If-None-Match");
+    if (ifNoneMatch != nullptr && ifNoneMatch->value() == asset.etag) {
+        AsyncWebServerResponse *response = request->beginResponse(304);
+        response->addHeader("ETag", asset.etag);
+        response->addHeader("Cache-Control", cacheControl);
+        response->addHeader("Vary", "Accept-Encoding");
+        request->send(response);
+        return;
+    }
+    // Only the compressed file is on flash, a client that refuses gzip cannot be served
+    if (!acceptsGzip(request)) {
+        AsyncWebServerResponse *response = request->beginResponse(406, "text/plain", "Este necesar gzip");
+        response->addHeader("Vary", "Accept-Encoding");
+        request->send(response);
+        return;
+    }
+    // Only path + ".gz" exists, the file response picks it up and adds Content-Encoding: gzip
+    AsyncWebServerResponse *response = request->beginResponse(LittleFS, asset.path, asset.contentType);
+    response->addHeader("ETag", asset.etag);
+    response->addHeader("Cache-Control", cacheControl);
+    response->addHeader("Vary", "Accept-Encoding");
+    request->send(response);
+}
+
+bool registerStaticAssets(AsyncWebServer &webServer) {
+    if (!loadManifest()) {
+        Serial.println("No static asset manifest, serving plain files");
+        return false;
+    }
+    for (uint8_t i = 0; i < assetCount; i++) {
+        const StaticAsset &asset = assets[i];
+        webServer.on(asset.path, HTTP_GET, [&asset](AsyncWebServerRequest *request) {
+            sendAsset(request, asset);
+        });
+        if (strcmp(asset.path, "/index.html") == 0) {
+            webServer.on("/", HTTP_GET, [&asset](AsyncWebServerRequest *request) {
+                sendAsset(request, asset);
+            });
+        }
+    }
+    Serial.printf("Serving %u compressed static assets\n", assetCount);
+    return true;
+}
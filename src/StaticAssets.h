@@ -0,0 +1,24 @@
+#ifndef ESP32_TERMOSTAT_STATICASSETS_H
+#define ESP32_TERMOSTAT_STATICASSETS_H
+
+#include <ESPAsyncWebServer.h>
+
+// Written by scripts/build_web_assets.py next to the gzip-compressed assets
+constexpr const char *STATIC_ASSET_MANIFEST = "/assets.txt";
+constexpr uint8_t MAX_STATIC_ASSETS = 16;
+constexpr size_t STATIC_ASSET_PATH_LEN = 48;
+constexpr size_t STATIC_ASSET_ETAG_LEN = 24;
+
+/**
+ * @brief Registers one route per asset listed in the manifest.
+ *
+ * Assets are sent gzip-compressed with a strong ETag, If-None-Match is answered with 304. A client whose
+ * Accept-Encoding refuses gzip gets 406, flash only holds the compressed files.
+ * Content-hashed names are cacheable for a year, index.html has to be revalidated on every load.
+ *
+ * @return False if the manifest is missing (LittleFS image from before the asset build step),
+ *         the caller should fall back to serving the plain files.
+ */
+bool registerStaticAssets(AsyncWebServer &webServer);
+
+#endif //ESP32_TERMOSTAT_STATICASSETS_H
@@ -0,0 +1,465 @@
+#include "SystemState.h"
+#include <Arduino.h>
+#include <freertos/queue.h>
+#include "StateSnapshot.h"
+#include "ChangeLog.h"
+#include "SaveLoad.h"
+#include "globalSettings.h"
+#include "EventLog.h"
+
+static_assert(MAX_REGISTERED_SENSORS >= MAX_ROOMS * MAX_ROOM_THERMOMETERS,
+              "Every thermometer a room accepts must fit in the sensor registry");
+
+static PublishedSnapshot<RoomsSnapshot> roomsState;
+static PublishedSnapshot<HeatingSnapshot> heatingState;
+static PublishedSnapshot<ScheduleSnapshot> scheduleState;
+static QueueHandle_t stateCommandQueue = NULL;
+
+// Staging buffers of the owning task, kept static so building a snapshot costs no stack or heap
+static RoomsSnapshot roomsStaging;
+static HeatingSnapshot heatingStaging;
+static ScheduleSnapshot scheduleStaging;
+static StateCommand pendingCommand;
+
+bool copyStateString(char *destination, size_t size, const char *source) {
+    size_t length = strlen(source);
+    bool fits = length < size;
+    if (!fits) {
+        length = size - 1;
+    }
+    memcpy(destination, source, length);
+    destination[length] = '\0';
+    return fits;
+}
+
+static Room *findLiveRoom(const char *roomName) {
+    for (auto &room: rooms) {
+        if (room.get_room_name() == roomName) {
+            return &room;
+        }
+    }
+    return nullptr;
+}
+
+static void applyRoomSettings(Room &room, const RoomSettings &settings) {
+    if (settings.fields & ROOM_FIELD_HOME_TARGET) room.set_home_temperature(settings.homeTarget, true);
+    if (settings.fields & ROOM_FIELD_HOME_LOW) room.set_home_low_offset(settings.homeLowOffset, true);
+    if (settings.fields & ROOM_FIELD_HOME_HIGH) room.set_home_high_offset(settings.homeHighOffset, true);
+    if (settings.fields & ROOM_FIELD_AWAY_TARGET) room.set_away_temperature(settings.awayTarget, true);
+    if (settings.fields & ROOM_FIELD_AWAY_LOW) room.set_away_low_offset(settings.awayLowOffset, true);
+    if (settings.fields & ROOM_FIELD_AWAY_HIGH) room.set_away_high_offset(settings.awayHighOffset, true);
+    if (settings.fields & ROOM_FIELD_NIGHT_TARGET) room.set_night_temperature(settings.nightTarget, true);
+    if (settings.fields & ROOM_FIELD_NIGHT_LOW) room.set_night_low_offset(settings.nightLowOffset, true);
+    if (settings.fields & ROOM_FIELD_NIGHT_HIGH) room.set_night_high_offset(settings.nightHighOffset, true);
+    if (settings.fields & ROOM_FIELD_PRIORITY) room.set_room_priority(settings.priority, true);
+}
+
+static void removeAllThermometers(Room &room) {
+    while (room.get_thermometer_number() > 0) {
+        room.removeThermometer(room.get_mac_by_index(0), true);
+    }
+}
+
+static bool applyStateCommand(const StateCommand &command) {
+    switch (command.type) {
+        case StateCommandType::CREATE_ROOM: {
+            if (findLiveRoom(command.roomName) != nullptr || rooms.size() >= MAX_ROOMS) {
+                logEvent(LogModule::STATE, LogLevel::WARN, LogEvent::ROOM_CREATE_REJECTED, rooms.size());
+                return false;
+            }
+            const RoomSettings &s = command.settings;
+            rooms.emplace_back(command.roomName, s.homeTarget, s.homeLowOffset, s.homeHighOffset, s.priority,
+                               s.awayTarget, s.awayLowOffset, s.awayHighOffset, s.nightTarget, s.nightLowOffset,
+                               s.nightHighOffset, true);
+            markDirty(PERSIST_ROOMS);
+            return true;
+        }
+        case StateCommandType::UPDATE_ROOM: {
+            Room *room = findLiveRoom(command.roomName);
+            if (room == nullptr) {
+                logEvent(LogModule::STATE, LogLevel::WARN, LogEvent::ROOM_UPDATE_UNKNOWN);
+                return false;
+            }
+            applyRoomSettings(*room, command.settings);
+            markDirty(PERSIST_ROOMS);
+            return true;
+        }
+        case StateCommandType::DELETE_ROOM: {
+            for (auto it = rooms.begin(); it != rooms.end(); ++it) {
+                if (it->get_room_name() == command.roomName) {
+                    removeAllThermometers(*it);
+                    rooms.erase(it);
+                    markDirty(PERSIST_ROOMS);
+                    return true;
+                }
+            }
+            return false;
+        }
+        case StateCommandType::ADD_THERMOMETER: {
+            Room *room = findLiveRoom(command.roomName);
+            uint8_t address[6];
+            if (room == nullptr || !parseMacAddress(command.mac, address) || room->thermometerExist(command.mac) ||
+                room->get_thermometer_number() >= MAX_ROOM_THERMOMETERS) {
+                logEvent(LogModule::STATE, LogLevel::WARN, LogEvent::THERMOMETER_ADD_REJECTED,
+                         room != nullptr ? room->get_thermometer_number() : -1);
+                return false;
+            }
+            if (!room->addThermometer(command.mac, true)) {
+                logEvent(LogModule::STATE, LogLevel::WARN, LogEvent::THERMOMETER_ADD_REJECTED,
+                         room->get_thermometer_number());
+                return false;
+            }
+            markDirty(PERSIST_ROOMS);
+            return true;
+        }
+        case StateCommandType::REMOVE_THERMOMETER: {
+            Room *room = findLiveRoom(command.roomName);
+            if (room == nullptr || !room->thermometerExist(command.mac)) {
+                return false;
+            }
+            room->removeThermometer(command.mac, true);
+            markDirty(PERSIST_ROOMS);
+            return true;
+        }
+        case StateCommandType::RESET_ROOMS: {
+            for (auto &room: rooms) {
+                removeAllThermometers(room);
+            }
+            rooms.clear();
+            markDirty(PERSIST_ROOMS);
+            return true;
+        }
+        case StateCommandType::SET_HEATING_MODE:
+            heatingMode = command.heating;
+            markDirty(PERSIST_HEATING_MODE);
+            return true;
+        case StateCommandType::SET_MANUAL_MODE:
+            manualMode = command.manual;
+            markDirty(PERSIST_HEATING_MODE);
+            return true;
+        case StateCommandType::SET_SCHEDULE_SLOT:
+            if (command.day >= 7 || command.slot >= 48) {
+                return false;
+            }
+            scheduler.setScheduleAtTime(command.day, command.slot, command.scheduleMode);
+            return true;
+        case StateCommandType::APPLY_BATCH:
+        case StateCommandType::SET_SCHEDULE_RANGES:
+            // Handled by applyStateBatch and applyScheduleRanges
+            return false;
+    }
+    return false;
+}
+
+bool batchThermometerPresent(const StateBatch &batch, uint8_t upTo, const char *roomName, const char *mac,
+                             bool presentBefore) {
+    bool present = presentBefore;
+    for (uint8_t i = 0; i < upTo && i < batch.count; i++) {
+        const StateCommand &operation = batch.operations[i];
+        if ((operation.type == StateCommandType::ADD_THERMOMETER ||
+             operation.type == StateCommandType::REMOVE_THERMOMETER) &&
+            strcmp(operation.roomName, roomName) == 0 && strcasecmp(operation.mac, mac) == 0) {
+            present = operation.type == StateCommandType::ADD_THERMOMETER;
+        }
+    }
+    return present;
+}
+
+uint8_t batchThermometerCount(const StateBatch &batch, uint8_t upTo, const char *roomName, uint8_t countBefore) {
+    int count = countBefore;
+    for (uint8_t i = 0; i < upTo && i < batch.count; i++) {
+        const StateCommand &operation = batch.operations[i];
+        if (strcmp(operation.roomName, roomName) != 0) {
+            continue;
+        }
+        if (operation.type == StateCommandType::ADD_THERMOMETER) {
+            count++;
+        } else if (operation.type == StateCommandType::REMOVE_THERMOMETER) {
+            count--;
+        }
+    }
+    return count < 0 ? 0 : static_cast<uint8_t>(count);
+}
+
+// Checks one operation against the live state as the earlier operations of the batch will leave it
+static bool batchOperationValid(const StateBatch &batch, uint8_t index) {
+    const StateCommand &operation = batch.operations[index];
+    switch (operation.type) {
+        case StateCommandType::UPDATE_ROOM:
+            return findLiveRoom(operation.roomName) != nullptr;
+        case StateCommandType::ADD_THERMOMETER: {
+            Room *room = findLiveRoom(operation.roomName);
+            uint8_t address[6];
+            return room != nullptr && parseMacAddress(operation.mac, address) &&
+                   !batchThermometerPresent(batch, index, operation.roomName, operation.mac,
+                                            room->thermometerExist(operation.mac)) &&
+                   batchThermometerCount(batch, index, operation.roomName, room->get_thermometer_number()) <
+                   MAX_ROOM_THERMOMETERS;
+        }
+        case StateCommandType::REMOVE_THERMOMETER: {
+            Room *room = findLiveRoom(operation.roomName);
+            return room != nullptr && batchThermometerPresent(batch, index, operation.roomName, operation.mac,
+                                                              room->thermometerExist(operation.mac));
+        }
+        case StateCommandType::SET_HEATING_MODE:
+        case StateCommandType::SET_MANUAL_MODE:
+            return true;
+        case StateCommandType::SET_SCHEDULE_SLOT:
+            return operation.day < 7 && operation.slot < 48;
+        default:
+            return false;
+    }
+}
+
+// Which snapshot a successfully applied command changed
+static void noteChangedDomain(StateCommandType type, bool &roomsChanged, bool &heatingChanged,
+                              bool &scheduleChanged) {
+    switch (type) {
+        case StateCommandType::SET_HEATING_MODE:
+        case StateCommandType::SET_MANUAL_MODE:
+            heatingChanged = true;
+            break;
+        case StateCommandType::SET_SCHEDULE_SLOT:
+            scheduleChanged = true;
+            break;
+        default:
+            roomsChanged = true;
+            break;
+    }
+}
+
+static void applyStateBatch(const StateBatch &batch, bool &roomsChanged, bool &heatingChanged,
+                            bool &scheduleChanged) {
+    // The batch was checked against a snapshot, another command may have been applied since
+    for (uint8_t i = 0; i < batch.count; i++) {
+        if (!batchOperationValid(batch, i)) {
+            logEvent(LogModule::STATE, LogLevel::WARN, LogEvent::BATCH_REJECTED, i);
+            return;
+        }
+    }
+    for (uint8_t i = 0; i < batch.count; i++) {
+        if (applyStateCommand(batch.operations[i])) {
+            noteChangedDomain(batch.operations[i].type, roomsChanged, heatingChanged, scheduleChanged);
+        }
+    }
+}
+
+// One commit for the whole request: every range is checked before any slot changes
+static bool applyScheduleRanges(const ScheduleRanges &ranges) {
+    for (uint8_t i = 0; i < ranges.count; i++) {
+        const ScheduleRange &range = ranges.ranges[i];
+        if (range.day >= 7 || range.fromSlot > range.toSlot || range.toSlot >= 48) {
+            logEvent(LogModule::STATE, LogLevel::WARN, LogEvent::SCHEDULE_RANGE_REJECTED, i);
+            return false;
+        }
+    }
+    bool changed = false;
+    for (uint8_t i = 0; i < ranges.count; i++) {
+        const ScheduleRange &range = ranges.ranges[i];
+        changed |= scheduler.setScheduleRange(range.day, range.fromSlot, range.toSlot, range.mode);
+    }
+    return changed;
+}
+
+void initSystemState() {
+    if (stateCommandQueue == NULL) {
+        stateCommandQueue = xQueueCreate(STATE_COMMAND_QUEUE_LENGTH, sizeof(StateCommand));
+        if (stateCommandQueue == NULL) {
+            Serial.println("Failed to create state command queue");
+        }
+    }
+    publishRoomsSnapshot();
+    publishHeatingSnapshot();
+    publishScheduleSnapshot();
+}
+
+bool submitStateCommand(const StateCommand &command) {
+    if (stateCommandQueue == NULL) {
+        return false;
+    }
+    if (xQueueSend(stateCommandQueue, &command, pdMS_TO_TICKS(100)) != pdTRUE) {
+        logEvent(LogModule::STATE, LogLevel::ERROR, LogEvent::STATE_QUEUE_FULL, static_cast<int32_t>(command.type));
+        return false;
+    }
+    requestControlUpdate();
+    return true;
+}
+
+bool submitStateBatch(StateBatch *batch) {
+    StateCommand command{};
+    command.type = StateCommandType::APPLY_BATCH;
+    command.batch = batch;
+    return submitStateCommand(command);
+}
+
+bool submitScheduleRanges(ScheduleRanges *ranges) {
+    StateCommand command{};
+    command.type = StateCommandType::SET_SCHEDULE_RANGES;
+    command.ranges = ranges;
+    return submitStateCommand(command);
+}
+
+bool applyPendingStateCommands() {
+    if (stateCommandQueue == NULL) {
+        return false;
+    }
+    bool roomsChanged = false, heatingChanged = false, scheduleChanged = false;
+    while (xQueueReceive(stateCommandQueue, &pendingCommand, 0) == pdTRUE) {
+        if (pendingCommand.type == StateCommandType::APPLY_BATCH) {
+            if (pendingCommand.batch != nullptr) {
+                applyStateBatch(*pendingCommand.batch, roomsChanged, heatingChanged, scheduleChanged);
+                delete pendingCommand.batch;
+            }
+            continue;
+        }
+        if (pendingCommand.type == StateCommandType::SET_SCHEDULE_RANGES) {
+            if (pendingCommand.ranges != nullptr) {
+                scheduleChanged |= applyScheduleRanges(*pendingCommand.ranges);
+                delete pendingCommand.ranges;
+            }
+            continue;
+        }
+        if (applyStateCommand(pendingCommand)) {
+            noteChangedDomain(pendingCommand.type, roomsChanged, heatingChanged, scheduleChanged);
+        }
+    }
+    if (roomsChanged) publishRoomsSnapshot();
+    if (heatingChanged) publishHeatingSnapshot();
+    if (scheduleChanged) publishScheduleSnapshot();
+    return roomsChanged || heatingChanged || scheduleChanged;
+}
+
+bool publishRoomsSnapshot(bool *aggregatesChanged) {
+    memset(&roomsStaging, 0, sizeof(roomsStaging));
+    roomsStaging.mode = Room::get_room_mode();
+    for (auto &room: rooms) {
+        if (roomsStaging.roomCount >= MAX_ROOMS) {
+            break;
+        }
+        RoomSnapshot &target = roomsStaging.rooms[roomsStaging.roomCount++];
+        copyStateString(target.name, sizeof(target.name), room.get_room_name().c_str());
+        target.valid = room.valid_thermometers();
+        target.currentTemperature = room.getRoomTemperature();
+        target.currentHumidity = room.get_humidity();
+        target.homeTarget = room.get_home_temperature();
+        target.homeLowOffset = room.get_home_low_offset();
+        target.homeHighOffset = room.get_home_high_offset();
+        target.awayTarget = room.get_away_temperature();
+        target.awayLowOffset = room.get_away_low_offset();
+        target.awayHighOffset = room.get_away_high_offset();
+        target.nightTarget = room.get_night_temperature();
+        target.nightLowOffset = room.get_night_low_offset();
+        target.nightHighOffset = room.get_night_high_offset();
+        target.priority = room.get_room_priority();
+        uint8_t count = room.get_thermometer_number();
+        for (uint8_t i = 0; i < count && target.thermometerCount < MAX_ROOM_THERMOMETERS; i++) {
+            ThermometerSnapshot &thermometer = target.thermometers[target.thermometerCount++];
+            copyStateString(thermometer.mac, sizeof(thermometer.mac), room.get_mac_by_index(i).c_str());
+            thermometer.valid = room.get_valid_by_index(i);
+            thermometer.temperature = thermometer.valid ? room.get_temperature_by_index(i) : 0.0f;
+            thermometer.humidity = room.get_humidity_by_index(i);
+            thermometer.batteryMv = room.get_battery_mv_by_index(i);
+            thermometer.batteryPercent = room.get_battery_percent_by_index(i);
+        }
+    }
+
+    const RoomsSnapshot &published = roomsState.writerView();
+    if (aggregatesChanged != nullptr) {
+        bool changed = published.mode != roomsStaging.mode || published.roomCount != roomsStaging.roomCount;
+        for (uint8_t i = 0; !changed && i < roomsStaging.roomCount; i++) {
+            changed = published.rooms[i].valid != roomsStaging.rooms[i].valid ||
+                      published.rooms[i].currentTemperature != roomsStaging.rooms[i].currentTemperature;
+        }
+        *aggregatesChanged = changed;
+    }
+    if (roomsState.version() != 0) {
+        if (memcmp(&published, &roomsStaging, sizeof(RoomsSnapshot)) == 0) {
+            return false;
+        }
+        recordRoomsChanges(published, roomsStaging);
+    }
+    roomsState.publish(roomsStaging);
+    return true;
+}
+
+bool publishHeatingSnapshot() {
+    memset(&heatingStaging, 0, sizeof(heatingStaging));
+    heatingStaging.mode = heatingMode;
+    heatingStaging.manual = manualMode;
+    heatingStaging.isHeating = isHeating;
+    if (heatingState.version() != 0) {
+        if (memcmp(&heatingState.writerView(), &heatingStaging, sizeof(HeatingSnapshot)) == 0) {
+            return false;
+        }
+        recordHeatingChange();
+    }
+    heatingState.publish(heatingStaging);
+    return true;
+}
+
+bool publishScheduleSnapshot() {
+    memset(&scheduleStaging, 0, sizeof(scheduleStaging));
+    for (uint8_t day = 0; day < 7; day++) {
+        for (uint8_t slot = 0; slot < 48; slot++) {
+            scheduleStaging.slots[day][slot] = scheduler.getScheduleAtTime(day, slot);
+        }
+    }
+    uint8_t userCount = scheduler.getUserDirectiveNumber();
+    for (uint8_t i = 0; i < userCount && scheduleStaging.userDirectiveCount < MAX_SNAPSHOT_DIRECTIVES; i++) {
+        scheduleStaging.userDirectives[scheduleStaging.userDirectiveCount++] = scheduler.getUserDirectiveAtIndex(i);
+    }
+    uint8_t smartCount = scheduler.getSmartDirectiveNumber();
+    for (uint8_t i = 0; i < smartCount && scheduleStaging.smartDirectiveCount < MAX_SNAPSHOT_DIRECTIVES; i++) {
+        scheduleStaging.smartDirectives[scheduleStaging.smartDirectiveCount++] = scheduler.getSmartDirectiveAtIndex(i);
+    }
+    if (scheduleState.version() != 0) {
+        if (memcmp(&scheduleState.writerView(), &scheduleStaging, sizeof(ScheduleSnapshot)) == 0) {
+            return false;
+        }
+        recordScheduleChanges(scheduleState.writerView(), scheduleStaging);
+    }
+    scheduleState.publish(scheduleStaging);
+    return true;
+}
+
+bool readRoomsSnapshot(RoomsSnapshot &out, uint32_t *version) {
+    return roomsState.read(out, version);
+}
+
+bool readHeatingSnapshot(HeatingSnapshot &out, uint32_t *version) {
+    return heatingState.read(out, version);
+}
+
+bool readScheduleSnapshot(ScheduleSnapshot &out, uint32_t *version) {
+    return scheduleState.read(out, version);
+}
+
+uint32_t roomsSnapshotVersion() {
+    return roomsState.version();
+}
+
+uint32_t heatingSnapshotVersion() {
+    return heatingState.version();
+}
+
+uint32_t scheduleSnapshotVersion() {
+    return scheduleState.version();
+}
+
+const RoomSnapshot *findRoomSnapshot(const RoomsSnapshot &snapshot, const char *roomName) {
+    for (uint8_t i = 0; i < snapshot.roomCount; i++) {
+        if (strcmp(snapshot.rooms[i].name, roomName) == 0) {
+            return &snapshot.rooms[i];
+        }
+    }
+    return nullptr;
+}
+
+bool roomSnapshotHasThermometer(const RoomSnapshot &room, const char *mac) {
+    for (uint8_t i = 0; i < room.thermometerCount; i++) {
+        if (strcasecmp(room.thermometers[i].mac, mac) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
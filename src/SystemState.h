@@ -0,0 +1,234 @@
+#ifndef ESP32_TERMOSTAT_SYSTEMSTATE_H
+#define ESP32_TERMOSTAT_SYSTEMSTATE_H
+
+#include <cstdint>
+#include <ctime>
+#include "Room.h"
+#include "Scheduler.h"
+#include "HeatingControl.h"
+
+// Rooms, heating mode and the scheduler are owned by the relay task. Every other task reads the
+// snapshots published below and asks for changes by submitting a StateCommand.
+
+constexpr uint8_t MAX_ROOMS = 16;
+constexpr uint8_t MAX_ROOM_THERMOMETERS = 4;
+constexpr uint8_t MAX_SNAPSHOT_DIRECTIVES = 16;
+constexpr size_t ROOM_NAME_LEN = 32;
+constexpr size_t MAC_STRING_LEN = 18;
+constexpr uint8_t STATE_COMMAND_QUEUE_LENGTH = 16;
+constexpr uint8_t MAX_BATCH_OPERATIONS = 16;
+// A whole week with a different mode every other slot needs 336, real templates and strokes need a few dozen
+constexpr uint8_t MAX_SCHEDULE_RANGES = 64;
+
+struct ThermometerSnapshot {
+    char mac[MAC_STRING_LEN];
+    bool valid;
+    float temperature;
+    float humidity;
+    int32_t batteryMv;
+    int32_t batteryPercent;
+};
+
+struct RoomSnapshot {
+    char name[ROOM_NAME_LEN];
+    bool valid;
+    float currentTemperature;
+    float currentHumidity;
+    float homeTarget;
+    float homeLowOffset;
+    float homeHighOffset;
+    float awayTarget;
+    float awayLowOffset;
+    float awayHighOffset;
+    float nightTarget;
+    float nightLowOffset;
+    float nightHighOffset;
+    float priority;
+    uint8_t thermometerCount;
+    ThermometerSnapshot thermometers[MAX_ROOM_THERMOMETERS];
+};
+
+struct RoomsSnapshot {
+    themperature_modes mode;
+    uint8_t roomCount;
+    RoomSnapshot rooms[MAX_ROOMS];
+};
+
+struct HeatingSnapshot {
+    enum heatingMode mode;
+    enum manualMode manual;
+    bool isHeating;
+};
+
+struct ScheduleSnapshot {
+    uint8_t slots[7][48];
+    uint8_t userDirectiveCount;
+    uint8_t smartDirectiveCount;
+    directive userDirectives[MAX_SNAPSHOT_DIRECTIVES];
+    directive smartDirectives[MAX_SNAPSHOT_DIRECTIVES];
+};
+
+enum class StateCommandType : uint8_t {
+    CREATE_ROOM,
+    UPDATE_ROOM,
+    DELETE_ROOM,
+    ADD_THERMOMETER,
+    REMOVE_THERMOMETER,
+    RESET_ROOMS,
+    SET_HEATING_MODE,
+    SET_MANUAL_MODE,
+    SET_SCHEDULE_SLOT,
+    APPLY_BATCH,
+    SET_SCHEDULE_RANGES
+};
+
+// Bits of RoomSettings::fields, telling which values an UPDATE_ROOM command carries
+enum RoomSettingField : uint16_t {
+    ROOM_FIELD_HOME_TARGET = 1 << 0,
+    ROOM_FIELD_HOME_LOW = 1 << 1,
+    ROOM_FIELD_HOME_HIGH = 1 << 2,
+    ROOM_FIELD_AWAY_TARGET = 1 << 3,
+    ROOM_FIELD_AWAY_LOW = 1 << 4,
+    ROOM_FIELD_AWAY_HIGH = 1 << 5,
+    ROOM_FIELD_NIGHT_TARGET = 1 << 6,
+    ROOM_FIELD_NIGHT_LOW = 1 << 7,
+    ROOM_FIELD_NIGHT_HIGH = 1 << 8,
+    ROOM_FIELD_PRIORITY = 1 << 9,
+    ROOM_FIELD_ALL = (1 << 10) - 1
+};
+
+struct RoomSettings {
+    uint16_t fields;
+    float homeTarget;
+    float homeLowOffset;
+    float homeHighOffset;
+    float awayTarget;
+    float awayLowOffset;
+    float awayHighOffset;
+    float nightTarget;
+    float nightLowOffset;
+    float nightHighOffset;
+    float priority;
+};
+
+struct StateBatch;
+struct ScheduleRanges;
+
+struct StateCommand {
+    StateCommandType type;
+    char roomName[ROOM_NAME_LEN];
+    char mac[MAC_STRING_LEN];
+    RoomSettings settings;
+    enum heatingMode heating;
+    enum manualMode manual;
+    uint8_t day;
+    uint8_t slot;
+    themperature_modes scheduleMode;
+    StateBatch *batch;  ///< APPLY_BATCH only, heap allocated and freed by the owning task.
+    ScheduleRanges *ranges;  ///< SET_SCHEDULE_RANGES only, heap allocated and freed by the owning task.
+};
+
+// Operations applied in one pass of the owning task, all of them or none. Only UPDATE_ROOM,
+// ADD_THERMOMETER, REMOVE_THERMOMETER, SET_HEATING_MODE, SET_MANUAL_MODE and SET_SCHEDULE_SLOT are allowed.
+struct StateBatch {
+    uint8_t count;
+    StateCommand operations[MAX_BATCH_OPERATIONS];
+};
+
+struct ScheduleRange {
+    uint8_t day;
+    uint8_t fromSlot;
+    uint8_t toSlot;     ///< Included.
+    themperature_modes mode;
+};
+
+// Runs of schedule slots applied in one pass of the owning task, all of them or none
+struct ScheduleRanges {
+    uint8_t count;
+    ScheduleRange ranges[MAX_SCHEDULE_RANGES];
+};
+
+/**
+ * @brief Creates the command queue and publishes the state loaded from flash. Call once from setup().
+ */
+void initSystemState();
+
+/**
+ * @brief Queues a change for the owning task and wakes it.
+ *
+ * @return False if the queue stayed full, the caller should answer 503.
+ */
+bool submitStateCommand(const StateCommand &command);
+
+/**
+ * @brief Queues a batch. On success the owning task takes over the batch and frees it.
+ *
+ * @return False if the queue stayed full, the batch still belongs to the caller.
+ */
+bool submitStateBatch(StateBatch *batch);
+
+/**
+ * @brief Queues schedule ranges. On success the owning task takes over the ranges and frees them.
+ *
+ * @return False if the queue stayed full, the ranges still belong to the caller.
+ */
+bool submitScheduleRanges(ScheduleRanges *ranges);
+
+/**
+ * @brief Tells whether a thermometer will be in a room once the first upTo operations of a batch are applied.
+ *
+ * @param presentBefore Whether it is in the room before the batch.
+ */
+bool batchThermometerPresent(const StateBatch &batch, uint8_t upTo, const char *roomName, const char *mac,
+                             bool presentBefore);
+
+/**
+ * @brief Number of thermometers of a room once the first upTo operations of a batch are applied.
+ */
+uint8_t batchThermometerCount(const StateBatch &batch, uint8_t upTo, const char *roomName, uint8_t countBefore);
+
+/**
+ * @brief Applies every queued command. Only called by the owning task.
+ *
+ * @return True if at least one command changed the state.
+ */
+bool applyPendingStateCommands();
+
+/**
+ * @brief Rebuilds the rooms snapshot from the live rooms and publishes it if anything changed.
+ * Only called by the owning task.
+ *
+ * @param aggregatesChanged Set when a room temperature, validity or the room mode changed.
+ * @return True if a new version was published.
+ */
+bool publishRoomsSnapshot(bool *aggregatesChanged = nullptr);
+
+bool publishHeatingSnapshot();
+
+bool publishScheduleSnapshot();
+
+bool readRoomsSnapshot(RoomsSnapshot &out, uint32_t *version = nullptr);
+
+bool readHeatingSnapshot(HeatingSnapshot &out, uint32_t *version = nullptr);
+
+bool readScheduleSnapshot(ScheduleSnapshot &out, uint32_t *version = nullptr);
+
+// Versions only move when a publish changed something, so they can key caches without copying the snapshot
+uint32_t roomsSnapshotVersion();
+
+uint32_t heatingSnapshotVersion();
+
+uint32_t scheduleSnapshotVersion();
+
+const RoomSnapshot *findRoomSnapshot(const RoomsSnapshot &snapshot, const char *roomName);
+
+bool roomSnapshotHasThermometer(const RoomSnapshot &room, const char *mac);
+
+/**
+ * @brief Copies a string into a fixed-size snapshot field.
+ *
+ * @return False if the value had to be truncated.
+ */
+bool copyStateString(char *destination, size_t size, const char *source);
+
+#endif //ESP32_TERMOSTAT_SYSTEMSTATE_H
@@ -4,7 +4,8 @@
 #include <vector>
 #include "Room.h"
 #include "Scheduler.h"
-#include "BLEAdvertisingReader.h"
+#include "SensorRegistry.h"
+#include "SensorDiscovery.h"
 #include "HeatingHistory.h"
 #include "HeatingControl.h"
 #include <freertos/FreeRTOS.h>
@@ -13,23 +14,24 @@
 
 extern std::vector<Room> rooms;
 extern Scheduler scheduler;
-extern BLEAdvertisingReader bleAdvertisingReader;
+extern SensorRegistry sensorRegistry;
+extern SensorDiscovery sensorDiscovery;
 extern HeatingHistory heatingHistory;
 extern bool isHeating;
 extern heatingMode heatingMode;
 extern manualMode manualMode;
-// Add mutex for scheduler operations
-extern portMUX_TYPE schedulerMux;
-extern SemaphoreHandle_t schedulerMutex;
+// rooms, scheduler, isHeating, heatingMode and manualMode are owned by the relay task,
+// other tasks go through SystemState.h
 // Replace mutex with semaphore for BLE operations
 extern SemaphoreHandle_t bleSemaphore;
-// Add mutex for heating control operations
+// Held by the relay task while it changes or saves heatingHistory and by web handlers while they read it
+extern SemaphoreHandle_t historySemaphore;
+// Guards the control latency histogram shared between the relay task and the web server
 extern portMUX_TYPE heatingMux;
 
 // Add task handles for better management
 extern TaskHandle_t webServerTaskHandle;
 extern TaskHandle_t bleTaskHandle;
-extern TaskHandle_t scheduleTaskHandle;
 extern TaskHandle_t relayTaskHandle;
 
 // Add flag for global watchdog initialization
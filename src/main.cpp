@@ -7,17 +7,21 @@
 #include "HeatingControl.h"
 #include "LocalAPI.h"
 #include "OTAUpdate.h"
-
-void print_free_mem() {
-    Serial.printf("Free heap: %u bytes\n", ESP.getFreeHeap());
-}
+#include "SystemState.h"
+#include "LiveEvents.h"
+#include "Metrics.h"
+#include "EventLog.h"
+#include <esp_system.h>
 
 void WebServerTask(void *pv);
-constexpr uint32_t WEB_TASK_STACK =  32* 1024;   // 12kB stack
+constexpr uint32_t WEB_TASK_STACK = 32 * 1024;   // 32kB stack, check /api/debug/tasks before shrinking it
 
 void setup() {
     Serial.begin(115200);
 
+    logEvent(LogModule::SYSTEM, LogLevel::INFO, LogEvent::BOOT, esp_reset_reason());
+    initSemaphores();
+    initMetrics();
     initSaveLoad();
     initBLEConnection();
     initWiFi(false);
@@ -29,9 +33,9 @@ void setup() {
     loadSchedule();
     loadHistory();
     loadHeatingMode();
+    initSystemState();
     Serial.println("Starting advertising readings");
     beginAdvertisingReadings();
-    start_schedule_sync();
     Serial.println("Starting web server task");
     vTaskDelay(10000 / portTICK_PERIOD_MS);
     xTaskCreatePinnedToCore(
@@ -40,7 +44,7 @@ void setup() {
         WEB_TASK_STACK,
         nullptr,
         1,
-        nullptr,
+        &webServerTaskHandle,
         0);
     start_relay_sync();
     startOTAUpdate();
@@ -60,6 +64,8 @@ void WebServerTask(void *pv) {
     Serial.println("Starting Web server task");
     startWebServer(nullptr);
     for (;;) {
-        vTaskDelay(5000 / portTICK_PERIOD_MS);
+        vTaskDelay(pdMS_TO_TICKS(EVENT_COALESCE_MS));
+        publishLiveEvents();
+        flushEventLog();
     }
 }
@@ -0,0 +1,285 @@
+// Admission control in front of the API: the per-client token bucket, the in-flight and heap limits, the
+// preformatted rejection and the body segments of a rejected request
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "Admission.h"
+#include "HeapTracker.h"
+#include "HostStubs.h"
+#include "HostTest.h"
+
+// RouteStats.cpp counts the requests in flight, it needs the whole web server
+static uint8_t requestsInFlight = 0;
+
+uint8_t apiRequestsInFlight() {
+    return requestsInFlight;
+}
+
+// Every test starts from its own clients, the buckets of the earlier ones would leak into it
+static uint32_t nextAddress = 0x0A000001;
+
+static uint32_t newAddress() {
+    return nextAddress++;
+}
+
+static Admission admitFrom(uint32_t address) {
+    AsyncWebServerRequest request;
+    request.connection.ip = address;
+    return admitRequest(&request);
+}
+
+// Admitted requests in a row from address before the first rejection
+static uint32_t admittedInARow(uint32_t address) {
+    uint32_t admitted = 0;
+    while (admitFrom(address) == Admission::ADMITTED) {
+        admitted++;
+        CHECK(admitted <= CLIENT_REQUEST_BURST);
+    }
+    return admitted;
+}
+
+static std::string sentBytes(const AsyncClient &client) {
+    std::string bytes;
+    for (size_t i = 0; i < client.segmentCount; i++) {
+        bytes.append(client.segments[i], client.segmentLengths[i]);
+    }
+    return bytes;
+}
+
+static void testBurstThenRefill() {
+    hostMillis = 1000;
+    uint32_t address = newAddress();
+    uint32_t limited = rateLimitedMetric.get();
+    CHECK_EQ(admittedInARow(address), CLIENT_REQUEST_BURST);
+    CHECK_EQ(rateLimitedMetric.get(), limited + 1);
+
+    // 5 per second is one every 200 ms, a refill is never rounded away
+    hostMillis += 199;
+    CHECK(admitFrom(address) == Admission::RATE_LIMITED);
+    hostMillis += 1;
+    CHECK(admitFrom(address) == Admission::ADMITTED);
+    CHECK(admitFrom(address) == Admission::RATE_LIMITED);
+    // Rejected requests keep what they refilled
+    hostMillis += 100;
+    CHECK(admitFrom(address) == Admission::RATE_LIMITED);
+    hostMillis += 100;
+    CHECK(admitFrom(address) == Admission::ADMITTED);
+
+    hostMillis += 1000;
+    CHECK_EQ(admittedInARow(address), CLIENT_REQUESTS_PER_SECOND);
+}
+
+static void testLongIdleOnlyFillsTheBucket() {
+    uint32_t address = newAddress();
+    hostMillis = 5000;
+    CHECK_EQ(admittedInARow(address), CLIENT_REQUEST_BURST);
+    // Long enough that elapsed * rate would overflow 32 bits
+    hostMillis += 3000000000u;
+    CHECK_EQ(admittedInARow(address), CLIENT_REQUEST_BURST);
+}
+
+static void testRefillAcrossMillisWrap() {
+    uint32_t address = newAddress();
+    hostMillis = 0xFFFFFF00u;
+    CHECK_EQ(admittedInARow(address), CLIENT_REQUEST_BURST);
+    // 0x100 + 0x48 = 328 ms across the wrap, one token and most of a second
+    hostMillis = 0x48;
+    CHECK(admitFrom(address) == Admission::ADMITTED);
+    CHECK(admitFrom(address) == Admission::RATE_LIMITED);
+}
+
+static void testClientsHaveTheirOwnBuckets() {
+    hostMillis = 10000;
+    uint32_t first = newAddress();
+    uint32_t second = newAddress();
+    CHECK_EQ(admittedInARow(first), CLIENT_REQUEST_BURST);
+    CHECK_EQ(admittedInARow(second), CLIENT_REQUEST_BURST);
+    CHECK(admitFrom(first) == Admission::RATE_LIMITED);
+}
+
+static void testOnlyRefilledBucketsAreReused() {
+    hostMillis = 20000;
+    uint32_t addresses[RATE_LIMITED_CLIENTS];
+    for (uint32_t &address: addresses) {
+        address = newAddress();
+        CHECK_EQ(admittedInARow(address), CLIENT_REQUEST_BURST);
+        hostMillis += 1;
+    }
+    // Every bucket was used within the refill window, newcomers share the overflow bucket
+    uint32_t shared = sharedBucketMetric.get();
+    uint32_t newcomer = newAddress();
+    uint32_t another = newAddress();
+    uint32_t admitted = 0;
+    while (admitFrom(admitted % 2 == 0 ? newcomer : another) == Admission::ADMITTED) {
+        admitted++;
+        CHECK(admitted <= CLIENT_REQUEST_BURST);
+    }
+    CHECK_EQ(admitted, CLIENT_REQUEST_BURST);
+    CHECK_EQ(sharedBucketMetric.get(), shared + CLIENT_REQUEST_BURST + 1);
+    // The tracked clients kept their empty buckets
+    CHECK(admitFrom(addresses[0]) == Admission::RATE_LIMITED);
+    CHECK(admitFrom(addresses[1]) == Admission::RATE_LIMITED);
+
+    // addresses[2] is now the least recently seen, its bucket is handed on once it would be full again
+    hostMillis = 20002 + CLIENT_BUCKET_REFILL_MS - 1;
+    shared = sharedBucketMetric.get();
+    admitFrom(newcomer);
+    CHECK_EQ(sharedBucketMetric.get(), shared + 1);
+    hostMillis += 1;
+    CHECK_EQ(admittedInARow(newcomer), CLIENT_REQUEST_BURST);
+    CHECK_EQ(sharedBucketMetric.get(), shared + 1);
+}
+
+// Many more clients than buckets, each sending far above its rate: what gets through stays bounded by the
+// tracked buckets plus the shared one. Also what the AsyncTCP task pays per request of the flood. The relay and
+// BLE tasks do not wait on this task, their scheduling is not modelled on the host.
+static void testFloodFromManyClients() {
+    constexpr uint32_t FLOOD_CLIENTS = 4 * RATE_LIMITED_CLIENTS;
+    constexpr uint32_t FLOOD_SECONDS = 10;
+    constexpr uint32_t REQUEST_EVERY_MS = 20;
+    hostMillis = 100000;
+    uint32_t base = newAddress();
+    nextAddress += FLOOD_CLIENTS;
+    unsigned long admitted = 0;
+    unsigned long requests = 0;
+    double floodNs = measureNanos(1, [&](unsigned long) {
+        for (uint32_t elapsed = 0; elapsed < FLOOD_SECONDS * 1000; elapsed += REQUEST_EVERY_MS) {
+            for (uint32_t client = 0; client < FLOOD_CLIENTS; client++) {
+                admitted += admitFrom(base + client) == Admission::ADMITTED ? 1 : 0;
+                requests++;
+            }
+            hostMillis += REQUEST_EVERY_MS;
+        }
+    });
+    double perRequestNs = floodNs / requests;
+    // Every bucket gives at most its burst and its refill
+    unsigned long bound = (RATE_LIMITED_CLIENTS + 1) * (CLIENT_REQUEST_BURST +
+                                                        CLIENT_REQUESTS_PER_SECOND * FLOOD_SECONDS);
+    std::printf("flood of %lu requests from %u clients over %u s: %lu admitted (bound %lu), %.1f ns per "
+                "request\n", requests, FLOOD_CLIENTS, FLOOD_SECONDS, admitted, bound, perRequestNs);
+    CHECK(admitted <= bound);
+}
+
+static void testInFlightCap() {
+    hostMillis = 30000;
+    uint32_t address = newAddress();
+    uint32_t overloaded = overloadedMetric.get();
+    uint32_t limited = rateLimitedMetric.get();
+    requestsInFlight = MAX_CONCURRENT_API_REQUESTS - 1;
+    CHECK(admitFrom(address) == Admission::ADMITTED);
+    requestsInFlight = MAX_CONCURRENT_API_REQUESTS;
+    CHECK(admitFrom(address) == Admission::OVERLOADED);
+    requestsInFlight = MAX_CONCURRENT_API_REQUESTS + 2;
+    CHECK(admitFrom(address) == Admission::OVERLOADED);
+    CHECK_EQ(overloadedMetric.get(), overloaded + 2);
+    CHECK_EQ(rateLimitedMetric.get(), limited);
+
+    // An empty bucket answers 429 before the in-flight count is looked at
+    while (admitFrom(address) != Admission::RATE_LIMITED) {
+    }
+    CHECK_EQ(rateLimitedMetric.get(), limited + 1);
+    requestsInFlight = 0;
+}
+
+static void testFragmentedHeap() {
+    hostMillis = 40000;
+    uint32_t address = newAddress();
+    hostMaxAllocHeap = ADMISSION_MIN_FREE_BLOCK - 1;
+    CHECK(admitFrom(address) == Admission::OVERLOADED);
+    hostMaxAllocHeap = ADMISSION_MIN_FREE_BLOCK;
+    CHECK(admitFrom(address) == Admission::ADMITTED);
+    hostMaxAllocHeap = 100000;
+}
+
+static void checkRejection(Admission admission, const char *statusLine) {
+    AsyncWebServerRequest request;
+    unsigned long before = heapUsage().allocations;
+    rejectRequest(&request, admission);
+    CHECK_EQ(heapUsage().allocations - before, 0);
+
+    const AsyncClient &client = request.connection;
+    CHECK(client.sent);
+    CHECK(!client.closed);
+    CHECK_EQ(request.sendCount, 0);
+    for (size_t i = 0; i < client.segmentCount; i++) {
+        // Sent from the constants, lwIP must not copy them
+        CHECK_EQ(client.segmentFlags[i], 0);
+    }
+    std::string bytes = sentBytes(client);
+    // The counter does see allocations, copying the reply out took one
+    CHECK(heapUsage().allocations > before);
+    CHECK(bytes.compare(0, strlen(statusLine), statusLine) == 0);
+    CHECK(bytes.find("\r\nRetry-After: 1\r\n") != std::string::npos);
+    CHECK(bytes.find("\r\nConnection: close\r\n") != std::string::npos);
+
+    size_t headEnd = bytes.find("\r\n\r\n");
+    CHECK(headEnd != std::string::npos);
+    size_t lengthAt = bytes.find("Content-Length: ");
+    CHECK(lengthAt != std::string::npos && lengthAt < headEnd);
+    unsigned long contentLength = strtoul(bytes.c_str() + lengthAt + strlen("Content-Length: "), nullptr, 10);
+    std::string body = bytes.substr(headEnd + 4);
+    CHECK_EQ(body.size(), contentLength);
+    CHECK(body.front() == '{' && body.back() == '}');
+
+    // Closed by the next poll of the connection, not under the parser
+    request.connection.poll();
+    CHECK(client.closed);
+}
+
+static void testRejectionIsPreformatted() {
+    checkRejection(Admission::RATE_LIMITED, "HTTP/1.1 429 Too Many Requests\r\n");
+    checkRejection(Admission::OVERLOADED, "HTTP/1.1 503 Service Unavailable\r\n");
+}
+
+static void testRejectedBodyIsDropped() {
+    hostMillis = 50000;
+    uint32_t address = newAddress();
+    CHECK_EQ(admittedInARow(address), CLIENT_REQUEST_BURST);
+
+    AsyncWebServerRequest request;
+    request.connection.ip = address;
+    CHECK(!admitBodySegment(&request, 0));
+    size_t segments = request.connection.segmentCount;
+    CHECK(segments > 0);
+    // Later segments neither reach the handler nor answer again
+    CHECK(!admitBodySegment(&request, 512));
+    CHECK(!admitBodySegment(&request, 1024));
+    CHECK_EQ(request.connection.segmentCount, segments);
+
+    // The next request on the same object is decided afresh once a token is back
+    hostMillis += 200;
+    request.connection.segmentCount = 0;
+    CHECK(admitBodySegment(&request, 0));
+    CHECK(admitBodySegment(&request, 512));
+    CHECK_EQ(request.connection.segmentCount, 0);
+}
+
+static void benchmarkAdmission() {
+    constexpr unsigned long ITERATIONS = 1000000;
+    AsyncWebServerRequest request;
+    uint32_t base = newAddress();
+    nextAddress += RATE_LIMITED_CLIENTS;
+    double admitNs = measureNanos(ITERATIONS, [&](unsigned long i) {
+        // A full table of clients, each seen every 16th request
+        request.connection.ip = base + static_cast<uint32_t>(i % RATE_LIMITED_CLIENTS);
+        hostMillis += 13;
+        admitRequest(&request);
+    });
+    std::printf("admitRequest: %.1f ns over %d clients\n", admitNs, RATE_LIMITED_CLIENTS);
+}
+
+int main() {
+    testBurstThenRefill();
+    testLongIdleOnlyFillsTheBucket();
+    testRefillAcrossMillisWrap();
+    testClientsHaveTheirOwnBuckets();
+    testOnlyRefilledBucketsAreReused();
+    testFloodFromManyClients();
+    testInFlightCap();
+    testFragmentedHeap();
+    testRejectionIsPreformatted();
+    testRejectedBodyIsDropped();
+    benchmarkAdmission();
+    std::printf("admission tests passed\n");
+    return 0;
+}
@@ -0,0 +1,220 @@
+// Advertisement decoding: captured frames of every supported format, truncated and oversized frames, and
+// random input. Every payload is copied into a buffer of exactly its length, so the sanitizers catch any
+// read past the end.
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+#include "AdvertisementParser.h"
+#include "HostTest.h"
+
+using Bytes = std::vector<uint8_t>;
+
+struct Fixture {
+    const char *name;
+    Bytes payload;
+    const char *decoder;
+    uint8_t fields;
+    int16_t temperatureCenti;
+    uint16_t humidityCenti;
+    uint16_t batteryMv;
+    uint8_t batteryPercent;
+    uint8_t frameCounter;
+};
+
+// Flags, then the service data last, so that no strict prefix of a frame is a complete advertisement
+static const Fixture FIXTURES[] = {
+    {"atc1441", {0x02, 0x01, 0x06,
+                 0x10, 0x16, 0x1A, 0x18, 0xA4, 0xC1, 0x38, 0x12, 0x34, 0x56, 0x00, 0xE6, 0x3C, 0x5A, 0x0B, 0xB8,
+                 0x2A},
+     "atc1441", READING_TEMPERATURE | READING_HUMIDITY | READING_BATTERY_MV | READING_BATTERY_PERCENT,
+     2300, 6000, 3000, 90, 42},
+    {"atc1441 below zero", {0x10, 0x16, 0x1A, 0x18, 0xA4, 0xC1, 0x38, 0x12, 0x34, 0x56, 0xFF, 0x9C, 0x50, 0x0A,
+                            0x0A, 0x8C, 0x01},
+     "atc1441", READING_TEMPERATURE | READING_HUMIDITY | READING_BATTERY_MV | READING_BATTERY_PERCENT,
+     -1000, 8000, 2700, 10, 1},
+    {"pvvx", {0x02, 0x01, 0x06,
+              0x12, 0x16, 0x1A, 0x18, 0x56, 0x34, 0x12, 0x38, 0xC1, 0xA4, 0xFC, 0x08, 0xA1, 0x13, 0x86, 0x0B, 0x55,
+              0x07, 0x04},
+     "pvvx", READING_TEMPERATURE | READING_HUMIDITY | READING_BATTERY_MV | READING_BATTERY_PERCENT,
+     2300, 5025, 2950, 85, 7},
+    {"bthome", {0x02, 0x01, 0x06,
+                0x0E, 0x16, 0xD2, 0xFC, 0x40, 0x00, 0x11, 0x01, 0x61, 0x02, 0xCA, 0x08, 0x03, 0xC6, 0x11},
+     "bthome", READING_TEMPERATURE | READING_HUMIDITY | READING_BATTERY_PERCENT, 2250, 4550, 0, 97, 0x11},
+    {"bthome 0.1 degree temperature and voltage", {0x0A, 0x16, 0xD2, 0xFC, 0x40, 0x45, 0xCE, 0xFF, 0x0C, 0xB8,
+                                                   0x0B},
+     "bthome", READING_TEMPERATURE | READING_BATTERY_MV, -500, 0, 3000, 0, 0},
+    {"bthome stops at an unknown object", {0x0A, 0x16, 0xD2, 0xFC, 0x40, 0x2E, 0x37, 0x30, 0x02, 0xCA, 0x08},
+     "bthome", READING_HUMIDITY, 0, 5500, 0, 0, 0},
+    {"mibeacon temperature and humidity", {0x02, 0x01, 0x06,
+                                           0x15, 0x16, 0x95, 0xFE, 0x50, 0x50, 0xAA, 0x01, 0x3E, 0x56, 0x34, 0x12,
+                                           0x38, 0xC1, 0xA4, 0x0D, 0x10, 0x04, 0xE2, 0x00, 0xF9, 0x01},
+     "mibeacon", READING_TEMPERATURE | READING_HUMIDITY, 2260, 5050, 0, 0, 0x3E},
+    {"mibeacon humidity after a capability byte", {0x14, 0x16, 0x95, 0xFE, 0x70, 0x50, 0xAA, 0x01, 0x3F, 0x56,
+                                                   0x34, 0x12, 0x38, 0xC1, 0xA4, 0x09, 0x06, 0x10, 0x02, 0x03,
+                                                   0x02},
+     "mibeacon", READING_HUMIDITY, 0, 5150, 0, 0, 0x3F},
+    {"mibeacon battery after capability and IO", {0x0F, 0x16, 0x95, 0xFE, 0x60, 0x50, 0xAA, 0x01, 0x40, 0x29,
+                                                  0x00, 0x00, 0x0A, 0x10, 0x01, 0x64},
+     "mibeacon", READING_BATTERY_PERCENT, 0, 0, 0, 100, 0x40},
+    {"mibeacon temperature", {0x0D, 0x16, 0x95, 0xFE, 0x40, 0x50, 0xAA, 0x01, 0x41, 0x04, 0x10, 0x02, 0x38, 0xFF},
+     "mibeacon", READING_TEMPERATURE, -2000, 0, 0, 0, 0x41},
+};
+
+// Frames that carry nothing usable
+static const Bytes REJECTED[] = {
+    {},
+    {0x02, 0x01, 0x06},
+    // Complete local name only
+    {0x05, 0x09, 'T', 'e', 'm', 'p'},
+    // Service data of an unsupported UUID
+    {0x05, 0x16, 0x0F, 0x18, 0x64, 0x00},
+    // 0x181A with a length neither custom firmware uses
+    {0x0F, 0x16, 0x1A, 0x18, 0xA4, 0xC1, 0x38, 0x12, 0x34, 0x56, 0x00, 0xE6, 0x3C, 0x5A, 0x0B, 0xB8},
+    {0x13, 0x16, 0x1A, 0x18, 0x56, 0x34, 0x12, 0x38, 0xC1, 0xA4, 0xFC, 0x08, 0xA1, 0x13, 0x86, 0x0B, 0x55, 0x07,
+     0x04, 0x00},
+    // BTHome encrypted, BTHome v1, BTHome with only a packet id
+    {0x0A, 0x16, 0xD2, 0xFC, 0x41, 0x02, 0xCA, 0x08, 0x03, 0xC6, 0x11},
+    {0x0A, 0x16, 0xD2, 0xFC, 0x20, 0x02, 0xCA, 0x08, 0x03, 0xC6, 0x11},
+    {0x06, 0x16, 0xD2, 0xFC, 0x40, 0x00, 0x11},
+    // BTHome object cut short by the end of the service data
+    {0x07, 0x16, 0xD2, 0xFC, 0x40, 0x00, 0x11, 0x02},
+    // MiBeacon encrypted, without an object, with an unknown object, with an object longer than the frame
+    {0x0D, 0x16, 0x95, 0xFE, 0x48, 0x50, 0xAA, 0x01, 0x41, 0x04, 0x10, 0x02, 0x38, 0xFF},
+    {0x08, 0x16, 0x95, 0xFE, 0x10, 0x50, 0xAA, 0x01, 0x41},
+    {0x0D, 0x16, 0x95, 0xFE, 0x40, 0x50, 0xAA, 0x01, 0x41, 0x07, 0x10, 0x02, 0x38, 0xFF},
+    {0x0D, 0x16, 0x95, 0xFE, 0x40, 0x50, 0xAA, 0x01, 0x41, 0x04, 0x10, 0x05, 0x38, 0xFF},
+    // MiBeacon temperature object shorter than a temperature
+    {0x0C, 0x16, 0x95, 0xFE, 0x40, 0x50, 0xAA, 0x01, 0x41, 0x04, 0x10, 0x01, 0x38},
+    // MiBeacon whose MAC flag points past the end of the frame
+    {0x0C, 0x16, 0x95, 0xFE, 0x70, 0x50, 0xAA, 0x01, 0x41, 0x04, 0x10, 0x01, 0x38},
+    // Structure length past the end of the payload
+    {0x02, 0x01, 0x06, 0xFF, 0x16, 0x1A, 0x18},
+};
+
+static bool parse(const Bytes &bytes, SensorReading &reading) {
+    // Exactly sized, a heap copy so an overread is reported
+    std::unique_ptr<uint8_t[]> copy(new uint8_t[bytes.size()]);
+    if (!bytes.empty()) {
+        memcpy(copy.get(), bytes.data(), bytes.size());
+    }
+    return parseThermometerAdvertisement(copy.get(), bytes.size(), reading);
+}
+
+static void testFixtures() {
+    for (const Fixture &fixture: FIXTURES) {
+        SensorReading reading{};
+        if (!parse(fixture.payload, reading)) {
+            std::fprintf(stderr, "fixture %s was not decoded\n", fixture.name);
+            CHECK(false);
+        }
+        CHECK(strcmp(decoderName(reading.decoder), fixture.decoder) == 0);
+        CHECK_EQ(reading.fields, fixture.fields);
+        if (fixture.fields & READING_TEMPERATURE) {
+            CHECK_EQ(reading.temperatureCenti, fixture.temperatureCenti);
+        }
+        if (fixture.fields & READING_HUMIDITY) {
+            CHECK_EQ(reading.humidityCenti, fixture.humidityCenti);
+        }
+        if (fixture.fields & READING_BATTERY_MV) {
+            CHECK_EQ(reading.batteryMv, fixture.batteryMv);
+        }
+        if (fixture.fields & READING_BATTERY_PERCENT) {
+            CHECK_EQ(reading.batteryPercent, fixture.batteryPercent);
+        }
+        CHECK_EQ(reading.frameCounter, fixture.frameCounter);
+    }
+}
+
+static void testRejected() {
+    for (const Bytes &payload: REJECTED) {
+        SensorReading reading{};
+        CHECK(!parse(payload, reading));
+    }
+}
+
+static void testTruncatedFrames() {
+    for (const Fixture &fixture: FIXTURES) {
+        for (size_t length = 0; length < fixture.payload.size(); length++) {
+            SensorReading reading{};
+            CHECK(!parse(Bytes(fixture.payload.begin(), fixture.payload.begin() + length), reading));
+        }
+    }
+}
+
+static void testPaddedAndExtendedFrames() {
+    for (const Fixture &fixture: FIXTURES) {
+        // Zero padding up to the legacy 31 bytes ends the walk
+        Bytes padded = fixture.payload;
+        padded.resize(std::max<size_t>(padded.size() + 1, 31), 0);
+        SensorReading reading{};
+        CHECK(parse(padded, reading));
+        CHECK(strcmp(decoderName(reading.decoder), fixture.decoder) == 0);
+
+        // Extended advertisements put other structures ahead of the service data
+        Bytes extended = {0x02, 0x01, 0x06, 0x05, 0x16, 0x0F, 0x18, 0x64, 0x00};
+        extended.push_back(0xF0);
+        extended.push_back(0xFF);
+        extended.insert(extended.end(), 0xEF, 0x55);
+        extended.insert(extended.end(), fixture.payload.begin(), fixture.payload.end());
+        reading = SensorReading{};
+        CHECK(parse(extended, reading));
+        CHECK(strcmp(decoderName(reading.decoder), fixture.decoder) == 0);
+    }
+}
+
+static void checkDecoded(const SensorReading &reading) {
+    CHECK(reading.fields != 0);
+    CHECK(strcmp(decoderName(reading.decoder), "unknown") != 0);
+}
+
+// Random bytes and random mutations of the fixtures, only looking for crashes and overreads
+static void testFuzz() {
+    std::mt19937 random(0x5EED);
+    unsigned long decoded = 0;
+    for (int i = 0; i < 200000; i++) {
+        Bytes payload(random() % 64);
+        for (uint8_t &byte: payload) {
+            byte = static_cast<uint8_t>(random());
+        }
+        // Steer a share of the inputs to the supported service data so the decoders themselves get exercised
+        if (payload.size() > 4 && i % 2 == 0) {
+            static const uint16_t UUIDS[] = {ATC_SERVICE_UUID, BTHOME_SERVICE_UUID, MIBEACON_SERVICE_UUID};
+            uint16_t uuid = UUIDS[random() % 3];
+            payload[0] = static_cast<uint8_t>(payload.size() - 1);
+            payload[1] = 0x16;
+            payload[2] = static_cast<uint8_t>(uuid);
+            payload[3] = static_cast<uint8_t>(uuid >> 8);
+        }
+        SensorReading reading{};
+        if (parse(payload, reading)) {
+            checkDecoded(reading);
+            decoded++;
+        }
+    }
+    for (const Fixture &fixture: FIXTURES) {
+        for (int i = 0; i < 20000; i++) {
+            Bytes payload = fixture.payload;
+            for (int flips = 1 + random() % 3; flips > 0; flips--) {
+                payload[random() % payload.size()] ^= static_cast<uint8_t>(1 << (random() % 8));
+            }
+            SensorReading reading{};
+            if (parse(payload, reading)) {
+                checkDecoded(reading);
+            }
+        }
+    }
+    std::printf("fuzzing decoded %lu of 200000 random payloads\n", decoded);
+}
+
+int main() {
+    testFixtures();
+    testRejected();
+    testTruncatedFrames();
+    testPaddedAndExtendedFrames();
+    testFuzz();
+    std::printf("advertisement parser tests passed\n");
+    return 0;
+}
@@ -0,0 +1,135 @@
+// Content negotiation of the API: which Accept headers get MessagePack, and what the send helpers put on the
+// response in each encoding
+#include <cstdio>
+#include <memory>
+#include <string>
+#include "ApiEncoding.h"
+#include "HostStubs.h"
+#include "HostTest.h"
+
+static ApiEncoding negotiate(const char *accept) {
+    AsyncWebServerRequest request;
+    if (accept != nullptr) {
+        request.headers.emplace_back("Accept", accept);
+    }
+    return negotiateEncoding(&request);
+}
+
+static void testNegotiation() {
+    struct Case {
+        const char *accept;
+        ApiEncoding expected;
+    };
+    const Case cases[] = {
+            {nullptr, ApiEncoding::JSON},
+            {"", ApiEncoding::JSON},
+            {"*/*", ApiEncoding::JSON},
+            {"application/json", ApiEncoding::JSON},
+            {"text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8", ApiEncoding::JSON},
+            {"application/msgpack", ApiEncoding::MSGPACK},
+            {"application/x-msgpack", ApiEncoding::MSGPACK},
+            {"Application/MsgPack", ApiEncoding::MSGPACK},
+            // What the dashboard sends
+            {"application/msgpack, application/json;q=0.9", ApiEncoding::MSGPACK},
+            {"application/json;q=0.5 , application/msgpack", ApiEncoding::MSGPACK},
+            // Named explicitly, it wins a tie with the wildcard
+            {"application/msgpack, */*", ApiEncoding::MSGPACK},
+            {"application/json, application/msgpack;q=0.1", ApiEncoding::JSON},
+            {"*/*;q=1, application/msgpack;q=0.5", ApiEncoding::JSON},
+            {"application/msgpack;q=0.8, application/*;q=0.7", ApiEncoding::MSGPACK},
+            // q=0 means not acceptable
+            {"application/msgpack;q=0", ApiEncoding::JSON},
+            {"application/msgpack;q=0.0, application/json", ApiEncoding::JSON},
+            {"application/msgpack;level=1;q=0.9", ApiEncoding::MSGPACK},
+            // Only the full media type counts
+            {"application/msgpack-ext", ApiEncoding::JSON},
+            {"text/msgpack", ApiEncoding::JSON},
+            {",,,", ApiEncoding::JSON},
+            {"application/msgpack;", ApiEncoding::MSGPACK},
+            {";q=1", ApiEncoding::JSON},
+    };
+    for (const Case &test: cases) {
+        ApiEncoding encoding = negotiate(test.accept);
+        if (encoding != test.expected) {
+            std::fprintf(stderr, "Accept: %s negotiated %u\n", test.accept != nullptr ? test.accept : "(none)",
+                         static_cast<unsigned>(encoding));
+            CHECK(false);
+        }
+    }
+}
+
+static void testSendDocument() {
+    JsonDocument doc;
+    doc.text = R"({"mode":"auto"})";
+    doc.msgpack = "\x81\xa4mode\xa4" "auto";
+
+    AsyncWebServerRequest json;
+    tracedResponseBytes = 0;
+    sendDocument(&json, 201, doc);
+    CHECK_EQ(json.sendCount, 1);
+    CHECK_EQ(json.sentCode, 201);
+    CHECK(json.sentBody == doc.text);
+    CHECK_EQ(tracedResponseBytes, doc.text.size());
+
+    AsyncWebServerRequest msgpack;
+    msgpack.headers.emplace_back("Accept", "application/msgpack");
+    tracedResponseBytes = 0;
+    sendDocument(&msgpack, 201, doc);
+    CHECK(msgpack.response != nullptr);
+    const AsyncWebServerResponse &response = *msgpack.response;
+    CHECK_EQ(response.code, 201);
+    CHECK(response.contentType == "application/msgpack");
+    CHECK(response.header("Vary") != nullptr && response.header("Vary")->value() == "Accept");
+    CHECK(response.header("ETag") == nullptr);
+    CHECK_EQ(response.contentLength, doc.msgpack.size());
+    std::string body(response.contentLength, '\0');
+    CHECK_EQ(response.filler(reinterpret_cast<uint8_t *>(&body[0]), body.size(), 0), body.size());
+    CHECK(body == doc.msgpack);
+    CHECK_EQ(tracedResponseBytes, doc.msgpack.size());
+}
+
+static void testSendEncodedBodyInPieces() {
+    auto body = std::make_shared<const std::string>(std::string(1000, 'j'));
+    AsyncWebServerRequest request;
+    sendEncodedBody(&request, 200, ApiEncoding::JSON, body, "\"etag\"");
+    const AsyncWebServerResponse &response = *request.response;
+    CHECK(response.contentType == "application/json");
+    CHECK(response.header("ETag")->value() == "\"etag\"");
+    CHECK(response.header("Cache-Control")->value() == "no-cache");
+    // The server asks for the bytes as TCP space frees up
+    std::string sent;
+    uint8_t buffer[300];
+    while (sent.size() < response.contentLength) {
+        size_t written = response.filler(buffer, sizeof(buffer), sent.size());
+        CHECK(written > 0);
+        sent.append(reinterpret_cast<const char *>(buffer), written);
+    }
+    CHECK(sent == *body);
+}
+
+static void benchmarkNegotiation() {
+    constexpr unsigned long ITERATIONS = 1000000;
+    AsyncWebServerRequest browser;
+    browser.headers.emplace_back("Accept", "text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8");
+    AsyncWebServerRequest dashboard;
+    dashboard.headers.emplace_back("Accept", "application/msgpack, application/json;q=0.9");
+    unsigned long msgpack = 0;
+    double browserNs = measureNanos(ITERATIONS, [&](unsigned long) {
+        msgpack += negotiateEncoding(&browser) == ApiEncoding::MSGPACK ? 1 : 0;
+    });
+    double dashboardNs = measureNanos(ITERATIONS, [&](unsigned long) {
+        msgpack += negotiateEncoding(&dashboard) == ApiEncoding::MSGPACK ? 1 : 0;
+    });
+    CHECK_EQ(msgpack, ITERATIONS);
+    std::printf("negotiateEncoding: %.1f ns for a browser Accept, %.1f ns for the dashboard's\n", browserNs,
+                dashboardNs);
+}
+
+int main() {
+    testNegotiation();
+    testSendDocument();
+    testSendEncodedBodyInPieces();
+    benchmarkNegotiation();
+    std::printf("api encoding tests passed\n");
+    return 0;
+}
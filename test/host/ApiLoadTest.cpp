@@ -0,0 +1,516 @@
+// Load test of the API request path: simulated dashboards and integration pollers send a realistic mix of room
+// reads, heating reads, schedule edits, thermometer edits and static asset loads to the real LocalAPI.cpp
+// handlers, through the route table startWebServer() registers, admission control, tracing, the response cache,
+// body collection and ArduinoJson. The test plays the relay task: it applies the queued state commands and
+// publishes new snapshots as sensor readings arrive. Reports throughput, service time percentiles and peak heap
+// per request type, and how many clients are served before admission turns requests away.
+//
+// Heap counts operator new and malloc, where ArduinoJson takes its pools from. It is measured with 64-bit
+// pointers and glibc's block sizes, the ESP32 numbers are smaller.
+//
+// Peak heap is checked against load_baseline.txt, times are only shown next to it since they depend on the
+// machine. After an intended change: api_load_test --write-baseline
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "Admission.h"
+#include "ApiRouter.h"
+#include "HeapTracker.h"
+#include "HostStubs.h"
+#include "HostTest.h"
+#include "LocalAPI.h"
+#include "SystemState.h"
+#include "globalSettings.h"
+
+// One TCP segment, what AsyncTCP usually has room for
+constexpr size_t SEGMENT_BYTES = 1436;
+// WiFi pace, a client gets one segment every few milliseconds
+constexpr uint32_t DELIVERY_MILLIS = 5;
+constexpr uint32_t DASHBOARD_THINK_MILLIS = 250;
+constexpr uint32_t POLLER_THINK_MILLIS = 100;
+// Sensor readings move the rooms and the heating state about once a second
+constexpr uint32_t PUBLISH_MILLIS = 1000;
+constexpr uint32_t RUN_MILLIS = 60000;
+// Every fourth client is an integration polling the heating state
+constexpr int POLLER_EVERY = 4;
+const int CLIENT_COUNTS[] = {1, 4, 8, 16, 32};
+constexpr uint8_t ROOMS = 8;
+constexpr uint8_t SCHEDULE_EDIT_RANGES = 24;
+// Allowed growth over the baseline before the test fails
+constexpr double HEAP_TOLERANCE = 1.25;
+constexpr size_t HEAP_SLACK_BYTES = 256;
+
+enum class RequestType : uint8_t {
+    ROOMS_READ,
+    HEATING_READ,
+    SCHEDULE_EDIT,
+    THERMOMETER_EDIT,
+    STATIC_ASSET,
+    COUNT
+};
+
+constexpr size_t REQUEST_TYPES = static_cast<size_t>(RequestType::COUNT);
+static const char *const TYPE_NAMES[REQUEST_TYPES] = {"rooms_read", "heating_read", "schedule_edit",
+                                                       "thermometer_edit", "static_asset"};
+// What a dashboard asks for, in percent
+static const unsigned DASHBOARD_MIX[REQUEST_TYPES] = {45, 25, 10, 5, 15};
+static const char *const SCHEDULE_MODES[] = {"HOME", "AWAY", "NIGHT", "ANTIFREEZE"};
+
+static unsigned long scheduleEdits = 0;
+static unsigned long thermometerEdits = 0;
+static uint32_t publishes = 0;
+
+static void roomName(uint8_t room, char *out) {
+    std::snprintf(out, ROOM_NAME_LEN, "Camera %u", room);
+}
+
+static void roomSensorMac(uint8_t room, char *out) {
+    std::snprintf(out, MAC_STRING_LEN, "A4:C1:38:00:00:%02X", room);
+}
+
+// What setup() loads from flash: rooms with one thermometer each
+static void createRooms() {
+    char name[ROOM_NAME_LEN];
+    char mac[MAC_STRING_LEN];
+    for (uint8_t room = 0; room < ROOMS; room++) {
+        roomName(room, name);
+        rooms.emplace_back(name, true);
+        roomSensorMac(room, mac);
+        CHECK(rooms.back().addThermometer(mac, true));
+    }
+}
+
+// One pass of the relay task after the BLE task delivered a round of readings
+static void publishReadings() {
+    publishes++;
+    time_t now = time(nullptr);
+    for (uint8_t room = 0; room < ROOMS; room++) {
+        SensorReading reading{};
+        char mac[MAC_STRING_LEN];
+        roomSensorMac(room, mac);
+        CHECK(parseMacAddress(mac, reading.mac));
+        reading.fields = READING_TEMPERATURE | READING_HUMIDITY;
+        reading.temperatureCenti = static_cast<int16_t>(2000 + room * 25 + publishes % 7);
+        reading.humidityCenti = static_cast<uint16_t>(4500 + room * 100);
+        reading.receivedMs = hostMillis;
+        sensorRegistry.apply(reading, now);
+    }
+    isHeating = publishes % 2 == 0;
+    applyPendingStateCommands();
+    publishRoomsSnapshot();
+    publishHeatingSnapshot();
+}
+
+
+struct TypeStats {
+    std::vector<double> serviceNs;      ///< Server task time per request, dispatch to disconnect.
+    unsigned long served = 0;
+    unsigned long notModified = 0;
+    unsigned long rateLimited = 0;
+    unsigned long overloaded = 0;
+    size_t peakHeap = 0;                ///< Most heap one request held, measured with a single client.
+};
+
+struct RunStats {
+    int clients;
+    unsigned long served;
+    unsigned long rateLimited;
+    unsigned long overloaded;
+    size_t peakHeap;
+};
+
+static TypeStats typeStats[REQUEST_TYPES];
+
+struct Client {
+    uint32_t address = 0;
+    bool poller = false;
+    uint32_t nextMillis = 0;
+    std::unique_ptr<AsyncWebServerRequest> request;
+    RequestType type = RequestType::ROOMS_READ;
+    double serviceNs = 0;
+    size_t sent = 0;
+    uint32_t nextSegmentMillis = 0;
+    size_t heapBefore = 0;
+    std::string roomsEtag;
+    bool thermometerAdded = false;  ///< Whether the client's own thermometer is in its room.
+};
+
+using Clock = std::chrono::steady_clock;
+
+static double nanosSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+static std::string scheduleEditBody(std::minstd_rand &random) {
+    std::string body = "{\"ranges\":[";
+    char range[96];
+    for (uint8_t i = 0; i < SCHEDULE_EDIT_RANGES; i++) {
+        unsigned from = static_cast<unsigned>(random() % 40);
+        unsigned to = from + static_cast<unsigned>(random() % 8);
+        int length = std::snprintf(range, sizeof(range), "%s{\"day\":%u,\"from\":%u,\"to\":%u,\"mode\":\"%s\"}",
+                                   i == 0 ? "" : ",", i % 7, from, to, SCHEDULE_MODES[random() % 4]);
+        body.append(range, length);
+    }
+    return body + "]}";
+}
+
+static RequestType pickType(const Client &client, std::minstd_rand &random) {
+    if (client.poller) {
+        return RequestType::HEATING_READ;
+    }
+    unsigned roll = random() % 100;
+    for (size_t type = 0; type < REQUEST_TYPES; type++) {
+        if (roll < DASHBOARD_MIX[type]) {
+            return static_cast<RequestType>(type);
+        }
+        roll -= DASHBOARD_MIX[type];
+    }
+    return RequestType::ROOMS_READ;
+}
+
+static AsyncWebHandler *handlerFor(AsyncWebServerRequest &request) {
+    for (AsyncWebHandler *handler: server.handlers) {
+        if (handler->canHandle(&request)) {
+            return handler;
+        }
+    }
+    return nullptr;
+}
+
+// The request is done: closed by the client or the server, freed by the server right after
+static void finishRequest(Client &client, bool measureHeap) {
+    Clock::time_point start = Clock::now();
+    AsyncWebServerRequest &request = *client.request;
+    TypeStats &stats = typeStats[static_cast<size_t>(client.type)];
+    if (client.type == RequestType::ROOMS_READ && request.response != nullptr &&
+        request.response->code == 200) {
+        const AsyncWebHeader *etag = request.response->header("ETag");
+        client.roomsEtag.assign(etag != nullptr ? etag->value().c_str() : "");
+    }
+    bool succeeded = request.sentCode >= 200 && request.sentCode < 300;
+    if (client.type == RequestType::SCHEDULE_EDIT && succeeded) {
+        scheduleEdits++;
+    } else if (client.type == RequestType::THERMOMETER_EDIT && succeeded) {
+        thermometerEdits++;
+        client.thermometerAdded = !client.thermometerAdded;
+    }
+    request.disconnect();
+    client.request.reset();
+    client.serviceNs += nanosSince(start);
+    stats.serviceNs.push_back(client.serviceNs);
+    if (measureHeap) {
+        stats.peakHeap = std::max(stats.peakHeap, heapUsage().peakBytes - client.heapBefore);
+    }
+    uint32_t think = client.poller ? POLLER_THINK_MILLIS : DASHBOARD_THINK_MILLIS;
+    client.nextMillis = hostMillis + think + client.address % 50;
+}
+
+static void startRequest(Client &client, std::minstd_rand &random, bool measureHeap) {
+    client.type = pickType(client, random);
+    // Each dashboard adds and removes a thermometer of its own, in a room shared with other clients
+    char room[ROOM_NAME_LEN];
+    char mac[MAC_STRING_LEN];
+    roomName(static_cast<uint8_t>(client.address % ROOMS), room);
+    std::snprintf(mac, sizeof(mac), "A4:C1:38:10:%02X:%02X", (client.address >> 8) & 0xFF, client.address & 0xFF);
+    std::string body;
+    if (client.type == RequestType::SCHEDULE_EDIT) {
+        body = scheduleEditBody(random);
+    } else if (client.type == RequestType::THERMOMETER_EDIT && !client.thermometerAdded) {
+        body = std::string("{\"mac\":\"") + mac + "\"}";
+    }
+    if (measureHeap) {
+        client.heapBefore = heapUsage().liveBytes;
+        resetHeapPeak();
+    }
+
+    Clock::time_point start = Clock::now();
+    client.request.reset(new AsyncWebServerRequest);
+    AsyncWebServerRequest &request = *client.request;
+    request.connection.ip = client.address;
+    switch (client.type) {
+        case RequestType::ROOMS_READ:
+            request.path = "/api/rooms";
+            request.headers.emplace_back("Accept", "application/json");
+            if (!client.roomsEtag.empty()) {
+                request.headers.emplace_back("If-None-Match", client.roomsEtag);
+            }
+            break;
+        case RequestType::HEATING_READ:
+            request.path = "/api/heating/status";
+            break;
+        case RequestType::SCHEDULE_EDIT:
+            request.path = "/api/schedule";
+            request.requestMethod = HTTP_PATCH;
+            break;
+        case RequestType::THERMOMETER_EDIT:
+            request.path = "/api/thermometers";
+            request.requestMethod = client.thermometerAdded ? HTTP_DELETE : HTTP_POST;
+            request.params.emplace_back("room_name", room);
+            if (client.thermometerAdded) {
+                request.params.emplace_back("mac", mac);
+            }
+            break;
+        default:
+            request.path = "/app.js";
+            break;
+    }
+
+    TypeStats &stats = typeStats[static_cast<size_t>(client.type)];
+    unsigned long rateLimited = rateLimitedMetric.get();
+    unsigned long overloaded = overloadedMetric.get();
+    AsyncWebHandler *handler = handlerFor(request);
+    if (handler != nullptr) {
+        // The body arrives one TCP segment at a time, then the request handler runs
+        for (size_t index = 0; index < body.size(); index += SEGMENT_BYTES) {
+            size_t len = std::min(SEGMENT_BYTES, body.size() - index);
+            handler->handleBody(&request, reinterpret_cast<uint8_t *>(&body[index]), len, index, body.size());
+        }
+        handler->handleRequest(&request);
+    }
+    client.serviceNs = nanosSince(start);
+    client.sent = 0;
+    client.nextSegmentMillis = hostMillis + DELIVERY_MILLIS;
+
+    stats.rateLimited += rateLimitedMetric.get() - rateLimited;
+    stats.overloaded += overloadedMetric.get() - overloaded;
+    bool rejected = request.sendCount == 0 && request.connection.segmentCount > 0;
+    if (handler == nullptr || rejected) {
+        // The static handler streams the asset from flash, a rejection closes on the next poll
+        stats.served += handler == nullptr ? 1 : 0;
+        finishRequest(client, measureHeap);
+        return;
+    }
+    CHECK(request.sendCount == 1);
+    stats.served++;
+    stats.notModified += request.response != nullptr && request.response->code == 304 ? 1 : 0;
+}
+
+// Sends the next segment of the response, true once the last one is out
+static bool deliverSegment(Client &client, uint8_t *segment) {
+    Clock::time_point start = Clock::now();
+    AsyncWebServerResponse *response = client.request->response;
+    bool done = true;
+    if (response != nullptr && response->filler && response->chunked) {
+        // A streamed miss ends when its source runs out
+        size_t written = response->filler(segment, SEGMENT_BYTES, client.sent);
+        client.sent += written;
+        done = written == 0;
+    } else if (response != nullptr && response->filler && client.sent < response->contentLength) {
+        size_t window = std::min(SEGMENT_BYTES, response->contentLength - client.sent);
+        size_t written = response->filler(segment, window, client.sent);
+        client.sent += written;
+        done = written == 0 || client.sent == response->contentLength;
+    }
+    client.serviceNs += nanosSince(start);
+    return done;
+}
+
+static RunStats runClients(int clientCount, bool measureHeap) {
+    std::vector<Client> clients(clientCount);
+    for (int i = 0; i < clientCount; i++) {
+        clients[i].address = 0x0A000001 + i + 256 * clientCount;
+        clients[i].poller = i % POLLER_EVERY == POLLER_EVERY - 1;
+        clients[i].nextMillis = hostMillis + i * 7 % DASHBOARD_THINK_MILLIS;
+        clients[i].roomsEtag.reserve(64);
+    }
+    std::minstd_rand random(clientCount);
+    uint8_t segment[SEGMENT_BYTES];
+    RunStats run{clientCount, 0, 0, 0, 0};
+    unsigned long served[REQUEST_TYPES];
+    unsigned long rateLimited = rateLimitedMetric.get();
+    unsigned long overloaded = overloadedMetric.get();
+    for (size_t type = 0; type < REQUEST_TYPES; type++) {
+        served[type] = typeStats[type].served;
+    }
+
+    size_t baseline = heapUsage().liveBytes;
+    resetHeapPeak();
+    uint32_t end = hostMillis + RUN_MILLIS;
+    uint32_t nextPublish = hostMillis + PUBLISH_MILLIS;
+    for (; hostMillis != end; hostMillis++, hostMicros += 1000) {
+        if (hostMillis == nextPublish) {
+            publishReadings();
+            nextPublish += PUBLISH_MILLIS;
+        }
+        // The relay task wakes up for every queued command
+        applyPendingStateCommands();
+        for (Client &client: clients) {
+            if (client.request) {
+                if (hostMillis >= client.nextSegmentMillis) {
+                    client.nextSegmentMillis = hostMillis + DELIVERY_MILLIS;
+                    if (deliverSegment(client, segment)) {
+                        finishRequest(client, measureHeap);
+                    }
+                }
+            } else if (hostMillis >= client.nextMillis) {
+                startRequest(client, random, measureHeap);
+            }
+        }
+        size_t peak = heapUsage().peakBytes;
+        run.peakHeap = std::max(run.peakHeap, peak > baseline ? peak - baseline : 0);
+    }
+    for (Client &client: clients) {
+        if (client.request) {
+            finishRequest(client, measureHeap);
+        }
+    }
+    for (size_t type = 0; type < REQUEST_TYPES; type++) {
+        run.served += typeStats[type].served - served[type];
+    }
+    run.rateLimited = rateLimitedMetric.get() - rateLimited;
+    run.overloaded = overloadedMetric.get() - overloaded;
+    CHECK_EQ(apiRequestsInFlight(), 0);
+    return run;
+}
+
+static double percentile(std::vector<double> sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    std::sort(sorted.begin(), sorted.end());
+    size_t rank = static_cast<size_t>(std::ceil(fraction * sorted.size()));
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+struct BaselineType {
+    double perSecond;
+    size_t peakHeap;
+};
+
+struct Baseline {
+    std::map<std::string, BaselineType> types;
+    std::map<int, RunStats> runs;
+};
+
+static Baseline readBaseline(const char *path) {
+    Baseline baseline;
+    FILE *file = std::fopen(path, "r");
+    if (file == nullptr) {
+        return baseline;
+    }
+    char line[256];
+    while (std::fgets(line, sizeof(line), file) != nullptr) {
+        char name[32];
+        double perSecond;
+        double p50;
+        double p90;
+        double p99;
+        size_t peakHeap;
+        RunStats run{};
+        if (std::sscanf(line, "type %31s %lf %lf %lf %lf %zu", name, &perSecond, &p50, &p90, &p99,
+                        &peakHeap) == 6) {
+            baseline.types[name] = {perSecond, peakHeap};
+        } else if (std::sscanf(line, "clients %d %lu %lu %lu %zu", &run.clients, &run.served, &run.rateLimited,
+                               &run.overloaded, &run.peakHeap) == 5) {
+            baseline.runs[run.clients] = run;
+        }
+    }
+    std::fclose(file);
+    return baseline;
+}
+
+static bool heapRegressed(size_t measured, size_t baseline) {
+    return measured > baseline * HEAP_TOLERANCE + HEAP_SLACK_BYTES;
+}
+
+int main(int argc, char **argv) {
+    bool writeBaseline = argc > 1 && std::strcmp(argv[1], "--write-baseline") == 0;
+    hostMillis = 1000;
+    initSemaphores();
+    createRooms();
+    initSystemState();
+    publishReadings();
+    startWebServer(nullptr);
+    for (TypeStats &stats: typeStats) {
+        stats.serviceNs.reserve(1 << 17);
+    }
+
+    // One client first, every request alone on the heap
+    std::vector<RunStats> runs;
+    runs.push_back(runClients(CLIENT_COUNTS[0], true));
+    CHECK_EQ(runs[0].rateLimited + runs[0].overloaded, 0);
+    for (size_t i = 1; i < sizeof(CLIENT_COUNTS) / sizeof(CLIENT_COUNTS[0]); i++) {
+        runs.push_back(runClients(CLIENT_COUNTS[i], false));
+    }
+    CHECK(scheduleEdits > 0);
+    CHECK(thermometerEdits > 0);
+
+    Baseline baseline = readBaseline(API_LOAD_BASELINE);
+    bool regressed = false;
+    std::string report = "# api_load_test on the host, " + std::to_string(RUN_MILLIS / 1000) +
+                         " simulated seconds per client count\n"
+                         "# type <name> <requests per second of server time> <p50 us> <p90 us> <p99 us> "
+                         "<peak heap per request>\n";
+    std::printf("%-16s %8s %12s %8s %8s %8s %10s   baseline\n", "request", "count", "requests/s", "p50 us",
+                "p90 us", "p99 us", "peak heap");
+    for (size_t type = 0; type < REQUEST_TYPES; type++) {
+        const TypeStats &stats = typeStats[type];
+        double totalNs = 0;
+        for (double ns: stats.serviceNs) {
+            totalNs += ns;
+        }
+        double perSecond = stats.serviceNs.size() / (totalNs / 1e9);
+        double p50 = percentile(stats.serviceNs, 0.50) / 1000;
+        double p90 = percentile(stats.serviceNs, 0.90) / 1000;
+        double p99 = percentile(stats.serviceNs, 0.99) / 1000;
+        char line[160];
+        std::snprintf(line, sizeof(line), "type %s %.0f %.2f %.2f %.2f %zu\n", TYPE_NAMES[type], perSecond, p50,
+                      p90, p99, stats.peakHeap);
+        report += line;
+        std::printf("%-16s %8zu %12.0f %8.2f %8.2f %8.2f %10zu", TYPE_NAMES[type], stats.serviceNs.size(),
+                    perSecond, p50, p90, p99, stats.peakHeap);
+        auto known = baseline.types.find(TYPE_NAMES[type]);
+        if (known != baseline.types.end()) {
+            std::printf("   %.0f requests/s, %zu bytes", known->second.perSecond, known->second.peakHeap);
+            if (heapRegressed(stats.peakHeap, known->second.peakHeap)) {
+                std::printf("   HEAP REGRESSION");
+                regressed = true;
+            }
+        }
+        std::printf("\n");
+        CHECK(stats.served > 0);
+    }
+
+    report += "# clients <count> <served> <rate limited> <overloaded> <peak heap of the run>\n";
+    std::printf("\n%-8s %8s %13s %11s %10s   baseline\n", "clients", "served", "rate limited", "overloaded",
+                "peak heap");
+    for (const RunStats &run: runs) {
+        char line[128];
+        std::snprintf(line, sizeof(line), "clients %d %lu %lu %lu %zu\n", run.clients, run.served,
+                      run.rateLimited, run.overloaded, run.peakHeap);
+        report += line;
+        std::printf("%-8d %8lu %13lu %11lu %10zu", run.clients, run.served, run.rateLimited, run.overloaded,
+                    run.peakHeap);
+        auto known = baseline.runs.find(run.clients);
+        if (known != baseline.runs.end()) {
+            std::printf("   %lu served, %lu rate limited, %lu overloaded, %zu bytes", known->second.served,
+                        known->second.rateLimited, known->second.overloaded, known->second.peakHeap);
+            if (heapRegressed(run.peakHeap, known->second.peakHeap)) {
+                std::printf("   HEAP REGRESSION");
+                regressed = true;
+            }
+        }
+        std::printf("\n");
+    }
+
+    // The first run records the baseline, it is committed next to the test
+    if (writeBaseline || baseline.types.empty()) {
+        FILE *file = std::fopen(API_LOAD_BASELINE, "w");
+        CHECK(file != nullptr);
+        std::fputs(report.c_str(), file);
+        std::fclose(file);
+        std::printf("baseline written to %s\n", API_LOAD_BASELINE);
+    } else {
+        CHECK(!regressed);
+    }
+    std::printf("api load test passed\n");
+    return 0;
+}
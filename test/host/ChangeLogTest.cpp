@@ -0,0 +1,278 @@
+// The change log behind /api/changes: dedup of repeated entities, overflow and the resync it forces, and a
+// client following the log while the owning task keeps publishing
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include "ChangeLog.h"
+#include "HostTest.h"
+
+// The two SystemState helpers the log uses, SystemState.cpp itself needs the relay task
+bool copyStateString(char *destination, size_t size, const char *source) {
+    size_t length = strlen(source);
+    bool fits = length < size;
+    if (!fits) {
+        length = size - 1;
+    }
+    memcpy(destination, source, length);
+    destination[length] = '\0';
+    return fits;
+}
+
+const RoomSnapshot *findRoomSnapshot(const RoomsSnapshot &snapshot, const char *roomName) {
+    for (uint8_t i = 0; i < snapshot.roomCount; i++) {
+        if (strcmp(snapshot.rooms[i].name, roomName) == 0) {
+            return &snapshot.rooms[i];
+        }
+    }
+    return nullptr;
+}
+
+static std::unique_ptr<RoomsSnapshot> roomsWith(std::initializer_list<std::string> names,
+                                                themperature_modes mode = HOME) {
+    std::unique_ptr<RoomsSnapshot> rooms(new RoomsSnapshot{});
+    rooms->mode = mode;
+    for (const std::string &name: names) {
+        copyStateString(rooms->rooms[rooms->roomCount++].name, ROOM_NAME_LEN, name.c_str());
+    }
+    return rooms;
+}
+
+// A publish that created or changed the given rooms
+static void changeRooms(std::initializer_list<std::string> names, themperature_modes mode = HOME) {
+    recordRoomsChanges(*roomsWith({}, mode), *roomsWith(names, mode));
+}
+
+static std::unique_ptr<ChangeSet> changesSince(uint32_t since) {
+    std::unique_ptr<ChangeSet> changes(new ChangeSet{});
+    readChangesSince(since, *changes);
+    return changes;
+}
+
+static void checkRoomEntry(const ChangeEntry &entry, const char *name, uint32_t version) {
+    CHECK(entry.kind == ChangeKind::ROOM);
+    CHECK(strcmp(entry.roomName, name) == 0);
+    CHECK_EQ(entry.version, version);
+}
+
+// Runs first, on the empty log
+static void testVersionsAndDedup() {
+    CHECK_EQ(changesSince(0)->version, 0);
+    recordHeatingChange();
+    changeRooms({"Kitchen"});
+    changeRooms({"Bedroom"});
+    changeRooms({"Kitchen"});
+
+    auto all = changesSince(0);
+    CHECK_EQ(all->version, 4);
+    CHECK(!all->resync);
+    // Kitchen moved to the end with its newest version, its first entry is gone
+    CHECK_EQ(all->count, 3);
+    CHECK(all->entries[0].kind == ChangeKind::HEATING);
+    CHECK_EQ(all->entries[0].version, 1);
+    checkRoomEntry(all->entries[1], "Bedroom", 3);
+    checkRoomEntry(all->entries[2], "Kitchen", 4);
+
+    auto sinceTwo = changesSince(2);
+    CHECK_EQ(sinceTwo->count, 2);
+    checkRoomEntry(sinceTwo->entries[0], "Bedroom", 3);
+    auto latest = changesSince(4);
+    CHECK_EQ(latest->count, 0);
+    CHECK(!latest->resync);
+}
+
+static void testOnePublishSharesAVersion() {
+    uint32_t base = changesSince(0)->version;
+    // Mode change, one room changed and one removed, in one publish
+    auto before = roomsWith({"Kitchen", "Bedroom"}, HOME);
+    auto after = roomsWith({"Kitchen"}, AWAY);
+    after->rooms[0].homeTarget = 22.5f;
+    recordRoomsChanges(*before, *after);
+
+    auto changes = changesSince(base);
+    CHECK_EQ(changes->version, base + 1);
+    CHECK_EQ(changes->count, 3);
+    CHECK(changes->entries[0].kind == ChangeKind::ROOM_MODE);
+    CHECK(changes->entries[1].kind == ChangeKind::ROOM);
+    CHECK(changes->entries[2].kind == ChangeKind::ROOM_REMOVED);
+    CHECK(strcmp(changes->entries[2].roomName, "Bedroom") == 0);
+    for (uint8_t i = 0; i < changes->count; i++) {
+        CHECK_EQ(changes->entries[i].version, base + 1);
+    }
+
+    // A publish that changed nothing takes no version
+    recordRoomsChanges(*after, *after);
+    CHECK_EQ(changesSince(0)->version, base + 1);
+
+    std::unique_ptr<ScheduleSnapshot> scheduleBefore(new ScheduleSnapshot{});
+    std::unique_ptr<ScheduleSnapshot> scheduleAfter(new ScheduleSnapshot{});
+    scheduleAfter->slots[2][10] = 1;
+    scheduleAfter->slots[5][0] = 2;
+    scheduleAfter->userDirectiveCount = 1;
+    recordScheduleChanges(*scheduleBefore, *scheduleAfter);
+    auto schedule = changesSince(base + 1);
+    CHECK_EQ(schedule->count, 3);
+    CHECK(schedule->entries[0].kind == ChangeKind::SCHEDULE_DAY);
+    CHECK_EQ(schedule->entries[0].day, 2);
+    CHECK_EQ(schedule->entries[1].day, 5);
+    CHECK(schedule->entries[2].kind == ChangeKind::DIRECTIVES);
+}
+
+// More distinct entities than the log holds
+static void testOverflowForcesResync() {
+    uint32_t base = changesSince(0)->version;
+    const uint32_t rooms = CHANGE_LOG_LENGTH + 12;
+    for (uint32_t i = 0; i < rooms; i++) {
+        changeRooms({"Overflow " + std::to_string(i)});
+    }
+    uint32_t last = base + rooms;
+    // The oldest surviving entry is the one after the newest dropped version
+    uint32_t dropped = last - CHANGE_LOG_LENGTH;
+
+    auto full = changesSince(dropped);
+    CHECK(!full->resync);
+    CHECK_EQ(full->version, last);
+    CHECK_EQ(full->count, CHANGE_LOG_LENGTH);
+    checkRoomEntry(full->entries[0], ("Overflow " + std::to_string(rooms - CHANGE_LOG_LENGTH)).c_str(),
+                   dropped + 1);
+
+    // A client whose since falls before the dropped entry may have missed it
+    auto stale = changesSince(dropped - 1);
+    CHECK(stale->resync);
+    CHECK_EQ(stale->count, 0);
+    CHECK_EQ(stale->version, last);
+    CHECK(changesSince(0)->resync);
+
+    // An entity already in the log moves to the end without dropping anything
+    changeRooms({"Overflow " + std::to_string(rooms - CHANGE_LOG_LENGTH)});
+    auto moved = changesSince(dropped);
+    CHECK(!moved->resync);
+    CHECK_EQ(moved->count, CHANGE_LOG_LENGTH);
+    checkRoomEntry(moved->entries[CHANGE_LOG_LENGTH - 1],
+                   ("Overflow " + std::to_string(rooms - CHANGE_LOG_LENGTH)).c_str(), last + 1);
+
+    // A version from before a restart is ahead of the log
+    auto ahead = changesSince(last + 100);
+    CHECK(ahead->resync);
+}
+
+// Entity ids of the concurrent test: pool rooms, then the room mode, then the heating state
+constexpr int POOL_ROOMS = 64;
+constexpr int MODE_ENTITY = POOL_ROOMS;
+constexpr int HEATING_ENTITY = POOL_ROOMS + 1;
+constexpr int ENTITIES = POOL_ROOMS + 2;
+constexpr uint32_t CONCURRENT_PUBLISHES = 100000;
+
+static std::string poolRoom(int index) {
+    return "Pool " + std::to_string(index);
+}
+
+// The owning task publishes in a loop while a client follows with ?since=, resyncing when told to. Once the
+// writer stops, every entity must have been reported at or after its last change, or covered by a resync.
+static void testClientFollowsConcurrentPublishes() {
+    uint32_t base = changesSince(0)->version;
+    static std::atomic<uint32_t> lastChange[ENTITIES];
+    std::atomic<bool> writerDone{false};
+
+    std::thread writer([&]() {
+        std::mt19937 random(7);
+        std::unique_ptr<RoomsSnapshot> before(new RoomsSnapshot{});
+        std::unique_ptr<RoomsSnapshot> after(new RoomsSnapshot{});
+        uint32_t version = base;
+        themperature_modes mode = HOME;
+        for (uint32_t i = 0; i < CONCURRENT_PUBLISHES; i++) {
+            if (random() % 4 == 0) {
+                recordHeatingChange();
+                lastChange[HEATING_ENTITY].store(++version);
+                continue;
+            }
+            // One to three new or changed rooms, sometimes with a mode change, in one publish
+            *before = RoomsSnapshot{};
+            *after = RoomsSnapshot{};
+            before->mode = mode;
+            bool modeChanged = random() % 5 == 0;
+            if (modeChanged) {
+                mode = mode == HOME ? AWAY : HOME;
+            }
+            after->mode = mode;
+            int touched[3];
+            int count = 1 + static_cast<int>(random() % 3);
+            for (int r = 0; r < count; r++) {
+                touched[r] = static_cast<int>(random() % POOL_ROOMS);
+                copyStateString(after->rooms[after->roomCount++].name, ROOM_NAME_LEN, poolRoom(touched[r]).c_str());
+            }
+            recordRoomsChanges(*before, *after);
+            version++;
+            for (int r = 0; r < count; r++) {
+                lastChange[touched[r]].store(version);
+            }
+            if (modeChanged) {
+                lastChange[MODE_ENTITY].store(version);
+            }
+        }
+        writerDone.store(true);
+    });
+
+    uint32_t reported[ENTITIES]{};
+    uint32_t since = base;
+    unsigned long reads = 0;
+    unsigned long resyncs = 0;
+    std::unique_ptr<ChangeSet> changes(new ChangeSet{});
+    bool finalPass = false;
+    while (true) {
+        // One last read after the writer stopped picks up its final publishes
+        finalPass = writerDone.load();
+        readChangesSince(since, *changes);
+        reads++;
+        CHECK(changes->version >= since);
+        if (changes->resync) {
+            // The client refetches everything, which covers every entity up to this version
+            resyncs++;
+            for (uint32_t &version: reported) {
+                version = changes->version;
+            }
+        } else {
+            uint32_t previous = since;
+            for (uint8_t i = 0; i < changes->count; i++) {
+                const ChangeEntry &entry = changes->entries[i];
+                CHECK(entry.version > since && entry.version <= changes->version);
+                CHECK(entry.version >= previous);
+                previous = entry.version;
+                int entity = entry.kind == ChangeKind::HEATING ? HEATING_ENTITY
+                             : entry.kind == ChangeKind::ROOM_MODE ? MODE_ENTITY
+                             : std::stoi(entry.roomName + 5);
+                CHECK(entry.kind != ChangeKind::ROOM || strncmp(entry.roomName, "Pool ", 5) == 0);
+                reported[entity] = entry.version;
+            }
+        }
+        since = changes->version;
+        if (finalPass) {
+            break;
+        }
+    }
+    writer.join();
+
+    CHECK_EQ(since, base + CONCURRENT_PUBLISHES);
+    for (int entity = 0; entity < ENTITIES; entity++) {
+        if (reported[entity] < lastChange[entity].load()) {
+            std::fprintf(stderr, "entity %d changed at %u, last reported at %u\n", entity,
+                         lastChange[entity].load(), reported[entity]);
+            CHECK(false);
+        }
+    }
+    std::printf("%u concurrent publishes followed in %lu reads, %lu resyncs\n", CONCURRENT_PUBLISHES, reads,
+                resyncs);
+}
+
+int main() {
+    testVersionsAndDedup();
+    testOnePublishSharesAVersion();
+    testOverflowForcesResync();
+    testClientFollowsConcurrentPublishes();
+    std::printf("change log tests passed\n");
+    return 0;
+}
@@ -0,0 +1,237 @@
+// Chunked JSON responses: the streamed bytes match the rendered document whatever chunk sizes the server
+// asks for, an oversized piece ends the response, and the heap a /api/rooms miss holds through the response
+// cache stops growing with the document once it is too large to keep, measured with several responses in
+// flight at once
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ChunkedJson.h"
+#include "HeapTracker.h"
+#include "HostStubs.h"
+#include "HostTest.h"
+#include "ResponseCache.h"
+
+// Dashboards open at once in the load test
+constexpr int CONCURRENT_REQUESTS = 8;
+// About one room with two thermometers as LocalAPI renders it
+constexpr size_t ELEMENT_BYTES = 220;
+// One TCP segment, what AsyncTCP usually has room for
+constexpr size_t SEGMENT_BYTES = 1436;
+
+/**
+ * @class ElementsSource
+ * @brief {"rooms":[...]} with a given number of elements, rendered one element per piece like RoomsJsonSource.
+ */
+class ElementsSource : public JsonChunkSource {
+private:
+    size_t elements;
+    size_t elementBytes;
+    bool *released;
+    size_t piece = 0;
+
+public:
+    ElementsSource(size_t elementCount, size_t bytes, bool *releasedFlag = nullptr)
+            : elements(elementCount), elementBytes(bytes), released(releasedFlag) {}
+
+    ~ElementsSource() override {
+        if (released != nullptr) {
+            *released = true;
+        }
+    }
+
+    size_t nextPiece(char *out, size_t size) override {
+        size_t current = piece++;
+        if (current == 0) {
+            return writeJsonLiteral(out, size, "{\"rooms\":[");
+        }
+        size_t element = current - 1;
+        if (element < elements) {
+            JsonDocument doc;
+            char head[64];
+            int length = std::snprintf(head, sizeof(head), "{\"name\":\"Camera %04zu\",\"pad\":\"", element);
+            doc.text = head;
+            size_t padding = elementBytes > static_cast<size_t>(length) + 2 ? elementBytes - length - 2 : 0;
+            doc.text.append(padding, 'x');
+            doc.text += "\"}";
+            return writeJsonElement(doc, element == 0, out, size);
+        }
+        if (element == elements) {
+            return writeJsonLiteral(out, size, "]}");
+        }
+        return 0;
+    }
+};
+
+// Pulls the body out of a chunked response, asking for the next of chunkSizes each time
+static std::string drain(AsyncWebServerRequest &request, const std::vector<size_t> &chunkSizes) {
+    CHECK(request.response != nullptr);
+    std::string body;
+    std::vector<uint8_t> buffer;
+    for (size_t call = 0;; call++) {
+        size_t maxLen = chunkSizes[call % chunkSizes.size()];
+        buffer.resize(maxLen);
+        size_t written = request.response->filler(buffer.data(), maxLen, body.size());
+        CHECK(written <= maxLen);
+        if (written == 0) {
+            return body;
+        }
+        body.append(reinterpret_cast<const char *>(buffer.data()), written);
+    }
+}
+
+static std::string render(size_t elements, size_t elementBytes) {
+    ElementsSource source(elements, elementBytes);
+    std::string body;
+    CHECK(renderJsonSource(source, body));
+    return body;
+}
+
+static void testStreamMatchesRenderAtEveryChunkSize() {
+    std::string expected = render(5, ELEMENT_BYTES);
+    CHECK(expected.compare(0, 10, "{\"rooms\":[") == 0);
+    CHECK(expected.compare(expected.size() - 2, 2, "]}") == 0);
+    for (size_t chunk = 1; chunk <= expected.size() + 1; chunk++) {
+        AsyncWebServerRequest request;
+        bool released = false;
+        tracedResponseBytes = 0;
+        CHECK(sendChunkedJson(&request, std::unique_ptr<JsonChunkSource>(new ElementsSource(5, ELEMENT_BYTES,
+                                                                                          &released))));
+        CHECK(!released);
+        CHECK(drain(request, {chunk}) == expected);
+        CHECK(released);
+        CHECK_EQ(tracedResponseBytes, expected.size());
+    }
+    // The window changes from one call to the next
+    AsyncWebServerRequest request;
+    CHECK(sendChunkedJson(&request, std::unique_ptr<JsonChunkSource>(new ElementsSource(5, ELEMENT_BYTES))));
+    CHECK(drain(request, {1, 7, 300, 2, 1436, 64}) == expected);
+}
+
+static void testEmptyDocument() {
+    AsyncWebServerRequest request;
+    CHECK(sendChunkedJson(&request, std::unique_ptr<JsonChunkSource>(new ElementsSource(0, ELEMENT_BYTES))));
+    CHECK(drain(request, {SEGMENT_BYTES}) == "{\"rooms\":[]}");
+}
+
+static void testOversizedPieceEndsTheResponse() {
+    // Two elements fit, the third is larger than a piece
+    class OversizedSource : public ElementsSource {
+    public:
+        OversizedSource() : ElementsSource(3, ELEMENT_BYTES) {}
+
+        size_t nextPiece(char *out, size_t size) override {
+            size_t length = ElementsSource::nextPiece(out, size);
+            return calls++ == 3 ? size : length;
+        }
+
+    private:
+        int calls = 0;
+    };
+
+    unsigned long logged = logEventCount;
+    AsyncWebServerRequest request;
+    CHECK(sendChunkedJson(&request, std::unique_ptr<JsonChunkSource>(new OversizedSource)));
+    std::string body = drain(request, {SEGMENT_BYTES});
+    CHECK(body.compare(0, 10, "{\"rooms\":[") == 0);
+    CHECK(body.back() == '}');
+    CHECK_EQ(logEventCount, logged + 1);
+    CHECK(lastLogEvent.event == LogEvent::API_JSON_PIECE_TOO_LARGE);
+    CHECK_EQ(lastLogEvent.args[0], 1);
+
+    OversizedSource rendered;
+    std::string out;
+    CHECK(!renderJsonSource(rendered, out));
+    CHECK_EQ(lastLogEvent.args[0], 0);
+
+    // A real element that outgrows the buffer is caught by writeJsonElement
+    AsyncWebServerRequest large;
+    CHECK(sendChunkedJson(&large, std::unique_ptr<JsonChunkSource>(new ElementsSource(2, JSON_PIECE_LEN))));
+    CHECK(drain(large, {SEGMENT_BYTES}) == "{\"rooms\":[");
+}
+
+// The rooms snapshot the cached route renders, a new version for every document size
+static uint32_t roomsVersion = 0;
+static size_t roomsElements = 0;
+
+// Stands in for LocalAPI's makeRoomsSource(), which needs the real ArduinoJson
+static std::unique_ptr<JsonChunkSource> makeElementsSource(ApiEncoding, uint32_t &version) {
+    version = roomsVersion;
+    return std::unique_ptr<JsonChunkSource>(new ElementsSource(roomsElements, ELEMENT_BYTES));
+}
+
+// Peak heap per request with CONCURRENT_REQUESTS misses of /api/rooms streamed side by side through the
+// response cache, one segment at a time, the way handleGetRooms() answers them
+static size_t streamedPeakPerRequest(size_t elements) {
+    roomsVersion++;
+    roomsElements = elements;
+    std::vector<std::unique_ptr<AsyncWebServerRequest>> requests;
+    for (int i = 0; i < CONCURRENT_REQUESTS; i++) {
+        requests.emplace_back(new AsyncWebServerRequest);
+    }
+    std::vector<uint8_t> segment(SEGMENT_BYTES);
+    size_t baseline = heapUsage().liveBytes;
+    resetHeapPeak();
+
+    for (auto &request: requests) {
+        CHECK(sendCachedStream(request.get(), CachedRoute::ROOMS, roomsVersion, makeElementsSource));
+        CHECK(request->response->chunked);
+    }
+    std::vector<size_t> sent(CONCURRENT_REQUESTS, 0);
+    size_t open = CONCURRENT_REQUESTS;
+    while (open > 0) {
+        open = 0;
+        for (int i = 0; i < CONCURRENT_REQUESTS; i++) {
+            AsyncWebServerResponse *response = requests[i]->response;
+            size_t written = response->filler(segment.data(), segment.size(), sent[i]);
+            sent[i] += written;
+            open += written > 0 ? 1 : 0;
+        }
+    }
+    size_t peak = heapUsage().peakBytes - baseline;
+    CHECK_EQ(sent[0], render(elements, ELEMENT_BYTES).size());
+    return peak / CONCURRENT_REQUESTS;
+}
+
+// What a miss did before it was streamed: the whole document in a string, held until it was sent
+static size_t bufferedPeakPerRequest(size_t elements) {
+    size_t baseline = heapUsage().liveBytes;
+    resetHeapPeak();
+    std::vector<std::string> bodies(CONCURRENT_REQUESTS);
+    for (std::string &body: bodies) {
+        ElementsSource source(elements, ELEMENT_BYTES);
+        CHECK(renderJsonSource(source, body));
+    }
+    return (heapUsage().peakBytes - baseline) / CONCURRENT_REQUESTS;
+}
+
+static void testPeakHeapDoesNotGrowWithTheDocument() {
+    const size_t sizes[] = {1, 10, 100, 1000};
+    size_t streamed[4];
+    for (int i = 0; i < 4; i++) {
+        streamed[i] = streamedPeakPerRequest(sizes[i]);
+        size_t buffered = bufferedPeakPerRequest(sizes[i]);
+        std::printf("%4zu elements, %6zu bytes: peak heap per request %zu bytes streamed, %zu buffered\n",
+                    sizes[i], render(sizes[i], ELEMENT_BYTES).size(), streamed[i], buffered);
+    }
+    // Small documents are copied aside for the cache while they are sent, past RESPONSE_CACHE_KEEP_LEN the copy
+    // is dropped and the peak is the same whatever the size
+    CHECK(streamed[0] < streamed[1]);
+    CHECK_EQ(streamed[3], streamed[2]);
+    for (size_t peak: streamed) {
+        // The state with its piece buffer, the source, the response, one element being serialized and the copy,
+        // whose capacity may reach twice what it holds
+        CHECK(peak < 2 * JSON_PIECE_LEN + 2 * RESPONSE_CACHE_KEEP_LEN);
+    }
+    // The last document was too large to keep
+    CHECK_EQ(getResponseCacheStats(CachedRoute::ROOMS, ApiEncoding::JSON).cachedBytes, 0);
+}
+
+int main() {
+    testStreamMatchesRenderAtEveryChunkSize();
+    testEmptyDocument();
+    testOversizedPieceEndsTheResponse();
+    testPeakHeapDoesNotGrowWithTheDocument();
+    std::printf("chunked json tests passed\n");
+    return 0;
+}
@@ -0,0 +1,134 @@
+// JSON against MessagePack for the dashboard's two largest bodies, /api/rooms and /api/schedule: the bytes the
+// real LocalAPI.cpp handlers send in each encoding, that the MessagePack body decodes to the same content, and
+// how long ArduinoJson takes to serialize the same document both ways.
+//
+// Times are from the host and only compare the two encodings with each other, the ESP32 is several times
+// slower at both.
+#include <cstdio>
+#include <string>
+#include "HostStubs.h"
+#include "HostTest.h"
+#include "LocalAPI.h"
+#include "SystemState.h"
+#include "globalSettings.h"
+
+constexpr uint8_t ROOMS = 8;
+constexpr uint8_t THERMOMETERS_PER_ROOM = 2;
+constexpr unsigned long SERIALIZE_ITERATIONS = 20000;
+
+// What setup() loads from flash, two thermometers per room
+static void createRooms() {
+    for (uint8_t room = 0; room < ROOMS; room++) {
+        char name[ROOM_NAME_LEN];
+        std::snprintf(name, sizeof(name), "Camera %u", room);
+        rooms.emplace_back(name, true);
+        for (uint8_t i = 0; i < THERMOMETERS_PER_ROOM; i++) {
+            char mac[MAC_STRING_LEN];
+            std::snprintf(mac, sizeof(mac), "A4:C1:38:00:%02X:%02X", room, i);
+            CHECK(rooms.back().addThermometer(mac, true));
+        }
+    }
+}
+
+// The whole body of a GET, read the way the server would
+static std::string fetch(void (*handler)(AsyncWebServerRequest *), const char *accept, std::string &contentType) {
+    AsyncWebServerRequest request;
+    request.headers.emplace_back("Accept", accept);
+    handler(&request);
+    CHECK(request.response != nullptr);
+    CHECK_EQ(request.response->code, 200);
+    contentType = request.response->contentType.c_str();
+    std::string body;
+    uint8_t segment[1436];
+    size_t written;
+    while ((written = request.response->filler(segment, sizeof(segment), body.size())) > 0) {
+        body.append(reinterpret_cast<const char *>(segment), written);
+        if (!request.response->chunked && body.size() == request.response->contentLength) {
+            break;
+        }
+    }
+    return body;
+}
+
+// Serialization time of one document in both encodings
+static void compareSerialization(const char *route, const JsonDocument &doc) {
+    std::string out;
+    out.reserve(16384);
+    double jsonNs = measureNanos(SERIALIZE_ITERATIONS, [&](unsigned long) {
+        out.clear();
+        serializeJson(doc, out);
+    });
+    size_t jsonBytes = out.size();
+    double msgpackNs = measureNanos(SERIALIZE_ITERATIONS, [&](unsigned long) {
+        out.clear();
+        serializeMsgPack(doc, out);
+    });
+    std::printf("%-9s same document: JSON %5zu bytes in %7.0f ns, MessagePack %5zu bytes in %7.0f ns\n", route,
+                jsonBytes, jsonNs, out.size(), msgpackNs);
+    CHECK(out.size() < jsonBytes);
+}
+
+static void testRooms() {
+    std::string type;
+    std::string json = fetch(handleGetRooms, "application/json", type);
+    CHECK(type == "application/json");
+    std::string msgpack = fetch(handleGetRooms, "application/msgpack", type);
+    CHECK(type == "application/msgpack");
+    std::printf("%-9s as sent: JSON %5zu bytes, MessagePack %5zu bytes (%.0f%%)\n", "rooms", json.size(),
+                msgpack.size(), 100.0 * msgpack.size() / json.size());
+    CHECK(msgpack.size() < json.size());
+
+    JsonDocument fromJson;
+    JsonDocument fromMsgPack;
+    CHECK(!deserializeJson(fromJson, json));
+    CHECK(!deserializeMsgPack(fromMsgPack, msgpack));
+    // Same content, only the encoding differs
+    CHECK_EQ(fromMsgPack["rooms"].size(), ROOMS);
+    for (uint8_t room = 0; room < ROOMS; room++) {
+        JsonObject packedRoom = fromMsgPack["rooms"][room];
+        JsonObject jsonRoom = fromJson["rooms"][room];
+        CHECK_EQ(packedRoom.size(), jsonRoom.size());
+        CHECK(std::string(packedRoom["name"].as<const char *>()) == jsonRoom["name"].as<const char *>());
+        CHECK_EQ(packedRoom["thermometers"].size(), THERMOMETERS_PER_ROOM);
+    }
+    compareSerialization("rooms", fromJson);
+}
+
+static void testSchedule() {
+    std::string type;
+    std::string json = fetch(handleGetSchedule, "application/json", type);
+    std::string msgpack = fetch(handleGetSchedule, "application/msgpack", type);
+    CHECK(type == "application/msgpack");
+    std::printf("%-9s as sent: JSON %5zu bytes, MessagePack %5zu bytes (%.0f%%), days as mode numbers\n",
+                "schedule", json.size(), msgpack.size(), 100.0 * msgpack.size() / json.size());
+    CHECK(msgpack.size() < json.size());
+
+    JsonDocument fromJson;
+    JsonDocument packed;
+    CHECK(!deserializeJson(fromJson, json));
+    CHECK(!deserializeMsgPack(packed, msgpack));
+    CHECK_EQ(packed["days"].size(), 7);
+    JsonArray modes = packed["modes"];
+    for (uint8_t day = 0; day < 7; day++) {
+        JsonArray slots = packed["days"][day];
+        CHECK_EQ(slots.size(), 48);
+        for (uint8_t slot = 0; slot < 48; slot++) {
+            const char *name = modes[slots[slot].as<int>()];
+            CHECK(std::string(name) == fromJson["days"][day]["hours"][slot].as<const char *>());
+        }
+    }
+    CHECK_EQ(packed["user_directives"].size(), fromJson["user_directives"].size());
+    CHECK_EQ(packed["smart_directives"].size(), fromJson["smart_directives"].size());
+    compareSerialization("schedule", fromJson);
+}
+
+int main() {
+    hostMillis = 1000;
+    initSemaphores();
+    createRooms();
+    initSystemState();
+    testRooms();
+    testSchedule();
+    std::printf("encoding size tests passed\n");
+    return 0;
+}
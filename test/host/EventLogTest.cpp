@@ -0,0 +1,269 @@
+// The event log ring: records and sequences as /api/logs returns them, overwriting the oldest, the flush
+// to Serial and to the log file with its rotation, two tasks logging while a client reads, and what
+// logEvent() costs
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <LittleFS.h>
+#include "EventLog.h"
+#include "HeapTracker.h"
+#include "HostStubs.h"
+#include "HostTest.h"
+#include "ResponseCache.h"
+
+// Far more than the host needs, logEvent() is a fetch_add and a few stores
+constexpr double LOG_BUDGET_NS = 1000.0;
+constexpr unsigned long BENCHMARK_EVENTS = 10000000;
+constexpr int LOGGING_THREADS = 2;
+
+struct FetchedLog {
+    LogHeader header;
+    std::vector<LogRecord> records;
+};
+
+static FetchedLog parseLog(const std::string &bytes) {
+    FetchedLog log{};
+    CHECK(bytes.size() >= sizeof(LogHeader));
+    CHECK_EQ((bytes.size() - sizeof(LogHeader)) % sizeof(LogRecord), 0);
+    memcpy(&log.header, bytes.data(), sizeof(LogHeader));
+    CHECK(memcmp(log.header.magic, "TLOG", 4) == 0);
+    CHECK_EQ(log.header.version, EVENT_LOG_FORMAT_VERSION);
+    CHECK_EQ(log.header.recordSize, sizeof(LogRecord));
+    for (size_t offset = sizeof(LogHeader); offset < bytes.size(); offset += sizeof(LogRecord)) {
+        LogRecord record{};
+        memcpy(&record, bytes.data() + offset, sizeof(record));
+        log.records.push_back(record);
+    }
+    return log;
+}
+
+// GET /api/logs?since=<since>
+static FetchedLog fetchRing(uint32_t since) {
+    AsyncWebServerRequest request;
+    request.params.emplace_back("since", std::to_string(since));
+    handleGetLogs(&request);
+    CHECK(request.response != nullptr);
+    std::string bytes(request.response->contentLength, '\0');
+    CHECK_EQ(request.response->filler(reinterpret_cast<uint8_t *>(&bytes[0]), bytes.size(), 0), bytes.size());
+    FetchedLog log = parseLog(bytes);
+    CHECK_EQ(log.header.bootId, cacheBootId());
+    return log;
+}
+
+static uint32_t lastLogged() {
+    FetchedLog log = fetchRing(0);
+    return log.records.empty() ? 0 : log.records.back().sequence;
+}
+
+static void testRecordsAndSequences() {
+    hostMillis = 12345;
+    uint32_t base = lastLogged();
+    logEvent(LogModule::SYSTEM, LogLevel::INFO, LogEvent::BOOT, 3);
+    hostMillis += 10;
+    logEvent(LogModule::API, LogLevel::WARN, LogEvent::API_BODY_TOO_LARGE, 5000, 4096);
+    logEvent(LogModule::PERSISTENCE, LogLevel::ERROR, LogEvent::FILE_WRITE_FAILED, 1, -2, 2147483647);
+
+    FetchedLog log = fetchRing(base);
+    CHECK_EQ(log.records.size(), 3);
+    const LogRecord &boot = log.records[0];
+    CHECK_EQ(boot.sequence, base + 1);
+    CHECK_EQ(boot.timeMs, 12345);
+    CHECK_EQ(boot.event, static_cast<uint16_t>(LogEvent::BOOT));
+    CHECK_EQ(boot.module, static_cast<uint8_t>(LogModule::SYSTEM));
+    CHECK_EQ(boot.level, static_cast<uint8_t>(LogLevel::INFO));
+    CHECK_EQ(boot.args[0], 3);
+    CHECK_EQ(log.records[1].timeMs, 12355);
+    CHECK_EQ(log.records[1].args[1], 4096);
+    CHECK_EQ(log.records[2].args[1], -2);
+    CHECK_EQ(log.records[2].args[2], 2147483647);
+
+    // since skips what the client already has
+    FetchedLog newer = fetchRing(base + 2);
+    CHECK_EQ(newer.records.size(), 1);
+    CHECK_EQ(newer.records[0].sequence, base + 3);
+    CHECK(fetchRing(base + 3).records.empty());
+    CHECK(fetchRing(base + 1000).records.empty());
+}
+
+static void testRingKeepsTheNewest() {
+    uint32_t base = lastLogged();
+    for (uint32_t i = 0; i < EVENT_LOG_CAPACITY + 10; i++) {
+        logEvent(LogModule::BLE, LogLevel::INFO, LogEvent::SENSOR_ADDRESS_INVALID, static_cast<int32_t>(i));
+    }
+    FetchedLog log = fetchRing(0);
+    CHECK_EQ(log.records.size(), EVENT_LOG_CAPACITY);
+    for (uint32_t i = 0; i < EVENT_LOG_CAPACITY; i++) {
+        CHECK_EQ(log.records[i].sequence, base + 11 + i);
+        CHECK_EQ(log.records[i].args[0], 10 + i);
+    }
+    // A client that fell behind gets what is left, the gap in the sequences shows what it lost
+    FetchedLog behind = fetchRing(base + 1);
+    CHECK_EQ(behind.records.front().sequence, base + 11);
+}
+
+static void testFlushEchoesAndPersists() {
+    flushEventLog();
+    LittleFS.files.clear();
+    Serial.output.clear();
+
+    logEvent(LogModule::SYSTEM, LogLevel::INFO, LogEvent::BOOT, 1);
+    logEvent(LogModule::STATE, LogLevel::INFO, LogEvent::ROOM_UPDATE_UNKNOWN);
+    logEvent(LogModule::HEATING, LogLevel::ERROR, LogEvent::RELAY_TASK_EXCEPTION);
+    logEvent(LogModule::OTA, LogLevel::WARN, LogEvent::OTA_ERROR, 2);
+    flushEventLog();
+
+    // Serial gets the boot, the warning and the error, one line each, not the informational record
+    size_t lines = 0;
+    for (char c: Serial.output) {
+        lines += c == '\n' ? 1 : 0;
+    }
+    CHECK_EQ(lines, 3);
+    CHECK(Serial.output.find("system info event 1: 1 0 0") != std::string::npos);
+    CHECK(Serial.output.find("event 11:") == std::string::npos);
+    CHECK(Serial.output.find("ota warn event 62: 2 0 0") != std::string::npos);
+
+    // The file keeps the boot, the warning and the error
+    CHECK(LittleFS.exists(EVENT_LOG_FILE));
+    FetchedLog file = parseLog(LittleFS.files[EVENT_LOG_FILE]);
+    CHECK_EQ(file.records.size(), 3);
+    CHECK_EQ(file.records[0].event, static_cast<uint16_t>(LogEvent::BOOT));
+    CHECK_EQ(file.records[1].event, static_cast<uint16_t>(LogEvent::RELAY_TASK_EXCEPTION));
+    CHECK_EQ(file.records[2].event, static_cast<uint16_t>(LogEvent::OTA_ERROR));
+
+    // Nothing new, nothing printed or written
+    Serial.output.clear();
+    flushEventLog();
+    CHECK(Serial.output.empty());
+    CHECK_EQ(parseLog(LittleFS.files[EVENT_LOG_FILE]).records.size(), 3);
+
+    // Records overwritten before the flush are skipped, the rest are flushed once
+    for (uint32_t i = 0; i < EVENT_LOG_CAPACITY * 2; i++) {
+        logEvent(LogModule::API, LogLevel::WARN, LogEvent::API_ROOM_NOT_FOUND, static_cast<int32_t>(i));
+    }
+    flushEventLog();
+    FetchedLog after = parseLog(LittleFS.files[EVENT_LOG_FILE]);
+    CHECK_EQ(after.records.size(), 3 + EVENT_LOG_CAPACITY);
+    CHECK_EQ(after.records.back().args[0], EVENT_LOG_CAPACITY * 2 - 1);
+
+    // GET /api/logs?file=current returns the file as it is
+    AsyncWebServerRequest current;
+    current.params.emplace_back("file", "current");
+    handleGetLogs(&current);
+    CHECK_EQ(current.sentCode, 200);
+    CHECK(current.sentBody == LittleFS.files[EVENT_LOG_FILE]);
+    AsyncWebServerRequest previous;
+    previous.params.emplace_back("file", "previous");
+    handleGetLogs(&previous);
+    CHECK_EQ(previous.sentCode, 404);
+}
+
+static void testFileRotation() {
+    flushEventLog();
+    LittleFS.files.clear();
+    size_t perFlush = EVENT_LOG_CAPACITY / 2;
+    // Whole flushes until the file reached its limit, the next one rotates it
+    while (LittleFS.files[EVENT_LOG_FILE].size() < EVENT_LOG_FILE_LIMIT) {
+        for (size_t i = 0; i < perFlush; i++) {
+            logEvent(LogModule::PERSISTENCE, LogLevel::WARN, LogEvent::FLUSH_TIMED_OUT, 1);
+        }
+        flushEventLog();
+    }
+    std::string full = LittleFS.files[EVENT_LOG_FILE];
+    logEvent(LogModule::PERSISTENCE, LogLevel::ERROR, LogEvent::FILE_OPEN_FAILED, 2);
+    flushEventLog();
+
+    CHECK(LittleFS.exists(EVENT_LOG_PREVIOUS_FILE));
+    CHECK(LittleFS.files[EVENT_LOG_PREVIOUS_FILE] == full);
+    FetchedLog fresh = parseLog(LittleFS.files[EVENT_LOG_FILE]);
+    CHECK_EQ(fresh.records.size(), 1);
+    CHECK_EQ(fresh.records[0].event, static_cast<uint16_t>(LogEvent::FILE_OPEN_FAILED));
+    CHECK(full.size() < EVENT_LOG_FILE_LIMIT + perFlush * sizeof(LogRecord));
+}
+
+// Two tasks log while a client follows the ring, every record it gets must be whole
+static void testConcurrentLogging() {
+    constexpr int32_t PER_THREAD = 100000;
+    uint32_t base = lastLogged();
+    std::atomic<int> running{LOGGING_THREADS};
+    std::vector<std::thread> writers;
+    for (int t = 0; t < LOGGING_THREADS; t++) {
+        writers.emplace_back([t, &running]() {
+            for (int32_t i = 0; i < PER_THREAD; i++) {
+                logEvent(LogModule::BLE, LogLevel::INFO, LogEvent::SENSOR_REGISTRY_FULL, t, i, t * 1000000 + i);
+                // Bursts with gaps, so the reader keeps up often enough to see records being written
+                if (i % 32 == 0) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(20));
+                }
+            }
+            running.fetch_sub(1);
+        });
+    }
+    uint32_t since = base;
+    unsigned long read = 0;
+    unsigned long fetches = 0;
+    while (true) {
+        bool finalPass = running.load() == 0;
+        FetchedLog log = fetchRing(since);
+        fetches++;
+        for (const LogRecord &record: log.records) {
+            CHECK(record.sequence > since);
+            CHECK_EQ(record.event, static_cast<uint16_t>(LogEvent::SENSOR_REGISTRY_FULL));
+            CHECK_EQ(record.args[2], record.args[0] * 1000000 + record.args[1]);
+            since = record.sequence;
+            read++;
+        }
+        if (finalPass) {
+            break;
+        }
+    }
+    for (std::thread &writer: writers) {
+        writer.join();
+    }
+    CHECK_EQ(since, base + LOGGING_THREADS * PER_THREAD);
+    std::printf("%d concurrent events, %lu read whole in %lu fetches\n", LOGGING_THREADS * PER_THREAD, read,
+                fetches);
+}
+
+static void benchmarkLogEvent() {
+    unsigned long allocations = heapUsage().allocations;
+    double singleNs = measureNanos(BENCHMARK_EVENTS, [](unsigned long i) {
+        logEvent(LogModule::HEATING, LogLevel::INFO, LogEvent::RELAY_TASK_UNKNOWN_ERROR, static_cast<int32_t>(i));
+    });
+    CHECK_EQ(heapUsage().allocations - allocations, 0);
+
+    // Both cores logging at once, they contend for the sequence counter
+    std::vector<double> threadNs(LOGGING_THREADS);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < LOGGING_THREADS; t++) {
+        threads.emplace_back([&threadNs, t]() {
+            threadNs[t] = measureNanos(BENCHMARK_EVENTS, [t](unsigned long i) {
+                logEvent(LogModule::BLE, LogLevel::INFO, LogEvent::SENSOR_ADDRESS_INVALID, t,
+                         static_cast<int32_t>(i));
+            });
+        });
+    }
+    double contendedNs = 0;
+    for (int t = 0; t < LOGGING_THREADS; t++) {
+        threads[t].join();
+        contendedNs = threadNs[t] > contendedNs ? threadNs[t] : contendedNs;
+    }
+    std::printf("logEvent: %.1f ns, contended by %d threads: %.1f ns, no allocations\n", singleNs,
+                LOGGING_THREADS, contendedNs);
+    CHECK(singleNs < LOG_BUDGET_NS);
+    CHECK(contendedNs < LOG_BUDGET_NS);
+}
+
+int main() {
+    testRecordsAndSequences();
+    testRingKeepsTheNewest();
+    testFlushEchoesAndPersists();
+    testFileRotation();
+    testConcurrentLogging();
+    benchmarkLogEvent();
+    std::printf("event log tests passed\n");
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include "HeapTracker.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#ifdef HEAP_TRACKER_WRAP_MALLOC
+#include <malloc.h>
+#endif
+
+// Every block starts with its size, padded so the caller still gets malloc's alignment
+constexpr size_t BLOCK_HEADER = alignof(std::max_align_t);
+
+static std::atomic<unsigned long> allocations{0};
+static std::atomic<size_t> liveBytes{0};
+static std::atomic<size_t> peakBytes{0};
+
+static void notePeak(size_t live) {
+    size_t peak = peakBytes.load(std::memory_order_relaxed);
+    while (live > peak && !peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+static void noteAllocation(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    notePeak(liveBytes.fetch_add(size, std::memory_order_relaxed) + size);
+}
+
+HeapUsage heapUsage() {
+    return {allocations.load(), liveBytes.load(), peakBytes.load()};
+}
+
+void resetHeapPeak() {
+    peakBytes.store(liveBytes.load());
+}
+
+#ifdef HEAP_TRACKER_WRAP_MALLOC
+
+// ArduinoJson takes its pools from malloc, so here malloc itself is counted: the test is linked with
+// -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free and operator new goes through it too. A block
+// counts with its malloc_usable_size(), no header is needed to free it.
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *memory, size_t size);
+void __real_free(void *memory);
+
+void *__wrap_malloc(size_t size) {
+    void *memory = __real_malloc(size);
+    if (memory != nullptr) {
+        noteAllocation(malloc_usable_size(memory));
+    }
+    return memory;
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    void *memory = __real_calloc(count, size);
+    if (memory != nullptr) {
+        noteAllocation(malloc_usable_size(memory));
+    }
+    return memory;
+}
+
+void *__wrap_realloc(void *memory, size_t size) {
+    size_t before = memory != nullptr ? malloc_usable_size(memory) : 0;
+    void *moved = __real_realloc(memory, size);
+    if (moved != nullptr || size == 0) {
+        liveBytes.fetch_sub(before, std::memory_order_relaxed);
+    }
+    if (moved != nullptr) {
+        noteAllocation(malloc_usable_size(moved));
+    }
+    return moved;
+}
+
+void __wrap_free(void *memory) {
+    if (memory != nullptr) {
+        liveBytes.fetch_sub(malloc_usable_size(memory), std::memory_order_relaxed);
+    }
+    __real_free(memory);
+}
+}
+
+void *operator new(size_t size) {
+    void *memory = std::malloc(size);
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return std::malloc(size);
+}
+
+void operator delete(void *memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void *memory, const std::nothrow_t &) noexcept {
+    std::free(memory);
+}
+
+#else
+
+void *operator new(size_t size) {
+    auto *block = static_cast<unsigned char *>(std::malloc(BLOCK_HEADER + size));
+    if (block == nullptr) {
+        throw std::bad_alloc();
+    }
+    *reinterpret_cast<size_t *>(block) = size;
+    noteAllocation(size);
+    return block + BLOCK_HEADER;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    try {
+        return operator new(size);
+    } catch (const std::bad_alloc &) {
+        return nullptr;
+    }
+}
+
+void operator delete(void *memory) noexcept {
+    if (memory == nullptr) {
+        return;
+    }
+    unsigned char *block = static_cast<unsigned char *>(memory) - BLOCK_HEADER;
+    liveBytes.fetch_sub(*reinterpret_cast<size_t *>(block), std::memory_order_relaxed);
+    std::free(block);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+    operator delete(memory);
+}
+
+void operator delete(void *memory, const std::nothrow_t &) noexcept {
+    operator delete(memory);
+}
+
+#endif
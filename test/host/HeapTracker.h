@@ -0,0 +1,23 @@
+#ifndef ESP32_TERMOSTAT_HEAPTRACKER_H
+#define ESP32_TERMOSTAT_HEAPTRACKER_H
+
+#include <cstddef>
+
+// A test that links HeapTracker.cpp replaces the global operator new and delete with ones that count what
+// is allocated, so it can show that a path allocates nothing or how much heap a request holds at most.
+// Built with HEAP_TRACKER_WRAP_MALLOC (see host_test_count_malloc in CMakeLists.txt) malloc is counted too.
+
+struct HeapUsage {
+    unsigned long allocations;  ///< Since the start of the test.
+    size_t liveBytes;
+    size_t peakBytes;           ///< Most bytes live at once since the last resetHeapPeak().
+};
+
+HeapUsage heapUsage();
+
+/**
+ * @brief Starts a new peak from the bytes live now.
+ */
+void resetHeapPeak();
+
+#endif //ESP32_TERMOSTAT_HEAPTRACKER_H
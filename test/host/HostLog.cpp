@@ -0,0 +1,10 @@
+// The stubbed logEvent(), its own object in host_stubs so a test that links EventLog.cpp gets the real one
+#include "HostStubs.h"
+
+HostLogRecord lastLogEvent{};
+unsigned long logEventCount = 0;
+
+void logEvent(LogModule module, LogLevel level, LogEvent event, int32_t arg0, int32_t arg1, int32_t arg2) {
+    lastLogEvent = {module, level, event, {arg0, arg1, arg2}};
+    logEventCount++;
+}
@@ -0,0 +1,106 @@
+// Definitions behind the host stand-ins in stubs/
+#include "HostStubs.h"
+#include <cstdarg>
+#include <cstdio>
+#include <deque>
+#include <vector>
+#include <LittleFS.h>
+#include <esp_system.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+uint32_t hostMillis = 0;
+uint32_t hostMicros = 0;
+uint32_t hostFreeHeap = 200000;
+uint32_t hostMaxAllocHeap = 100000;
+uint32_t hostRandom = 0x5EED1234;
+EspClass ESP;
+HardwareSerial Serial;
+LittleFSFS LittleFS;
+
+uint32_t millis() {
+    return hostMillis;
+}
+
+uint32_t micros() {
+    return hostMicros;
+}
+
+uint32_t EspClass::getFreeHeap() {
+    return hostFreeHeap;
+}
+
+uint32_t EspClass::getMaxAllocHeap() {
+    return hostMaxAllocHeap;
+}
+
+uint32_t esp_random() {
+    return hostRandom;
+}
+
+TickType_t xTaskGetTickCount() {
+    return hostMillis / portTICK_PERIOD_MS;
+}
+
+int HardwareSerial::printf(const char *format, ...) {
+    char line[256];
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vsnprintf(line, sizeof(line), format, arguments);
+    va_end(arguments);
+    output += line;
+    return length;
+}
+
+struct HostQueue {
+    UBaseType_t length;
+    UBaseType_t itemSize;
+    std::deque<std::vector<uint8_t>> items;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    return new HostQueue{length, itemSize, {}};
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait) {
+    (void) wait;
+    if (queue->items.size() >= queue->length) {
+        return pdFALSE;
+    }
+    const auto *bytes = static_cast<const uint8_t *>(item);
+    queue->items.emplace_back(bytes, bytes + queue->itemSize);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait) {
+    (void) wait;
+    if (queue->items.empty()) {
+        return pdFALSE;
+    }
+    memcpy(item, queue->items.front().data(), queue->itemSize);
+    queue->items.pop_front();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    return static_cast<UBaseType_t>(queue->items.size());
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    return new HostSemaphore{false};
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait) {
+    (void) wait;
+    if (semaphore->taken) {
+        return pdFALSE;
+    }
+    semaphore->taken = true;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    semaphore->taken = false;
+    return pdTRUE;
+}
@@ -0,0 +1,32 @@
+#ifndef ESP32_TERMOSTAT_HOSTSTUBS_H
+#define ESP32_TERMOSTAT_HOSTSTUBS_H
+
+#include <cstddef>
+#include <cstdint>
+#include "EventLog.h"
+
+// The clock the stubbed millis() and micros() return, tests move it by hand
+extern uint32_t hostMillis;
+extern uint32_t hostMicros;
+// What the stubbed ESP.getFreeHeap() and ESP.getMaxAllocHeap() report
+extern uint32_t hostFreeHeap;
+extern uint32_t hostMaxAllocHeap;
+// What the stubbed esp_random() returns
+extern uint32_t hostRandom;
+
+// The stubbed logEvent() keeps the last record instead of the ring, tests that link EventLog.cpp get the ring
+struct HostLogRecord {
+    LogModule module;
+    LogLevel level;
+    LogEvent event;
+    int32_t args[3];
+};
+
+extern HostLogRecord lastLogEvent;
+extern unsigned long logEventCount;
+
+// Counted by TraceHooks.cpp in tests that do not link RouteStats.cpp
+extern unsigned long tracedResponseStarts;
+extern size_t tracedResponseBytes;
+
+#endif //ESP32_TERMOSTAT_HOSTSTUBS_H
@@ -0,0 +1,40 @@
+#ifndef ESP32_TERMOSTAT_HOSTTEST_H
+#define ESP32_TERMOSTAT_HOSTTEST_H
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// Minimal checks for the host tests, a failed CHECK prints where and ends the test with a non-zero status
+
+#define CHECK(condition)                                                                        \
+    do {                                                                                        \
+        if (!(condition)) {                                                                     \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition);  \
+            std::exit(1);                                                                       \
+        }                                                                                       \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                                              \
+    do {                                                                                        \
+        long long actualValue = static_cast<long long>(actual);                                 \
+        long long expectedValue = static_cast<long long>(expected);                             \
+        if (actualValue != expectedValue) {                                                     \
+            std::fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__,      \
+                         #actual, actualValue, expectedValue);                                  \
+            std::exit(1);                                                                       \
+        }                                                                                       \
+    } while (0)
+
+// Average nanoseconds per call of body over iterations calls
+template<typename Body>
+double measureNanos(unsigned long iterations, Body body) {
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < iterations; i++) {
+        body(i);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(iterations);
+}
+
+#endif //ESP32_TERMOSTAT_HOSTTEST_H
@@ -0,0 +1,66 @@
+// What LocalAPI.cpp calls in the modules api_load_test does not link: the relay task, flash persistence, the
+// BLE scan, live events, static assets and the diagnostics pages. None of them is on the request path the
+// test drives, here they only record that they were asked.
+#include "BLEConnection.h"
+#include "Diagnostics.h"
+#include "EventLog.h"
+#include "HeatingControl.h"
+#include "LiveEvents.h"
+#include "Metrics.h"
+#include "SaveLoad.h"
+#include "StaticAssets.h"
+
+unsigned long controlUpdatesRequested = 0;
+unsigned long persistenceMarks = 0;
+
+void requestControlUpdate() {
+    controlUpdatesRequested++;
+}
+
+ControlLatencyHistogram getControlLatencyHistogram() {
+    return {};
+}
+
+void markDirty(PersistDomain domain) {
+    (void) domain;
+    persistenceMarks++;
+}
+
+PersistenceStats getPersistenceStats() {
+    return {};
+}
+
+const char *persistDomainName(PersistDomain domain) {
+    (void) domain;
+    return "host";
+}
+
+BLEScanStats getBLEScanStats() {
+    return {};
+}
+
+void initLiveEvents(AsyncWebServer &webServer) {
+    (void) webServer;
+}
+
+// No manifest on the host, LocalAPI falls back to serving the plain files
+bool registerStaticAssets(AsyncWebServer &webServer) {
+    (void) webServer;
+    return false;
+}
+
+void handleGetTasks(AsyncWebServerRequest *request) {
+    request->send(501);
+}
+
+void handleGetHeap(AsyncWebServerRequest *request) {
+    request->send(501);
+}
+
+void handleGetMetrics(AsyncWebServerRequest *request) {
+    request->send(501);
+}
+
+void handleGetLogs(AsyncWebServerRequest *request) {
+    request->send(501);
+}
@@ -0,0 +1,134 @@
+// The recording side of the metrics: bucket placement of a histogram, no lost updates from concurrent tasks,
+// and what MetricCounter::add() and MetricHistogram::observe() cost, the calls that sit in hot paths
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "HostTest.h"
+#include "Metrics.h"
+
+// Per call, far above what the host measures, only a lock or an allocation sneaking in would cross it
+constexpr double RECORD_BUDGET_NS = 1000.0;
+constexpr unsigned long BENCHMARK_ITERATIONS = 10000000;
+// The ESP32 has two cores
+constexpr int RECORDING_THREADS = 2;
+
+static void testHistogramBuckets() {
+    MetricHistogram histogram;
+    CHECK_EQ(histogram.getBoundCount(), METRIC_LATENCY_BOUND_COUNT);
+    // A bucket holds the values up to and including its bound
+    histogram.observe(0);
+    histogram.observe(100);
+    histogram.observe(101);
+    histogram.observe(500000);
+    histogram.observe(500001);
+    histogram.observe(UINT32_MAX);
+    CHECK_EQ(histogram.getCount(0), 2);
+    CHECK_EQ(histogram.getCount(1), 1);
+    CHECK_EQ(histogram.getCount(METRIC_LATENCY_BOUND_COUNT - 1), 1);
+    CHECK_EQ(histogram.getCount(METRIC_LATENCY_BOUND_COUNT), 2);
+    // The sum wraps like the counters
+    CHECK_EQ(histogram.getSum(), static_cast<uint32_t>(0 + 100 + 101 + 500000 + 500001 + UINT32_MAX));
+
+    static const uint32_t BYTES_BOUNDS[] = {64, 256};
+    MetricHistogram bytes(BYTES_BOUNDS, 2);
+    bytes.observe(64);
+    bytes.observe(65);
+    bytes.observe(257);
+    CHECK_EQ(bytes.getCount(0), 1);
+    CHECK_EQ(bytes.getCount(1), 1);
+    CHECK_EQ(bytes.getCount(2), 1);
+
+    // More bounds than the histogram has room for are cut off
+    static const uint32_t MANY_BOUNDS[METRIC_MAX_BOUNDS + 4] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14};
+    MetricHistogram many(MANY_BOUNDS, METRIC_MAX_BOUNDS + 4);
+    CHECK_EQ(many.getBoundCount(), METRIC_MAX_BOUNDS);
+    many.observe(14);
+    CHECK_EQ(many.getCount(METRIC_MAX_BOUNDS), 1);
+}
+
+static void testCounterAndGauge() {
+    MetricCounter counter;
+    counter.add();
+    counter.add(41);
+    CHECK_EQ(counter.get(), 42);
+    counter.add(UINT32_MAX - 41);
+    CHECK_EQ(counter.get(), 0);
+
+    MetricGauge gauge;
+    gauge.set(-5);
+    CHECK_EQ(gauge.get(), -5);
+}
+
+static void testConcurrentRecording() {
+    constexpr uint32_t PER_THREAD = 1000000;
+    MetricCounter counter;
+    MetricHistogram histogram;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < RECORDING_THREADS; t++) {
+        threads.emplace_back([&counter, &histogram, t]() {
+            for (uint32_t i = 0; i < PER_THREAD; i++) {
+                counter.add();
+                histogram.observe(t == 0 ? 50 : 700);
+            }
+        });
+    }
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+    CHECK_EQ(counter.get(), RECORDING_THREADS * PER_THREAD);
+    CHECK_EQ(histogram.getCount(0), PER_THREAD);
+    CHECK_EQ(histogram.getCount(3), PER_THREAD);
+    CHECK_EQ(histogram.getSum(), static_cast<uint32_t>(PER_THREAD * 50u + PER_THREAD * 700u));
+}
+
+static void benchmarkRecording() {
+    MetricCounter counter;
+    double addNs = measureNanos(BENCHMARK_ITERATIONS, [&](unsigned long) {
+        counter.add();
+    });
+    CHECK_EQ(counter.get(), BENCHMARK_ITERATIONS);
+
+    // Spread over every bucket, the +Inf one walks all the bounds
+    MetricHistogram histogram;
+    double observeNs = measureNanos(BENCHMARK_ITERATIONS, [&](unsigned long i) {
+        histogram.observe(static_cast<uint32_t>(i * 7919 % 1000000));
+    });
+    MetricHistogram slowest;
+    double observeInfNs = measureNanos(BENCHMARK_ITERATIONS, [&](unsigned long) {
+        slowest.observe(UINT32_MAX);
+    });
+
+    // Both cores hitting the same counter, the worst case for the shared cache line
+    MetricCounter shared;
+    double contendedNs = 0;
+    std::vector<std::thread> threads;
+    std::vector<double> threadNs(RECORDING_THREADS);
+    for (int t = 0; t < RECORDING_THREADS; t++) {
+        threads.emplace_back([&shared, &threadNs, t]() {
+            threadNs[t] = measureNanos(BENCHMARK_ITERATIONS, [&](unsigned long) {
+                shared.add();
+            });
+        });
+    }
+    for (int t = 0; t < RECORDING_THREADS; t++) {
+        threads[t].join();
+        contendedNs = threadNs[t] > contendedNs ? threadNs[t] : contendedNs;
+    }
+
+    std::printf("MetricCounter::add: %.1f ns, contended by %d threads: %.1f ns\n", addNs, RECORDING_THREADS,
+                contendedNs);
+    std::printf("MetricHistogram::observe: %.1f ns spread, %.1f ns into +Inf\n", observeNs, observeInfNs);
+    CHECK(addNs < RECORD_BUDGET_NS);
+    CHECK(observeNs < RECORD_BUDGET_NS);
+    CHECK(observeInfNs < RECORD_BUDGET_NS);
+    CHECK(contendedNs < RECORD_BUDGET_NS);
+}
+
+int main() {
+    testHistogramBuckets();
+    testCounterAndGauge();
+    testConcurrentRecording();
+    benchmarkRecording();
+    std::printf("metrics tests passed\n");
+    return 0;
+}
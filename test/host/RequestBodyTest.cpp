@@ -0,0 +1,117 @@
+// collectRequestBody against every way TCP can cut a body into segments
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "HostStubs.h"
+#include "HostTest.h"
+#include "RequestBody.h"
+
+static std::string makeBody(size_t length) {
+    std::string body;
+    for (size_t i = 0; i < length; i++) {
+        body += static_cast<char>('a' + i % 26);
+    }
+    return body;
+}
+
+// Delivers body in segments ending at the given offsets, checks that only the last one returns it, complete
+static void deliver(const std::string &body, const std::vector<size_t> &ends, size_t limit) {
+    AsyncWebServerRequest request;
+    std::string wire = body;
+    size_t index = 0;
+    for (size_t i = 0; i < ends.size(); i++) {
+        size_t len = ends[i] - index;
+        size_t length = 0;
+        const char *result = collectRequestBody(&request, reinterpret_cast<uint8_t *>(&wire[index]), len, index,
+                                                body.size(), limit, length);
+        if (i + 1 < ends.size()) {
+            CHECK(result == nullptr);
+        } else {
+            CHECK(result != nullptr);
+            CHECK_EQ(length, body.size());
+            CHECK(std::string(result, length) == body);
+        }
+        index = ends[i];
+    }
+    CHECK_EQ(request.sendCount, 0);
+}
+
+static void testEveryTwoSegmentSplit() {
+    std::string body = makeBody(ROOM_BODY_LIMIT);
+    for (size_t split = 1; split < body.size(); split++) {
+        deliver(body, {split, body.size()}, ROOM_BODY_LIMIT);
+    }
+}
+
+static void testEveryThreeSegmentSplit() {
+    std::string body = makeBody(96);
+    for (size_t first = 1; first < body.size(); first++) {
+        for (size_t second = first + 1; second < body.size(); second++) {
+            deliver(body, {first, second, body.size()}, THERMOMETER_BODY_LIMIT);
+        }
+    }
+}
+
+static void testByteBySegment() {
+    std::string body = makeBody(SCHEDULE_RANGES_BODY_LIMIT);
+    std::vector<size_t> ends;
+    for (size_t end = 1; end <= body.size(); end++) {
+        ends.push_back(end);
+    }
+    deliver(body, ends, SCHEDULE_RANGES_BODY_LIMIT);
+}
+
+static void testSingleSegmentIsNotCopied() {
+    AsyncWebServerRequest request;
+    std::string body = makeBody(100);
+    size_t length = 0;
+    const char *result = collectRequestBody(&request, reinterpret_cast<uint8_t *>(&body[0]), body.size(), 0,
+                                            body.size(), ROOM_BODY_LIMIT, length);
+    CHECK(result == body.data());
+    CHECK_EQ(length, body.size());
+    CHECK(request._tempObject == nullptr);
+}
+
+static void testOversizedBodyIsRejectedOnce() {
+    for (size_t total: {ROOM_BODY_LIMIT + 1, ROOM_BODY_LIMIT * 4}) {
+        AsyncWebServerRequest request;
+        std::string body = makeBody(total);
+        size_t length = 0;
+        unsigned long logged = logEventCount;
+        for (size_t index = 0; index < total; index += 100) {
+            size_t len = std::min<size_t>(100, total - index);
+            CHECK(collectRequestBody(&request, reinterpret_cast<uint8_t *>(&body[index]), len, index, total,
+                                     ROOM_BODY_LIMIT, length) == nullptr);
+        }
+        CHECK_EQ(request.sendCount, 1);
+        CHECK_EQ(request.sentCode, 413);
+        CHECK_EQ(logEventCount, logged + 1);
+        CHECK(lastLogEvent.event == LogEvent::API_BODY_TOO_LARGE);
+        CHECK_EQ(lastLogEvent.args[0], total);
+        CHECK_EQ(lastLogEvent.args[1], ROOM_BODY_LIMIT);
+        CHECK(request._tempObject == nullptr);
+    }
+}
+
+static void testSegmentPastContentLengthIsDropped() {
+    AsyncWebServerRequest request;
+    std::string body = makeBody(64);
+    size_t length = 0;
+    CHECK(collectRequestBody(&request, reinterpret_cast<uint8_t *>(&body[0]), 32, 0, 48, ROOM_BODY_LIMIT,
+                             length) == nullptr);
+    CHECK(collectRequestBody(&request, reinterpret_cast<uint8_t *>(&body[32]), 32, 32, 48, ROOM_BODY_LIMIT,
+                             length) == nullptr);
+    CHECK_EQ(request.sendCount, 0);
+}
+
+int main() {
+    testEveryTwoSegmentSplit();
+    testEveryThreeSegmentSplit();
+    testByteBySegment();
+    testSingleSegmentIsNotCopied();
+    testOversizedBodyIsRejectedOnce();
+    testSegmentPastContentLengthIsDropped();
+    std::printf("request body tests passed\n");
+    return 0;
+}
@@ -0,0 +1,422 @@
+// The response cache in front of the GET routes: one entry per route and encoding, a render only when the
+// snapshot version moves, ETags and 304s, bodies shared with responses still in flight, streamed misses that
+// are kept only when small, and what the cache saves with many requests between two state changes
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "HostStubs.h"
+#include "HostTest.h"
+#include "ResponseCache.h"
+
+// Simulated cost of a render on the ESP32, what the stats report as saved
+constexpr uint32_t RENDER_MICROS = 1800;
+constexpr uint8_t BENCHMARK_ROOMS = 8;
+constexpr unsigned long BENCHMARK_REQUESTS = 50000;
+// Streamed routes produce pieces of this size, each costing this much
+constexpr size_t STREAM_PIECE_LEN = 100;
+constexpr uint32_t STREAM_PIECE_MICROS = 50;
+
+// The published state the renderers read
+static uint32_t stateVersion = 1;
+static unsigned long renders = 0;
+static bool renderFails = false;
+// Moves the state on while rendering, like a publish landing between the version check and the copy
+static bool publishDuringRender = false;
+
+// Close to what LocalAPI renders for /api/rooms
+static void renderRoomsJson(std::string &body, uint32_t version) {
+    char room[192];
+    body += "{\"rooms\":[";
+    for (uint8_t r = 0; r < BENCHMARK_ROOMS; r++) {
+        int length = std::snprintf(room, sizeof(room),
+                                   "%s{\"name\":\"Camera %u\",\"temperature\":%.2f,\"humidity\":%.1f,"
+                                   "\"target\":%.1f,\"heating\":%s,\"thermometers\":[\"A4:C1:38:00:00:%02X\"]}",
+                                   r == 0 ? "" : ",", r, 20.0 + r * 0.25 + version % 7 * 0.01, 45.0 + r,
+                                   21.5, r % 2 == 0 ? "true" : "false", r);
+        body.append(room, length);
+    }
+    body += "]}";
+}
+
+static bool renderRooms(ApiEncoding encoding, std::string &body, uint32_t &version) {
+    if (renderFails) {
+        return false;
+    }
+    if (publishDuringRender) {
+        stateVersion++;
+    }
+    renders++;
+    version = stateVersion;
+    hostMicros += RENDER_MICROS;
+    if (encoding == ApiEncoding::MSGPACK) {
+        body = "msgpack " + std::to_string(version);
+    } else {
+        renderRoomsJson(body, version);
+    }
+    return true;
+}
+
+static bool renderMode(ApiEncoding, std::string &body, uint32_t &version) {
+    renders++;
+    version = stateVersion;
+    body = "{\"mode\":\"auto\"}";
+    return true;
+}
+
+// How many pieces the next streamed body has
+static unsigned long streamPieces = 4;
+static unsigned long sourcesMade = 0;
+
+// A version's letter repeated, one piece at a time
+class VersionSource : public JsonChunkSource {
+private:
+    uint32_t version;
+    unsigned long remaining;
+
+public:
+    VersionSource(uint32_t sourceVersion, unsigned long pieces) : version(sourceVersion), remaining(pieces) {}
+
+    size_t nextPiece(char *out, size_t size) override {
+        if (remaining == 0) {
+            return 0;
+        }
+        remaining--;
+        hostMicros += STREAM_PIECE_MICROS;
+        memset(out, 'a' + version % 26, STREAM_PIECE_LEN);
+        return STREAM_PIECE_LEN;
+    }
+};
+
+static std::unique_ptr<JsonChunkSource> makeStream(ApiEncoding, uint32_t &version) {
+    if (renderFails) {
+        return nullptr;
+    }
+    sourcesMade++;
+    version = stateVersion;
+    return std::unique_ptr<JsonChunkSource>(new VersionSource(stateVersion, streamPieces));
+}
+
+static std::string bodyOf(const AsyncWebServerResponse &response) {
+    std::string body(response.contentLength, '\0');
+    size_t written = response.filler(reinterpret_cast<uint8_t *>(&body[0]), body.size(), 0);
+    CHECK_EQ(written, body.size());
+    return body;
+}
+
+static std::string etagOf(const AsyncWebServerResponse &response) {
+    const AsyncWebHeader *etag = response.header("ETag");
+    CHECK(etag != nullptr);
+    return etag->value();
+}
+
+// A GET answered by the cache, keeps the response for the caller to look at
+struct CachedGet {
+    AsyncWebServerRequest request;
+
+    CachedGet(CachedRoute route, CachedRenderer render, const char *accept = nullptr,
+              const std::string &ifNoneMatch = std::string()) {
+        if (accept != nullptr) {
+            request.headers.emplace_back("Accept", accept);
+        }
+        if (!ifNoneMatch.empty()) {
+            request.headers.emplace_back("If-None-Match", ifNoneMatch);
+        }
+        CHECK(sendCachedResponse(&request, route, stateVersion, render));
+        CHECK(request.response != nullptr);
+    }
+
+    const AsyncWebServerResponse &response() const {
+        return *request.response;
+    }
+};
+
+// A GET whose miss is streamed, the body is read like the network would
+struct StreamedGet {
+    AsyncWebServerRequest request;
+
+    explicit StreamedGet(const std::string &ifNoneMatch = std::string()) {
+        if (!ifNoneMatch.empty()) {
+            request.headers.emplace_back("If-None-Match", ifNoneMatch);
+        }
+        CHECK(sendCachedStream(&request, CachedRoute::MANUAL_MODE, stateVersion, makeStream));
+        CHECK(request.response != nullptr);
+    }
+
+    const AsyncWebServerResponse &response() const {
+        return *request.response;
+    }
+
+    // A hit has its length up front, a miss is read chunk by chunk until the source runs out
+    std::string read() const {
+        if (!response().chunked) {
+            return bodyOf(response());
+        }
+        std::string body;
+        uint8_t chunk[256];
+        size_t written;
+        while ((written = response().filler(chunk, sizeof(chunk), body.size())) > 0) {
+            body.append(reinterpret_cast<const char *>(chunk), written);
+        }
+        return body;
+    }
+};
+
+static void testRenderedOncePerVersion() {
+    stateVersion = 1;
+    unsigned long before = renders;
+    ResponseCacheStats initial = getResponseCacheStats(CachedRoute::ROOMS, ApiEncoding::JSON);
+
+    CachedGet first(CachedRoute::ROOMS, renderRooms);
+    CHECK_EQ(first.response().code, 200);
+    CHECK(first.response().contentType == "application/json");
+    CHECK(first.response().header("Vary") != nullptr);
+    CachedGet second(CachedRoute::ROOMS, renderRooms);
+    CHECK_EQ(renders, before + 1);
+    CHECK(bodyOf(second.response()) == bodyOf(first.response()));
+    CHECK(etagOf(second.response()) == etagOf(first.response()));
+
+    stateVersion++;
+    CachedGet third(CachedRoute::ROOMS, renderRooms);
+    CHECK_EQ(renders, before + 2);
+    CHECK(bodyOf(third.response()) != bodyOf(first.response()));
+    CHECK(etagOf(third.response()) != etagOf(first.response()));
+
+    ResponseCacheStats stats = getResponseCacheStats(CachedRoute::ROOMS, ApiEncoding::JSON);
+    CHECK_EQ(stats.misses - initial.misses, 2);
+    CHECK_EQ(stats.hits - initial.hits, 1);
+    CHECK_EQ(stats.lastRenderMicros, RENDER_MICROS);
+    CHECK_EQ(stats.savedMicros - initial.savedMicros, RENDER_MICROS);
+    CHECK_EQ(stats.cachedBytes, bodyOf(third.response()).size());
+}
+
+static void testEntryPerRouteAndEncoding() {
+    stateVersion = 100;
+    unsigned long before = renders;
+    CachedGet json(CachedRoute::ROOMS, renderRooms);
+    CachedGet msgpack(CachedRoute::ROOMS, renderRooms, "application/msgpack");
+    CachedGet xMsgpack(CachedRoute::ROOMS, renderRooms, "application/x-msgpack, application/json;q=0.5");
+    CachedGet mode(CachedRoute::HEATING_MODE, renderMode);
+    // The same version on another route or in another encoding is a separate entry
+    CHECK_EQ(renders, before + 3);
+    CHECK(msgpack.response().contentType == "application/msgpack");
+    CHECK(bodyOf(msgpack.response()) == "msgpack 100");
+    CHECK(bodyOf(xMsgpack.response()) == "msgpack 100");
+    CHECK(bodyOf(json.response()).front() == '{');
+    CHECK(etagOf(json.response()) != etagOf(msgpack.response()));
+    CHECK(etagOf(json.response()) != etagOf(mode.response()));
+    CHECK(etagOf(msgpack.response()) == etagOf(xMsgpack.response()));
+
+    // A JSON request right after does not get the MessagePack bytes
+    CachedGet jsonAgain(CachedRoute::ROOMS, renderRooms, "application/json");
+    CHECK_EQ(renders, before + 3);
+    CHECK(bodyOf(jsonAgain.response()) == bodyOf(json.response()));
+}
+
+static void testNotModified() {
+    stateVersion = 200;
+    CachedGet first(CachedRoute::ROOMS, renderRooms);
+    std::string etag = etagOf(first.response());
+    unsigned long before = renders;
+    ResponseCacheStats initial = getResponseCacheStats(CachedRoute::ROOMS, ApiEncoding::JSON);
+
+    CachedGet revalidated(CachedRoute::ROOMS, renderRooms, nullptr, etag);
+    CHECK_EQ(revalidated.response().code, 304);
+    CHECK_EQ(revalidated.response().contentLength, 0);
+    CHECK(etagOf(revalidated.response()) == etag);
+    CHECK_EQ(renders, before);
+    ResponseCacheStats stats = getResponseCacheStats(CachedRoute::ROOMS, ApiEncoding::JSON);
+    CHECK_EQ(stats.notModified - initial.notModified, 1);
+    CHECK_EQ(stats.savedMicros - initial.savedMicros, stats.lastRenderMicros);
+
+    // The ETag of another encoding or an older version does not match
+    CachedGet otherEncoding(CachedRoute::ROOMS, renderRooms, "application/msgpack", etag);
+    CHECK_EQ(otherEncoding.response().code, 200);
+    stateVersion++;
+    CachedGet stale(CachedRoute::ROOMS, renderRooms, nullptr, etag);
+    CHECK_EQ(stale.response().code, 200);
+    CHECK(etagOf(stale.response()) != etag);
+}
+
+static void testEtagChangesWithTheBootId() {
+    stateVersion = 300;
+    CachedGet first(CachedRoute::SCHEDULE, renderMode);
+    std::string etag = etagOf(first.response());
+    char bootId[9];
+    std::snprintf(bootId, sizeof(bootId), "%08x", cacheBootId());
+    // Versions start over after a restart, an ETag from the previous boot must not match
+    CHECK(etag.find(bootId) != std::string::npos);
+    CHECK(cacheBootId() & 1);
+}
+
+static void testTaggedWithTheRenderedVersion() {
+    stateVersion = 400;
+    publishDuringRender = true;
+    CachedGet rendered(CachedRoute::ROOMS, renderRooms);
+    publishDuringRender = false;
+    // The body is from 401, so is the ETag, and the next request for 401 is a hit
+    CHECK_EQ(stateVersion, 401);
+    unsigned long before = renders;
+    CachedGet next(CachedRoute::ROOMS, renderRooms);
+    CHECK_EQ(renders, before);
+    CHECK(etagOf(next.response()) == etagOf(rendered.response()));
+}
+
+static void testFailedRenderSendsNothing() {
+    stateVersion = 500;
+    CachedGet cached(CachedRoute::ROOMS, renderRooms);
+    stateVersion++;
+    renderFails = true;
+    AsyncWebServerRequest request;
+    CHECK(!sendCachedResponse(&request, CachedRoute::ROOMS, stateVersion, renderRooms));
+    CHECK_EQ(request.sendCount, 0);
+    renderFails = false;
+    // The entry is still the old one, the next request renders
+    unsigned long before = renders;
+    CachedGet retried(CachedRoute::ROOMS, renderRooms);
+    CHECK_EQ(renders, before + 1);
+}
+
+static void testReplacedBodyOutlivesItsEntry() {
+    stateVersion = 600;
+    CachedGet inFlight(CachedRoute::ROOMS, renderRooms);
+    std::string expected = bodyOf(inFlight.response());
+    // New versions replace the entry while the first response is still being sent
+    for (int i = 0; i < 3; i++) {
+        stateVersion++;
+        CachedGet newer(CachedRoute::ROOMS, renderRooms);
+    }
+    CHECK(bodyOf(inFlight.response()) == expected);
+}
+
+static void testStreamedMissKeepsSmallBodies() {
+    stateVersion = 700;
+    streamPieces = 4;
+    unsigned long before = sourcesMade;
+    ResponseCacheStats initial = getResponseCacheStats(CachedRoute::MANUAL_MODE, ApiEncoding::JSON);
+
+    StreamedGet first;
+    CHECK_EQ(first.response().code, 200);
+    CHECK(first.response().chunked);
+    CHECK(first.response().contentType == "application/json");
+    CHECK(first.response().header("Vary") != nullptr);
+    std::string etag = etagOf(first.response());
+    // Nothing is kept until the last piece was produced, a request in between streams its own copy
+    StreamedGet concurrent;
+    CHECK_EQ(sourcesMade, before + 2);
+    std::string body = first.read();
+    CHECK_EQ(body.size(), 4 * STREAM_PIECE_LEN);
+    CHECK(concurrent.read() == body);
+
+    StreamedGet hit;
+    CHECK_EQ(sourcesMade, before + 2);
+    CHECK(!hit.response().chunked);
+    CHECK_EQ(hit.response().contentLength, body.size());
+    CHECK(hit.read() == body);
+    CHECK(etagOf(hit.response()) == etag);
+    StreamedGet revalidated(etag);
+    CHECK_EQ(revalidated.response().code, 304);
+
+    ResponseCacheStats stats = getResponseCacheStats(CachedRoute::MANUAL_MODE, ApiEncoding::JSON);
+    CHECK_EQ(stats.misses - initial.misses, 2);
+    CHECK_EQ(stats.hits - initial.hits, 1);
+    CHECK_EQ(stats.cachedBytes, body.size());
+    CHECK_EQ(stats.lastRenderMicros, 4 * STREAM_PIECE_MICROS);
+}
+
+static void testStreamedLargeBodyIsNotKept() {
+    stateVersion = 800;
+    streamPieces = RESPONSE_CACHE_KEEP_LEN / STREAM_PIECE_LEN + 1;
+    unsigned long before = sourcesMade;
+
+    StreamedGet first;
+    std::string etag = etagOf(first.response());
+    CHECK_EQ(first.read().size(), streamPieces * STREAM_PIECE_LEN);
+    StreamedGet again;
+    CHECK_EQ(sourcesMade, before + 2);
+    CHECK_EQ(again.read().size(), streamPieces * STREAM_PIECE_LEN);
+    CHECK_EQ(getResponseCacheStats(CachedRoute::MANUAL_MODE, ApiEncoding::JSON).cachedBytes, 0);
+    // The ETag still answers a revalidation without streaming anything
+    StreamedGet revalidated(etag);
+    CHECK_EQ(revalidated.response().code, 304);
+    CHECK_EQ(sourcesMade, before + 2);
+
+    // A small body after a large one is kept again
+    stateVersion++;
+    streamPieces = 2;
+    StreamedGet small;
+    small.read();
+    StreamedGet hit;
+    CHECK_EQ(sourcesMade, before + 3);
+}
+
+static void testOlderStreamDoesNotReplaceNewer() {
+    stateVersion = 900;
+    streamPieces = 3;
+    StreamedGet older;
+    stateVersion++;
+    StreamedGet newer;
+    newer.read();
+    // The slower stream of 900 ends last, the entry stays at 901
+    older.read();
+    unsigned long before = sourcesMade;
+    StreamedGet hit;
+    CHECK_EQ(sourcesMade, before);
+    CHECK(etagOf(hit.response()) == etagOf(newer.response()));
+}
+
+static void testFailedStreamSendsNothing() {
+    stateVersion = 1000;
+    renderFails = true;
+    AsyncWebServerRequest request;
+    CHECK(!sendCachedStream(&request, CachedRoute::MANUAL_MODE, stateVersion, makeStream));
+    CHECK_EQ(request.sendCount, 0);
+    renderFails = false;
+}
+
+static void benchmarkRequestsBetweenChanges() {
+    const unsigned long changeEvery[] = {1, 10, 100, 1000};
+    for (unsigned long every: changeEvery) {
+        CachedRoute route = CachedRoute::HEATING_STATUS;
+        ResponseCacheStats initial = getResponseCacheStats(route, ApiEncoding::JSON);
+        double cachedNs = measureNanos(BENCHMARK_REQUESTS, [&](unsigned long i) {
+            if (i % every == 0) {
+                stateVersion++;
+            }
+            AsyncWebServerRequest request;
+            sendCachedResponse(&request, route, stateVersion, renderRooms);
+        });
+        double renderedNs = measureNanos(BENCHMARK_REQUESTS, [&](unsigned long) {
+            AsyncWebServerRequest request;
+            auto body = std::make_shared<std::string>();
+            uint32_t version = 0;
+            renderRooms(ApiEncoding::JSON, *body, version);
+            sendEncodedBody(&request, 200, ApiEncoding::JSON, body);
+        });
+        ResponseCacheStats stats = getResponseCacheStats(route, ApiEncoding::JSON);
+        uint32_t hits = stats.hits - initial.hits;
+        uint32_t misses = stats.misses - initial.misses;
+        std::printf("state change every %4lu requests: hit rate %5.1f%%, %6.0f ns per request cached, "
+                    "%6.0f ns rendered every time\n", every, 100.0 * hits / (hits + misses), cachedNs, renderedNs);
+        CHECK_EQ(misses, (BENCHMARK_REQUESTS + every - 1) / every);
+        if (every >= 10) {
+            CHECK(cachedNs < renderedNs);
+        }
+    }
+}
+
+int main() {
+    testRenderedOncePerVersion();
+    testEntryPerRouteAndEncoding();
+    testNotModified();
+    testEtagChangesWithTheBootId();
+    testTaggedWithTheRenderedVersion();
+    testFailedRenderSendsNothing();
+    testReplacedBodyOutlivesItsEntry();
+    testStreamedMissKeepsSmallBodies();
+    testStreamedLargeBodyIsNotKept();
+    testOlderStreamDoesNotReplaceNewer();
+    testFailedStreamSendsNothing();
+    benchmarkRequestsBetweenChanges();
+    std::printf("response cache tests passed\n");
+    return 0;
+}
@@ -0,0 +1,215 @@
+// Per-route request tracing: what a traced request records from arrival to disconnect, the handler callbacks
+// chained behind the trace, the limits on routes and slots, and what the bookkeeping costs per request
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include "HeapTracker.h"
+#include "HostStubs.h"
+#include "HostTest.h"
+#include "RouteStats.h"
+
+// Far more than the host needs, the bookkeeping is a few stores into fixed slots
+constexpr double TRACE_BUDGET_NS = 1000.0;
+constexpr unsigned long BENCHMARK_REQUESTS = 1000000;
+
+static AsyncWebServer server;
+
+// Headers parsed: the server offers the request to every handler, the arrival probe comes first
+static void arrive(AsyncWebServerRequest &request) {
+    for (AsyncWebHandler *handler: server.handlers) {
+        CHECK(!handler->canHandle(&request));
+    }
+}
+
+// One request the way ApiRouter runs it: arrival, handler, response and finally the disconnect
+static void serve(AsyncWebServerRequest &request, RouteStats *route, uint32_t waitUs, uint32_t handlerUs,
+                  uint32_t sendUs, size_t bytes) {
+    arrive(request);
+    hostMicros += waitUs;
+    RequestTrace trace = beginRouteHandler(route, &request);
+    hostMicros += handlerUs;
+    noteResponseStart(currentRequestTrace());
+    noteResponseBytes(currentRequestTrace(), bytes);
+    endRouteHandler(trace);
+    hostMicros += sendUs;
+    request.disconnect();
+}
+
+static uint32_t histogramTotal(const MetricHistogram &histogram) {
+    uint32_t total = 0;
+    for (uint8_t bucket = 0; bucket <= histogram.getBoundCount(); bucket++) {
+        total += histogram.getCount(bucket);
+    }
+    return total;
+}
+
+static void testRequestIsTraced() {
+    RouteStats *route = addRouteStats("GET", "/api/rooms");
+    CHECK(route != nullptr);
+    CHECK_EQ(getRouteStatsCount(), 1);
+    CHECK(&getRouteStats(0) == route);
+
+    AsyncWebServerRequest request;
+    arrive(request);
+    hostMicros += 300;
+    RequestTrace trace = beginRouteHandler(route, &request);
+    CHECK(trace.slot >= 0);
+    CHECK_EQ(currentRequestTrace().slot, trace.slot);
+    CHECK_EQ(apiRequestsInFlight(), 1);
+    CHECK_EQ(route->inFlight.get(), 1);
+    // The handler holds 2000 bytes of heap for its response
+    hostFreeHeap -= 2000;
+    hostMicros += 700;
+    noteResponseStart(currentRequestTrace());
+    noteResponseBytes(currentRequestTrace(), 1500);
+    endRouteHandler(trace);
+    CHECK_EQ(currentRequestTrace().slot, -1);
+    // A chunked response reports its bytes after the handler returned
+    noteResponseBytes(trace, 2500);
+    CHECK_EQ(histogramTotal(route->handlerMicros), 1);
+    CHECK_EQ(route->handlerMicros.getSum(), 700);
+    CHECK_EQ(route->heapHeldMax.get(), 2000);
+    CHECK_EQ(histogramTotal(route->responseBytes), 0);
+
+    hostFreeHeap += 2000;
+    hostMicros += 5000;
+    request.disconnect();
+    CHECK_EQ(apiRequestsInFlight(), 0);
+    CHECK_EQ(route->inFlight.get(), 0);
+    CHECK_EQ(route->responseStartMicros.getSum(), 1000);
+    CHECK_EQ(route->responseBytes.getSum(), 4000);
+    CHECK_EQ(histogramTotal(route->responseBytes), 1);
+
+    // Late notes of a finished trace are ignored
+    noteResponseBytes(trace, 100);
+    request.disconnect();
+    CHECK_EQ(apiRequestsInFlight(), 0);
+    CHECK_EQ(histogramTotal(route->responseBytes), 1);
+}
+
+static void testHandlerDisconnectIsChained() {
+    RouteStats *route = addRouteStats("GET", "/api/events");
+    AsyncWebServerRequest request;
+    arrive(request);
+    RequestTrace trace = beginRouteHandler(route, &request);
+    int calls = 0;
+    uint8_t inFlightSeen = 255;
+    // Registered inside the handler, it must not replace the callback that closes the trace
+    onRequestDisconnect(&request, [&calls, &inFlightSeen]() {
+        calls++;
+        inFlightSeen = apiRequestsInFlight();
+    });
+    endRouteHandler(trace);
+    CHECK_EQ(apiRequestsInFlight(), 1);
+    request.disconnect();
+    CHECK_EQ(calls, 1);
+    // Runs after the bookkeeping, the request no longer counts
+    CHECK_EQ(inFlightSeen, 0);
+    CHECK_EQ(route->inFlight.get(), 0);
+
+    // Without a trace the callback goes straight to the request
+    AsyncWebServerRequest untraced;
+    onRequestDisconnect(&untraced, [&calls]() {
+        calls++;
+    });
+    untraced.disconnect();
+    CHECK_EQ(calls, 2);
+}
+
+static void testSlotsAreLimited() {
+    RouteStats *route = addRouteStats("GET", "/api/history");
+    std::vector<std::unique_ptr<AsyncWebServerRequest>> open;
+    std::vector<RequestTrace> traces;
+    for (uint8_t i = 0; i < MAX_TRACED_REQUESTS; i++) {
+        open.emplace_back(new AsyncWebServerRequest);
+        arrive(*open.back());
+        traces.push_back(beginRouteHandler(route, open.back().get()));
+        endRouteHandler(traces.back());
+        CHECK(traces.back().slot >= 0);
+    }
+    CHECK_EQ(apiRequestsInFlight(), MAX_TRACED_REQUESTS);
+
+    // Every slot waits for a disconnect, one more request is served untraced
+    AsyncWebServerRequest extra;
+    arrive(extra);
+    RequestTrace untraced = beginRouteHandler(route, &extra);
+    CHECK_EQ(untraced.slot, -1);
+    endRouteHandler(untraced);
+    CHECK_EQ(apiRequestsInFlight(), MAX_TRACED_REQUESTS);
+
+    for (auto &request: open) {
+        request->disconnect();
+    }
+    CHECK_EQ(apiRequestsInFlight(), 0);
+    CHECK_EQ(route->inFlight.get(), 0);
+
+    // A reused slot has a new generation, the old trace no longer reaches it
+    AsyncWebServerRequest reuse;
+    arrive(reuse);
+    RequestTrace fresh = beginRouteHandler(route, &reuse);
+    const RequestTrace *old = nullptr;
+    for (const RequestTrace &candidate: traces) {
+        if (candidate.slot == fresh.slot) {
+            old = &candidate;
+        }
+    }
+    CHECK(old != nullptr);
+    CHECK(old->generation != fresh.generation);
+    noteResponseBytes(*old, 999);
+    endRouteHandler(fresh);
+    uint32_t bytesBefore = route->responseBytes.getSum();
+    reuse.disconnect();
+    CHECK_EQ(route->responseBytes.getSum(), bytesBefore);
+}
+
+static void testRoutesAreLimited() {
+    while (getRouteStatsCount() < MAX_TRACED_ROUTES) {
+        CHECK(addRouteStats("GET", "/api/filler") != nullptr);
+    }
+    unsigned long logged = logEventCount;
+    CHECK(addRouteStats("GET", "/api/one-too-many") == nullptr);
+    CHECK_EQ(logEventCount, logged + 1);
+    CHECK(lastLogEvent.event == LogEvent::API_ROUTE_NOT_TRACED);
+    CHECK_EQ(lastLogEvent.args[0], MAX_TRACED_ROUTES);
+
+    // A route without statistics still runs its handler, just untraced
+    AsyncWebServerRequest request;
+    arrive(request);
+    RequestTrace trace = beginRouteHandler(nullptr, &request);
+    CHECK_EQ(trace.slot, -1);
+    endRouteHandler(trace);
+    request.disconnect();
+    CHECK_EQ(apiRequestsInFlight(), 0);
+}
+
+static void benchmarkTracing() {
+    RouteStats *route = const_cast<RouteStats *>(&getRouteStats(0));
+    AsyncWebServerRequest request;
+    uint32_t before = histogramTotal(route->handlerMicros);
+    unsigned long allocations = heapUsage().allocations;
+    double perRequestNs = measureNanos(BENCHMARK_REQUESTS, [&](unsigned long i) {
+        serve(request, route, 200, 150 + i % 2000, 900, 512 + i % 4096);
+    });
+    CHECK_EQ(heapUsage().allocations - allocations, 0);
+    CHECK_EQ(histogramTotal(route->handlerMicros) - before, BENCHMARK_REQUESTS);
+
+    // The probe alone, the part every request pays, API or not
+    double probeNs = measureNanos(BENCHMARK_REQUESTS, [&](unsigned long) {
+        arrive(request);
+    });
+    std::printf("tracing: %.1f ns per request from arrival to disconnect, %.1f ns in the arrival probe, "
+                "no allocations\n", perRequestNs, probeNs);
+    CHECK(perRequestNs < TRACE_BUDGET_NS);
+}
+
+int main() {
+    initRouteTracing(server);
+    CHECK_EQ(server.handlers.size(), 1);
+    testRequestIsTraced();
+    testHandlerDisconnectIsChained();
+    testSlotsAreLimited();
+    testRoutesAreLimited();
+    benchmarkTracing();
+    std::printf("route stats tests passed\n");
+    return 0;
+}
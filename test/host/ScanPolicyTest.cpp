@@ -0,0 +1,259 @@
+// Simulation of the adaptive BLE scan: sensors advertise on a simulated clock into a real SensorRegistry and
+// the policy is evaluated once per second, the way the BLE task does it
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "HostStubs.h"
+#include "HostTest.h"
+#include "ScanPolicy.h"
+#include "SensorRegistry.h"
+
+struct SimulatedSensor {
+    std::string mac;
+    uint32_t periodS;
+    uint32_t phaseS;
+    uint32_t silentFromS;   ///< Stops advertising from this second on.
+    uint32_t silentUntilS;  ///< Advertises again from this second on.
+};
+
+class ScanSimulation {
+public:
+    std::unique_ptr<SensorRegistry> registry{new SensorRegistry};
+    std::vector<SimulatedSensor> sensors;
+    ScanLevel level = ScanLevel::RELAXED;
+    uint32_t changes = 0;
+    uint32_t secondsIn[static_cast<uint8_t>(ScanLevel::COUNT)]{};
+    uint32_t nowS = 0;
+
+    void add(const SimulatedSensor &sensor) {
+        hostMillis = nowS * 1000;
+        CHECK(registry->registerSensor(sensor.mac));
+        sensors.push_back(sensor);
+    }
+
+    // One second: the sensors due advertise, then the policy runs
+    void tick() {
+        uint32_t nowMs = nowS * 1000;
+        hostMillis = nowMs;
+        for (const SimulatedSensor &sensor: sensors) {
+            bool silent = nowS >= sensor.silentFromS && nowS < sensor.silentUntilS;
+            if (!silent && nowS >= sensor.phaseS && (nowS - sensor.phaseS) % sensor.periodS == 0) {
+                SensorReading reading{};
+                CHECK(parseMacAddress(sensor.mac, reading.mac));
+                reading.fields = READING_TEMPERATURE;
+                reading.temperatureCenti = 2100;
+                reading.receivedMs = nowMs;
+                CHECK(registry->apply(reading, nowS));
+            }
+        }
+        int32_t oldestAge = registry->oldestReadingAge(nowMs, SCAN_LOST_SENSOR_AGE_S);
+        ScanLevel next = selectScanLevel(oldestAge, level);
+        if (next != level) {
+            changes++;
+            level = next;
+        }
+        secondsIn[static_cast<uint8_t>(level)]++;
+        nowS++;
+    }
+
+    void runUntil(uint32_t endS) {
+        while (nowS < endS) {
+            tick();
+        }
+    }
+
+    uint32_t seconds(ScanLevel scanLevel) const {
+        return secondsIn[static_cast<uint8_t>(scanLevel)];
+    }
+};
+
+static const uint32_t NEVER = UINT32_MAX;
+
+static SimulatedSensor steadySensor(int index, uint32_t periodS, uint32_t phaseS) {
+    char mac[18];
+    std::snprintf(mac, sizeof(mac), "A4:C1:38:00:00:%02X", index);
+    return {mac, periodS, phaseS, NEVER, NEVER};
+}
+
+// Every threshold and every step down, from each level
+static void testHysteresisTable() {
+    for (ScanLevel current: {ScanLevel::RELAXED, ScanLevel::NORMAL, ScanLevel::AGGRESSIVE}) {
+        CHECK(selectScanLevel(-1, current) == ScanLevel::RELAXED);
+        for (int32_t age = SCAN_AGGRESSIVE_AGE_S; age <= SCAN_LOST_SENSOR_AGE_S; age++) {
+            CHECK(selectScanLevel(age, current) == ScanLevel::AGGRESSIVE);
+        }
+    }
+    for (int32_t age = 0; age < SCAN_AGGRESSIVE_AGE_S; age++) {
+        ScanLevel fromRelaxed = age >= SCAN_NORMAL_AGE_S ? ScanLevel::NORMAL : ScanLevel::RELAXED;
+        ScanLevel fromNormal = age >= SCAN_NORMAL_AGE_S - SCAN_RELAX_HYSTERESIS_S ? ScanLevel::NORMAL
+                                                                                 : ScanLevel::RELAXED;
+        ScanLevel fromAggressive = age >= SCAN_AGGRESSIVE_AGE_S - SCAN_RELAX_HYSTERESIS_S ? ScanLevel::AGGRESSIVE
+                                                                                         : fromNormal;
+        CHECK(selectScanLevel(age, ScanLevel::RELAXED) == fromRelaxed);
+        CHECK(selectScanLevel(age, ScanLevel::NORMAL) == fromNormal);
+        CHECK(selectScanLevel(age, ScanLevel::AGGRESSIVE) == fromAggressive);
+    }
+}
+
+static void testWindows() {
+    ScanParameters relaxed = scanParametersFor(ScanLevel::RELAXED);
+    ScanParameters normal = scanParametersFor(ScanLevel::NORMAL);
+    ScanParameters aggressive = scanParametersFor(ScanLevel::AGGRESSIVE);
+    // Duty cycles of 25, 50 and 100 %
+    CHECK_EQ(relaxed.windowMs * 4, relaxed.intervalMs);
+    CHECK_EQ(normal.windowMs * 2, normal.intervalMs);
+    CHECK_EQ(aggressive.windowMs, aggressive.intervalMs);
+    // A sensor advertising every 2.5 s is heard within 10 s even when relaxed
+    CHECK(relaxed.intervalMs <= 2500);
+    CHECK(std::string(scanLevelName(ScanLevel::RELAXED)) == "relaxed");
+    CHECK(std::string(scanLevelName(ScanLevel::NORMAL)) == "normal");
+    CHECK(std::string(scanLevelName(ScanLevel::AGGRESSIVE)) == "aggressive");
+}
+
+// Healthy sensors keep the scan relaxed once each was heard for the first time
+static void testSteadySensorsStayRelaxed() {
+    ScanSimulation simulation;
+    for (int i = 0; i < 4; i++) {
+        simulation.add(steadySensor(i, 10, 2 * i + 1));
+    }
+    simulation.runUntil(10);
+    CHECK(simulation.level == ScanLevel::RELAXED);
+    uint32_t changesAfterStart = simulation.changes;
+    // Never heard sensors count as stale, so the start is aggressive until the last first reading
+    CHECK_EQ(changesAfterStart, 2);
+    simulation.runUntil(3600);
+    CHECK_EQ(simulation.changes, changesAfterStart);
+    CHECK(simulation.level == ScanLevel::RELAXED);
+}
+
+// A sensor that goes quiet escalates at the thresholds and relaxes as soon as it is heard again
+static void testQuietSensorEscalatesAndRecovers() {
+    ScanSimulation simulation;
+    for (int i = 0; i < 3; i++) {
+        simulation.add(steadySensor(i, 10, i + 1));
+    }
+    SimulatedSensor quiet = steadySensor(9, 10, 4);
+    quiet.silentFromS = 105;    // Last heard at 104 s
+    quiet.silentUntilS = 150;  // Heard again at 154 s
+    simulation.add(quiet);
+
+    simulation.runUntil(104 + SCAN_NORMAL_AGE_S);
+    CHECK(simulation.level == ScanLevel::RELAXED);
+    simulation.tick();
+    CHECK(simulation.level == ScanLevel::NORMAL);
+    simulation.runUntil(104 + SCAN_AGGRESSIVE_AGE_S);
+    CHECK(simulation.level == ScanLevel::NORMAL);
+    simulation.tick();
+    CHECK(simulation.level == ScanLevel::AGGRESSIVE);
+    simulation.runUntil(154);
+    CHECK(simulation.level == ScanLevel::AGGRESSIVE);
+    simulation.tick();
+    CHECK(simulation.level == ScanLevel::RELAXED);
+}
+
+// Readings that keep the oldest age on a threshold must not restart the scan every second
+static void testBoundaryDoesNotFlap() {
+    ScanSimulation simulation;
+    // Eight sensors every 16 s, two seconds apart: the oldest age alternates between 14 and 15
+    for (int i = 0; i < 8; i++) {
+        simulation.add(steadySensor(i, 16, 2 * i));
+    }
+    simulation.runUntil(60);
+    uint32_t changes = simulation.changes;
+    simulation.runUntil(3600);
+    CHECK(simulation.changes - changes <= 1);
+    CHECK(simulation.level == ScanLevel::NORMAL);
+}
+
+// A sensor silent for SCAN_LOST_SENSOR_AGE_S stops driving the scan, and drives it again once heard
+static void testLostSensorIsIgnored() {
+    ScanSimulation simulation;
+    for (int i = 0; i < 3; i++) {
+        simulation.add(steadySensor(i, 10, i + 1));
+    }
+    SimulatedSensor lost = steadySensor(9, 10, 5);
+    lost.silentFromS = 56;      // Last heard at 55 s
+    lost.silentUntilS = 2000;
+    simulation.add(lost);
+
+    simulation.runUntil(55 + SCAN_LOST_SENSOR_AGE_S + 1);
+    CHECK(simulation.level == ScanLevel::AGGRESSIVE);
+    uint32_t aggressiveBefore = simulation.seconds(ScanLevel::AGGRESSIVE);
+    simulation.tick();
+    CHECK(simulation.level == ScanLevel::RELAXED);
+    simulation.runUntil(1995);
+    CHECK_EQ(simulation.seconds(ScanLevel::AGGRESSIVE), aggressiveBefore);
+    CHECK(simulation.level == ScanLevel::RELAXED);
+    // Heard again at 2005 s, it counts like any other sensor from then on
+    simulation.runUntil(2006);
+    CHECK(simulation.level == ScanLevel::RELAXED);
+    SensorState state{};
+    CHECK(simulation.registry->getState(lost.mac, state));
+    CHECK_EQ(state.lastSeenMs, 2005 * 1000);
+    simulation.sensors.back().silentFromS = 2006;
+    simulation.sensors.back().silentUntilS = NEVER;
+    simulation.runUntil(2005 + SCAN_AGGRESSIVE_AGE_S + 1);
+    CHECK(simulation.level == ScanLevel::AGGRESSIVE);
+}
+
+// A sensor added to a room but never heard holds the scan aggressive for SCAN_LOST_SENSOR_AGE_S at most,
+// one removed from its room stops counting at once
+static void testUnheardAndRemovedSensors() {
+    ScanSimulation simulation;
+    simulation.add(steadySensor(0, 10, 1));
+    simulation.runUntil(100);
+    CHECK(simulation.level == ScanLevel::RELAXED);
+    simulation.add(steadySensor(1, 10, NEVER));
+    simulation.runUntil(100 + SCAN_LOST_SENSOR_AGE_S);
+    CHECK(simulation.level == ScanLevel::AGGRESSIVE);
+    simulation.runUntil(100 + SCAN_LOST_SENSOR_AGE_S + 2);
+    CHECK(simulation.level == ScanLevel::RELAXED);
+
+    SimulatedSensor quiet = steadySensor(2, 10, 3);
+    quiet.silentFromS = 0;
+    simulation.add(quiet);
+    simulation.tick();
+    CHECK(simulation.level == ScanLevel::AGGRESSIVE);
+    simulation.registry->unregisterSensor(quiet.mac);
+    simulation.tick();
+    CHECK(simulation.level == ScanLevel::RELAXED);
+}
+
+// Sixteen rooms of four thermometers fit, the health of an applied reading lands in the table
+static void testRegistryCapacityAndHealth() {
+    std::unique_ptr<SensorRegistry> registry(new SensorRegistry);
+    char mac[18];
+    for (int i = 0; i < MAX_REGISTERED_SENSORS; i++) {
+        std::snprintf(mac, sizeof(mac), "A4:C1:38:00:00:%02X", i);
+        CHECK(registry->registerSensor(mac));
+    }
+    CHECK(!registry->registerSensor("A4:C1:38:00:01:00"));
+    CHECK(!registry->registerSensor("not a mac"));
+
+    SensorReading reading{};
+    CHECK(parseMacAddress("A4:C1:38:00:00:05", reading.mac));
+    reading.fields = READING_TEMPERATURE | READING_BATTERY_MV;
+    reading.batteryMv = 2950;
+    reading.rssi = -70;
+    reading.receivedMs = 1000;
+    CHECK(registry->apply(reading, 1));
+    std::unique_ptr<SensorHealthEntry[]> health(new SensorHealthEntry[MAX_REGISTERED_SENSORS]);
+    CHECK_EQ(registry->listHealth(health.get(), MAX_REGISTERED_SENSORS, 2000), MAX_REGISTERED_SENSORS);
+    CHECK(health[5].report.hasFrame);
+    CHECK_EQ(health[5].report.batteryMv, 2950);
+    CHECK(!health[4].report.hasFrame);
+}
+
+int main() {
+    testHysteresisTable();
+    testWindows();
+    testSteadySensorsStayRelaxed();
+    testQuietSensorEscalatesAndRecovers();
+    testBoundaryDoesNotFlap();
+    testLostSensorIsIgnored();
+    testUnheardAndRemovedSensors();
+    testRegistryCapacityAndHealth();
+    std::printf("scan policy tests passed\n");
+    return 0;
+}
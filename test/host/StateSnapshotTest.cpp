@@ -0,0 +1,95 @@
+// Torn-read stress test of PublishedSnapshot: one writer publishes as fast as it can while readers check that
+// every copy they accept is one whole published version.
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "HostTest.h"
+#include "StateSnapshot.h"
+
+constexpr uint32_t PUBLISHES = 2000000;
+constexpr unsigned READERS = 3;
+// Large enough that a copy spans many cache lines, like the room snapshot
+constexpr size_t WORDS = 256;
+
+struct Sample {
+    uint32_t words[WORDS];
+};
+
+static PublishedSnapshot<Sample> snapshot;
+static std::atomic<bool> writerDone{false};
+
+struct ReaderResult {
+    unsigned long accepted = 0;
+    unsigned long gaveUp = 0;
+    unsigned long torn = 0;
+    unsigned long wrongVersion = 0;
+    unsigned long wentBack = 0;
+};
+
+static void writer() {
+    static Sample sample;
+    for (uint32_t version = 1; version <= PUBLISHES; version++) {
+        for (uint32_t &word: sample.words) {
+            word = version;
+        }
+        snapshot.publish(sample);
+    }
+    writerDone.store(true);
+}
+
+static void reader(ReaderResult &result) {
+    static thread_local Sample copy;
+    uint32_t lastVersion = 0;
+    while (!writerDone.load(std::memory_order_relaxed)) {
+        uint32_t version = 0;
+        if (!snapshot.read(copy, &version)) {
+            result.gaveUp++;
+            continue;
+        }
+        result.accepted++;
+        for (uint32_t word: copy.words) {
+            if (word != copy.words[0]) {
+                result.torn++;
+                break;
+            }
+        }
+        // Version n holds the words written for the n-th publish
+        if (copy.words[0] != version) {
+            result.wrongVersion++;
+        }
+        if (version < lastVersion) {
+            result.wentBack++;
+        }
+        lastVersion = version;
+    }
+}
+
+int main() {
+    std::vector<ReaderResult> results(READERS);
+    std::vector<std::thread> readers;
+    for (unsigned i = 0; i < READERS; i++) {
+        readers.emplace_back(reader, std::ref(results[i]));
+    }
+    std::thread writerThread(writer);
+    writerThread.join();
+    for (std::thread &thread: readers) {
+        thread.join();
+    }
+
+    unsigned long accepted = 0;
+    unsigned long gaveUp = 0;
+    for (const ReaderResult &result: results) {
+        CHECK_EQ(result.torn, 0);
+        CHECK_EQ(result.wrongVersion, 0);
+        CHECK_EQ(result.wentBack, 0);
+        accepted += result.accepted;
+        gaveUp += result.gaveUp;
+    }
+    CHECK(accepted > 0);
+    CHECK_EQ(snapshot.version(), PUBLISHES);
+    CHECK_EQ(snapshot.writerView().words[0], PUBLISHES);
+    std::printf("%u publishes, %lu reads accepted, %lu gave up after retrying\n", PUBLISHES, accepted, gaveUp);
+    return 0;
+}
@@ -0,0 +1,204 @@
+// Static assets, served from the LittleFS image scripts/build_web_assets.py builds out of the real web/ sources:
+// one route per manifest line with damaged lines skipped and the registry capped, gzip bodies with their ETag
+// and cache policy, 304 on If-None-Match, 406 for a client that refuses gzip, and what a first and a repeat
+// dashboard load transfer
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <LittleFS.h>
+#include "HostStubs.h"
+#include "HostTest.h"
+#include "StaticAssets.h"
+
+constexpr unsigned long BENCHMARK_REQUESTS = 200000;
+constexpr const char *BROWSER_ENCODINGS = "gzip, deflate, br, zstd";
+
+struct ManifestLine {
+    std::string path;
+    std::string tag;
+    bool immutable;
+};
+
+static std::string readFile(const std::string &path) {
+    std::ifstream input(path, std::ios::binary);
+    CHECK(input);
+    std::ostringstream content;
+    content << input.rdbuf();
+    return content.str();
+}
+
+// The built image in LittleFS, with a damaged line and more assets than fit behind the real ones
+static std::vector<ManifestLine> loadImage() {
+    std::string manifest = readFile(WEB_IMAGE_DIR "/assets.txt");
+    std::vector<ManifestLine> lines;
+    std::istringstream input(manifest);
+    ManifestLine line;
+    int immutable = 0;
+    while (input >> line.path >> line.tag >> immutable) {
+        line.immutable = immutable != 0;
+        lines.push_back(line);
+        LittleFS.files["/" + line.path + ".gz"] = readFile(WEB_IMAGE_DIR "/" + line.path + ".gz");
+    }
+    CHECK(!lines.empty());
+    CHECK(lines.size() < MAX_STATIC_ASSETS);
+    manifest += "not a manifest line\n";
+    for (uint8_t i = 0; i < MAX_STATIC_ASSETS; i++) {
+        char extra[48];
+        std::snprintf(extra, sizeof(extra), "extra%02u.svg e%02u 1\n", i, i);
+        manifest += extra;
+    }
+    LittleFS.files[STATIC_ASSET_MANIFEST] = manifest;
+    return lines;
+}
+
+static std::unique_ptr<AsyncWebServerRequest> get(const AsyncWebServer &server, const std::string &path,
+                                                  const char *acceptEncoding = BROWSER_ENCODINGS,
+                                                  const std::string &ifNoneMatch = std::string()) {
+    std::unique_ptr<AsyncWebServerRequest> request(new AsyncWebServerRequest);
+    request->path = path;
+    if (acceptEncoding != nullptr) {
+        request->headers.emplace_back("Accept-Encoding", acceptEncoding);
+    }
+    if (!ifNoneMatch.empty()) {
+        request->headers.emplace_back("If-None-Match", ifNoneMatch);
+    }
+    const ArRequestHandlerFunction *route = server.route(path.c_str());
+    CHECK(route != nullptr);
+    (*route)(request.get());
+    CHECK_EQ(request->sendCount, 1);
+    return request;
+}
+
+static std::string headerOf(const AsyncWebServerRequest &request, const char *name) {
+    const AsyncWebHeader *header = request.response->header(name);
+    return header != nullptr ? std::string(header->value()) : std::string();
+}
+
+static std::string bodyOf(const AsyncWebServerRequest &request) {
+    std::string body(request.response->contentLength, '\0');
+    if (!body.empty()) {
+        CHECK_EQ(request.response->filler(reinterpret_cast<uint8_t *>(&body[0]), body.size(), 0), body.size());
+    }
+    return body;
+}
+
+static void testRoutesFromTheManifest(const AsyncWebServer &server, const std::vector<ManifestLine> &lines) {
+    // Every real asset, the extras up to the cap, and "/" for index.html
+    CHECK_EQ(server.routes.size(), MAX_STATIC_ASSETS + 1);
+    for (const ManifestLine &line: lines) {
+        CHECK(server.route(("/" + line.path).c_str()) != nullptr);
+    }
+    CHECK(server.route("/") != nullptr);
+    CHECK(server.route("/extra00.svg") != nullptr);
+    char firstDropped[32];
+    std::snprintf(firstDropped, sizeof(firstDropped), "/extra%02u.svg",
+                  static_cast<unsigned>(MAX_STATIC_ASSETS - lines.size()));
+    CHECK(server.route(firstDropped) == nullptr);
+    CHECK(server.route("/not") == nullptr);
+}
+
+static void testGzipBodies(const AsyncWebServer &server, const std::vector<ManifestLine> &lines) {
+    for (const ManifestLine &line: lines) {
+        auto request = get(server, "/" + line.path);
+        CHECK_EQ(request->sentCode, 200);
+        CHECK(headerOf(*request, "Content-Encoding") == "gzip");
+        CHECK(headerOf(*request, "ETag") == "\"" + line.tag + "\"");
+        CHECK(headerOf(*request, "Vary") == "Accept-Encoding");
+        CHECK(headerOf(*request, "Cache-Control") ==
+              (line.immutable ? "public, max-age=31536000, immutable" : "no-cache"));
+        std::string body = bodyOf(*request);
+        CHECK(body == LittleFS.files["/" + line.path + ".gz"]);
+        CHECK(body.compare(0, 2, "\x1f\x8b") == 0);
+    }
+    auto page = get(server, "/");
+    CHECK(page->response->contentType == "text/html");
+    CHECK(bodyOf(*page) == LittleFS.files["/index.html.gz"]);
+    CHECK(headerOf(*page, "Cache-Control") == "no-cache");
+}
+
+static void testNotModified(const AsyncWebServer &server, const std::vector<ManifestLine> &lines) {
+    for (const ManifestLine &line: lines) {
+        std::string etag = "\"" + line.tag + "\"";
+        auto revalidated = get(server, "/" + line.path, BROWSER_ENCODINGS, etag);
+        CHECK_EQ(revalidated->sentCode, 304);
+        CHECK_EQ(revalidated->response->contentLength, 0);
+        CHECK(headerOf(*revalidated, "ETag") == etag);
+        CHECK(!headerOf(*revalidated, "Cache-Control").empty());
+        // An ETag from an older build gets the new body
+        auto changed = get(server, "/" + line.path, BROWSER_ENCODINGS, "\"0123456789ab\"");
+        CHECK_EQ(changed->sentCode, 200);
+    }
+}
+
+static void testAcceptEncoding(const AsyncWebServer &server) {
+    struct Case {
+        const char *acceptEncoding;
+        int code;
+    };
+    const Case cases[] = {
+            {nullptr,                  200},  // No header, any coding is acceptable
+            {"gzip",                   200},
+            {"GZip",                   200},
+            {"br;q=1.0, gzip;q=0.5",   200},
+            {"*",                      200},
+            {"*;q=0, gzip",            200},
+            {"deflate, br",            406},
+            {"identity",               406},
+            {"gzip;q=0",               406},
+            {"gzip;q=0, *",            406},
+            {"br, *;q=0",              406},
+    };
+    for (const Case &test: cases) {
+        auto request = get(server, "/", test.acceptEncoding);
+        CHECK_EQ(request->sentCode, test.code);
+        CHECK(headerOf(*request, "Vary") == "Accept-Encoding");
+        CHECK(test.code != 406 || headerOf(*request, "Content-Encoding").empty());
+    }
+}
+
+// What the browser transfers, the hashed assets of a repeat visit come from its cache without a request
+static void measureDashboardLoads(const AsyncWebServer &server, const std::vector<ManifestLine> &lines) {
+    size_t compressed = 0;
+    size_t uncompressed = 0;
+    for (const ManifestLine &line: lines) {
+        compressed += bodyOf(*get(server, "/" + line.path)).size();
+        // The source is the name without the hash the build added
+        std::string source = line.path;
+        if (line.immutable) {
+            source.erase(source.find("." + line.tag), line.tag.size() + 1);
+        }
+        uncompressed += readFile(WEB_SOURCE_DIR "/" + source).size();
+    }
+    auto page = get(server, "/");
+    auto repeat = get(server, "/", BROWSER_ENCODINGS, headerOf(*page, "ETag"));
+    CHECK_EQ(repeat->sentCode, 304);
+    CHECK(compressed < uncompressed);
+
+    std::string etag = headerOf(*page, "ETag");
+    double fullNs = measureNanos(BENCHMARK_REQUESTS, [&](unsigned long) {
+        get(server, "/");
+    });
+    double notModifiedNs = measureNanos(BENCHMARK_REQUESTS, [&](unsigned long) {
+        get(server, "/", BROWSER_ENCODINGS, etag);
+    });
+    std::printf("first visit: %zu requests, %zu body bytes gzip-compressed (%zu uncompressed, %.0f%%)\n",
+                lines.size(), compressed, uncompressed, 100.0 * compressed / uncompressed);
+    std::printf("repeat visit: 1 request, 304 for index.html with no body\n");
+    std::printf("handler time on the host: %.0f ns for a 200, %.0f ns for a 304\n", fullNs, notModifiedNs);
+}
+
+int main() {
+    std::vector<ManifestLine> lines = loadImage();
+    AsyncWebServer server;
+    CHECK(registerStaticAssets(server));
+    testRoutesFromTheManifest(server, lines);
+    testGzipBodies(server, lines);
+    testNotModified(server, lines);
+    testAcceptEncoding(server);
+    measureDashboardLoads(server, lines);
+    std::printf("static assets tests passed\n");
+    return 0;
+}
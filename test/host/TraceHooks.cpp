@@ -0,0 +1,18 @@
+// The response notes of RouteStats.cpp, for tests that send responses without the whole web server
+#include "HostStubs.h"
+#include "RouteStats.h"
+
+unsigned long tracedResponseStarts = 0;
+size_t tracedResponseBytes = 0;
+
+RequestTrace currentRequestTrace() {
+    return {0, 1};
+}
+
+void noteResponseStart(RequestTrace) {
+    tracedResponseStarts++;
+}
+
+void noteResponseBytes(RequestTrace, size_t bytes) {
+    tracedResponseBytes += bytes;
+}
@@ -0,0 +1,32 @@
+# Runs the PlatformIO pre-script scripts/build_web_assets.py outside PlatformIO, so static_assets_test serves
+# the LittleFS image a real build uploads.
+#
+# Usage: build_web_image.py <project dir> <output dir>
+
+import os
+import sys
+
+
+class Environment:
+    """The two variables the pre-script reads from the PlatformIO build environment."""
+
+    def __init__(self, project_dir, data_dir):
+        self.variables = {"$PROJECT_DIR": project_dir, "$PROJECT_DATA_DIR": data_dir}
+
+    def subst(self, name):
+        return self.variables[name]
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("Usage: build_web_image.py <project dir> <output dir>")
+    project_dir, data_dir = (os.path.abspath(path) for path in sys.argv[1:])
+    script = os.path.join(project_dir, "scripts", "build_web_assets.py")
+    with open(script) as source:
+        code = compile(source.read(), script, "exec")
+    # SCons' Import("env") only makes env visible, it already is
+    exec(code, {"Import": lambda name: None, "env": Environment(project_dir, data_dir)})
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,73 @@
+#ifndef ESP32_TERMOSTAT_HOST_ARDUINO_H
+#define ESP32_TERMOSTAT_HOST_ARDUINO_H
+
+// Host stand-in for the parts of the Arduino core the tested modules use
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+// Like the real core, which pulls FreeRTOS in for every sketch
+#include "freertos/FreeRTOS.h"
+
+class String : public std::string {
+public:
+    String() = default;
+    String(const char *text) : std::string(text != nullptr ? text : "") {}
+    String(const std::string &text) : std::string(text) {}
+
+    bool startsWith(const char *prefix) const {
+        return compare(0, strlen(prefix), prefix) == 0;
+    }
+
+    int indexOf(const char *text) const {
+        size_t at = find(text);
+        return at == npos ? -1 : static_cast<int>(at);
+    }
+
+    // ArduinoJson's custom writer interface, serializeJson() into a String relies on it outside of Arduino
+    size_t write(uint8_t c) {
+        push_back(static_cast<char>(c));
+        return 1;
+    }
+
+    size_t write(const uint8_t *data, size_t length) {
+        append(reinterpret_cast<const char *>(data), length);
+        return length;
+    }
+};
+
+// Set by the tests, the firmware reads the clock through these
+uint32_t millis();
+uint32_t micros();
+
+class EspClass {
+public:
+    uint32_t getFreeHeap();
+    uint32_t getMaxAllocHeap();
+};
+
+extern EspClass ESP;
+
+// Collects what the firmware prints, a test clears it when it has looked
+class HardwareSerial {
+public:
+    std::string output;
+
+    int printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+    size_t print(const char *text) {
+        output += text;
+        return strlen(text);
+    }
+
+    size_t println(const char *text = "") {
+        output += text;
+        output += "\n";
+        return strlen(text) + 1;
+    }
+};
+
+extern HardwareSerial Serial;
+
+#endif //ESP32_TERMOSTAT_HOST_ARDUINO_H
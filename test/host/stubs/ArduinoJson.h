@@ -0,0 +1,82 @@
+#ifndef ESP32_TERMOSTAT_HOST_ARDUINOJSON_H
+#define ESP32_TERMOSTAT_HOST_ARDUINOJSON_H
+
+// ArduinoJson is not vendored in this repository, PlatformIO downloads it for the firmware. The host tests
+// only need a document to put into a buffer, so here a document is the JSON and MessagePack bytes the test
+// gives it. The element API compiles so modules with a JSON handler can be linked, but it keeps nothing.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+class JsonVariant {
+public:
+    JsonVariant operator[](const char *key) const {
+        (void) key;
+        return {};
+    }
+
+    template<typename T>
+    JsonVariant &operator=(const T &value) {
+        (void) value;
+        return *this;
+    }
+
+    template<typename T>
+    T to() const {
+        return T();
+    }
+
+    template<typename T>
+    T add() const {
+        return T();
+    }
+};
+
+class JsonObject : public JsonVariant {
+public:
+    using JsonVariant::operator=;
+};
+
+class JsonArray : public JsonVariant {
+public:
+    using JsonVariant::operator=;
+};
+
+class JsonDocument : public JsonVariant {
+public:
+    std::string text;
+    std::string msgpack;
+};
+
+// Like ArduinoJson: writes at most size - 1 characters and a terminator, returns the characters written
+inline size_t serializeJson(const JsonDocument &doc, char *output, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    size_t count = std::min(doc.text.size(), size - 1);
+    memcpy(output, doc.text.data(), count);
+    output[count] = '\0';
+    return count;
+}
+
+template<typename Output>
+size_t serializeJson(const JsonDocument &doc, Output &output) {
+    output += doc.text;
+    return doc.text.size();
+}
+
+// Like ArduinoJson: writes at most size bytes without a terminator, returns the bytes written
+inline size_t serializeMsgPack(const JsonDocument &doc, void *output, size_t size) {
+    size_t count = std::min(doc.msgpack.size(), size);
+    memcpy(output, doc.msgpack.data(), count);
+    return count;
+}
+
+inline size_t serializeMsgPack(const JsonDocument &doc, std::string &output) {
+    output += doc.msgpack;
+    return doc.msgpack.size();
+}
+
+#endif //ESP32_TERMOSTAT_HOST_ARDUINOJSON_H
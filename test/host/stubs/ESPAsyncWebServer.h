@@ -0,0 +1,399 @@
+#ifndef ESP32_TERMOSTAT_HOST_ESPASYNCWEBSERVER_H
+#define ESP32_TERMOSTAT_HOST_ESPASYNCWEBSERVER_H
+
+// Host stand-in for ESPAsyncWebServer: a request records what was sent on it instead of writing to a socket
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Arduino.h"
+#include "FS.h"
+
+#define ASYNC_WRITEFLAG_COPY 0x01
+
+typedef enum {
+    HTTP_GET = 0b00000001,
+    HTTP_POST = 0b00000010,
+    HTTP_DELETE = 0b00000100,
+    HTTP_PUT = 0b00001000,
+    HTTP_PATCH = 0b00010000,
+    HTTP_HEAD = 0b00100000,
+    HTTP_OPTIONS = 0b01000000,
+    HTTP_ANY = 0b01111111,
+} WebRequestMethod;
+typedef uint8_t WebRequestMethodComposite;
+
+class IPAddress {
+private:
+    uint32_t address;
+
+public:
+    IPAddress(uint32_t value = 0) : address(value) {}
+
+    operator uint32_t() const {
+        return address;
+    }
+};
+
+class AsyncClient;
+typedef std::function<void(void *, AsyncClient *)> AcConnectHandler;
+
+// Keeps pointers to what was added instead of copying it, so tests can count the allocations of a handler
+class AsyncClient {
+public:
+    static constexpr size_t MAX_SEGMENTS = 8;
+
+    IPAddress ip;
+    const char *segments[MAX_SEGMENTS] = {};
+    size_t segmentLengths[MAX_SEGMENTS] = {};
+    uint8_t segmentFlags[MAX_SEGMENTS] = {};
+    size_t segmentCount = 0;
+    bool sent = false;
+    bool closed = false;
+    AcConnectHandler pollHandler;
+    void *pollArgument = nullptr;
+
+    IPAddress remoteIP() const {
+        return ip;
+    }
+
+    size_t add(const char *data, size_t size, uint8_t apiflags = ASYNC_WRITEFLAG_COPY) {
+        if (segmentCount == MAX_SEGMENTS) {
+            return 0;
+        }
+        segments[segmentCount] = data;
+        segmentLengths[segmentCount] = size;
+        segmentFlags[segmentCount] = apiflags;
+        segmentCount++;
+        return size;
+    }
+
+    bool send() {
+        sent = true;
+        return true;
+    }
+
+    void onPoll(AcConnectHandler handler, void *argument = nullptr) {
+        pollHandler = handler;
+        pollArgument = argument;
+    }
+
+    // What the AsyncTCP task does about twice a second
+    void poll() {
+        if (pollHandler) {
+            pollHandler(pollArgument, this);
+        }
+    }
+
+    void close(bool now = false) {
+        (void) now;
+        closed = true;
+    }
+};
+
+class AsyncWebParameter {
+private:
+    String parameterName;
+    String parameterValue;
+
+public:
+    AsyncWebParameter(const String &name, const String &value) : parameterName(name), parameterValue(value) {}
+
+    const String &name() const {
+        return parameterName;
+    }
+
+    const String &value() const {
+        return parameterValue;
+    }
+};
+
+class AsyncWebServerRequest;
+
+class AsyncWebHandler {
+public:
+    virtual ~AsyncWebHandler() = default;
+
+    virtual bool canHandle(AsyncWebServerRequest *request) {
+        (void) request;
+        return false;
+    }
+
+    virtual void handleRequest(AsyncWebServerRequest *request) {
+        (void) request;
+    }
+
+    virtual void handleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+        (void) request;
+        (void) data;
+        (void) len;
+        (void) index;
+        (void) total;
+    }
+
+    virtual bool isRequestHandlerTrivial() {
+        return true;
+    }
+};
+
+typedef std::function<void(AsyncWebServerRequest *)> ArRequestHandlerFunction;
+
+// Only keeps the handlers and the routes added with on(), the test offers them each request the way the server
+// does. serveStatic() routes are not kept.
+class AsyncWebServer {
+public:
+    std::vector<AsyncWebHandler *> handlers;
+    std::vector<std::pair<std::string, ArRequestHandlerFunction>> routes;
+    ArRequestHandlerFunction notFoundHandler;
+
+    explicit AsyncWebServer(uint16_t port = 80) {
+        (void) port;
+    }
+
+    AsyncWebHandler &addHandler(AsyncWebHandler *handler) {
+        handlers.push_back(handler);
+        return *handler;
+    }
+
+    void on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest) {
+        (void) method;
+        routes.emplace_back(uri, std::move(onRequest));
+    }
+
+    const ArRequestHandlerFunction *route(const char *uri) const {
+        for (const auto &candidate: routes) {
+            if (candidate.first == uri) {
+                return &candidate.second;
+            }
+        }
+        return nullptr;
+    }
+
+    void serveStatic(const char *uri, FS &fs, const char *path) {
+        (void) uri;
+        (void) fs;
+        (void) path;
+    }
+
+    void onNotFound(ArRequestHandlerFunction handler) {
+        notFoundHandler = std::move(handler);
+    }
+
+    void begin() {
+    }
+};
+
+typedef std::function<size_t(uint8_t *, size_t, size_t)> AwsResponseFiller;
+
+class AsyncWebHeader {
+private:
+    String headerName;
+    String headerValue;
+
+public:
+    AsyncWebHeader(const String &name, const String &value) : headerName(name), headerValue(value) {}
+
+    const String &name() const {
+        return headerName;
+    }
+
+    const String &value() const {
+        return headerValue;
+    }
+};
+
+// Keeps the filler, the test pulls the body out of it the way the server would as TCP space frees up
+class AsyncWebServerResponse {
+public:
+    int code = 200;
+    String contentType;
+    size_t contentLength = 0;
+    bool chunked = false;  ///< No length up front, the body ends when the filler returns 0.
+    AwsResponseFiller filler;
+    std::vector<AsyncWebHeader> headers;
+
+    void setCode(int responseCode) {
+        code = responseCode;
+    }
+
+    void addHeader(const String &name, const String &value) {
+        headers.emplace_back(name, value);
+    }
+
+    const AsyncWebHeader *header(const char *name) const {
+        for (const AsyncWebHeader &candidate: headers) {
+            if (candidate.name() == name) {
+                return &candidate;
+            }
+        }
+        return nullptr;
+    }
+};
+
+class AsyncWebServerRequest {
+public:
+    void *_tempObject = nullptr;
+    AsyncClient connection;
+    String path;
+    WebRequestMethodComposite requestMethod = HTTP_GET;
+    bool keepsAllHeaders = false;
+
+    int sentCode = 0;
+    String sentBody;
+    int sendCount = 0;
+    AsyncWebServerResponse *response = nullptr;
+    std::vector<AsyncWebHeader> headers;
+    std::vector<AsyncWebParameter> params;
+    std::function<void()> disconnectHandler;
+
+    AsyncWebServerRequest() = default;
+    AsyncWebServerRequest(const AsyncWebServerRequest &) = delete;
+    AsyncWebServerRequest &operator=(const AsyncWebServerRequest &) = delete;
+
+    ~AsyncWebServerRequest() {
+        free(_tempObject);
+        delete response;
+    }
+
+    AsyncClient *client() {
+        return &connection;
+    }
+
+    const String &url() const {
+        return path;
+    }
+
+    WebRequestMethodComposite method() const {
+        return requestMethod;
+    }
+
+    void addInterestingHeader(const String &name) {
+        keepsAllHeaders = keepsAllHeaders || name == "ANY";
+    }
+
+    // Keeps a single callback, like the real request
+    void onDisconnect(std::function<void()> handler) {
+        disconnectHandler = std::move(handler);
+    }
+
+    // What the server does when the connection closes, just before it deletes the request
+    void disconnect() {
+        if (disconnectHandler) {
+            disconnectHandler();
+        }
+    }
+
+    void send(int code, const String &contentType = String(), const String &content = String()) {
+        (void) contentType;
+        sentCode = code;
+        sentBody = content;
+        sendCount++;
+    }
+
+    AsyncWebHeader *getHeader(const String &name) {
+        for (AsyncWebHeader &header: headers) {
+            if (header.name() == name) {
+                return &header;
+            }
+        }
+        return nullptr;
+    }
+
+    bool hasParam(const String &name) {
+        return getParam(name) != nullptr;
+    }
+
+    AsyncWebParameter *getParam(const String &name) {
+        for (AsyncWebParameter &param: params) {
+            if (param.name() == name) {
+                return &param;
+            }
+        }
+        return nullptr;
+    }
+
+    AsyncWebServerResponse *beginResponse(int code) {
+        auto *empty = new AsyncWebServerResponse;
+        empty->code = code;
+        return empty;
+    }
+
+    AsyncWebServerResponse *beginResponse(int code, const String &contentType, const String &content) {
+        auto *text = beginResponse(code);
+        text->contentType = contentType;
+        text->contentLength = content.length();
+        std::string body = content;
+        text->filler = [body](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            size_t count = std::min(maxLen, body.size() - index);
+            memcpy(buffer, body.data() + index, count);
+            return count;
+        };
+        return text;
+    }
+
+    // Like the real file response: when only path + ".gz" exists it is sent with Content-Encoding: gzip
+    AsyncWebServerResponse *beginResponse(FS &fs, const String &path, const String &contentType = String()) {
+        std::string name = path.c_str();
+        bool gzipped = !fs.exists(name.c_str()) && fs.exists((name + ".gz").c_str());
+        if (gzipped) {
+            name += ".gz";
+        }
+        auto file = fs.files.find(name);
+        auto *response = beginResponse(file != fs.files.end() ? 200 : 404);
+        if (file == fs.files.end()) {
+            return response;
+        }
+        const std::string *body = &file->second;
+        response->contentType = contentType;
+        response->contentLength = body->size();
+        response->filler = [body](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            size_t count = std::min(maxLen, body->size() - index);
+            memcpy(buffer, body->data() + index, count);
+            return count;
+        };
+        if (gzipped) {
+            response->addHeader("Content-Encoding", "gzip");
+        }
+        return response;
+    }
+
+    AsyncWebServerResponse *beginResponse(const String &contentType, size_t length, AwsResponseFiller filler) {
+        auto *callback = new AsyncWebServerResponse;
+        callback->contentType = contentType;
+        callback->contentLength = length;
+        callback->filler = std::move(filler);
+        return callback;
+    }
+
+    // The file is read at once, the real response streams it
+    void send(FS &fs, const String &path, const String &contentType = String()) {
+        (void) contentType;
+        fs::File file = fs.open(path.c_str(), "r");
+        sentCode = file ? 200 : 404;
+        sentBody = file ? fs.files[path] : String();
+        sendCount++;
+    }
+
+    AsyncWebServerResponse *beginChunkedResponse(const String &contentType, AwsResponseFiller filler) {
+        auto *chunked = new AsyncWebServerResponse;
+        chunked->contentType = contentType;
+        chunked->chunked = true;
+        chunked->filler = std::move(filler);
+        return chunked;
+    }
+
+    void send(AsyncWebServerResponse *sent) {
+        delete response;
+        response = sent;
+        sentCode = sent->code;
+        sendCount++;
+    }
+};
+
+#endif //ESP32_TERMOSTAT_HOST_ESPASYNCWEBSERVER_H
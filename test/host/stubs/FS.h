@@ -0,0 +1,103 @@
+#ifndef ESP32_TERMOSTAT_HOST_FS_H
+#define ESP32_TERMOSTAT_HOST_FS_H
+
+// Host stand-in for the Arduino file system API, files live in memory
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace fs {
+
+class File {
+private:
+    std::string *content = nullptr;
+    size_t position = 0;
+
+public:
+    File() = default;
+
+    explicit File(std::string *fileContent) : content(fileContent) {}
+
+    explicit operator bool() const {
+        return content != nullptr;
+    }
+
+    size_t size() const {
+        return content != nullptr ? content->size() : 0;
+    }
+
+    int available() const {
+        return content != nullptr ? static_cast<int>(content->size() - position) : 0;
+    }
+
+    // Like Stream: stops before the terminator and consumes it
+    size_t readBytesUntil(char terminator, char *buffer, size_t length) {
+        size_t count = 0;
+        while (count < length && available() > 0) {
+            char c = (*content)[position++];
+            if (c == terminator) {
+                break;
+            }
+            buffer[count++] = c;
+        }
+        return count;
+    }
+
+    size_t write(const uint8_t *data, size_t length) {
+        if (content == nullptr) {
+            return 0;
+        }
+        content->append(reinterpret_cast<const char *>(data), length);
+        return length;
+    }
+
+    void close() {
+        content = nullptr;
+        position = 0;
+    }
+};
+
+class FS {
+public:
+    std::map<std::string, std::string> files;
+
+    // Only appending and reading are used by the tested modules, "w" truncates
+    File open(const char *path, const char *mode) {
+        auto file = files.find(path);
+        if (mode[0] == 'r') {
+            return file != files.end() ? File(&file->second) : File();
+        }
+        std::string &content = files[path];
+        if (mode[0] == 'w') {
+            content.clear();
+        }
+        return File(&content);
+    }
+
+    bool exists(const char *path) const {
+        return files.count(path) != 0;
+    }
+
+    bool remove(const char *path) {
+        return files.erase(path) != 0;
+    }
+
+    bool rename(const char *from, const char *to) {
+        auto file = files.find(from);
+        if (file == files.end()) {
+            return false;
+        }
+        files[to] = std::move(file->second);
+        files.erase(file);
+        return true;
+    }
+};
+
+}
+
+using fs::FS;
+using fs::File;
+
+#endif //ESP32_TERMOSTAT_HOST_FS_H
@@ -0,0 +1,11 @@
+#ifndef ESP32_TERMOSTAT_HOST_LITTLEFS_H
+#define ESP32_TERMOSTAT_HOST_LITTLEFS_H
+
+#include "FS.h"
+
+class LittleFSFS : public fs::FS {
+};
+
+extern LittleFSFS LittleFS;
+
+#endif //ESP32_TERMOSTAT_HOST_LITTLEFS_H
@@ -0,0 +1,6 @@
+#ifndef ESP32_TERMOSTAT_HOST_WIFICLIENTSECURE_H
+#define ESP32_TERMOSTAT_HOST_WIFICLIENTSECURE_H
+
+// Included by LocalAPI.h, nothing in the host build talks TLS
+
+#endif //ESP32_TERMOSTAT_HOST_WIFICLIENTSECURE_H
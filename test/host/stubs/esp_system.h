@@ -0,0 +1,9 @@
+#ifndef ESP32_TERMOSTAT_HOST_ESP_SYSTEM_H
+#define ESP32_TERMOSTAT_HOST_ESP_SYSTEM_H
+
+#include <cstdint>
+
+// Returns hostRandom, so a test knows the per-boot ids derived from it
+uint32_t esp_random();
+
+#endif //ESP32_TERMOSTAT_HOST_ESP_SYSTEM_H
@@ -0,0 +1,38 @@
+#ifndef ESP32_TERMOSTAT_HOST_FREERTOS_H
+#define ESP32_TERMOSTAT_HOST_FREERTOS_H
+
+// Host stand-in for the FreeRTOS pieces the tested modules use. Critical sections are real spinlocks, so
+// threaded tests exercise the same mutual exclusion as the two cores of the ESP32.
+
+#include <atomic>
+#include <cstdint>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY 0xffffffff
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) (static_cast<TickType_t>(ms))
+
+struct portMUX_TYPE {
+    std::atomic<bool> locked;
+};
+
+#define portMUX_INITIALIZER_UNLOCKED {}
+
+inline void hostEnterCritical(portMUX_TYPE *mux) {
+    while (mux->locked.exchange(true, std::memory_order_acquire)) {
+    }
+}
+
+inline void hostExitCritical(portMUX_TYPE *mux) {
+    mux->locked.store(false, std::memory_order_release);
+}
+
+#define portENTER_CRITICAL(mux) hostEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) hostExitCritical(mux)
+
+#endif //ESP32_TERMOSTAT_HOST_FREERTOS_H
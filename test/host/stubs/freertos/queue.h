@@ -0,0 +1,15 @@
+#ifndef ESP32_TERMOSTAT_HOST_FREERTOS_QUEUE_H
+#define ESP32_TERMOSTAT_HOST_FREERTOS_QUEUE_H
+
+#include "freertos/FreeRTOS.h"
+
+// Copies items like the real queue, a full queue fails at once instead of waiting
+struct HostQueue;
+typedef HostQueue *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+#endif //ESP32_TERMOSTAT_HOST_FREERTOS_QUEUE_H
@@ -0,0 +1,17 @@
+#ifndef ESP32_TERMOSTAT_HOST_FREERTOS_SEMPHR_H
+#define ESP32_TERMOSTAT_HOST_FREERTOS_SEMPHR_H
+
+#include "freertos/FreeRTOS.h"
+
+// A mutex that never waits: the host tests that take one run a single task
+struct HostSemaphore {
+    bool taken;
+};
+
+typedef HostSemaphore *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+
+#endif //ESP32_TERMOSTAT_HOST_FREERTOS_SEMPHR_H
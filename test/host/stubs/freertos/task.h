@@ -0,0 +1,12 @@
+#ifndef ESP32_TERMOSTAT_HOST_FREERTOS_TASK_H
+#define ESP32_TERMOSTAT_HOST_FREERTOS_TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+// Tasks do not exist on the host: handles stay NULL and the test calls what a task would run
+typedef void *TaskHandle_t;
+
+// Follows hostMillis
+TickType_t xTaskGetTickCount();
+
+#endif //ESP32_TERMOSTAT_HOST_FREERTOS_TASK_H
@@ -1,17 +1,11 @@
 // heatingControls.js
 function loadHeatingMode() {
-    fetch('/heating/mode')
-        .then(response => response.json())
+    apiGet('/heating/mode')
+        .then(readApiResponse)
         .then(data => {
-            const mode = data.mode;
-            document.getElementById('heating-mode-display').innerText = `Mod Încălzire: ${mode}`;
-            const heatingModeSelect = document.getElementById('heating-mode-select');
-            heatingModeSelect.value = mode;
-
-            if (mode === 'MANUAL') {
-                showManualControls();
-            } else {
-                hideManualControls();
+            renderHeatingMode(data.mode);
+            if (data.mode === 'MANUAL') {
+                loadManualMode();
             }
         })
         .catch(error => {
@@ -20,6 +14,25 @@ function loadHeatingMode() {
         });
 }
 
+function renderHeatingMode(mode) {
+    document.getElementById('heating-mode-display').innerText = `Mod Încălzire: ${mode}`;
+    const heatingModeSelect = document.getElementById('heating-mode-select');
+    heatingModeSelect.value = mode;
+
+    if (mode === 'MANUAL') {
+        showManualControls();
+    } else {
+        hideManualControls();
+    }
+}
+
+// Applies a "heating" event or the heating part of the snapshot
+function applyHeatingState(heating) {
+    renderHeatingMode(heating.mode);
+    renderManualMode(heating.manual);
+    renderRelayStatus(heating.isHeating);
+}
+
 function setHeatingMode(mode) {
     fetch(`/heating/mode?mode=${encodeURIComponent(mode)}`, {
         method: 'PUT', headers: {'Content-Type': 'application/json'}
@@ -46,7 +59,6 @@ function setHeatingMode(mode) {
 function showManualControls() {
     const manualControls = document.getElementById('manual-controls');
     manualControls.classList.remove('hidden');
-    loadManualMode();
 }
 
 function hideManualControls() {
@@ -55,11 +67,10 @@ function hideManualControls() {
 }
 
 function loadManualMode() {
-    fetch('/heating/manual')
-        .then(response => response.json())
+    apiGet('/heating/manual')
+        .then(readApiResponse)
         .then(data => {
-            const mode = data.mode;
-            document.getElementById('manual-mode-display').innerText = `Mod Manual: ${mode}`;
+            renderManualMode(data.mode);
             loadRelayStatus();
         })
         .catch(error => {
@@ -90,19 +101,24 @@ function setManualMode(mode) {
         });
 }
 
+function renderManualMode(mode) {
+    document.getElementById('manual-mode-display').innerText = `Mod Manual: ${mode}`;
+}
+
 function loadRelayStatus() {
-    fetch('/heating')
-        .then(response => response.json())
-        .then(data => {
-            const isHeating = data.isHeating;
-            document.getElementById('relay-status').innerText = `Stare Releu: ${isHeating ? 'Pornit' : 'Oprit'}`;
-        })
+    apiGet('/heating')
+        .then(readApiResponse)
+        .then(data => renderRelayStatus(data.isHeating))
         .catch(error => {
             console.error('Error:', error);
             showErrorMessage('Nu s-a putut încărca starea releului.');
         });
 }
 
+function renderRelayStatus(isHeating) {
+    document.getElementById('relay-status').innerText = `Stare Releu: ${isHeating ? 'Pornit' : 'Oprit'}`;
+}
+
 function setupManualControls() {
     const manualOnBtn = document.getElementById('set-manual-on');
     const manualOffBtn = document.getElementById('set-manual-off');
@@ -0,0 +1,83 @@
+// msgpack.js
+
+// The API answers in MessagePack when asked to: key names and floats take a fraction of the JSON bytes.
+const API_ACCEPT = 'application/msgpack, application/json;q=0.9';
+
+function apiGet(url) {
+    return fetch(url, {headers: {'Accept': API_ACCEPT}});
+}
+
+// Decodes a response body by its Content-Type, error responses are still JSON
+function readApiResponse(response) {
+    const contentType = response.headers.get('Content-Type') || '';
+    if (contentType.includes('msgpack')) {
+        return response.arrayBuffer().then(buffer => decodeMsgPack(buffer));
+    }
+    return response.json();
+}
+
+function decodeMsgPack(buffer) {
+    const view = new DataView(buffer);
+    const bytes = new Uint8Array(buffer);
+    const textDecoder = new TextDecoder();
+    let offset = 0;
+
+    function readString(length) {
+        const text = textDecoder.decode(bytes.subarray(offset, offset + length));
+        offset += length;
+        return text;
+    }
+
+    function readArray(length) {
+        const array = new Array(length);
+        for (let i = 0; i < length; i++) {
+            array[i] = readValue();
+        }
+        return array;
+    }
+
+    function readMap(length) {
+        const map = {};
+        for (let i = 0; i < length; i++) {
+            const key = readValue();
+            map[key] = readValue();
+        }
+        return map;
+    }
+
+    function readValue() {
+        const type = bytes[offset++];
+        if (type <= 0x7f) return type;
+        if (type <= 0x8f) return readMap(type & 0x0f);
+        if (type <= 0x9f) return readArray(type & 0x0f);
+        if (type <= 0xbf) return readString(type & 0x1f);
+        if (type >= 0xe0) return type - 0x100;
+        let value;
+        switch (type) {
+            case 0xc0: return null;
+            case 0xc2: return false;
+            case 0xc3: return true;
+            case 0xca: value = view.getFloat32(offset); offset += 4; return value;
+            case 0xcb: value = view.getFloat64(offset); offset += 8; return value;
+            case 0xcc: return bytes[offset++];
+            case 0xcd: value = view.getUint16(offset); offset += 2; return value;
+            case 0xce: value = view.getUint32(offset); offset += 4; return value;
+            case 0xcf: value = Number(view.getBigUint64(offset)); offset += 8; return value;
+            case 0xd0: value = view.getInt8(offset); offset += 1; return value;
+            case 0xd1: value = view.getInt16(offset); offset += 2; return value;
+            case 0xd2: value = view.getInt32(offset); offset += 4; return value;
+            case 0xd3: value = Number(view.getBigInt64(offset)); offset += 8; return value;
+            case 0xd9: value = bytes[offset]; offset += 1; return readString(value);
+            case 0xda: value = view.getUint16(offset); offset += 2; return readString(value);
+            case 0xdb: value = view.getUint32(offset); offset += 4; return readString(value);
+            case 0xdc: value = view.getUint16(offset); offset += 2; return readArray(value);
+            case 0xdd: value = view.getUint32(offset); offset += 4; return readArray(value);
+            case 0xde: value = view.getUint16(offset); offset += 2; return readMap(value);
+            case 0xdf: value = view.getUint32(offset); offset += 4; return readMap(value);
+            default:
+                throw new Error(`Tip MessagePack necunoscut: 0x${type.toString(16)}`);
+        }
+    }
+
+    return readValue();
+}
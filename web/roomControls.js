@@ -1,39 +1,60 @@
 // roomControls.js
 
 function loadRooms() {
-    fetch('/rooms')
-        .then(response => response.json())
-        .then(data => {
-            const roomsContainer = document.getElementById('rooms-container');
-            roomsContainer.innerHTML = '';
-            data.rooms.forEach(room => {
-                const roomDiv = document.createElement('div');
-                roomDiv.classList.add('room');
-                const currentRoomMode = room.mode;
-                let targetTemp = room.home_target_temperature;
-                if (currentRoomMode === 'AWAY') {
-                    targetTemp = room.away_target_temperature;
-                } else if (currentRoomMode === 'NIGHT') {
-                    targetTemp = room.night_target_temperature;
-                }
-                roomDiv.innerHTML = `
-                    <h2>${room.room_name}</h2>
-                    <p>Temperatură Curentă: ${room.current_temperature.toFixed(1)}°C</p>
-                    <p>Umiditate Curentă: ${room.current_humidity.toFixed(1)}%</p>
-                    <p>Temperatură Țintă: ${targetTemp.toFixed(1)}°C</p>
-                    <p>Modul Camerei: ${currentRoomMode}</p>
-                    <button class="room-settings-btn">Setări</button>
-                `;
-                roomDiv.querySelector('.room-settings-btn').addEventListener('click', () => openRoomSettingsPopup(room));
-                roomsContainer.appendChild(roomDiv);
-            });
-        })
+    apiGet('/rooms')
+        .then(readApiResponse)
+        .then(data => renderRooms(data.rooms))
         .catch(error => {
             console.error('Error:', error);
             showErrorMessage('Nu s-au putut încărca camerele.');
         });
 }
 
+function renderRooms(rooms) {
+    const roomsContainer = document.getElementById('rooms-container');
+    roomsContainer.innerHTML = '';
+    rooms.forEach(room => {
+        const roomDiv = document.createElement('div');
+        roomDiv.classList.add('room');
+        roomDiv.dataset.roomName = room.room_name;
+        roomDiv.roomData = room;
+        const currentRoomMode = room.mode;
+        let targetTemp = room.home_target_temperature;
+        if (currentRoomMode === 'AWAY') {
+            targetTemp = room.away_target_temperature;
+        } else if (currentRoomMode === 'NIGHT') {
+            targetTemp = room.night_target_temperature;
+        }
+        roomDiv.innerHTML = `
+            <h2>${room.room_name}</h2>
+            <p class="room-temperature">Temperatură Curentă: ${room.current_temperature.toFixed(1)}°C</p>
+            <p class="room-humidity">Umiditate Curentă: ${room.current_humidity.toFixed(1)}%</p>
+            <p>Temperatură Țintă: ${targetTemp.toFixed(1)}°C</p>
+            <p>Modul Camerei: ${currentRoomMode}</p>
+            <button class="room-settings-btn">Setări</button>
+        `;
+        roomDiv.querySelector('.room-settings-btn').addEventListener('click', () => openRoomSettingsPopup(room));
+        roomsContainer.appendChild(roomDiv);
+    });
+}
+
+// Applies a "temperatures" event: only the readings of the listed rooms changed
+function updateRoomReadings(changedRooms) {
+    const roomDivs = document.querySelectorAll('#rooms-container .room');
+    changedRooms.forEach(update => {
+        const roomDiv = Array.from(roomDivs).find(div => div.dataset.roomName === update.room_name);
+        if (!roomDiv) {
+            return;
+        }
+        // Same object the settings button opens, so the popup shows the new readings too
+        Object.assign(roomDiv.roomData, update);
+        roomDiv.querySelector('.room-temperature').innerText =
+            `Temperatură Curentă: ${update.current_temperature.toFixed(1)}°C`;
+        roomDiv.querySelector('.room-humidity').innerText =
+            `Umiditate Curentă: ${update.current_humidity.toFixed(1)}%`;
+    });
+}
+
 function openRoomSettingsPopup(roomData) {
     const popup = document.getElementById('room-settings-popup');
     const content = document.getElementById('popup-inner-content');
@@ -262,8 +283,8 @@ function addThermometer(roomName) {
         .then(data => {
             showSuccessMessage(data.message);
             macInput.value = '';
-            fetch(`/rooms`)
-                .then(response => response.json())
+            apiGet('/rooms')
+                .then(readApiResponse)
                 .then(updatedData => {
                     const updatedRoom = updatedData.rooms.find(r => r.room_name === roomName);
                     if (updatedRoom) {
@@ -301,8 +322,8 @@ function deleteThermometer(roomName, macAddress) {
                 })
                 .then(data => {
                     showSuccessMessage(data.message);
-                    fetch(`/rooms`)
-                        .then(response => response.json())
+                    apiGet('/rooms')
+                        .then(readApiResponse)
                         .then(updatedData => {
                             const updatedRoom = updatedData.rooms.find(r => r.room_name === roomName);
                             if (updatedRoom) {
@@ -396,8 +417,8 @@ function createRoom() {
 }
 
 function roomExists(roomName) {
-    return fetch('/rooms')
-        .then(response => response.json())
+    return apiGet('/rooms')
+        .then(readApiResponse)
         .then(data => {
             return data.rooms.some(room => room.room_name.toLowerCase() === roomName.toLowerCase());
         })
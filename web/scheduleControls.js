@@ -155,19 +155,29 @@ function leaveAtSlot(day, slotInDay) {
         });
 }
 
+// The MessagePack schedule carries each day as mode numbers indexing data.modes
+function unpackSchedule(data) {
+    if (!data.modes) {
+        return data;
+    }
+    data.days = data.days.map(slots => ({hours: slots.map(mode => data.modes[mode])}));
+    return data;
+}
+
 function openViewSchedulePopup() {
     console.log('openViewSchedulePopup called');
     const popup = document.getElementById('schedule-view-popup');
     const content = document.getElementById('schedule-popup-inner-content');
     content.innerHTML = '<h2>Programul Săptămânal</h2>';
-    fetch('/schedule')
+    apiGet('/schedule')
         .then(response => {
             console.log('Received response from /schedule');
             if (!response.ok) {
                 throw new Error('Nu s-a putut încărca programul.');
             }
-            return response.json();
+            return readApiResponse(response);
         })
+        .then(unpackSchedule)
         .then(data => {
             console.log('Schedule data:', data);
             const daysOfWeek = ['Duminică', 'Luni', 'Marți', 'Miercuri', 'Joi', 'Vineri', 'Sâmbătă'];
@@ -224,8 +234,9 @@ function openEditSchedulePopup() {
     const popup = document.getElementById('schedule-edit-popup');
     const content = document.getElementById('schedule-edit-popup-inner-content');
     content.innerHTML = '<h2>Editează Programul Săptămânal</h2>';
-    fetch('/schedule')
-        .then(response => response.json())
+    apiGet('/schedule')
+        .then(readApiResponse)
+        .then(unpackSchedule)
         .then(data => {
             const daysOfWeek = ['Dum', 'Lun', 'Mar', 'Mie', 'Joi', 'Vin', 'Sâm'];
             const scheduleGrid = document.createElement('div');
@@ -397,26 +408,14 @@ function saveSchedule() {
         console.warn('No modifications found in modifiedSlots.');
         return;
     }
-    const scheduleData = modifiedSlots.map(slot => {
-        const {day, hour, mode} = slot;
-        if (day < 0 || day > 6 || hour < 0 || hour > 47) {
-            console.warn(`Slot invalid: day=${day}, hour=${hour}`);
-            return null; // Ignorăm sloturile invalide
-        }
-        return {day, hour, mode};
-    }).filter(slot => slot !== null);
-    console.log('Schedule Data to Send:', scheduleData);
-    Promise.all(scheduleData.map(directive => {
-        console.log('Sending directive:', directive);
-        return fetch('/schedule', {
-            method: 'PUT', headers: {'Content-Type': 'application/json'}, body: JSON.stringify({
-                day: directive.day, hour: directive.hour, mode: directive.mode
-            })
-        })
-            .then(response => handleResponse(response));
-    }))
+    const ranges = buildScheduleRanges(modifiedSlots);
+    console.log('Schedule ranges to send:', ranges);
+    fetch('/schedule', {
+        method: 'PATCH', headers: {'Content-Type': 'application/json'}, body: JSON.stringify({ranges})
+    })
+        .then(response => handleResponse(response))
         .then(results => {
-            console.log('All directives saved successfully:', results);
+            console.log('Schedule saved:', results);
             showSuccessMessage('Programul a fost actualizat cu succes');
             closeEditSchedulePopup();
             loadHeatingMode();
@@ -428,6 +427,23 @@ function saveSchedule() {
         });
 }
 
+// Merges the modified slots into runs of consecutive slots of one day with the same mode
+function buildScheduleRanges(slots) {
+    const valid = slots
+        .filter(({day, hour}) => day >= 0 && day <= 6 && hour >= 0 && hour <= 47)
+        .sort((a, b) => a.day - b.day || a.hour - b.hour);
+    const ranges = [];
+    valid.forEach(({day, hour, mode}) => {
+        const last = ranges[ranges.length - 1];
+        if (last && last.day === day && last.to === hour - 1 && last.mode === mode) {
+            last.to = hour;
+        } else {
+            ranges.push({day, from: hour, to: hour, mode});
+        }
+    });
+    return ranges;
+}
+
 function resetModifiedSlots() {
     console.log('Resetting modifiedSlots...');
     modifiedSlots = [];
@@ -1,10 +1,7 @@
 // script.js
 
 document.addEventListener('DOMContentLoaded', function () {
-    loadRooms();
     setupThemeToggle();
-    loadHeatingMode();
-    loadRelayStatus();
     setupAddRoom();
     setupManualControls();
     setupScheduleControls();
@@ -20,12 +17,52 @@ document.addEventListener('DOMContentLoaded', function () {
     if (closeSchedulePopupBtn) {
         closeSchedulePopupBtn.addEventListener('click', closeScheduleViewPopup);
     }
-    setInterval(() => {
+    connectLiveEvents();
+});
+
+let pollTimer = null;
+
+function startPolling() {
+    if (pollTimer) {
+        return;
+    }
+    loadRooms();
+    loadHeatingMode();
+    loadRelayStatus();
+    pollTimer = setInterval(() => {
         loadRooms();
         loadHeatingMode();
         loadRelayStatus();
     }, 30000);
-});
+}
+
+function stopPolling() {
+    if (pollTimer) {
+        clearInterval(pollTimer);
+        pollTimer = null;
+    }
+}
+
+// The thermostat pushes a snapshot and then only the changes over /api/events.
+// Polling is kept as the fallback while the stream is unavailable (old browser, client limit reached).
+function connectLiveEvents() {
+    if (!window.EventSource) {
+        startPolling();
+        return;
+    }
+    const source = new EventSource('/api/events');
+    source.addEventListener('snapshot', event => {
+        stopPolling();
+        const data = JSON.parse(event.data);
+        renderRooms(data.rooms);
+        applyHeatingState(data.heating);
+    });
+    source.addEventListener('rooms', event => renderRooms(JSON.parse(event.data).rooms));
+    source.addEventListener('temperatures', event => updateRoomReadings(JSON.parse(event.data).rooms));
+    source.addEventListener('heating', event => applyHeatingState(JSON.parse(event.data)));
+    // The browser reconnects by itself and gets a fresh snapshot, keep the page current meanwhile
+    source.onerror = () => startPolling();
+}
 
 function setupThemeToggle() {
     const toggleButton = document.getElementById('toggle-theme');